@@ -79,6 +79,22 @@ if(USE_OPENCV)
   add_definitions(-DUSE_OPENCV)
 endif()
 
+# ---[ libjpeg-turbo
+if(USE_LIBJPEG_TURBO)
+  find_package(JPEG REQUIRED)
+  include_directories(SYSTEM ${JPEG_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS ${JPEG_LIBRARIES})
+  add_definitions(-DUSE_LIBJPEG_TURBO)
+endif()
+
+# ---[ FFmpeg
+if(USE_FFMPEG)
+  find_package(FFmpeg REQUIRED)
+  include_directories(SYSTEM ${FFMPEG_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS ${FFMPEG_LIBRARIES})
+  add_definitions(-DUSE_FFMPEG)
+endif()
+
 # ---[ BLAS
 if(NOT APPLE)
   set(BLAS "Atlas" CACHE STRING "Selected BLAS library")
@@ -0,0 +1,30 @@
+# Try to find the FFmpeg libraries and headers
+#  FFMPEG_FOUND - system has the FFmpeg libraries
+#  FFMPEG_INCLUDE_DIR - the FFmpeg include directory
+#  FFMPEG_LIBRARIES - Libraries needed to use FFmpeg
+#
+# Looks for libavformat, libavcodec, libavutil and libswscale, under
+# $ENV{FFMPEG_DIR} first.
+
+find_path(FFMPEG_INCLUDE_DIR NAMES libavcodec/avcodec.h PATHS "$ENV{FFMPEG_DIR}/include")
+
+set(FFMPEG_LIBRARIES "")
+set(FFMPEG_LIBRARY_VARS "")
+foreach(__component avformat avcodec avutil swscale)
+  string(TOUPPER ${__component} __upper)
+  find_library(FFMPEG_${__upper}_LIBRARY NAMES ${__component} PATHS "$ENV{FFMPEG_DIR}/lib")
+  list(APPEND FFMPEG_LIBRARY_VARS FFMPEG_${__upper}_LIBRARY)
+  list(APPEND FFMPEG_LIBRARIES ${FFMPEG_${__upper}_LIBRARY})
+endforeach()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(FFmpeg DEFAULT_MSG FFMPEG_INCLUDE_DIR ${FFMPEG_LIBRARY_VARS})
+
+if(FFMPEG_FOUND)
+  message(STATUS "Found FFmpeg  (include: ${FFMPEG_INCLUDE_DIR}, library: ${FFMPEG_LIBRARIES})")
+  mark_as_advanced(FFMPEG_INCLUDE_DIR ${FFMPEG_LIBRARY_VARS})
+
+  caffe_parse_header(${FFMPEG_INCLUDE_DIR}/libavcodec/version.h
+                     FFMPEG_VERSION_LINES LIBAVCODEC_VERSION_MAJOR LIBAVCODEC_VERSION_MINOR LIBAVCODEC_VERSION_MICRO)
+  set(FFMPEG_VERSION "${LIBAVCODEC_VERSION_MAJOR}.${LIBAVCODEC_VERSION_MINOR}.${LIBAVCODEC_VERSION_MICRO}")
+endif()
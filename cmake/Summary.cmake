@@ -117,6 +117,8 @@ function(caffe_print_configuration_summary)
   caffe_status("  USE_OPENCV        :   ${USE_OPENCV}")
   caffe_status("  USE_LEVELDB       :   ${USE_LEVELDB}")
   caffe_status("  USE_LMDB          :   ${USE_LMDB}")
+  caffe_status("  USE_LIBJPEG_TURBO :   ${USE_LIBJPEG_TURBO}")
+  caffe_status("  USE_FFMPEG        :   ${USE_FFMPEG}")
   caffe_status("  ALLOW_LMDB_NOLOCK :   ${ALLOW_LMDB_NOLOCK}")
   caffe_status("")
   caffe_status("Dependencies:")
@@ -135,6 +137,12 @@ function(caffe_print_configuration_summary)
   if(USE_OPENCV)
     caffe_status("  OpenCV            :   Yes (ver. ${OpenCV_VERSION})")
   endif()
+  if(USE_LIBJPEG_TURBO)
+    caffe_status("  libjpeg-turbo     : " JPEG_FOUND THEN "Yes" ELSE "No")
+  endif()
+  if(USE_FFMPEG)
+    caffe_status("  FFmpeg            : " FFMPEG_FOUND THEN "Yes (libavcodec ver. ${FFMPEG_VERSION})" ELSE "No")
+  endif()
   caffe_status("  CUDA              : " HAVE_CUDA THEN "Yes (ver. ${CUDA_VERSION})" ELSE "No" )
   caffe_status("")
   if(HAVE_CUDA)
@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), layout_(PLANAR) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int length,
@@ -248,6 +248,7 @@ class Blob {
   void set_cpu_data(Dtype* data);
   const int* gpu_shape() const;
   const Dtype* gpu_data() const;
+  void set_gpu_data(Dtype* data);
   const Dtype* cpu_diff() const;
   const Dtype* gpu_diff() const;
   Dtype* mutable_cpu_data();
@@ -279,6 +280,8 @@ class Blob {
    *
    * This deallocates the SyncedMemory holding this Blob's data_, as
    * shared_ptr calls its destructor when reset with the "=" operator.
+   * A later Reshape beyond the current count allocates fresh memory rather
+   * than growing into the shared one.
    */
   void ShareData(const Blob& other);
   /**
@@ -293,6 +296,13 @@ class Blob {
 
   bool ShapeEquals(const BlobProto& other);
 
+  /**
+   * @brief The order in which the values are stored in memory. The shape
+   *        always lists the axes in planar (num, channels, ...) order.
+   */
+  inline BlobLayout layout() const { return layout_; }
+  inline void set_layout(const BlobLayout layout) { layout_ = layout; }
+
  protected:
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
@@ -300,6 +310,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  BlobLayout layout_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
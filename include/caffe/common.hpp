@@ -97,6 +97,8 @@ using std::vector;
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class ThreadPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -163,6 +165,30 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // CPU threading. The thread budget is the number of threads Caffe keeps
+  // busy with computation: the workers of the shared thread pool plus the
+  // thread that hands them work. It defaults to --threads, or one per core.
+  static int num_threads();
+  // Sets the thread budget and resizes the pool. Must not be called while
+  // parallel work is running.
+  static void set_num_threads(const int num_threads);
+  // The process-wide pool for parallel CPU work, with num_threads() - 1
+  // workers pinned to --cpu_affinity if given.
+  static ThreadPool& thread_pool();
+  // How many threads the calling thread may use for its parallel work and
+  // BLAS calls: the whole budget by default, data_threads() in data
+  // prefetch threads, and 1 inside parallel work. Each BLAS call is sized
+  // by its work within this limit where the library sets threads per
+  // thread; elsewhere BLAS gets the budget for the process, or a single
+  // thread once any thread is limited.
+  static int max_threads();
+  // Limits max_threads() of the calling thread, or lifts the limit if 0.
+  // Returns the previous limit, 0 if there was none.
+  static int set_max_threads(const int max_threads);
+  // The share of the budget of each data prefetch thread (--data_threads).
+  static int data_threads();
+  // Applies the data share and --data_cpu_affinity to the calling thread.
+  static void EnterDataThread();
 
  protected:
 #ifndef CPU_ONLY
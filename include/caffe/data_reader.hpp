@@ -52,6 +52,8 @@ class DataReader {
     virtual ~Body();
 
    protected:
+    // Reading gets the bounded CPU share of a data thread.
+    void InternalThreadSetUp() { Caffe::EnterDataThread(); }
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
 
@@ -1,6 +1,10 @@
 #ifndef CAFFE_DATA_TRANSFORMER_HPP
 #define CAFFE_DATA_TRANSFORMER_HPP
 
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -74,6 +78,34 @@ class DataTransformer {
                 Blob<Dtype>* transformed_blob,
                 const bool is_video = false);
 
+  /**
+   * @brief Picks the crop of a video clip before its frames are read, the
+   *    way Transform would pick it: at random in training, centered
+   *    otherwise. Frames read over this crop transform to the same blob
+   *    as the whole frames, when there is no mean_file.
+   *
+   * @param img_height, img_width
+   *    The size of the frames of the clip.
+   * @return
+   *    The crop_size x crop_size crop.
+   */
+  cv::Rect ChooseVideoCrop(const int img_height, const int img_width);
+
+  /// @brief Picks whether to mirror a video clip, the way Transform would.
+  bool ChooseVideoMirror();
+
+  /**
+   * @brief Transforms the frames of a video clip like Transform, with the
+   *    mirroring and crop given, so that several inputs of a clip can
+   *    share them.
+   *
+   * @param h_off, w_off
+   *    The offsets of the crop in training; testing crops the center.
+   */
+  void TransformVideo(const vector<cv::Mat> & mat_vector,
+                      Blob<Dtype>* transformed_blob, const bool mirror,
+                      const int h_off, const int w_off);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a cv::Mat
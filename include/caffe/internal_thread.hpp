@@ -38,6 +38,10 @@ class InternalThread {
       with the code you want your thread to run. */
   virtual void InternalThreadEntry() {}
 
+  /* Called in the thread before InternalThreadEntry, once the thread local
+      state is initialized, to adjust it. */
+  virtual void InternalThreadSetUp() {}
+
   /* Should be tested when running loops to exit when requested. */
   bool must_stop();
 
@@ -39,8 +39,9 @@ class Layer {
    */
   explicit Layer(const LayerParameter& param)
     : layer_param_(param), is_shared_(false) {
-      // Set phase and copy blobs (if there are any).
+      // Set phase and layout and copy blobs (if there are any).
       phase_ = param.phase();
+      layout_ = param.layout();
       if (layer_param_.blobs_size() > 0) {
         blobs_.resize(layer_param_.blobs_size());
         for (int i = 0; i < layer_param_.blobs_size(); ++i) {
@@ -61,7 +62,9 @@ class Layer {
    * Checks that the number of bottom and top blobs is correct.
    * Calls LayerSetUp to do special layer setup for individual layer types,
    * followed by Reshape to set up sizes of top blobs and internal buffers.
-   * Sets up the loss weight multiplier blobs for any non-zero loss weights.
+   * Sets up the loss weight multiplier blobs for any non-zero loss weights
+   * and tags the top blobs with the layout of the layer, which
+   * LayerRegistry::CreateLayer checks the layer supports.
    * This method may not be overridden.
    */
   void SetUp(const vector<Blob<Dtype>*>& bottom,
@@ -71,6 +74,9 @@ class Layer {
     LayerSetUp(bottom, top);
     Reshape(bottom, top);
     SetLossWeights(top);
+    for (int top_id = 0; top_id < top.size(); ++top_id) {
+      top[top_id]->set_layout(layout_);
+    }
   }
 
   /**
@@ -294,6 +300,40 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns true if Reshape shapes the tops from the bottom shapes
+   *        only.
+   *
+   * Net::Reshape skips such layers when their bottom and top shapes are
+   * unchanged since they were last reshaped. Layers whose Reshape depends on
+   * other state, like Python layers, should return false to be reshaped
+   * every time.
+   */
+  virtual inline bool ReshapeDependsOnlyOnBottomShapes() const {
+    return true;
+  }
+
+  /**
+   * @brief Returns true if layers of this class, configured by param,
+   *        compute the same in any BlobLayout, like elementwise layers do.
+   *
+   * Unless configured otherwise, such layers keep the layout of their first
+   * bottom blob so that the Net does not insert reorders around them. Like
+   * SupportsLayout, this is static so that the Net can plan the layouts of
+   * its blobs, through LayerRegistry, before it creates any layer.
+   */
+  static bool LayoutAgnostic(const LayerParameter& param) { return false; }
+  /**
+   * @brief Returns true if layers of this class, configured by param, can
+   *        read and write blobs in the given BlobLayout besides PLANAR.
+   */
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    return layout == PLANAR;
+  }
+  /// @brief Returns the layout of the blobs the layer reads and writes.
+  inline BlobLayout layout() const { return layout_; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -316,12 +356,24 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns the rows (indices along the first axis, sorted and
+   *        unique) of the param_id-th parameter blob whose diff may be
+   *        non-zero, or NULL if the layer computes a dense gradient for it.
+   *
+   * Layers with row-sparse gradients append to this list in Backward; the
+   * Net clears it together with the diff in ClearParamDiffs.
+   */
+  virtual vector<int>* param_diff_rows(const int param_id) { return NULL; }
+
 
  protected:
   /** The protobuf that stores the layer parameters */
   LayerParameter layer_param_;
   /** The phase: TRAIN or TEST */
   Phase phase_;
+  /** The layout of the bottom and top blobs */
+  BlobLayout layout_;
   /** The vector that stores the learnable parameters as a set of blobs. */
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
@@ -34,6 +34,12 @@
  * REGISTER_LAYER_CREATOR(MyAwesome, GetMyAwesomeLayer)
  *
  * Note that each layer type should only be registered once.
+ *
+ * REGISTER_LAYER_CLASS also registers the blob layouts the class supports
+ * (Layer::LayoutAgnostic and Layer::SupportsLayout). Types registered with a
+ * creator run in PLANAR only, unless their layouts are registered as well:
+ *
+ * REGISTER_LAYER_LAYOUTS(MyAwesome, MyAwesomeLayer)
  */
 
 #ifndef CAFFE_LAYER_FACTORY_H_
@@ -41,6 +47,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/common.hpp"
@@ -57,12 +64,21 @@ class LayerRegistry {
  public:
   typedef shared_ptr<Layer<Dtype> > (*Creator)(const LayerParameter&);
   typedef std::map<string, Creator> CreatorRegistry;
+  typedef bool (*LayoutAgnosticQuery)(const LayerParameter&);
+  typedef bool (*SupportsLayoutQuery)(const LayerParameter&, const BlobLayout);
+  typedef std::map<string, std::pair<LayoutAgnosticQuery,
+      SupportsLayoutQuery> > LayoutRegistry;
 
   static CreatorRegistry& Registry() {
     static CreatorRegistry* g_registry_ = new CreatorRegistry();
     return *g_registry_;
   }
 
+  static LayoutRegistry& Layouts() {
+    static LayoutRegistry* g_layouts_ = new LayoutRegistry();
+    return *g_layouts_;
+  }
+
   // Adds a creator.
   static void AddCreator(const string& type, Creator creator) {
     CreatorRegistry& registry = Registry();
@@ -71,6 +87,15 @@ class LayerRegistry {
     registry[type] = creator;
   }
 
+  // Adds the layouts a layer type supports.
+  static void AddLayouts(const string& type, LayoutAgnosticQuery agnostic,
+      SupportsLayoutQuery supports) {
+    LayoutRegistry& layouts = Layouts();
+    CHECK_EQ(layouts.count(type), 0)
+        << "Layouts of layer type " << type << " already registered.";
+    layouts[type] = std::make_pair(agnostic, supports);
+  }
+
   // Get a layer using a LayerParameter.
   static shared_ptr<Layer<Dtype> > CreateLayer(const LayerParameter& param) {
     if (Caffe::root_solver()) {
@@ -80,9 +105,30 @@ class LayerRegistry {
     CreatorRegistry& registry = Registry();
     CHECK_EQ(registry.count(type), 1) << "Unknown layer type: " << type
         << " (known types: " << LayerTypeListString() << ")";
+    CHECK(SupportsLayout(param, param.layout())) << type
+        << " Layer does not support the " << BlobLayout_Name(param.layout())
+        << " layout.";
     return registry[type](param);
   }
 
+  // Whether layers of the type of param, as configured by it, compute the
+  // same in any layout. Answered without creating a layer.
+  static bool LayoutAgnostic(const LayerParameter& param) {
+    typename LayoutRegistry::const_iterator it = Layouts().find(param.type());
+    return it != Layouts().end() && it->second.first(param);
+  }
+
+  // Whether layers of the type of param, as configured by it, can run in
+  // the given layout. Answered without creating a layer.
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    if (layout == PLANAR || LayoutAgnostic(param)) {
+      return true;
+    }
+    typename LayoutRegistry::const_iterator it = Layouts().find(param.type());
+    return it != Layouts().end() && it->second.second(param, layout);
+  }
+
   static vector<string> LayerTypeList() {
     CreatorRegistry& registry = Registry();
     vector<string> layer_types;
@@ -124,6 +170,17 @@ class LayerRegisterer {
 };
 
 
+template <typename Dtype>
+class LayerLayoutsRegisterer {
+ public:
+  LayerLayoutsRegisterer(const string& type,
+      typename LayerRegistry<Dtype>::LayoutAgnosticQuery agnostic,
+      typename LayerRegistry<Dtype>::SupportsLayoutQuery supports) {
+    LayerRegistry<Dtype>::AddLayouts(type, agnostic, supports);
+  }
+};
+
+
 #define REGISTER_LAYER_CREATOR(type, creator)                                  \
   static LayerRegisterer<float> g_creator_f_##type(#type, creator<float>);     \
   static LayerRegisterer<double> g_creator_d_##type(#type, creator<double>)    \
@@ -134,7 +191,16 @@ class LayerRegisterer {
   {                                                                            \
     return shared_ptr<Layer<Dtype> >(new type##Layer<Dtype>(param));           \
   }                                                                            \
-  REGISTER_LAYER_CREATOR(type, Creator_##type##Layer)
+  REGISTER_LAYER_CREATOR(type, Creator_##type##Layer);                         \
+  REGISTER_LAYER_LAYOUTS(type, type##Layer)
+
+#define REGISTER_LAYER_LAYOUTS(type, layer_class)                              \
+  static LayerLayoutsRegisterer<float> g_layouts_f_##type(#type,               \
+      &layer_class<float>::LayoutAgnostic,                                     \
+      &layer_class<float>::SupportsLayout);                                    \
+  static LayerLayoutsRegisterer<double> g_layouts_d_##type(#type,              \
+      &layer_class<double>::LayoutAgnostic,                                    \
+      &layer_class<double>::SupportsLayout)
 
 }  // namespace caffe
 
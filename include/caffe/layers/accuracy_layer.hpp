@@ -78,7 +78,11 @@ class AccuracyLayer : public Layer<Dtype> {
     }
   }
 
-  int label_axis_, outer_num_, inner_num_;
+  /// Ranks the true labels of outer indices [begin, end).
+  void rank_labels_cpu(const Dtype* bottom_data, const Dtype* bottom_label,
+      int* label_ids, Dtype* label_scores, int* ranks, int begin, int end);
+
+  int label_axis_, outer_num_, inner_num_, num_labels_;
 
   int top_k_;
 
@@ -88,6 +92,11 @@ class AccuracyLayer : public Layer<Dtype> {
   int ignore_label_;
   /// Keeps counts of the number of samples per class.
   Blob<Dtype> nums_buffer_;
+  /// Per-label scratch: the true label (-1 if ignored), its score and the
+  /// number of classes ranked above it.
+  Blob<int> label_buffer_;
+  Blob<int> rank_buffer_;
+  Blob<Dtype> score_buffer_;
 };
 
 }  // namespace caffe
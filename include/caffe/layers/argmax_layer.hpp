@@ -1,6 +1,7 @@
 #ifndef CAFFE_ARGMAX_LAYER_HPP_
 #define CAFFE_ARGMAX_LAYER_HPP_
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -66,10 +67,28 @@ class ArgMaxLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
     NOT_IMPLEMENTED;
   }
+  /// The number of values each maximum is taken over.
+  int axis_size(const Blob<Dtype>* bottom) const;
+  /// The positions worth a parallel chunk on the top_k > 1 path.
+  int top_k_grain(const Blob<Dtype>* bottom) const;
+  /// The top_k == 1 path for outer slices [begin, end).
+  void forward_max_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* max_vals, int* max_ids, int dim, int axis_dist, int begin,
+      int end);
+  /// The top_k > 1 path for one of num_chunks chunks of the num positions.
+  void forward_top_k_cpu(const Dtype* bottom_data, Dtype* top_data, int dim,
+      int axis_dist, int num, int num_chunks, int chunk);
+
   bool out_max_val_;
   size_t top_k_;
   bool has_axis_;
   int axis_;
+  /// Running max values and indices for the top_k == 1 fast path.
+  Blob<Dtype> max_val_;
+  Blob<int> max_id_;
+  /// Heap storage for the top_k > 1 path, one heap per parallel chunk,
+  /// sized once in Reshape.
+  vector<std::pair<Dtype, int> > top_k_buffer_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,8 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <boost/function.hpp>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -30,17 +32,58 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. A col_buff
+  // replaces the layer's column buffer, for images run in parallel.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, Dtype* col_buff = NULL);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, Dtype* col_buff = NULL);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
 
+  // The same for the CHANNELS_LAST layout (group 1 only). The gemms use the
+  // weights reordered to (num_output, kernel taps, channels), which
+  // channels_last_weights_cpu prepares, and accumulate the weight gradient
+  // in that order until add_channels_last_weight_diff_cpu adds it to the
+  // weight diff.
+  void channels_last_weights_cpu(const Dtype* weights);
+  void forward_cpu_gemm_channels_last(const Dtype* input, Dtype* output,
+      Dtype* col_buff = NULL);
+  void forward_cpu_bias_channels_last(Dtype* output, const Dtype* bias);
+  void backward_cpu_gemm_channels_last(const Dtype* output, Dtype* input,
+      Dtype* col_buff = NULL);
+  void weight_cpu_gemm_channels_last(const Dtype* input, const Dtype* output);
+  void backward_cpu_bias_channels_last(Dtype* bias, const Dtype* input);
+  void add_channels_last_weight_diff_cpu(Dtype* weight_diff);
+
+  // Batch loops. image_cpu(n, col_buff) does the work of image n with a
+  // column buffer that no image running at the same time uses.
+  typedef boost::function<void(int, Dtype*)> ImageFunction;
+  // The number of blocks of images for_each_image_cpu runs in parallel, or 1
+  // to run them serially. Images run in parallel when there are threads to
+  // spare and the per-image GEMMs are too small for BLAS alone to keep them
+  // busy, in as many blocks as threads whose column buffers fit in
+  // gemm_batch_workspace.
+  int parallel_blocks_cpu();
+  void for_each_image_cpu(const ImageFunction& image_cpu);
+
+  // Batched GEMMs for the planar layout: num_images consecutive images go
+  // through one GEMM with the outputs of all of them as columns, which keeps
+  // BLAS efficient when conv_out_spatial_dim_ is small. The wide column and
+  // output buffers hold the images side by side, so the inputs are gathered
+  // into them and the results scattered back to the images.
+  // batch_images_cpu() tells whether to run gemm_batch_ images at a time.
+  bool batch_images_cpu();
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, int num_images);
+  void backward_cpu_gemm_batch(const Dtype* output, const Dtype* weights,
+      Dtype* input, int num_images);
+  void weight_cpu_gemm_batch(const Dtype* input, const Dtype* output,
+      Dtype* weights, int num_images);
+
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
@@ -93,6 +136,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool is_1x1_;
   bool force_nd_im2col_;
   bool forced_3d_;
+  /// the number of images per batched GEMM, 1 when not batching
+  int gemm_batch_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -104,6 +149,16 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      const int* shape = conv_input_shape_.cpu_data();
+      const int* kernel = kernel_shape_.cpu_data();
+      const int* pad = pad_.cpu_data();
+      const int* stride = stride_.cpu_data();
+      const int* dilation = dilation_.cpu_data();
+      im2col_3d_cpu(data, conv_in_channels_, shape[1], shape[2], shape[3],
+          kernel[0], kernel[1], kernel[2], pad[0], pad[1], pad[2],
+          stride[0], stride[1], stride[2],
+          dilation[0], dilation[1], dilation[2], col_buff);
     } else {
       im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -118,12 +173,59 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      const int* shape = conv_input_shape_.cpu_data();
+      const int* kernel = kernel_shape_.cpu_data();
+      const int* pad = pad_.cpu_data();
+      const int* stride = stride_.cpu_data();
+      const int* dilation = dilation_.cpu_data();
+      col2im_3d_cpu(col_buff, conv_in_channels_, shape[1], shape[2], shape[3],
+          kernel[0], kernel[1], kernel[2], pad[0], pad[1], pad[2],
+          stride[0], stride[1], stride[2],
+          dilation[0], dilation[1], dilation[2], data);
     } else {
       col2im_nd_cpu(col_buff, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // The channels-last wrappers treat any input as 3-D, with unit kernels
+  // along the missing leading axes.
+  inline void channels_last_geometry(int* shape, int* kernel, int* pad,
+      int* stride, int* dilation) {
+    const int offset = 3 - num_spatial_axes_;
+    for (int i = 0; i < 3; ++i) {
+      const int j = i - offset;
+      shape[i] = j < 0 ? 1 : conv_input_shape_.cpu_data()[j + 1];
+      kernel[i] = j < 0 ? 1 : kernel_shape_.cpu_data()[j];
+      pad[i] = j < 0 ? 0 : pad_.cpu_data()[j];
+      stride[i] = j < 0 ? 1 : stride_.cpu_data()[j];
+      dilation[i] = j < 0 ? 1 : dilation_.cpu_data()[j];
+    }
+  }
+  inline void conv_im2col_channels_last_cpu(const Dtype* data,
+      Dtype* col_buff) {
+    int shape[3], kernel[3], pad[3], stride[3], dilation[3];
+    channels_last_geometry(shape, kernel, pad, stride, dilation);
+    im2col_channels_last_cpu(data, conv_in_channels_,
+        shape[0], shape[1], shape[2], kernel[0], kernel[1], kernel[2],
+        pad[0], pad[1], pad[2], stride[0], stride[1], stride[2],
+        dilation[0], dilation[1], dilation[2], col_buff);
+  }
+  inline void conv_col2im_channels_last_cpu(const Dtype* col_buff,
+      Dtype* data) {
+    int shape[3], kernel[3], pad[3], stride[3], dilation[3];
+    channels_last_geometry(shape, kernel, pad, stride, dilation);
+    col2im_channels_last_cpu(col_buff, conv_in_channels_,
+        shape[0], shape[1], shape[2], kernel[0], kernel[1], kernel[2],
+        pad[0], pad[1], pad[2], stride[0], stride[1], stride[2],
+        dilation[0], dilation[1], dilation[2], data);
+  }
+  void images_cpu(const ImageFunction& image_cpu, Dtype* col_buffers,
+      int num_blocks, int block_begin, int block_end);
+  int gemm_batch_size();
+  void gather_col_batch(const Dtype* input, int num_images);
+  void gather_output_batch(const Dtype* output, int num_images);
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -167,7 +269,14 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_;
+  /// one column buffer per block of images run in parallel
+  Blob<Dtype> parallel_col_buffer_;
+  /// the columns, and the outputs, of gemm_batch_ images side by side
+  Blob<Dtype> batch_col_buffer_;
+  Blob<Dtype> batch_output_buffer_;
   Blob<Dtype> bias_multiplier_;
+  /// weights (data) and weight gradient (diff) in channels-last order
+  Blob<Dtype> channels_last_weights_;
 };
 
 }  // namespace caffe
@@ -71,14 +71,24 @@ class BasePrefetchingDataLayer :
   static const int PREFETCH_COUNT = 3;
 
  protected:
+  // Prefetching gets the bounded CPU share of a data thread.
+  virtual void InternalThreadSetUp() { Caffe::EnterDataThread(); }
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  /// Copies the data of a batch to the data tops, and returns the index of
+  /// the label top.
+  int CopyBatchData(const Batch<Dtype>& batch,
+      const vector<Blob<Dtype>*>& top, const bool gpu);
 
   Batch<Dtype> prefetch_[PREFETCH_COUNT];
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
+  /// When not empty, the batch data stacks the data of several tops along
+  /// axis 1, with these numbers of channels, and the label top follows
+  /// them.
+  vector<int> stacked_data_channels_;
 };
 
 }  // namespace caffe
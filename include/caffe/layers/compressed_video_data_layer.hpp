@@ -0,0 +1,48 @@
+#ifndef CAFFE_COMPRESSED_VIDEO_DATA_LAYER_HPP_
+#define CAFFE_COMPRESSED_VIDEO_DATA_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Provides data to the Net from video files in the compressed domain
+ *        (see ReadCompressedVideo): the I-frames, the accumulated motion
+ *        vectors and the residuals of the clips.
+ *
+ * The clips are listed and sampled like those of VideoDataLayer, with its
+ * video_data_param. There are three data tops of 5-D blobs, plus an
+ * optional label top:
+ *  - the I-frames of the frames of the clips, transformed like the frames
+ *    of VideoDataLayer (3 channels);
+ *  - the (dx, dy) motion vectors in pixels (2 channels);
+ *  - the residuals of the luma (1 channel).
+ * All three share the crop and mirroring of the clip; mirroring negates dx.
+ * The motion vectors and residuals are not scaled, nor are means subtracted
+ * from them.
+ */
+template <typename Dtype>
+class CompressedVideoDataLayer : public VideoDataLayer<Dtype> {
+ public:
+  explicit CompressedVideoDataLayer(const LayerParameter& param)
+      : VideoDataLayer<Dtype>(param) {}
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "CompressedVideoData"; }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 3; }
+  virtual inline int MaxTopBlobs() const { return 4; }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_COMPRESSED_VIDEO_DATA_LAYER_HPP_
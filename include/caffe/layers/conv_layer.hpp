@@ -65,6 +65,14 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       : BaseConvolutionLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "Convolution"; }
+  /// CHANNELS_LAST is supported on the CPU for ungrouped convolution.
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    const ConvolutionParameter& conv_param = param.convolution_param();
+    return layout == PLANAR || (layout == CHANNELS_LAST &&
+        conv_param.group() == 1 && conv_param.axis() == 1 &&
+        !conv_param.force_nd_im2col());
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +85,13 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // The forward pass and the bottom gradient of image n, for
+  // for_each_image_cpu. bias is NULL without a bias term.
+  void forward_image_cpu(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int n, Dtype* col_buff);
+  void backward_image_cpu(const Dtype* top_diff, const Dtype* weight,
+      Dtype* bottom_diff, int n, Dtype* col_buff);
 };
 
 }  // namespace caffe
@@ -14,6 +14,11 @@ namespace caffe {
  * @brief Takes a Blob and crop it, to the shape specified by the second input
  *  Blob, across all dimensions after the specified axis.
  *
+ * When the crop is contiguous in the input, as for crops that only touch the
+ * outermost non-singleton axis, the output aliases the input data at an
+ * offset instead of copying it, like FlattenLayer and ReshapeLayer share
+ * their input. Other crops are copied row by row in parallel.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 
@@ -21,7 +26,7 @@ template <typename Dtype>
 class CropLayer : public Layer<Dtype> {
  public:
   explicit CropLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), top_is_view_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -44,18 +49,27 @@ class CropLayer : public Layer<Dtype> {
   vector<int> offsets;
 
  private:
-  // Recursive copy function.
-  void crop_copy(const vector<Blob<Dtype>*>& bottom,
-               const vector<Blob<Dtype>*>& top,
-               const vector<int>& offsets,
-               vector<int> indices,
-               int cur_dim,
-               const Dtype* src_data,
-               Dtype* dest_data,
-               bool is_forward);
+  // Copies the rows [begin, end) of the crop, which run over the axes before
+  // copy_axis_, from the bottom to the top or back.
+  void crop_copy_rows(const Dtype* src_data, Dtype* dest_data,
+      bool is_forward, int begin, int end);
+  int row_grain() const;
+
+  // The crop copies rows of row_size_ contiguous values, one per index of
+  // the axes before copy_axis_; is_view_ is set when there is only one.
+  int copy_axis_;
+  int row_size_;
+  bool is_view_;
+  // Whether the top data currently aliases the bottom.
+  bool top_is_view_;
+  // The offset of the first cropped value in the bottom.
+  int crop_offset_;
+  // The top shape and the bottom strides of the axes before copy_axis_.
+  vector<int> row_shape_;
+  vector<int> row_strides_;
 
-  // Recursive copy function: this is similar to crop_copy() but loops over all
-  // but the last two dimensions to allow for ND cropping while still relying on
+  // Recursive copy function for the GPU: this loops over all but the last two
+  // dimensions to allow for ND cropping while still relying on
   // a CUDA kernel for the innermost two dimensions for performance reasons.  An
   // alterantive implementation could rely on the kernel more by passing
   // offsets, but this is problematic because of its variable length.
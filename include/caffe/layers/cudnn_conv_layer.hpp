@@ -36,6 +36,11 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNConvolutionLayer();
+  // The channels-last path of ConvolutionLayer runs on the CPU only.
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    return layout == PLANAR;
+  }
 
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
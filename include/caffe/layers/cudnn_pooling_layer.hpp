@@ -26,6 +26,11 @@ class CuDNNPoolingLayer : public PoolingLayer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNPoolingLayer();
+  // The channels-last path of PoolingLayer runs on the CPU only.
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    return layout == PLANAR;
+  }
   // Currently, cuDNN does not support the extra top blob.
   virtual inline int MinTopBlobs() const { return -1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
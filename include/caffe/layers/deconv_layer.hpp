@@ -44,6 +44,13 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return true; }
   virtual void compute_output_shape();
+
+  // The forward pass and the bottom gradient of image n, for
+  // for_each_image_cpu. bias is NULL without a bias term.
+  void forward_image_cpu(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int n, Dtype* col_buff);
+  void backward_image_cpu(const Dtype* top_diff, const Dtype* weight,
+      Dtype* bottom_diff, int n, Dtype* col_buff);
 };
 
 }  // namespace caffe
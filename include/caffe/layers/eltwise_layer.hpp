@@ -26,6 +26,7 @@ class EltwiseLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Eltwise"; }
+  static bool LayoutAgnostic(const LayerParameter& param) { return true; }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
@@ -41,7 +42,9 @@ class EltwiseLayer : public Layer<Dtype> {
 
   EltwiseParameter_EltwiseOp op_;
   vector<Dtype> coeffs_;
-  Blob<int> max_idx_;
+  bool unit_coeffs_;
+  // The winning bottom of each MAX output, one byte each.
+  shared_ptr<SyncedMemory> max_idx_;
 
   bool stable_prod_grad_;
 };
@@ -30,6 +30,10 @@ class EmbedLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual vector<int>* param_diff_rows(const int param_id) {
+    return (param_id == 0 && sparse_gradient_) ? &weight_diff_rows_ : NULL;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -45,6 +49,9 @@ class EmbedLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  bool sparse_gradient_;
+  /// Rows of the weight touched by Backward_cpu since the last clear.
+  vector<int> weight_diff_rows_;
 };
 
 }  // namespace caffe
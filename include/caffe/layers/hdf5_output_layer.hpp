@@ -7,24 +7,42 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
 #define HDF5_DATA_DATASET_NAME "data"
 #define HDF5_DATA_LABEL_NAME "label"
 
+/// Rows gathered by HDF5OutputLayer for one append to its datasets.
+template <typename Dtype>
+class HDF5OutputBuffer {
+ public:
+  Blob<Dtype> data_, label_;
+  int rows_;
+};
+
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
+ * By default every forward pass writes its batch synchronously. With
+ * HDF5OutputParameter.buffer_rows set, rows are instead gathered into
+ * in-memory buffers and appended to chunked, extendable "data" and "label"
+ * datasets by a background writer thread, so the net only blocks when the
+ * writer falls more than a buffer behind. Pending rows are flushed when the
+ * layer is destroyed.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), file_opened_(false) {}
+      : Layer<Dtype>(param), file_opened_(false), buffer_rows_(0),
+        current_buffer_(NULL) {}
   virtual ~HDF5OutputLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -52,11 +70,26 @@ class HDF5OutputLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void SaveBlobs();
 
+  static const int BUFFER_COUNT = 2;
+
+  /// Copies a batch (from host or device memory) into the pending buffers.
+  void BufferBatch(const Dtype* data, const Dtype* label,
+      const vector<Blob<Dtype>*>& bottom);
+  /// Hands the partial buffer to the writer and waits until it is idle.
+  void FlushBuffers();
+  virtual void InternalThreadEntry();
+
   bool file_opened_;
   std::string file_name_;
   hid_t file_id_;
   Blob<Dtype> data_blob_;
   Blob<Dtype> label_blob_;
+
+  int buffer_rows_;
+  HDF5OutputBuffer<Dtype> buffers_[BUFFER_COUNT];
+  HDF5OutputBuffer<Dtype>* current_buffer_;
+  BlockingQueue<HDF5OutputBuffer<Dtype>*> buffer_free_;
+  BlockingQueue<HDF5OutputBuffer<Dtype>*> buffer_full_;
 };
 
 }  // namespace caffe
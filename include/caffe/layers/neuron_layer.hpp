@@ -24,6 +24,7 @@ class NeuronLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline int ExactNumBottomBlobs() const { return 1; }
+  static bool LayoutAgnostic(const LayerParameter& param) { return true; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 };
 
@@ -33,6 +33,14 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  /// CHANNELS_LAST is supported on the CPU for MAX and AVE pooling.
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+    const PoolingParameter_PoolMethod pool = param.pooling_param().pool();
+    return layout == PLANAR || (layout == CHANNELS_LAST &&
+        (pool == PoolingParameter_PoolMethod_MAX ||
+         pool == PoolingParameter_PoolMethod_AVE));
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -43,12 +51,31 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // Pool the (image, channel, frame) planes [begin, end) of PLANAR blobs;
+  // the CPU passes run these in parallel.
+  void ForwardMaxPlanes_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int* mask, Dtype* top_mask, int begin, int end);
+  void ForwardAvePlanes_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int begin, int end);
+  void BackwardMaxPlanes_cpu(const Dtype* top_diff, const int* mask,
+      const Dtype* top_mask, Dtype* bottom_diff, int begin, int end);
+  void BackwardAvePlanes_cpu(const Dtype* top_diff, Dtype* bottom_diff,
+      int begin, int end);
+  // Planes per parallel chunk, enough to amortize the scheduling.
+  int plane_grain() const;
+  // Pool CHANNELS_LAST blobs, with the channels as the innermost loop.
+  void ForwardChannelsLast_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void BackwardChannelsLast_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
   int channels_;
   int height_, width_;
+  // Frames per image; 5-D clips are pooled one frame at a time.
+  int length_;
   int pooled_height_, pooled_width_;
   bool global_pooling_;
   Blob<Dtype> rand_idx_;
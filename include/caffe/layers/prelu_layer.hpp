@@ -40,6 +40,8 @@ class PReLULayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "PReLU"; }
+  // The slopes are per channel, so PReLU needs the planar layout.
+  static bool LayoutAgnostic(const LayerParameter& param) { return false; }
 
  protected:
   /**
@@ -91,9 +93,22 @@ class PReLULayer : public NeuronLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   bool channel_shared_;
+  int channels_;
+  int dim_;  // the values per channel and sample
   Blob<Dtype> multiplier_;  // dot multiplier for backward computation of params
   Blob<Dtype> backward_buff_;  // temporary buffer for backward computation
   Blob<Dtype> bottom_memory_;  // memory for in-place computation
+
+ private:
+  // Each (sample, channel) run of count(2) values has a single slope; these
+  // process the runs [begin, end).
+  void forward_runs_cpu(const Dtype* bottom_data, const Dtype* slope_data,
+      Dtype* top_data, int begin, int end);
+  void backward_runs_cpu(const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* slope_data, Dtype* bottom_diff, int begin, int end);
+  // Accumulates the slope diffs of the channels [begin, end).
+  void slope_diff_cpu(const Dtype* top_diff, const Dtype* bottom_data,
+      Dtype* slope_diff, int num_runs, int begin, int end);
 };
 
 }  // namespace caffe
@@ -0,0 +1,53 @@
+#ifndef CAFFE_PYTHON_DATA_LAYER_HPP_
+#define CAFFE_PYTHON_DATA_LAYER_HPP_
+
+#include <boost/python.hpp>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace bp = boost::python;
+
+namespace caffe {
+
+/**
+ * @brief Provides data to the Net from a Python batch generator running in
+ *        separate worker processes.
+ *
+ * python_param.module and python_param.layer name a class that is built as
+ * `cls(param_str)` and provides `top_shapes()` and a generator
+ * `batches(worker_id, num_workers)` (see caffe/prefetch.py). The generator
+ * runs in python_param.num_workers processes that write batches into a
+ * shared-memory ring; the prefetch thread points each Batch straight at its
+ * ring slot, so Python augmentation overlaps with the net and uses several
+ * cores without copying the batch. A failing worker aborts with its
+ * traceback.
+ */
+template <typename Dtype>
+class PythonDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit PythonDataLayer(const LayerParameter& param);
+  virtual ~PythonDataLayer();
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "PythonData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch);
+
+  /// the caffe.prefetch.BatchPrefetcher feeding this layer
+  shared_ptr<bp::object> prefetcher_;
+  /// ring slot each prefetch batch points to, or -1
+  int slot_[BasePrefetchingDataLayer<Dtype>::PREFETCH_COUNT];
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_PYTHON_DATA_LAYER_HPP_
@@ -10,11 +10,45 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+/**
+ * @brief Holds the GIL for its lifetime. pycaffe releases the GIL while nets
+ *        compute, so every call back into Python has to take it again; this
+ *        is a no-op when the calling thread already holds it.
+ */
+class ScopedGILAcquire {
+ public:
+  ScopedGILAcquire() : state_(PyGILState_Ensure()) { }
+  ~ScopedGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+};
+
+/**
+ * @brief Starts the interpreter if Caffe is not running inside Python (e.g.
+ *        in the caffe tool). The calling thread then drops the GIL, so that
+ *        Python can be called from any thread through ScopedGILAcquire.
+ */
+inline void InitPython() {
+  if (!Py_IsInitialized()) {
+    Py_Initialize();
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
+    PyEval_SaveThread();
+  }
+}
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
   PythonLayer(PyObject* self, const LayerParameter& param)
       : Layer<Dtype>(param), self_(bp::handle<>(bp::borrowed(self))) { }
+  // The caller, e.g. the caffe tool, may not hold the GIL.
+  virtual ~PythonLayer() {
+    ScopedGILAcquire gil;
+    self_ = bp::object();
+  }
 
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -24,6 +58,7 @@ class PythonLayer : public Layer<Dtype> {
         && !ShareInParallel()) {
       LOG(FATAL) << "PythonLayer is not implemented in Multi-GPU training";
     }
+    ScopedGILAcquire gil;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("phase") = static_cast<int>(this->phase_);
@@ -31,22 +66,29 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     self_.attr("reshape")(bottom, top);
   }
 
   virtual inline bool ShareInParallel() const {
     return this->layer_param_.python_param().share_in_parallel();
   }
+  // The Python reshape may depend on anything.
+  virtual inline bool ReshapeDependsOnlyOnBottomShapes() const {
+    return false;
+  }
 
   virtual inline const char* type() const { return "Python"; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    ScopedGILAcquire gil;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
@@ -54,6 +96,26 @@ class PythonLayer : public Layer<Dtype> {
   bp::object self_;
 };
 
+/**
+ * @brief Deleter of the shared_ptr the layer factory hands out for a
+ *        PythonLayer. The layer is owned by its Python object, which
+ *        boost.python releases without taking the GIL, so the last reference
+ *        is dropped here with the GIL held.
+ */
+template <typename Dtype>
+class PythonLayerDeleter {
+ public:
+  explicit PythonLayerDeleter(const shared_ptr<PythonLayer<Dtype> >& layer)
+      : layer_(layer) { }
+  void operator()(Layer<Dtype>* layer) {
+    ScopedGILAcquire gil;
+    layer_.reset();
+  }
+
+ private:
+  shared_ptr<PythonLayer<Dtype> > layer_;
+};
+
 }  // namespace caffe
 
 #endif
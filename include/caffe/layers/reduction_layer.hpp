@@ -12,7 +12,10 @@ namespace caffe {
 /**
  * @brief Compute "reductions" -- operations that return a scalar output Blob
  *        for an input Blob of arbitrary size, such as the sum, absolute sum,
- *        and sum of squares.
+ *        sum of squares and maximum.
+ *
+ * The reduced axes are either all the axes from axis on, or any set of axes
+ * given by reduce_axis, such as the temporal axis of a batch of clips.
  *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
@@ -44,14 +47,35 @@ class ReductionLayer : public Layer<Dtype> {
   ReductionParameter_ReductionOp op_;
   /// @brief a scalar coefficient applied to all outputs
   Dtype coeff_;
-  /// @brief the index of the first input axis to reduce
+  /// @brief the index of the first input axis to reduce, without reduce_axis
   int axis_;
+  /// @brief whether the reduced axes are trailing ones, so that each output
+  ///        reduces dim_ contiguous inputs (the GPU implementation needs it)
+  bool tail_reduction_;
   /// @brief the number of reductions performed
   int num_;
   /// @brief the input size of each reduction
   int dim_;
   /// @brief a helper Blob used for summation (op_ == SUM)
   Blob<Dtype> sum_multiplier_;
+
+  /// @brief the number of contiguous outputs of a row, reduced together
+  int inner_;
+  /// @brief the number of contiguous inputs reduced into one output
+  int segment_;
+  /// @brief the input offset of each row of outputs
+  vector<int> row_offsets_;
+  /// @brief the input offsets of the reduced positions, relative to a row
+  vector<int> reduce_offsets_;
+  /// @brief the position of the maximum of each output (op_ == MAX), as
+  ///        reduced position * segment_ + index in the segment
+  Blob<int> max_idx_;
+
+ private:
+  void forward_rows_cpu(const Dtype* bottom_data, const Dtype* mult_data,
+      Dtype* top_data, int* max_idx, int begin, int end);
+  void backward_rows_cpu(const Dtype* top_diff, const Dtype* bottom_data,
+      const int* max_idx, Dtype* bottom_diff, int begin, int end);
 };
 
 }  // namespace caffe
@@ -24,7 +24,7 @@ template <typename Dtype>
 class ScaleLayer: public Layer<Dtype> {
  public:
   explicit ScaleLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), recompute_bottom_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -75,6 +75,16 @@ class ScaleLayer: public Layer<Dtype> {
   Blob<Dtype> temp_;
   int axis_;
   int outer_dim_, scale_dim_, inner_dim_;
+  // Set by an in-place Forward_cpu that kept no copy of the bottom, see
+  // ScaleParameter.in_place_recompute.
+  bool recompute_bottom_;
+
+ private:
+  // Computes the scale diffs [begin, end). Without a bottom copy, bottom_data
+  // is the top and the bottom is recovered with bias_data and the scale.
+  void scale_diff_cpu(const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* scale_data, const Dtype* bias_data, Dtype* scale_diff,
+      bool accumulate, int begin, int end);
 };
 
 
@@ -22,6 +22,7 @@ class SilenceLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "Silence"; }
+  static bool LayoutAgnostic(const LayerParameter& param) { return true; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 0; }
 
@@ -1,6 +1,7 @@
 #ifndef CAFFE_SOFTMAX_WITH_LOSS_LAYER_HPP_
 #define CAFFE_SOFTMAX_WITH_LOSS_LAYER_HPP_
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -107,6 +108,15 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   virtual Dtype get_normalizer(
       LossParameter_NormalizationMode normalization_mode, int valid_count);
 
+  /// The loss summed over samples [begin, end) and their count of valid
+  /// outputs; the samples are reduced in parallel.
+  std::pair<Dtype, int> sample_loss_cpu(const Dtype* prob_data,
+      const Dtype* label, int begin, int end);
+  /// Turns the probabilities of samples [begin, end) into unscaled
+  /// gradients and returns their count of valid outputs.
+  int sample_diff_cpu(const Dtype* label, Dtype* bottom_diff, int begin,
+      int end);
+
   /// The internal SoftmaxLayer used to map predictions to a distribution.
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
@@ -25,6 +25,7 @@ class SplitLayer : public Layer<Dtype> {
 
   virtual inline const char* type() const { return "Split"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
+  static bool LayoutAgnostic(const LayerParameter& param) { return true; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
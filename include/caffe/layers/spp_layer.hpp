@@ -14,6 +14,14 @@ namespace caffe {
  *        by taking the max, average, etc. within regions
  *        so that the result vector of different sized
  *        images are of the same size.
+ *
+ * Accepts 4-D (num, channels, height, width) and 5-D (num, channels, length,
+ * height, width) inputs. Level i splits height and width into 2^i bins, and
+ * also the length if SPPParameter.temporal_pyramid is set (otherwise each bin
+ * spans the whole clip). The bins are laid out as if every level were pooled
+ * by a PoolingLayer, flattened and concatenated along the channel axis, but
+ * all levels are computed in a single pass over the input that writes
+ * straight into the (num, channels * total bins) output.
  */
 template <typename Dtype>
 class SPPLayer : public Layer<Dtype> {
@@ -29,46 +37,49 @@ class SPPLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /// Per-level entries of level_info_: the bin offset of the level followed
+  /// by the pooled size, kernel size (== stride) and padding of each of the
+  /// length, height and width axes.
+  enum { LEVEL_OFFSET = 0, LEVEL_POOLED = 1, LEVEL_KERNEL = 4, LEVEL_PAD = 7,
+         LEVEL_INFO_SIZE = 10 };
+
+  /// Whether an axis of the given size splits into num_bins bins: the
+  /// padding PoolingLayer would need must stay below the kernel size.
+  static bool AxisFitsBins(const int size, const int num_bins);
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  // calculates the kernel and stride dimensions for the pooling layer,
-  // returns a correctly configured LayerParameter for a PoolingLayer
-  virtual LayerParameter GetPoolingParam(const int pyramid_level,
-      const int bottom_h, const int bottom_w, const SPPParameter spp_param);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// Computes the pooling geometry of one axis the way PoolingLayer would
+  /// for a kernel and stride covering the axis with num_bins bins.
+  static void GetBinGeometry(const int size, const int num_bins,
+      int* pooled, int* kernel, int* pad);
 
   int pyramid_height_;
-  int bottom_h_, bottom_w_;
+  bool temporal_pyramid_;
   int num_;
   int channels_;
-  int kernel_h_, kernel_w_;
-  int pad_h_, pad_w_;
+  int bottom_l_, bottom_h_, bottom_w_;
+  /// number of bins over all levels, for a single channel
+  int total_bins_;
   bool reshaped_first_time_;
 
-  /// the internal Split layer that feeds the pooling layers
-  shared_ptr<SplitLayer<Dtype> > split_layer_;
-  /// top vector holder used in call to the underlying SplitLayer::Forward
-  vector<Blob<Dtype>*> split_top_vec_;
-  /// bottom vector holder used in call to the underlying PoolingLayer::Forward
-  vector<vector<Blob<Dtype>*>*> pooling_bottom_vecs_;
-  /// the internal Pooling layers of different kernel sizes
-  vector<shared_ptr<PoolingLayer<Dtype> > > pooling_layers_;
-  /// top vector holders used in call to the underlying PoolingLayer::Forward
-  vector<vector<Blob<Dtype>*>*> pooling_top_vecs_;
-  /// pooling_outputs stores the outputs of the PoolingLayers
-  vector<Blob<Dtype>*> pooling_outputs_;
-  /// the internal Flatten layers that the Pooling layers feed into
-  vector<FlattenLayer<Dtype>*> flatten_layers_;
-  /// top vector holders used in call to the underlying FlattenLayer::Forward
-  vector<vector<Blob<Dtype>*>*> flatten_top_vecs_;
-  /// flatten_outputs stores the outputs of the FlattenLayers
-  vector<Blob<Dtype>*> flatten_outputs_;
-  /// bottom vector holder used in call to the underlying ConcatLayer::Forward
-  vector<Blob<Dtype>*> concat_bottom_vec_;
-  /// the internal Concat layers that the Flatten layers feed into
-  shared_ptr<ConcatLayer<Dtype> > concat_layer_;
+  /// pooling geometry of each level, LEVEL_INFO_SIZE entries per level
+  Blob<int> level_info_;
+  /// for each level, the bin index of every position along the length,
+  /// height and width axes, or -1 if the position is not pooled
+  Blob<int> bin_index_;
+  /// reciprocal of the (padded) window size of every bin, for AVE pooling
+  Blob<Dtype> bin_scale_;
+  /// position of the maximum within its channel, for MAX pooling
+  Blob<int> max_idx_;
 };
 
 }  // namespace caffe
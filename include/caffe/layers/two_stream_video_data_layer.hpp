@@ -0,0 +1,71 @@
+#ifndef CAFFE_TWO_STREAM_VIDEO_DATA_LAYER_HPP_
+#define CAFFE_TWO_STREAM_VIDEO_DATA_LAYER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#ifdef USE_OPENCV
+namespace caffe {
+
+/**
+ * @brief Provides the RGB frames and the precomputed optical flow of the
+ *        clips of frame directories to two-stream nets, in one pass over
+ *        the list.
+ *
+ * The clips are listed and sampled like those of VideoDataLayer. The frame
+ * directories hold flow_x_%04d.jpg and flow_y_%04d.jpg files along with
+ * their image_%04d.jpg files, numbered alike. There are two data tops of
+ * 5-D blobs, the frames and the (x, y) flow, plus an optional label top.
+ *
+ * The frames and the flow of a clip share their frames, crop and
+ * mirroring; mirroring negates the flow-x. The flow is transformed with
+ * the scale of transform_param, less flow_mean_value. The clips of a batch
+ * are read and transformed in parallel.
+ */
+template <typename Dtype>
+class TwoStreamVideoDataLayer : public VideoDataLayer<Dtype> {
+ public:
+  explicit TwoStreamVideoDataLayer(const LayerParameter& param)
+      : VideoDataLayer<Dtype>(param) {}
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "TwoStreamVideoData"; }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 2; }
+  virtual inline int MaxTopBlobs() const { return 3; }
+
+ protected:
+  /// A clip of a batch, as it is read and transformed.
+  struct Clip {
+    string path;
+    vector<int> frames;
+    bool mirror;
+    /// The crop of the frames read, or all of them.
+    cv::Rect crop;
+    std::vector<cv::Mat> rgb;
+    std::vector<cv::Mat> flow;
+  };
+
+  virtual void load_batch(Batch<Dtype>* batch);
+  virtual int CountFrames(const string& path);
+  /// Reads the frames and flow of clips [begin, end).
+  void ReadClips(vector<Clip>* clips, const int begin, const int end);
+  /// Transforms clips [begin, end) to their items of the batch data.
+  void TransformClips(const vector<Clip>& clips, Blob<Dtype>* data,
+      const int begin, const int end);
+
+  /// Transforms the flow, sharing the crops and mirroring of the frames.
+  shared_ptr<DataTransformer<Dtype> > flow_transformer_;
+};
+
+}  // namespace caffe
+#endif  // USE_OPENCV
+
+#endif  // CAFFE_TWO_STREAM_VIDEO_DATA_LAYER_HPP_
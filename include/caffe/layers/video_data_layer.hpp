@@ -1,6 +1,8 @@
 #ifndef CAFFE_VIDEO_DATA_LAYER_HPP_
 #define CAFFE_VIDEO_DATA_LAYER_HPP_
 
+#include <deque>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -14,10 +16,12 @@
 
 // an extension the std::pair which used to store image filename and
 // its label (int). now, a frame number associated with the video filename
-// is needed (second param) to fully represent a video segment
+// is needed (second param) to fully represent a video segment. length is the
+// number of frames of the segment, or 0 for new_length.
 struct triplet {
   std::string first;
   int second, third;
+  int length;
 };
 
 namespace caffe {
@@ -25,6 +29,16 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from video files.
  *
+ * With bucket_by_shape, clips keep their native length and resolution:
+ * each batch holds clips of a single shape, and the net is reshaped to it.
+ *
+ * With crop_before_decode, the crop of each clip is picked before its
+ * frames are read, and only the crop is decoded.
+ *
+ * Clips take every temporal_stride-th frame from their start frame, or,
+ * with num_segments, a snippet from each of num_segments segments of the
+ * video.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -44,9 +58,34 @@ class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleVideos();
   virtual void load_batch(Batch<Dtype>* batch);
+  /// Fills the batch from the first shape bucket to reach batch_size clips.
+  virtual void load_bucketed_batch(Batch<Dtype>* batch);
+  /// Reads the list of clips, and sets up its shuffling and sampling.
+  void LoadLines();
+  /// Moves on to the next line, reshuffling after the last one.
+  void NextLine();
+  /// The transformer picking the crops to decode, NULL to decode it all.
+  DataTransformer<Dtype>* CropTransformer();
+  /// The frames of the clip on a line, sampled as set by the parameters.
+  vector<int> ClipFrames(const triplet& line);
+  /// The number of frames of a video, for segments.
+  virtual int CountFrames(const string& path);
 
   vector<triplet> lines_;
   int lines_id_;
+  bool crop_before_decode_;
+  /// Picks the snippets of the segments in training.
+  shared_ptr<Caffe::RNG> segment_rng_;
+  /// The number of frames of the videos, for segments.
+  std::map<string, int> num_frames_;
+
+  /// A transformed clip and its label, waiting for a batch of its shape.
+  typedef std::pair<shared_ptr<Blob<Dtype> >, int> PendingClip;
+  /// Pending clips by shape, in the order they were read.
+  std::map<vector<int>, std::deque<PendingClip> > buckets_;
+  int num_pending_;
+  /// Clip blobs no longer pending, kept for reuse.
+  vector<shared_ptr<Blob<Dtype> > > free_clips_;
 };
 
 
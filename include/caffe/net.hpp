@@ -61,6 +61,9 @@ class Net {
   /**
    * @brief Zeroes out the diffs of all net parameters.
    *        Should be run before Backward.
+   *
+   * With sparse parameter updates enabled, only the touched rows of params
+   * with row-sparse gradients are zeroed.
    */
   void ClearParamDiffs();
 
@@ -79,6 +82,12 @@ class Net {
    *
    * This is useful to propagate changes to layer sizes without running
    * a forward pass, e.g. to compute output feature size.
+   *
+   * Layers whose bottom and top shapes are unchanged since they were last
+   * reshaped are skipped, so reshaping to the current shapes is a no-op.
+   * This assumes a layer shapes its tops from its bottom shapes only; layers
+   * without bottoms, and those whose ReshapeDependsOnlyOnBottomShapes() is
+   * false, are always reshaped.
    */
   void Reshape();
 
@@ -91,6 +100,22 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /**
+   * @brief Enables row-wise clearing and updating of params whose layers
+   *        report row-sparse gradients (see Layer::param_diff_rows).
+   *
+   * Set by solvers whose update rules can be applied lazily; CPU only.
+   */
+  inline void set_sparse_param_updates(bool value) {
+    sparse_param_updates_ = value;
+  }
+  /**
+   * @brief Returns the rows of the learnable param whose diff may be
+   *        non-zero, or NULL if its diff has to be treated as dense.
+   */
+  inline const vector<int>* learnable_param_diff_rows(int param_id) const {
+    return sparse_param_updates_ ? learnable_param_diff_rows_[param_id] : NULL;
+  }
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -241,6 +266,12 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Whether a layer's bottom or top shapes differ from those it was
+  ///        last reshaped with.
+  bool LayerShapesChanged(const int layer_id) const;
+  /// @brief Records the shapes a layer was reshaped with.
+  void RecordLayerShapes(const int layer_id);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -271,6 +302,9 @@ class Net {
   /// top_vecs stores the vectors containing the output for each layer
   vector<vector<Blob<Dtype>*> > top_vecs_;
   vector<vector<int> > top_id_vecs_;
+  /// The bottom and top shapes each layer was last reshaped with.
+  vector<vector<vector<int> > > layer_bottom_shapes_;
+  vector<vector<vector<int> > > layer_top_shapes_;
   /// Vector of weight in the loss (or objective) function of each net blob,
   /// indexed by blob_id.
   vector<Dtype> blob_loss_weights_;
@@ -301,6 +335,10 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// the touched rows of learnable_params_ with row-sparse gradients, or NULL
+  vector<vector<int>*> learnable_param_diff_rows_;
+  /// Whether to clear and update row-sparse params row by row.
+  bool sparse_param_updates_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
@@ -31,6 +31,11 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  virtual inline bool SupportsSparseParamUpdates() const { return true; }
+  virtual void ApplyPendingUpdates();
+  // Applies to the given rows of a param with a row-sparse gradient the
+  // updates of the iterations for which they received no gradient.
+  virtual void CatchUpRows(int param_id, const vector<int>& rows);
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -41,6 +46,12 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // Lazy update state of params with row-sparse gradients: row_iters_[i][r]
+  // is the first iteration not yet applied to row r of param i, and
+  // lazy_rates_ holds the learning rates from iteration lazy_rates_start_ on.
+  vector<vector<int> > row_iters_;
+  vector<Dtype> lazy_rates_;
+  int lazy_rates_start_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -55,6 +66,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "Nesterov"; }
 
  protected:
+  virtual inline bool SupportsSparseParamUpdates() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
@@ -70,6 +82,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaGrad"; }
 
  protected:
+  virtual inline bool SupportsSparseParamUpdates() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
@@ -90,6 +103,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "RMSProp"; }
 
  protected:
+  virtual inline bool SupportsSparseParamUpdates() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
@@ -113,6 +127,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaDelta"; }
 
  protected:
+  virtual inline bool SupportsSparseParamUpdates() const { return false; }
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
 
@@ -139,6 +154,11 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool SupportsSparseParamUpdates() const {
+    return this->param_.lazy_adam();
+  }
+  // Lazy Adam leaves idle rows as they are.
+  virtual void CatchUpRows(int param_id, const vector<int>& rows) {}
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
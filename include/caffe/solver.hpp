@@ -97,9 +97,16 @@ class Solver {
  protected:
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
+  // Whether ApplyUpdate can update params with row-sparse gradients row by
+  // row, deferring the updates of idle rows (see Net::set_sparse_param_updates).
+  virtual inline bool SupportsSparseParamUpdates() const { return false; }
+  // Brings the rows whose updates were deferred up to date; called before the
+  // weights are tested, snapshotted or handed back to the client.
+  virtual void ApplyPendingUpdates() {}
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  string SnapshotToCodebook();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
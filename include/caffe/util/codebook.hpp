@@ -0,0 +1,44 @@
+#ifndef CAFFE_UTIL_CODEBOOK_HPP_
+#define CAFFE_UTIL_CODEBOOK_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Codebook compression of BlobProto data, for the CODEBOOK snapshot
+ *        format.
+ *
+ * The values of a blob are clustered by k-means into a codebook of at most
+ * 2^bits floats, and each value is replaced by the Huffman-coded index of
+ * its cluster. The indices are coded in chunks of kCodebookChunkSize values
+ * that decode independently, so that decompression runs in parallel.
+ */
+const int kCodebookChunkSize = 1 << 16;
+
+/// @brief Whether the BlobProto holds codebook-compressed data.
+inline bool IsCodebookCompressed(const BlobProto& proto) {
+  return proto.codebook_size() > 0;
+}
+
+/// @brief Replaces the data (or double_data) of the proto by a codebook of
+///        at most 2^bits values and the coded indices into it.
+void CodebookCompress(const int bits, BlobProto* proto);
+
+/// @brief Decodes the count values of a codebook-compressed proto.
+template <typename Dtype>
+void CodebookDecompress(const BlobProto& proto, const int count,
+    Dtype* data);
+
+/**
+ * @brief Codebook-compresses the weights of a net, in parallel over blobs.
+ *
+ * Only blobs of two or more axes with at least 16 values per codebook entry
+ * are compressed: biases and normalization statistics are small and
+ * sensitive, and keep their full precision.
+ */
+void CodebookCompressNet(const int bits, NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CODEBOOK_HPP_
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_COMPRESSED_VIDEO_HPP_
+#define CAFFE_UTIL_COMPRESSED_VIDEO_HPP_
+
+#if defined(USE_OPENCV) && defined(USE_FFMPEG)
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Frames of a video in the compressed domain, as in "Compressed
+ *        Video Action Recognition" (Wu et al., 2018).
+ *
+ * Each frame is represented relative to the I-frame that starts its group
+ * of pictures (GOP):
+ *  - iframes: that I-frame, as BGR (CV_8UC3). The frames of a GOP share it.
+ *  - motion_vectors: the motion of the frame accumulated back to the
+ *    I-frame, as the (dx, dy) offset in pixels from each pixel to the pixel
+ *    of the I-frame it is predicted from (CV_32FC2), traced per 4x4 block
+ *    with the sub-pixel precision of the codec. Zero for I-frames.
+ *  - residuals: the luma of the frame minus that of the I-frame displaced
+ *    by the accumulated motion, rounded to whole pixels (CV_16SC1). Zero for
+ *    I-frames.
+ */
+struct CompressedFrames {
+  vector<cv::Mat> iframes;
+  vector<cv::Mat> motion_vectors;
+  vector<cv::Mat> residuals;
+};
+
+/**
+ * @brief Reads the given (1-based) frames of a video file in the
+ *        compressed domain.
+ *
+ * The motion vectors are those libavcodec exports as frame side data. The
+ * frames from the I-frame to the last one asked for are decoded, since the
+ * later ones are predicted from them, but those outside the clip only add
+ * their motion vectors to the accumulated motion; only the I-frames are
+ * converted to BGR, and only the frames asked for get a residual. Motion
+ * vectors that refer to later frames are ignored, and libavcodec does not
+ * tell which past frame a block refers to, so the videos should be encoded
+ * without B-frames and with a single reference frame (e.g. MPEG-4 part 2,
+ * or H.264 with bframes=0 and ref=1).
+ */
+bool ReadCompressedVideo(const string& path, const vector<int>& frames,
+    CompressedFrames* compressed);
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV && USE_FFMPEG
+#endif  // CAFFE_UTIL_COMPRESSED_VIDEO_HPP_
@@ -0,0 +1,98 @@
+#ifndef CAFFE_UTIL_CPU_ISA_HPP_
+#define CAFFE_UTIL_CPU_ISA_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief The x86 vector instruction sets hand-written CPU kernels exist for,
+///        in increasing order.
+enum CpuIsa {
+  CPU_ISA_GENERIC = 0,
+  CPU_ISA_SSE42 = 1,
+  CPU_ISA_AVX2 = 2,
+  CPU_ISA_AVX512 = 3
+};
+
+/// @brief The best instruction set that both the CPU and the OS support.
+CpuIsa DetectCpuIsa();
+
+/**
+ * @brief The instruction set the CPU kernels run with.
+ *
+ * Chosen once, on first use, as the detected instruction set or the one
+ * given by the --cpu_isa flag (generic, sse4.2, avx2 or avx512), and logged.
+ */
+CpuIsa cpu_isa();
+
+/**
+ * @brief Switches the CPU kernels to another supported instruction set.
+ *
+ * Meant for tests and startup code: the switch is not synchronized with
+ * kernels running on other threads.
+ */
+void SetCpuIsa(const CpuIsa isa);
+
+string CpuIsaName(const CpuIsa isa);
+CpuIsa CpuIsaFromName(const string& name);
+
+/**
+ * @brief Single precision kernels with one implementation per CpuIsa.
+ *
+ * Use them through the caffe_* math functions rather than directly.
+ * Every implementation gives the same results as the generic one.
+ */
+struct CpuKernels {
+  void (*add)(const int n, const float* a, const float* b, float* y);
+  void (*sub)(const int n, const float* a, const float* b, float* y);
+  void (*mul)(const int n, const float* a, const float* b, float* y);
+  void (*div)(const int n, const float* a, const float* b, float* y);
+  void (*sqr)(const int n, const float* a, float* y);
+  void (*sqrt)(const int n, const float* a, float* y);
+  /// y = max(x, 0) + negative_slope * min(x, 0)
+  void (*relu)(const int n, const float* x, const float negative_slope,
+      float* y);
+  /// bottom_diff = top_diff * ((x > 0) + negative_slope * (x <= 0))
+  void (*relu_backward)(const int n, const float* top_diff,
+      const float* bottom_data, const float negative_slope,
+      float* bottom_diff);
+  /// where x > y: y = x and mask = index
+  void (*max_update)(const int n, const float* x, const int index, float* y,
+      int* mask);
+  /// y = (x - (mean ? mean : mean_value)) * scale
+  void (*transform_u8)(const int n, const uint8_t* x, const float* mean,
+      const float mean_value, const float scale, float* y);
+  /// y = sum_j coeffs[j] * x[j], or sum_j x[j] without coeffs, for the
+  /// indices [begin, end) of num_inputs arrays
+  void (*sum_n)(const int begin, const int end, const int num_inputs,
+      const float* const* x, const float* coeffs, float* y);
+  /// y = prod_j x[j] for the indices [begin, end)
+  void (*prod_n)(const int begin, const int end, const int num_inputs,
+      const float* const* x, float* y);
+  /// y = max_j x[j] and mask = the first maximal j, except that x[1] wins
+  /// ties with x[0], for the indices [begin, end)
+  void (*max_n)(const int begin, const int end, const int num_inputs,
+      const float* const* x, float* y, uint8_t* mask);
+  /// y = alpha * x
+  void (*scale)(const int n, const float alpha, const float* x, float* y);
+  /// y = alpha * x + beta
+  void (*scale_bias)(const int n, const float alpha, const float beta,
+      const float* x, float* y);
+  /// y += |x|
+  void (*asum_update)(const int n, const float* x, float* y);
+  /// y += x * x
+  void (*sumsq_update)(const int n, const float* x, float* y);
+};
+
+/// @brief The kernels of the instruction set chosen by cpu_isa().
+const CpuKernels& cpu_kernels();
+/// @brief The kernels of a given instruction set.
+const CpuKernels& GetCpuKernels(const CpuIsa isa);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_ISA_HPP_
@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_FACTORIZE_HPP_
+#define CAFFE_UTIL_FACTORIZE_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Low-rank factorization of trained 3-D convolutions, for the
+ *        factorize_net tool.
+ *
+ * SEPARABLE splits a k x k x k convolution into a 1 x k x k spatial
+ * convolution followed by a k x 1 x 1 temporal one, through as many
+ * intermediate channels as the rank. CHANNEL splits it into a k x k x k
+ * convolution onto rank channels followed by a 1 x 1 x 1 convolution onto
+ * the outputs. Both come from a truncated SVD of the filters, so that at
+ * full rank the pair computes the same outputs as the original.
+ */
+enum FactorizationMethod {
+  SEPARABLE_FACTORIZATION,
+  CHANNEL_FACTORIZATION
+};
+
+/// @brief Diagonalizes the symmetric n x n row-major matrix a by cyclic
+///        Jacobi rotations. On return the diagonal of a holds the
+///        eigenvalues, and the columns of v the eigenvectors.
+void SymmetricEigen(const int n, vector<double>* a,
+    vector<double>* v);
+
+/**
+ * @brief Factors the m x n row-major matrix a into left (m x r) times
+ *        right (r x n) by a truncated SVD.
+ *
+ * Takes rank r if it is positive, and otherwise the smallest rank that
+ * keeps the given fraction of the energy (the sum of the squared singular
+ * values). Returns the relative Frobenius error of the product.
+ */
+double LowRankFactor(const vector<double>& a, const int m, const int n,
+    const int rank, const double energy, vector<double>* left,
+    vector<double>* right, int* out_rank);
+
+/// @brief A factorized convolution: the layers that replace it and their
+///        weights.
+struct ConvFactorization {
+  LayerParameter first;
+  LayerParameter second;
+  vector<int> first_shape;
+  vector<int> second_shape;
+  vector<float> first_weights;
+  vector<float> second_weights;
+};
+
+/**
+ * @brief Factorizes a Convolution or NdConvolution layer with weights of
+ *        the given (O, C, T, H, W) shape, at the requested rank or energy
+ *        as LowRankFactor takes them. Returns the relative error of the
+ *        filters.
+ *
+ * The first layer reads the bottom of the original into rank channels,
+ * without a bias; the second writes the top of the original, with its bias.
+ */
+double FactorizeConvolution(const LayerParameter& layer,
+    const Blob<float>& weights, const FactorizationMethod method,
+    const int requested_rank, const double energy,
+    ConvFactorization* result);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FACTORIZE_HPP_
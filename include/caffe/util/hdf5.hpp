@@ -8,6 +8,8 @@
 
 #include "caffe/blob.hpp"
 
+namespace boost { class mutex; }
+
 namespace caffe {
 
 template <typename Dtype>
@@ -25,6 +27,22 @@ void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
     bool write_diff = false);
 
+/**
+ * Appends the first num_rows rows (along axis 0) of blob to a chunked,
+ * extendable dataset, creating it with chunks of chunk_rows rows on first
+ * use. The remaining axes must match those of the existing dataset.
+ */
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    int num_rows, int chunk_rows);
+
+/**
+ * Serializes HDF5 calls made from Caffe's background threads against those
+ * of the main thread, as the library is usually built without thread safety.
+ */
+boost::mutex& hdf5_mutex();
+
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
 string hdf5_load_string(hid_t loc_id, const string& dataset_name);
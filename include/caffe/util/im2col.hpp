@@ -16,6 +16,15 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+template <typename Dtype>
+void im2col_3d_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -29,6 +38,35 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+template <typename Dtype>
+void col2im_3d_cpu(const Dtype* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_im);
+
+/// @brief im2col for channels-last (length, height, width, channels) images;
+///        the columns are (output location) x (kernel tap, channels).
+template <typename Dtype>
+void im2col_channels_last_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_col);
+
+template <typename Dtype>
+void col2im_channels_last_cpu(const Dtype* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
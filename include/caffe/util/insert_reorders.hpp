@@ -0,0 +1,26 @@
+#ifndef _CAFFE_UTIL_INSERT_REORDERS_HPP_
+#define _CAFFE_UTIL_INSERT_REORDERS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the BlobLayout of every layer resolved and
+// ReorderLayers added wherever a layer reads a blob stored in another layout.
+// Layers run in NetParameter.layout if they support it, layout agnostic
+// layers keep the layout of their first bottom, and net outputs are always
+// handed out in the PLANAR layout.
+template <typename Dtype>
+void InsertReorders(const NetParameter& param,
+    NetParameter* param_reordered);
+
+void ConfigureReorderLayer(const string& blob_name, const BlobLayout layout,
+    LayerParameter* reorder_layer_param);
+
+string ReorderBlobName(const string& blob_name, const BlobLayout layout);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INSERT_REORDERS_HPP_
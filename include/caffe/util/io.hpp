@@ -2,6 +2,9 @@
 #define CAFFE_UTIL_IO_H_
 
 #include <boost/filesystem.hpp>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
 #include <iomanip>
 #include <iostream>  // NOLINT(readability/streams)
 #include <string>
@@ -150,6 +153,61 @@ void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 bool ReadVideoToCVMat(const string& filename,
     const int frame_num, const int length, const int height, const int width,
     const bool is_color, std::vector<cv::Mat>* cv_imgs);
+
+/**
+ * @brief Reads the given frames of a video file or frame directory, in
+ *        the order given.
+ *
+ * Each frame of a video file is decoded once, and the frames that are not
+ * in the list are only grabbed,
+ * neither retrieved nor converted, and those of a frame directory are not
+ * read at all, so the cost follows the number of frames in the list.
+ */
+bool ReadVideoToCVMat(const string& filename,
+    const vector<int>& frames, const int height, const int width,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs);
+
+/// @brief The number of frames of a video file or frame directory, 0 if it
+///        cannot be read.
+int CountVideoFrames(const string& path);
+
+/// @brief Reads the size of the frames of a video file or frame directory,
+///        from the header of frame_num alone where possible.
+bool ReadVideoFrameSize(const string& path, const int frame_num,
+    int* height, int* width);
+
+/**
+ * @brief Reads the roi of length frames, like ReadVideoToCVMat without
+ *        resizing.
+ *
+ * When built with libjpeg-turbo, the JPEG frames of frame directories are
+ * only decoded over the iMCU-aligned bounding box of the roi, so the decode
+ * cost follows the area of the roi rather than that of the frames.
+ */
+bool ReadVideoCropToCVMat(const string& path,
+    const int start_frame, const int length, const cv::Rect& roi,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs);
+
+bool ReadVideoCropToCVMat(const string& path,
+    const vector<int>& frames, const cv::Rect& roi,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs);
+
+/// @brief The number of frames of precomputed optical flow of a frame
+///        directory, 0 if there is none.
+int CountFlowFrames(const string& path);
+
+/**
+ * @brief Reads the given frames of the precomputed optical flow of a frame
+ *        directory, as two-channel (x, y) images, from its flow_x_%04d.jpg
+ *        and flow_y_%04d.jpg files, resized like ReadVideoToCVMat.
+ */
+bool ReadFlowToCVMat(const string& path, const vector<int>& frames,
+    const int height, const int width, std::vector<cv::Mat>* cv_imgs);
+
+/// @brief Reads the roi of the given frames of flow, like ReadFlowToCVMat
+///        and ReadVideoCropToCVMat.
+bool ReadFlowCropToCVMat(const string& path, const vector<int>& frames,
+    const cv::Rect& roi, std::vector<cv::Mat>* cv_imgs);
 #endif  // USE_OPENCV
 
 }  // namespace caffe
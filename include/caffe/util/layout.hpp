@@ -0,0 +1,31 @@
+#ifndef CAFFE_UTIL_LAYOUT_HPP_
+#define CAFFE_UTIL_LAYOUT_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// @brief The lower case name of a BlobLayout, e.g. "channels_last".
+string BlobLayoutName(const BlobLayout layout);
+
+/**
+ * @brief Converts num items from (channels, spatial) to (spatial, channels)
+ *        order, i.e. from PLANAR to CHANNELS_LAST.
+ */
+template <typename Dtype>
+void planar_to_channels_last_cpu(const int num, const int channels,
+    const int spatial, const Dtype* planar, Dtype* channels_last);
+
+/**
+ * @brief Converts num items from (spatial, channels) to (channels, spatial)
+ *        order, i.e. from CHANNELS_LAST to PLANAR.
+ */
+template <typename Dtype>
+void channels_last_to_planar_cpu(const int num, const int channels,
+    const int spatial, const Dtype* channels_last, Dtype* planar);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LAYOUT_HPP_
@@ -12,6 +12,13 @@
 
 namespace caffe {
 
+// Sets how many threads BLAS calls use: those of the calling thread only if
+// calling_thread_only and the library can (MKL, OpenBLAS 0.3.27 and later),
+// else those of the whole process. Where it cannot, a calling thread limit
+// below the budget makes all BLAS calls of the process single-threaded.
+void caffe_set_blas_threads(const int num_threads,
+    const bool calling_thread_only);
+
 // Caffe gemm provides a simpler interface to the gemm functions, with the
 // limitation that the data has to be contiguous in memory.
 template <typename Dtype>
@@ -94,6 +101,60 @@ void caffe_log(const int n, const Dtype* a, Dtype* y);
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
+// y = max(x, 0) + negative_slope * min(x, 0)
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype* x, const Dtype negative_slope,
+    Dtype* y);
+
+// bottom_diff = top_diff * ((x > 0) + negative_slope * (x <= 0)) for the
+// bottom_data x
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype negative_slope, Dtype* bottom_diff);
+
+// Where x > y: y = x and mask = index. A max pooling step.
+template <typename Dtype>
+void caffe_cpu_max_update(const int n, const Dtype* x, const int index,
+    Dtype* y, int* mask);
+
+// y += |x|. An absolute sum reduction step.
+template <typename Dtype>
+void caffe_cpu_asum_update(const int n, const Dtype* x, Dtype* y);
+
+// y += x * x. A sum of squares reduction step.
+template <typename Dtype>
+void caffe_cpu_sumsq_update(const int n, const Dtype* x, Dtype* y);
+
+// y = (x - mean) * scale, with a mean value instead when mean is NULL
+template <typename Dtype>
+void caffe_cpu_transform_u8(const int n, const uint8_t* x, const Dtype* mean,
+    const Dtype mean_value, const Dtype scale, Dtype* y);
+
+// y = sum_j coeffs[j] * x[j] over num_inputs arrays, or their plain sum when
+// coeffs is NULL. Reads each input and writes y once, in parallel.
+template <typename Dtype>
+void caffe_cpu_sum_n(const int n, const int num_inputs, const Dtype* const* x,
+    const Dtype* coeffs, Dtype* y);
+
+// y = prod_j x[j], in one parallel pass
+template <typename Dtype>
+void caffe_cpu_prod_n(const int n, const int num_inputs,
+    const Dtype* const* x, Dtype* y);
+
+// y = max_j x[j] and mask = the winning j, in one parallel pass over 2 to 256
+// inputs. Ties go to the first maximal input, except that x[1] wins a tie
+// with x[0].
+template <typename Dtype>
+void caffe_cpu_max_n(const int n, const int num_inputs,
+    const Dtype* const* x, Dtype* y, uint8_t* mask);
+
+// y = scale[d] * x + bias[d] over an outer_dim x dim x inner_dim array, in
+// one parallel pass; scale or bias may be NULL
+template <typename Dtype>
+void caffe_cpu_channel_scale_bias(const int outer_dim, const int dim,
+    const int inner_dim, const Dtype* scale, const Dtype* bias,
+    const Dtype* x, Dtype* y);
+
 template <typename Dtype>
 Dtype caffe_cpu_dot(const int n, const Dtype* x, const Dtype* y);
 
@@ -0,0 +1,98 @@
+#ifndef CAFFE_UTIL_PARALLEL_FOR_HPP_
+#define CAFFE_UTIL_PARALLEL_FOR_HPP_
+
+#include <boost/function.hpp>
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Splits a range of n indices into chunks of at least grain indices.
+ *
+ * The split depends only on n and grain, never on the number of threads, so
+ * parallel_reduce results are the same however many threads run them.
+ */
+int ParallelNumChunks(const int n, const int grain);
+
+/// @brief The first index of a chunk; chunk num_chunks gives the end.
+inline int ParallelChunkBegin(const int begin, const int n,
+    const int num_chunks, const int chunk) {
+  return begin + static_cast<int64_t>(n) * chunk / num_chunks;
+}
+
+/**
+ * @brief Runs chunk_body(chunk) for every chunk in [0, num_chunks) on
+ *        Caffe::thread_pool(), with the calling thread taking part.
+ *
+ * Each participating thread owns a contiguous block of chunks and runs it
+ * front to back; once done it steals chunks from the back of the others'
+ * blocks. The chunks run with a Caffe::max_threads() of 1, which keeps
+ * their BLAS calls serial and makes nested calls run serially on the
+ * calling thread, so nested use is safe.
+ */
+void ParallelForChunks(const int num_chunks,
+    const boost::function<void(int)>& chunk_body);
+
+/**
+ * @brief Runs body(chunk_begin, chunk_end) over consecutive chunks of
+ *        [begin, end) in parallel. See ParallelForChunks.
+ *
+ * @param grain the smallest number of indices worth a chunk of its own.
+ */
+void parallel_for(const int begin, const int end,
+    const boost::function<void(int, int)>& body, const int grain = 1);
+
+template <typename T>
+class ParallelReduceChunk {
+ public:
+  ParallelReduceChunk(const int begin, const int n, const int num_chunks,
+      const boost::function<T(int, int)>& body, vector<T>* partial)
+      : begin_(begin), n_(n), num_chunks_(num_chunks), body_(body),
+        partial_(partial) {}
+  void operator()(const int chunk) const {
+    (*partial_)[chunk] = body_(
+        ParallelChunkBegin(begin_, n_, num_chunks_, chunk),
+        ParallelChunkBegin(begin_, n_, num_chunks_, chunk + 1));
+  }
+
+ private:
+  int begin_, n_, num_chunks_;
+  const boost::function<T(int, int)>& body_;
+  vector<T>* partial_;
+};
+
+/**
+ * @brief Reduces [begin, end) in parallel: body(chunk_begin, chunk_end)
+ *        gives the partial result of a chunk, and the partial results are
+ *        combined with join in chunk order, starting from identity.
+ *
+ * The chunks and the order of the joins are fixed by the range and the
+ * grain alone, so floating point results are reproducible across thread
+ * counts and runs.
+ */
+template <typename T>
+T parallel_reduce(const int begin, const int end, const T& identity,
+    const boost::function<T(int, int)>& body,
+    const boost::function<T(const T&, const T&)>& join, const int grain = 1) {
+  const int n = end - begin;
+  if (n <= 0) {
+    return identity;
+  }
+  const int num_chunks = ParallelNumChunks(n, grain);
+  vector<T> partial(num_chunks, identity);
+  ParallelForChunks(num_chunks,
+      ParallelReduceChunk<T>(begin, n, num_chunks, body, &partial));
+  T result = identity;
+  for (int i = 0; i < num_chunks; ++i) {
+    result = join(result, partial[i]);
+  }
+  return result;
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PARALLEL_FOR_HPP_
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads running tasks in FIFO order.
+ *
+ * Caffe::thread_pool() is the process-wide instance that parallel CPU work
+ * runs on, so that its threads are shared instead of created by every user.
+ * Tasks must not block waiting for other tasks of the pool.
+ */
+class ThreadPool {
+ public:
+  typedef boost::function<void()> Task;
+
+  /// @param cpus pins worker i to cpus[i % cpus.size()] when not empty.
+  explicit ThreadPool(int num_threads,
+      const vector<int>& cpus = vector<int>());
+  /// Runs the tasks already scheduled, then joins the workers.
+  ~ThreadPool();
+
+  void Schedule(const Task& task);
+  int num_threads() const { return threads_.size(); }
+  /// @brief Whether the calling thread is a worker of any pool.
+  static bool InWorker();
+
+ protected:
+  void Work(int cpu);
+
+  vector<shared_ptr<boost::thread> > threads_;
+  BlockingQueue<Task> tasks_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/// @brief Parses a CPU list such as "0-7,16,18" into CPU indices.
+vector<int> ParseCpuList(const string& list);
+
+/// @brief Pins the calling thread to the given CPUs (Linux only).
+void SetThreadAffinity(const vector<int>& cpus);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -23,6 +23,8 @@
 // You're strongly advised to upgrade to >= 1.7.
 #ifndef NPY_ARRAY_C_CONTIGUOUS
 #define NPY_ARRAY_C_CONTIGUOUS NPY_C_CONTIGUOUS
+#define NPY_ARRAY_ALIGNED NPY_ALIGNED
+#define NPY_ARRAY_WRITEABLE NPY_WRITEABLE
 #define PyArray_SetBaseObject(arr, x) (PyArray_BASE(arr) = (x))
 #endif
 
@@ -47,6 +49,18 @@ namespace caffe {
 typedef float Dtype;
 const int NPY_DTYPE = NPY_FLOAT32;
 
+// Releases the GIL for its lifetime, so that other Python threads can run
+// while Caffe computes. Python layers take the GIL back through
+// ScopedGILAcquire whenever the net calls into them.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) { }
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+};
+
 // Selecting mode.
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
@@ -107,10 +121,29 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
 
   shared_ptr<Net<Dtype> > net(new Net<Dtype>(param_file,
       static_cast<Phase>(phase)));
-  net->CopyTrainedLayersFrom(pretrained_param_file);
+  {
+    ScopedGILRelease gil;
+    net->CopyTrainedLayersFrom(pretrained_param_file);
+  }
   return net;
 }
 
+// The compute-bound Net and Solver entry points release the GIL.
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease gil;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease gil;
+  net->BackwardFromTo(start, end);
+}
+
+void Net_CopyFrom(Net<Dtype>* net, const string filename) {
+  ScopedGILRelease gil;
+  net->CopyTrainedLayersFrom(filename);
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
   NetParameter net_param;
   net.ToProto(&net_param, false);
@@ -122,6 +155,7 @@ void Net_SaveHDF5(const Net<Dtype>& net, string filename) {
 }
 
 void Net_LoadHDF5(Net<Dtype>* net, string filename) {
+  ScopedGILRelease gil;
   net->CopyTrainedLayersFromHDF5(filename.c_str());
 }
 
@@ -163,6 +197,16 @@ Solver<Dtype>* GetSolverFromFile(const string& filename) {
   return SolverRegistry<Dtype>::CreateSolver(param);
 }
 
+void Solver_Solve(Solver<Dtype>* solver, const char* resume_file = NULL) {
+  ScopedGILRelease gil;
+  solver->Solve(resume_file);
+}
+
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  ScopedGILRelease gil;
+  solver->Step(iters);
+}
+
 struct NdarrayConverterGenerator {
   template <typename T> struct apply;
 };
@@ -216,6 +260,126 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// Points the blob at the memory of a writeable, aligned, C-contiguous
+// float32 array, reshaping the blob to the array's shape, so that the array
+// is used without a copy. The blob aliases the array from then on: the
+// caller must keep the array alive (Net.set_input does).
+void Blob_Borrow(Blob<Dtype>* self, bp::object arr_obj) {
+  if (!PyArray_Check(arr_obj.ptr())) {
+    throw std::runtime_error("Blob can only borrow numpy arrays");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj.ptr());
+  const int required = NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED |
+      NPY_ARRAY_WRITEABLE;
+  if ((PyArray_FLAGS(arr) & required) != required) {
+    throw std::runtime_error("borrowed array must be aligned, writeable"
+        " and C contiguous");
+  }
+  if (PyArray_TYPE(arr) != NPY_DTYPE) {
+    throw std::runtime_error("borrowed array must be float32");
+  }
+  if (PyArray_SIZE(arr) == 0) {
+    throw std::runtime_error("borrowed array must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  self->Reshape(shape);
+  // Alias the array through memory of exactly its size: the blob's own may be
+  // larger from an earlier shape, and syncs would then overrun the array.
+  Blob<Dtype> exact(shape);
+  self->ShareData(exact);
+  self->set_cpu_data(static_cast<Dtype*>(PyArray_DATA(arr)));
+}
+
+// Gives a blob that borrowed an array memory of its own again.
+void Blob_Unborrow(Blob<Dtype>* self) {
+  Blob<Dtype> owned(self->shape());
+  self->ShareData(owned);
+}
+
+template <typename T>
+void NormalizeInto(const T* src, const int num, const int channels,
+    const int spatial, const Dtype* mean, const int mean_count,
+    const Dtype scale, Dtype* dst) {
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      Dtype channel_mean = 0;
+      const Dtype* image_mean = NULL;
+      if (mean_count == 1) {
+        channel_mean = mean[0];
+      } else if (mean_count == channels) {
+        channel_mean = mean[c];
+      } else if (mean_count > 0) {
+        image_mean = mean + c * spatial;
+      }
+      if (image_mean) {
+        for (int i = 0; i < spatial; ++i) {
+          dst[i] = (static_cast<Dtype>(src[i]) - image_mean[i]) * scale;
+        }
+      } else {
+        for (int i = 0; i < spatial; ++i) {
+          dst[i] = (static_cast<Dtype>(src[i]) - channel_mean) * scale;
+        }
+      }
+      src += spatial;
+      dst += spatial;
+    }
+  }
+}
+
+// Reshapes the blob to a C-contiguous uint8 or float32 array and fills it
+// with (array - mean) * scale in a single pass, without the GIL. mean may be
+// None, a scalar, one value per channel (axis 1) or one value per element of
+// an item (a mean image).
+void Blob_SetNormalized(Blob<Dtype>* self, bp::object arr_obj,
+    bp::object mean_obj, Dtype scale) {
+  if (!PyArray_Check(arr_obj.ptr())) {
+    throw std::runtime_error("input must be a numpy array");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj.ptr());
+  if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+    throw std::runtime_error("input array must be C contiguous");
+  }
+  const int type = PyArray_TYPE(arr);
+  if (type != NPY_UINT8 && type != NPY_DTYPE) {
+    throw std::runtime_error("input array must be uint8 or float32");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  if (shape.size() < 2) {
+    throw std::runtime_error("input array needs num and channel axes");
+  }
+  const int num = shape[0];
+  const int channels = shape[1];
+  const int spatial = num * channels == 0 ? 0 :
+      PyArray_SIZE(arr) / (num * channels);
+  const Dtype* mean = NULL;
+  int mean_count = 0;
+  if (!mean_obj.is_none()) {
+    PyArrayObject* mean_arr = reinterpret_cast<PyArrayObject*>(
+        mean_obj.ptr());
+    if (!PyArray_Check(mean_obj.ptr()) || PyArray_TYPE(mean_arr) != NPY_DTYPE
+        || !(PyArray_FLAGS(mean_arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+      throw std::runtime_error("mean must be a C contiguous float32 array");
+    }
+    mean = static_cast<const Dtype*>(PyArray_DATA(mean_arr));
+    mean_count = PyArray_SIZE(mean_arr);
+    if (mean_count != 1 && mean_count != channels &&
+        mean_count != channels * spatial) {
+      throw std::runtime_error("mean must have 1, channels or"
+          " channels * spatial elements");
+    }
+  }
+  self->Reshape(shape);
+  Dtype* dst = self->mutable_cpu_data();
+  ScopedGILRelease gil;
+  if (type == NPY_UINT8) {
+    NormalizeInto(static_cast<const uint8_t*>(PyArray_DATA(arr)), num,
+        channels, spatial, mean, mean_count, scale, dst);
+  } else {
+    NormalizeInto(static_cast<const Dtype*>(PyArray_DATA(arr)), num,
+        channels, spatial, mean, mean_count, scale, dst);
+  }
+}
+
 bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("BlobVec.add_blob takes no kwargs");
@@ -231,7 +395,7 @@ bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
+BOOST_PYTHON_FUNCTION_OVERLOADS(SolveOverloads, Solver_Solve, 1, 2);
 
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
@@ -250,12 +414,10 @@ BOOST_PYTHON_MODULE(_caffe) {
     bp::no_init)
     .def("__init__", bp::make_constructor(&Net_Init))
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
     .def("reshape", &Net<Dtype>::Reshape)
-    // The cast is to select a particular overload.
-    .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
-        &Net<Dtype>::CopyTrainedLayersFrom))
+    .def("copy_from", &Net_CopyFrom)
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
     .add_property("_blob_loss_weights", bp::make_function(
         &Net<Dtype>::blob_loss_weights, bp::return_internal_reference<>()))
@@ -298,6 +460,9 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("count",    static_cast<int (Blob<Dtype>::*)() const>(
         &Blob<Dtype>::count))
     .def("reshape",           bp::raw_function(&Blob_Reshape))
+    .def("_borrow",           &Blob_Borrow)
+    .def("_unborrow",         &Blob_Unborrow)
+    .def("_set_normalized",   &Blob_SetNormalized)
     .add_property("data",     bp::make_function(&Blob<Dtype>::mutable_cpu_data,
           NdarrayCallPolicies()))
     .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
@@ -321,9 +486,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("test_nets", bp::make_function(&Solver<Dtype>::test_nets,
           bp::return_internal_reference<>()))
     .add_property("iter", &Solver<Dtype>::iter)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
+    .def("solve", &Solver_Solve, SolveOverloads())
+    .def("step", &Solver_Step)
     .def("restore", &Solver<Dtype>::Restore)
     .def("snapshot", &Solver<Dtype>::Snapshot);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Solver<Dtype>);
@@ -369,6 +533,12 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::class_<vector<bool> >("BoolVec")
     .def(bp::vector_indexing_suite<vector<bool> >());
 
+  // Make sure the GIL exists before any binding releases it (Python >= 3.7
+  // always creates it).
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
@@ -0,0 +1,147 @@
+"""
+Multi-process batch prefetching for the PythonData layer.
+
+The layer's python_param names a module and a class. The class is built in
+the training process as `cls(param_str)` and must provide
+
+- `top_shapes()`: the shape of every top blob of the layer, and
+- `batches(worker_id, num_workers)`: a generator of batches, each a sequence
+  of arrays with those shapes, one per top.
+
+`batches` runs in `num_workers` worker processes and is started again
+whenever it is exhausted, so it only needs to cover one epoch of its share of
+the data. The workers write batches straight into the slots of a shared
+memory ring that the layer reads in place. Batches of different workers
+arrive in no particular order.
+"""
+import ctypes
+import importlib
+import multiprocessing
+import traceback
+
+import numpy as np
+from six.moves import queue
+
+
+def _get_slot(free_slots, stop):
+    """Take a free ring slot, or return None once the prefetcher stops."""
+    while not stop.is_set():
+        try:
+            return free_slots.get(timeout=0.1)
+        except queue.Empty:
+            pass
+    return None
+
+
+def _run_worker(source, worker_id, num_workers, ring, dtype, shapes,
+                free_slots, full_slots, stop):
+    try:
+        slots = np.frombuffer(ring, dtype=dtype).reshape(-1, sum(
+            int(np.prod(shape)) for shape in shapes))
+        while not stop.is_set():
+            num_batches = 0
+            for batch in source.batches(worker_id, num_workers):
+                if len(batch) != len(shapes):
+                    raise ValueError('batch has {} arrays for {} tops'.format(
+                        len(batch), len(shapes)))
+                slot = _get_slot(free_slots, stop)
+                if slot is None:
+                    return
+                offset = 0
+                for array, shape in zip(batch, shapes):
+                    count = int(np.prod(shape))
+                    array = np.asarray(array)
+                    if array.shape != shape:
+                        raise ValueError('batch array of shape {} for a top '
+                                         'of shape {}'.format(array.shape,
+                                                              shape))
+                    slots[slot, offset:offset + count].reshape(shape)[...] = \
+                        array
+                    offset += count
+                full_slots.put(slot)
+                num_batches += 1
+            if num_batches == 0:
+                raise ValueError('batches() produced no batch')
+    except Exception:
+        full_slots.put((worker_id, traceback.format_exc()))
+
+
+class BatchPrefetcher(object):
+    """
+    Runs a batch source in worker processes and hands out its batches as
+    addresses of shared memory slots. Used by the PythonData layer.
+
+    Parameters
+    ----------
+    module, layer : module and class name of the batch source.
+    param_str : passed to the batch source constructor.
+    num_workers : number of worker processes.
+    num_slots : number of batches the shared memory ring holds.
+    dtype : 'float32' or 'float64', the blob data type.
+    """
+
+    def __init__(self, module, layer, param_str, num_workers, num_slots,
+                 dtype):
+        source = getattr(importlib.import_module(module), layer)(param_str)
+        self.shapes = [tuple(int(d) for d in shape)
+                       for shape in source.top_shapes()]
+        self.dtype = np.dtype(dtype)
+        counts = [int(np.prod(shape)) for shape in self.shapes]
+        self.offsets = np.cumsum([0] + counts[:-1]) * self.dtype.itemsize
+        self.slot_bytes = sum(counts) * self.dtype.itemsize
+        ctype = ctypes.c_float if self.dtype == np.float32 else ctypes.c_double
+        self.ring = multiprocessing.RawArray(ctype, num_slots * sum(counts))
+        self.address = ctypes.addressof(self.ring)
+        self.free_slots = multiprocessing.Queue()
+        self.full_slots = multiprocessing.Queue()
+        self.stop = multiprocessing.Event()
+        for slot in range(num_slots):
+            self.free_slots.put(slot)
+        self.workers = []
+        for worker_id in range(num_workers):
+            worker = multiprocessing.Process(
+                target=_run_worker,
+                args=(source, worker_id, num_workers, self.ring, self.dtype,
+                      self.shapes, self.free_slots, self.full_slots,
+                      self.stop))
+            worker.daemon = True
+            worker.start()
+            self.workers.append(worker)
+
+    def next(self, timeout):
+        """
+        Wait up to `timeout` seconds for a batch. Returns None on timeout,
+        or the ring slot of the batch and the address of each of its arrays.
+        The slot stays in use until it is released.
+        """
+        try:
+            item = self.full_slots.get(timeout=timeout)
+        except queue.Empty:
+            for worker in self.workers:
+                if not worker.is_alive() and worker.exitcode != 0:
+                    self.close()
+                    raise RuntimeError('PythonData worker exited with code '
+                                       '{}'.format(worker.exitcode))
+            return None
+        if isinstance(item, tuple):
+            self.close()
+            raise RuntimeError('PythonData worker {} failed:\n{}'.format(
+                *item))
+        base = self.address + item * self.slot_bytes
+        return item, [int(base + offset) for offset in self.offsets]
+
+    def release(self, slot):
+        """Hand a slot back to the workers once its batch has been used."""
+        self.free_slots.put(slot)
+
+    def close(self):
+        """Stop and join the workers."""
+        self.stop.set()
+        # do not block interpreter exit on slots the workers never took
+        self.free_slots.cancel_join_thread()
+        for worker in self.workers:
+            worker.join(timeout=1)
+            if worker.is_alive():
+                worker.terminate()
+                worker.join()
+        self.workers = []
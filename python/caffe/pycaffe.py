@@ -254,11 +254,55 @@ def _Net_set_input_arrays(self, data, labels):
     (Note: this is only for networks declared with the memory data layer.)
     """
     if labels.ndim == 1:
-        labels = np.ascontiguousarray(labels[:, np.newaxis, np.newaxis,
-                                             np.newaxis, np.newaxis])
+        labels = labels[:, np.newaxis, np.newaxis, np.newaxis, np.newaxis]
+    # The layer keeps pointers into the arrays, so only copy when the layout
+    # or dtype does not already match.
+    data = np.ascontiguousarray(data, dtype=np.float32)
+    labels = np.ascontiguousarray(labels, dtype=np.float32)
     return self._set_input_arrays(data, labels)
 
 
+def _Net_set_input(self, name, arr, mean=None, scale=None):
+    """
+    Feed an array to a blob, usually a net input, avoiding copies.
+
+    Parameters
+    ----------
+    name : blob name.
+    arr : ndarray of shape (N, C, ...). The blob is reshaped to match.
+    mean : optional scalar, per-channel (C,) or per-item (C, ...) mean to
+           subtract.
+    scale : optional factor applied after subtracting the mean.
+
+    Without mean and scale, an aligned, writeable, C-contiguous float32 array
+    is borrowed rather than copied: the blob aliases `arr`, which the net
+    keeps alive until the next set_input for the same blob. Writing to the
+    blob (e.g. by an in-place layer on it) writes to `arr`. Any other array
+    (such as uint8 frames) is converted and normalized in a single pass.
+    """
+    blob = self.blobs[name]
+    if not hasattr(self, '_borrowed_inputs'):
+        self._borrowed_inputs = {}
+    if (mean is None and scale is None and isinstance(arr, np.ndarray)
+            and arr.dtype == np.float32 and arr.size > 0
+            and arr.flags.c_contiguous and arr.flags.aligned
+            and arr.flags.writeable):
+        blob._borrow(arr)
+        self._borrowed_inputs[name] = arr
+        return
+    if name in self._borrowed_inputs:
+        # stop aliasing the previous array before writing the new data
+        blob._unborrow()
+        del self._borrowed_inputs[name]
+    arr = np.asarray(arr)
+    if arr.dtype not in (np.uint8, np.float32):
+        arr = arr.astype(np.float32)
+    arr = np.ascontiguousarray(arr)
+    if mean is not None:
+        mean = np.ascontiguousarray(mean, dtype=np.float32)
+    blob._set_normalized(arr, mean, 1.0 if scale is None else scale)
+
+
 def _Net_batch(self, blobs):
     """
     Batch blob lists according to net's batch size.
@@ -317,6 +361,7 @@ Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
 Net.set_input_arrays = _Net_set_input_arrays
+Net.set_input = _Net_set_input
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
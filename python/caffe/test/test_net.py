@@ -93,3 +93,85 @@ class TestNet(unittest.TestCase):
             for i in range(len(self.net.params[name])):
                 self.assertEqual(abs(self.net.params[name][i].data
                     - net2.params[name][i].data).sum(), 0)
+
+
+def input_net_file():
+    """Make a net with an Input layer feeding a Power layer that doubles its
+    input, returning the name of the (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+    f.write("""name: 'inputnet'
+    layer { type: 'Input' name: 'data' top: 'data'
+      input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 dim: 6 } } }
+    layer { type: 'Power' name: 'double' bottom: 'data' top: 'double'
+      power_param { scale: 2 } }""")
+    f.close()
+    return f.name
+
+
+class TestNetSetInput(unittest.TestCase):
+    def setUp(self):
+        net_file = input_net_file()
+        self.net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        self.shape = tuple(self.net.blobs['data'].data.shape)
+
+    def test_borrow(self):
+        x = np.random.randn(*self.shape).astype(np.float32)
+        self.net.set_input('data', x)
+        self.net.forward()
+        self.assertTrue(np.allclose(self.net.blobs['double'].data, 2 * x))
+        # the blob aliases the array, so later writes show up without a copy
+        x[...] = 1
+        self.assertTrue(np.all(self.net.blobs['data'].data == 1))
+        self.net.forward()
+        self.assertTrue(np.all(self.net.blobs['double'].data == 2))
+
+    def test_borrow_reshapes(self):
+        x = np.random.randn(3, 3, 2, 4, 5).astype(np.float32)
+        self.net.set_input('data', x)
+        self.net.reshape()
+        self.net.forward()
+        self.assertEqual(self.net.blobs['double'].data.shape, x.shape)
+        self.assertTrue(np.allclose(self.net.blobs['double'].data, 2 * x))
+
+    def test_borrow_after_larger_shape(self):
+        # the blob's own memory is sized for self.shape; borrow a smaller
+        # array, then grow again without writing into the borrowed one
+        small = np.random.randn(1, 3, 4, 5, 6).astype(np.float32)
+        kept = small.copy()
+        self.net.set_input('data', small)
+        self.net.reshape()
+        self.net.forward()
+        self.assertTrue(np.allclose(self.net.blobs['double'].data, 2 * small))
+        self.net.blobs['data'].reshape(*self.shape)
+        self.net.blobs['data'].data[...] = 1
+        self.assertTrue(np.array_equal(small, kept))
+
+    def test_uint8_normalize(self):
+        x = np.random.randint(256, size=self.shape).astype(np.uint8)
+        mean = np.array([100, 110, 120], dtype=np.float32)
+        self.net.set_input('data', x, mean=mean, scale=0.5)
+        self.net.forward()
+        expected = (x.astype(np.float32) -
+                    mean[np.newaxis, :, np.newaxis, np.newaxis, np.newaxis])
+        expected *= 0.5
+        self.assertTrue(np.allclose(self.net.blobs['data'].data, expected))
+        self.assertTrue(np.allclose(self.net.blobs['double'].data,
+                                    2 * expected))
+
+    def test_mean_image(self):
+        x = np.random.randn(*self.shape).astype(np.float32)
+        mean = np.random.randn(*self.shape[1:]).astype(np.float32)
+        self.net.set_input('data', x, mean=mean)
+        self.assertTrue(np.allclose(self.net.blobs['data'].data, x - mean))
+
+    def test_copy_after_borrow(self):
+        x = np.random.randn(*self.shape).astype(np.float32)
+        self.net.set_input('data', x)
+        # a non-contiguous float64 array is converted, and must not be
+        # written into the previously borrowed array
+        y = np.random.randn(*(self.shape + (2,)))[..., 0]
+        self.net.set_input('data', y)
+        self.assertTrue(np.allclose(self.net.blobs['data'].data, y))
+        self.assertFalse(np.allclose(x, y))
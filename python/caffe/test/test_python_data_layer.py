@@ -0,0 +1,98 @@
+import unittest
+import tempfile
+import os
+import numpy as np
+
+import caffe
+from caffe.prefetch import BatchPrefetcher
+
+
+class CountingSource(object):
+    """A batch source whose data encode the worker and the batch number"""
+
+    def __init__(self, param_str):
+        self.batch_size = int(param_str)
+
+    def top_shapes(self):
+        return [(self.batch_size, 3, 2, 4, 5), (self.batch_size,)]
+
+    def batches(self, worker_id, num_workers):
+        for i in range(4):
+            data = np.empty(self.top_shapes()[0], dtype=np.float32)
+            data[...] = 100 * worker_id + i
+            label = np.empty(self.batch_size, dtype=np.float32)
+            label[...] = worker_id
+            yield data, label
+
+
+class FailingSource(CountingSource):
+    """A batch source for checking that worker errors are reported"""
+
+    def batches(self, worker_id, num_workers):
+        raise ValueError('broken source')
+
+
+def python_data_net_file(num_workers):
+    with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
+        f.write("""name: 'pythondatanet'
+        layer { type: 'PythonData' name: 'data' top: 'data' top: 'label'
+          python_param { module: 'test_python_data_layer'
+            layer: 'CountingSource' param_str: '2'
+            num_workers: """ + str(num_workers) + """ } }""")
+        return f.name
+
+
+class TestPythonDataLayer(unittest.TestCase):
+    def setUp(self):
+        caffe.set_mode_cpu()
+        net_file = python_data_net_file(2)
+        self.net = caffe.Net(net_file, caffe.TRAIN)
+        os.remove(net_file)
+
+    def test_shapes(self):
+        self.assertEqual(self.net.blobs['data'].data.shape, (2, 3, 2, 4, 5))
+        self.assertEqual(self.net.blobs['label'].data.shape, (2,))
+
+    def test_forward(self):
+        for i in range(20):
+            self.net.forward()
+            data = self.net.blobs['data'].data
+            label = self.net.blobs['label'].data
+            value = data.flat[0]
+            self.assertTrue(np.all(data == value))
+            self.assertTrue(np.all(label == value // 100))
+            self.assertIn(value // 100, (0, 1))
+            self.assertIn(value % 100, range(4))
+
+
+class TestBatchPrefetcher(unittest.TestCase):
+    def test_slots(self):
+        prefetcher = BatchPrefetcher('test_python_data_layer',
+                                     'CountingSource', '3', 1, 4, 'float32')
+        self.assertEqual(prefetcher.shapes, [(3, 3, 2, 4, 5), (3,)])
+        seen = []
+        while len(seen) < 8:
+            item = prefetcher.next(1.0)
+            if item is None:
+                continue
+            slot, addresses = item
+            self.assertEqual(len(addresses), 2)
+            data = np.frombuffer(prefetcher.ring, dtype=np.float32)
+            start = slot * prefetcher.slot_bytes // 4
+            seen.append(data[start])
+            prefetcher.release(slot)
+        # one worker repeats its epoch in order
+        self.assertEqual(seen, [0, 1, 2, 3, 0, 1, 2, 3])
+        workers = list(prefetcher.workers)
+        prefetcher.close()
+        for worker in workers:
+            self.assertFalse(worker.is_alive())
+
+    def test_error(self):
+        prefetcher = BatchPrefetcher('test_python_data_layer',
+                                     'FailingSource', '2', 1, 4, 'float32')
+        with self.assertRaises(RuntimeError) as context:
+            while prefetcher.next(1.0) is None:
+                pass
+        self.assertIn('broken source', str(context.exception))
+        self.assertEqual(prefetcher.workers, [])
@@ -0,0 +1,113 @@
+import unittest
+import tempfile
+import os
+import threading
+import numpy as np
+
+import caffe
+from test_net import simple_net_file
+from test_python_layer import python_net_file
+
+
+class TestThreading(unittest.TestCase):
+    """Run nets from several Python threads at once. pycaffe releases the GIL
+    while nets compute, so this checks that compute and Python layer callbacks
+    interleave safely and give the same results as a single thread."""
+
+    num_threads = 4
+    num_iters = 20
+
+    def run_threads(self, target):
+        errors = []
+
+        def wrapper(i):
+            try:
+                caffe.set_mode_cpu()
+                target(i)
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=wrapper, args=(i,))
+                   for i in range(self.num_threads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if errors:
+            raise errors[0]
+
+    def test_python_layer_threads(self):
+        net_file = python_net_file()
+        nets = [caffe.Net(net_file, caffe.TRAIN)
+                for _ in range(self.num_threads)]
+        os.remove(net_file)
+
+        def work(i):
+            net = nets[i]
+            for it in range(self.num_iters):
+                x = np.random.randn(*net.blobs['data'].data.shape)
+                net.blobs['data'].data[...] = x
+                net.forward()
+                self.assertTrue(np.allclose(net.blobs['three'].data,
+                                            1e3 * x, rtol=1e-5, atol=1e-3))
+                net.blobs['three'].diff[...] = x
+                net.backward()
+                self.assertTrue(np.allclose(net.blobs['data'].diff,
+                                            1e3 * x, rtol=1e-5, atol=1e-3))
+
+        self.run_threads(work)
+
+    def test_net_threads(self):
+        num_output = 13
+        net_file = simple_net_file(num_output)
+        nets = [caffe.Net(net_file, caffe.TRAIN)
+                for _ in range(self.num_threads + 1)]
+        os.remove(net_file)
+        # every net computes the same inputs with the same weights
+        reference = nets.pop()
+        label = np.random.randint(num_output,
+                                  size=reference.blobs['label'].data.shape)
+        data = np.random.randn(*reference.blobs['data'].data.shape)
+        for net in nets[1:] + [reference]:
+            net.share_with(nets[0])
+        reference.blobs['data'].data[...] = data
+        reference.blobs['label'].data[...] = label
+        reference.forward(start='conv')
+        reference.backward()
+        loss = reference.blobs['loss'].data.copy()
+        grad = reference.blobs['conv'].diff.copy()
+
+        def work(i):
+            net = nets[i]
+            for it in range(self.num_iters):
+                net.blobs['data'].data[...] = data
+                net.blobs['label'].data[...] = label
+                net.forward(start='conv')
+                net.backward()
+                self.assertTrue(np.allclose(net.blobs['loss'].data, loss))
+                self.assertTrue(np.allclose(net.blobs['conv'].diff, grad))
+
+        self.run_threads(work)
+
+    def test_python_thread_runs_during_forward(self):
+        net_file = python_net_file()
+        net = caffe.Net(net_file, caffe.TRAIN)
+        os.remove(net_file)
+        ticks = []
+        done = threading.Event()
+
+        def ticker():
+            while not done.is_set():
+                ticks.append(1)
+                done.wait(0.0001)
+
+        t = threading.Thread(target=ticker)
+        t.start()
+        try:
+            for it in range(self.num_iters):
+                net.forward()
+                net.backward()
+        finally:
+            done.set()
+            t.join()
+        self.assertTrue(len(ticks) > 0)
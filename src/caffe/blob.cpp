@@ -4,6 +4,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/codebook.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -76,7 +77,7 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int length,
     const int height, const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), layout_(PLANAR) {
   Reshape(num, channels, length, height, width);
 }
 
@@ -84,7 +85,7 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), layout_(PLANAR) {
   if (num == 0 && channels == 0 && height == 0 && width == 0)
     Reshape(num, channels, 0, height, width);
   else
@@ -94,7 +95,7 @@ Blob<Dtype>::Blob(const int num, const int channels, const int height,
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), layout_(PLANAR) {
   Reshape(shape);
 }
 
@@ -122,6 +123,12 @@ const Dtype* Blob<Dtype>::gpu_data() const {
   return (const Dtype*)data_->gpu_data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_gpu_data(Dtype* data) {
+  CHECK(data);
+  data_->set_gpu_data(data);
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
@@ -162,12 +169,15 @@ template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
   data_ = other.data();
+  // The shared memory may hold no more than count_, so reallocate on growth.
+  capacity_ = count_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
   diff_ = other.diff();
+  capacity_ = count_;
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -530,7 +540,9 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (IsCodebookCompressed(proto)) {
+    CodebookDecompress(proto, count_, data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
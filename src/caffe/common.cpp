@@ -1,11 +1,28 @@
+#include <boost/atomic.hpp>
 #include <boost/thread.hpp>
 #include <glog/logging.h>
 #include <cmath>
 #include <cstdio>
 #include <ctime>
 
+#include <algorithm>
+
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_isa.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+DEFINE_int32(threads, 0,
+    "Optional; the number of CPU threads Caffe computes with, including the "
+    "calling thread. Defaults to one per core.");
+DEFINE_int32(data_threads, 0,
+    "Optional; the CPU threads each data prefetch thread may use for BLAS and "
+    "parallel work. Defaults to a quarter of --threads.");
+DEFINE_string(cpu_affinity, "",
+    "Optional; the CPUs to pin the thread pool workers to, e.g. 0-15.");
+DEFINE_string(data_cpu_affinity, "",
+    "Optional; the CPUs to pin the data prefetch threads to, e.g. 16-19.");
 
 namespace caffe {
 
@@ -40,6 +57,78 @@ int64_t cluster_seedgen(void) {
 }
 
 
+// The CPU thread budget and pool are shared by all threads. The budget is
+// only written under the mutex, but read without it once sized, since every
+// BLAS call asks for it.
+static boost::mutex thread_pool_mutex_;
+static boost::atomic<int> num_threads_(0);
+static shared_ptr<ThreadPool> thread_pool_;
+static boost::thread_specific_ptr<int> max_threads_;
+
+int Caffe::num_threads() {
+  const int num_threads = num_threads_.load(boost::memory_order_acquire);
+  if (num_threads > 0) {
+    return num_threads;
+  }
+  boost::mutex::scoped_lock lock(thread_pool_mutex_);
+  if (num_threads_ == 0) {
+    const int sized = FLAGS_threads > 0 ? FLAGS_threads :
+        std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+    caffe_set_blas_threads(sized, false);
+    num_threads_.store(sized, boost::memory_order_release);
+  }
+  return num_threads_;
+}
+
+void Caffe::set_num_threads(const int num_threads) {
+  CHECK_GE(num_threads, 1);
+  shared_ptr<ThreadPool> old_pool;
+  {
+    boost::mutex::scoped_lock lock(thread_pool_mutex_);
+    caffe_set_blas_threads(num_threads, false);
+    num_threads_.store(num_threads, boost::memory_order_release);
+    old_pool.swap(thread_pool_);
+  }
+  // Joins the old workers outside of the lock.
+  old_pool.reset();
+}
+
+ThreadPool& Caffe::thread_pool() {
+  const int num_threads = Caffe::num_threads();
+  boost::mutex::scoped_lock lock(thread_pool_mutex_);
+  if (!thread_pool_) {
+    LOG(INFO) << "Using " << num_threads << " CPU threads";
+    thread_pool_.reset(new ThreadPool(num_threads - 1,
+        ParseCpuList(FLAGS_cpu_affinity)));
+  }
+  return *thread_pool_;
+}
+
+int Caffe::max_threads() {
+  const int num_threads = Caffe::num_threads();
+  return max_threads_.get() && *max_threads_ > 0 ?
+      std::min(*max_threads_, num_threads) : num_threads;
+}
+
+int Caffe::set_max_threads(const int max_threads) {
+  CHECK_GE(max_threads, 0);
+  const int previous = max_threads_.get() ? *max_threads_ : 0;
+  max_threads_.reset(new int(max_threads));
+  caffe_set_blas_threads(Caffe::max_threads(), true);
+  return previous;
+}
+
+int Caffe::data_threads() {
+  const int num_threads = Caffe::num_threads();
+  return FLAGS_data_threads > 0 ? std::min(FLAGS_data_threads, num_threads) :
+      std::max(1, num_threads / 4);
+}
+
+void Caffe::EnterDataThread() {
+  set_max_threads(data_threads());
+  SetThreadAffinity(ParseCpuList(FLAGS_data_cpu_affinity));
+}
+
 void GlobalInit(int* pargc, char*** pargv) {
   // Google flags.
   ::gflags::ParseCommandLineFlags(pargc, pargv, true);
@@ -47,6 +136,10 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InitGoogleLogging(*(pargv)[0]);
   // Provide a backtrace on segfault.
   ::google::InstallFailureSignalHandler();
+  // Choose the CPU kernels now, so the choice is logged at startup.
+  cpu_isa();
+  // Hand the thread budget to BLAS before its first call.
+  Caffe::num_threads();
 }
 
 #ifdef CPU_ONLY  // CPU-only Caffe.
@@ -93,6 +93,23 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  if (has_uint8 && !do_mirror) {
+    // Rows are contiguous in both the datum and the output, so convert a
+    // row at a time with the vectorized kernel.
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        caffe_cpu_transform_u8(width, bytes + data_index,
+            has_mean_file ? mean + data_index : NULL, mean_value, scale,
+            transformed_data + (c * height + h) * width);
+      }
+    }
+    return;
+  }
+
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -207,12 +224,6 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
                                        Blob<Dtype>* transformed_blob,
                                        const bool is_video) {
   if (is_video) {
-    const int mat_num = mat_vector.size();
-    const int num = transformed_blob->shape(0);
-    const int channels = transformed_blob->shape(1);
-    const int length = transformed_blob->shape(2);
-    const int height = transformed_blob->shape(3);
-    const int width = transformed_blob->shape(4);
     const int img_height = mat_vector[0].rows;
     const int img_width = mat_vector[0].cols;
 
@@ -220,39 +231,14 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
     // individually as images come from a same video clip
     // mirror / cropping is picked once here, and will be reused for all frames
     // within a video clip
-    const bool rand_mirror = param_.mirror()
-                             ? static_cast<bool>(Rand(2)) : false;
+    const bool rand_mirror = ChooseVideoMirror();
     const int crop_size = param_.crop_size();
     const int rand_h_off = (phase_ == TRAIN && param_.crop_size())
                            ? Rand(img_height - crop_size + 1) : 0;
     const int rand_w_off = (phase_ == TRAIN && param_.crop_size())
                            ? Rand(img_width - crop_size + 1) : 0;
-
-    CHECK_GT(mat_num, 0) << "There is no MAT to add";
-    CHECK_EQ(num, 1) << "First dimension (batch number) must be 1";
-    CHECK_EQ(mat_num, length) <<
-      "The size of mat_vector must be equals to transformed_blob->shape(2)";
-    vector<int> uni_blob_shape(5);
-    uni_blob_shape[0] = 1;
-    uni_blob_shape[1] = channels;
-    uni_blob_shape[2] = 1;
-    uni_blob_shape[3] = height;
-    uni_blob_shape[4] = width;
-    Blob<Dtype> uni_blob(uni_blob_shape);
-    vector<int> indices(5);
-    indices[0] = 0; indices[1] = 0; indices[3] = 0; indices[4] = 0;
-    for (int item_id = 0; item_id < mat_num; ++item_id) {
-      indices[2] = item_id;
-      int offset = transformed_blob->offset(indices);
-      uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-      Transform(mat_vector[item_id],
-                &uni_blob,
-                is_video,
-                item_id,
-                rand_mirror,
-                rand_h_off,
-                rand_w_off);
-    }
+    TransformVideo(mat_vector, transformed_blob, rand_mirror, rand_h_off,
+                   rand_w_off);
   } else {
     const int mat_num = mat_vector.size();
     const int num = transformed_blob->num();
@@ -272,6 +258,62 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
   }
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformVideo(const vector<cv::Mat> & mat_vector,
+                                            Blob<Dtype>* transformed_blob,
+                                            const bool mirror,
+                                            const int h_off,
+                                            const int w_off) {
+  const int mat_num = mat_vector.size();
+  const int num = transformed_blob->shape(0);
+  const int channels = transformed_blob->shape(1);
+  const int length = transformed_blob->shape(2);
+  const int height = transformed_blob->shape(3);
+  const int width = transformed_blob->shape(4);
+
+  CHECK_GT(mat_num, 0) << "There is no MAT to add";
+  CHECK_EQ(num, 1) << "First dimension (batch number) must be 1";
+  CHECK_EQ(mat_num, length) <<
+    "The size of mat_vector must be equals to transformed_blob->shape(2)";
+  vector<int> uni_blob_shape(5);
+  uni_blob_shape[0] = 1;
+  uni_blob_shape[1] = channels;
+  uni_blob_shape[2] = 1;
+  uni_blob_shape[3] = height;
+  uni_blob_shape[4] = width;
+  Blob<Dtype> uni_blob(uni_blob_shape);
+  vector<int> indices(5);
+  indices[0] = 0; indices[1] = 0; indices[3] = 0; indices[4] = 0;
+  for (int item_id = 0; item_id < mat_num; ++item_id) {
+    indices[2] = item_id;
+    int offset = transformed_blob->offset(indices);
+    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
+    Transform(mat_vector[item_id], &uni_blob, true, item_id, mirror, h_off,
+              w_off);
+  }
+}
+
+template<typename Dtype>
+bool DataTransformer<Dtype>::ChooseVideoMirror() {
+  return param_.mirror() ? static_cast<bool>(Rand(2)) : false;
+}
+
+template<typename Dtype>
+cv::Rect DataTransformer<Dtype>::ChooseVideoCrop(const int img_height,
+                                                 const int img_width) {
+  const int crop_size = param_.crop_size();
+  CHECK_GT(crop_size, 0) << "Only crops need choosing";
+  CHECK_GE(img_height, crop_size);
+  CHECK_GE(img_width, crop_size);
+  if (phase_ == TRAIN) {
+    const int h_off = Rand(img_height - crop_size + 1);
+    const int w_off = Rand(img_width - crop_size + 1);
+    return cv::Rect(w_off, h_off, crop_size, crop_size);
+  }
+  return cv::Rect((img_width - crop_size) / 2, (img_height - crop_size) / 2,
+                  crop_size, crop_size);
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
                                        Blob<Dtype>* transformed_blob,
@@ -311,7 +353,7 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
 
-  Dtype* mean = NULL;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     if (is_mean_cube) {
       CHECK_EQ(img_channels, data_mean_.shape(1));
@@ -325,17 +367,13 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
       CHECK_EQ(img_height, data_mean_.height());
       CHECK_EQ(img_width, data_mean_.width());
     }
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
   }
+  // A single mean_value applies to all the channels. The mean values are
+  // left as they are, so that clips can be transformed concurrently.
   if (has_mean_values) {
     CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
      "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
   }
 
   int h_off = 0;
@@ -388,7 +426,7 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
           transformed_data[top_index] = (pixel - mean[mean_index]) * scale;
         } else if (has_mean_values) {
             transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
+              (pixel - mean_values_[mean_values_.size() == 1 ? 0 : c]) * scale;
         } else {
           transformed_data[top_index] = pixel * scale;
         }
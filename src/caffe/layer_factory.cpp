@@ -74,7 +74,32 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 
 REGISTER_LAYER_CREATOR(Convolution, GetConvolutionLayer);
 
-// Get NdConvolution layer if CUDNN is available
+// The layouts of the layer GetConvolutionLayer creates.
+template <typename Dtype>
+struct ConvolutionLayouts {
+  static bool LayoutAgnostic(const LayerParameter& param) { return false; }
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+#ifdef USE_CUDNN
+    const ConvolutionParameter& conv_param = param.convolution_param();
+    bool use_dilation = false;
+    for (int i = 0; i < conv_param.dilation_size(); ++i) {
+      use_dilation |= conv_param.dilation(i) > 1;
+    }
+    if (conv_param.engine() == ConvolutionParameter_Engine_CUDNN ||
+        (conv_param.engine() == ConvolutionParameter_Engine_DEFAULT &&
+         !use_dilation)) {
+      return CuDNNConvolutionLayer<Dtype>::SupportsLayout(param, layout);
+    }
+#endif
+    return ConvolutionLayer<Dtype>::SupportsLayout(param, layout);
+  }
+};
+
+REGISTER_LAYER_LAYOUTS(Convolution, ConvolutionLayouts);
+
+// Get NdConvolution layer if CUDNN is available. It has no CPU path, so no
+// layouts are registered and it runs PLANAR.
 
 #ifdef USE_CUDNN
 template <typename Dtype>
@@ -133,6 +158,25 @@ shared_ptr<Layer<Dtype> > GetPoolingLayer(const LayerParameter& param) {
 
 REGISTER_LAYER_CREATOR(Pooling, GetPoolingLayer);
 
+// The layouts of the layer GetPoolingLayer creates.
+template <typename Dtype>
+struct PoolingLayouts {
+  static bool LayoutAgnostic(const LayerParameter& param) { return false; }
+  static bool SupportsLayout(const LayerParameter& param,
+      const BlobLayout layout) {
+#ifdef USE_CUDNN
+    if (param.pooling_param().engine() != PoolingParameter_Engine_CAFFE &&
+        param.top_size() <= 1 &&
+        param.pooling_param().pool() != PoolingParameter_PoolMethod_MAX) {
+      return CuDNNPoolingLayer<Dtype>::SupportsLayout(param, layout);
+    }
+#endif
+    return PoolingLayer<Dtype>::SupportsLayout(param, layout);
+  }
+};
+
+REGISTER_LAYER_LAYOUTS(Pooling, PoolingLayouts);
+
 
 // Get unpooling layer according to engine.
 template <typename Dtype>
@@ -195,7 +239,8 @@ shared_ptr<Layer<Dtype> > GetLRNLayer(const LayerParameter& param) {
 REGISTER_LAYER_CREATOR(LRN, GetLRNLayer);
 
 
-// Get NdPooling layer if CUDNN is available
+// Get NdPooling layer if CUDNN is available. Like NdConvolution it runs
+// PLANAR only.
 #ifdef USE_CUDNN
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetNdPoolingLayer(const LayerParameter& param) {
@@ -238,6 +283,7 @@ shared_ptr<Layer<Dtype> > GetReLULayer(const LayerParameter& param) {
 }
 
 REGISTER_LAYER_CREATOR(ReLU, GetReLULayer);
+REGISTER_LAYER_LAYOUTS(ReLU, ReLULayer);
 
 // Get sigmoid layer according to engine.
 template <typename Dtype>
@@ -261,6 +307,7 @@ shared_ptr<Layer<Dtype> > GetSigmoidLayer(const LayerParameter& param) {
 }
 
 REGISTER_LAYER_CREATOR(Sigmoid, GetSigmoidLayer);
+REGISTER_LAYER_LAYOUTS(Sigmoid, SigmoidLayer);
 
 // Get softmax layer according to engine.
 template <typename Dtype>
@@ -307,15 +354,20 @@ shared_ptr<Layer<Dtype> > GetTanHLayer(const LayerParameter& param) {
 }
 
 REGISTER_LAYER_CREATOR(TanH, GetTanHLayer);
+REGISTER_LAYER_LAYOUTS(TanH, TanHLayer);
 
 #ifdef WITH_PYTHON_LAYER
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPythonLayer(const LayerParameter& param) {
-  Py_Initialize();
+  InitPython();
+  ScopedGILAcquire gil;
   try {
     bp::object module = bp::import(param.python_param().module().c_str());
     bp::object layer = module.attr(param.python_param().layer().c_str())(param);
-    return bp::extract<shared_ptr<PythonLayer<Dtype> > >(layer)();
+    shared_ptr<PythonLayer<Dtype> > python_layer =
+        bp::extract<shared_ptr<PythonLayer<Dtype> > >(layer)();
+    return shared_ptr<Layer<Dtype> >(python_layer.get(),
+        PythonLayerDeleter<Dtype>(python_layer));
   } catch (bp::error_already_set) {
     PyErr_Print();
     throw;
@@ -1,12 +1,17 @@
-#include <functional>
-#include <utility>
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/accuracy_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
+// Scores worth a parallel chunk of outer indices.
+static const int kAccuracyChunkWork = 1 << 14;
+
 template <typename Dtype>
 void AccuracyLayer<Dtype>::LayerSetUp(
   const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -28,6 +33,7 @@ void AccuracyLayer<Dtype>::Reshape(
       bottom[0]->CanonicalAxisIndex(this->layer_param_.accuracy_param().axis());
   outer_num_ = bottom[0]->count(0, label_axis_);
   inner_num_ = bottom[0]->count(label_axis_ + 1);
+  num_labels_ = bottom[0]->shape(label_axis_);
   CHECK_EQ(outer_num_ * inner_num_, bottom[1]->count())
       << "Number of labels must match number of predictions; "
       << "e.g., if label axis == 1 and prediction shape is (N, C, H, W), "
@@ -35,6 +41,9 @@ void AccuracyLayer<Dtype>::Reshape(
       << "with integer values in {0, 1, ..., C-1}.";
   vector<int> top_shape(0);  // Accuracy is a scalar; 0 axes.
   top[0]->Reshape(top_shape);
+  label_buffer_.Reshape(bottom[1]->shape());
+  rank_buffer_.Reshape(bottom[1]->shape());
+  score_buffer_.Reshape(bottom[1]->shape());
   if (top.size() > 1) {
     // Per-class accuracy is a vector; 1 axes.
     vector<int> top_shape_per_class(1);
@@ -45,50 +54,76 @@ void AccuracyLayer<Dtype>::Reshape(
 }
 
 template <typename Dtype>
-void AccuracyLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  Dtype accuracy = 0;
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* bottom_label = bottom[1]->cpu_data();
-  const int dim = bottom[0]->count() / outer_num_;
-  const int num_labels = bottom[0]->shape(label_axis_);
-  vector<Dtype> maxval(top_k_+1);
-  vector<int> max_id(top_k_+1);
-  if (top.size() > 1) {
-    caffe_set(nums_buffer_.count(), Dtype(0), nums_buffer_.mutable_cpu_data());
-    caffe_set(top[1]->count(), Dtype(0), top[1]->mutable_cpu_data());
-  }
-  int count = 0;
-  for (int i = 0; i < outer_num_; ++i) {
+void AccuracyLayer<Dtype>::rank_labels_cpu(const Dtype* bottom_data,
+    const Dtype* bottom_label, int* label_ids, Dtype* label_scores,
+    int* ranks, int begin, int end) {
+  const int dim = num_labels_ * inner_num_;
+  for (int i = begin; i < end; ++i) {
+    const Dtype* data = bottom_data + i * dim;
+    int* label_id = label_ids + i * inner_num_;
+    Dtype* label_score = label_scores + i * inner_num_;
+    int* rank = ranks + i * inner_num_;
     for (int j = 0; j < inner_num_; ++j) {
       const int label_value =
           static_cast<int>(bottom_label[i * inner_num_ + j]);
       if (has_ignore_label_ && label_value == ignore_label_) {
+        label_id[j] = -1;
+        label_score[j] = 0;
         continue;
       }
-      if (top.size() > 1) ++nums_buffer_.mutable_cpu_data()[label_value];
       DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, num_labels);
-      // Top-k accuracy
-      std::vector<std::pair<Dtype, int> > bottom_data_vector;
-      for (int k = 0; k < num_labels; ++k) {
-        bottom_data_vector.push_back(std::make_pair(
-            bottom_data[i * dim + k * inner_num_ + j], k));
-      }
-      std::partial_sort(
-          bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-          bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
-      // check if true label is in top k predictions
-      for (int k = 0; k < top_k_; k++) {
-        if (bottom_data_vector[k].second == label_value) {
-          ++accuracy;
-          if (top.size() > 1) ++top[1]->mutable_cpu_data()[label_value];
-          break;
-        }
+      DCHECK_LT(label_value, num_labels_);
+      label_id[j] = label_value;
+      label_score[j] = data[label_value * inner_num_ + j];
+    }
+    // Rank the true label at every spatial position in one class-major sweep
+    // over contiguous memory: a class outranks the label if its score is
+    // higher, or equal with a higher index (the order std::partial_sort on
+    // (score, index) pairs would produce). The label is within the top k iff
+    // fewer than k classes outrank it, so no per-position sort is needed.
+    caffe_set(inner_num_, 0, rank);
+    for (int k = 0; k < num_labels_; ++k) {
+      const Dtype* class_data = data + k * inner_num_;
+      for (int j = 0; j < inner_num_; ++j) {
+        rank[j] += (class_data[j] > label_score[j]) |
+            ((class_data[j] == label_score[j]) & (k > label_id[j]));
       }
-      ++count;
     }
   }
+}
+
+template <typename Dtype>
+void AccuracyLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  Dtype accuracy = 0;
+  if (top.size() > 1) {
+    caffe_set(nums_buffer_.count(), Dtype(0), nums_buffer_.mutable_cpu_data());
+    caffe_set(top[1]->count(), Dtype(0), top[1]->mutable_cpu_data());
+  }
+  // Ranking costs a pass over all scores and runs in parallel over the outer
+  // indices; tallying the ranks is cheap and stays serial.
+  parallel_for(0, outer_num_,
+      boost::bind(&AccuracyLayer<Dtype>::rank_labels_cpu, this,
+          bottom[0]->cpu_data(), bottom[1]->cpu_data(),
+          label_buffer_.mutable_cpu_data(), score_buffer_.mutable_cpu_data(),
+          rank_buffer_.mutable_cpu_data(), _1, _2),
+      std::max(1, kAccuracyChunkWork / (num_labels_ * inner_num_)));
+  const int* label_id = label_buffer_.cpu_data();
+  const int* rank = rank_buffer_.cpu_data();
+  int count = 0;
+  for (int j = 0; j < label_buffer_.count(); ++j) {
+    const int label_value = label_id[j];
+    if (label_value < 0) {
+      continue;
+    }
+    if (top.size() > 1) ++nums_buffer_.mutable_cpu_data()[label_value];
+    // check if true label is in top k predictions
+    if (rank[j] < top_k_) {
+      ++accuracy;
+      if (top.size() > 1) ++top[1]->mutable_cpu_data()[label_value];
+    }
+    ++count;
+  }
 
   // LOG(INFO) << "Accuracy: " << accuracy;
   top[0]->mutable_cpu_data()[0] = accuracy / count;
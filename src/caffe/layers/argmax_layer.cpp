@@ -1,12 +1,19 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <functional>
 #include <utility>
 #include <vector>
 
 #include "caffe/layers/argmax_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
+// Bottom values worth a parallel chunk.
+static const int kArgMaxChunkWork = 1 << 14;
+
 template <typename Dtype>
 void ArgMaxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -49,52 +56,128 @@ void ArgMaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   top[0]->Reshape(shape);
+  max_val_.Reshape(top[0]->shape());
+  max_id_.Reshape(top[0]->shape());
+  const int num = bottom[0]->count() / axis_size(bottom[0]);
+  top_k_buffer_.resize(
+      ParallelNumChunks(num, top_k_grain(bottom[0])) * top_k_);
 }
 
 template <typename Dtype>
-void ArgMaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  int dim, axis_dist;
-  if (has_axis_) {
-    dim = bottom[0]->shape(axis_);
-    // Distance between values of axis in blob
-    axis_dist = bottom[0]->count(axis_) / dim;
-  } else {
-    dim = bottom[0]->count(1);
-    axis_dist = 1;
+int ArgMaxLayer<Dtype>::axis_size(const Blob<Dtype>* bottom) const {
+  return has_axis_ ? bottom->shape(axis_) : bottom->count(1);
+}
+
+template <typename Dtype>
+int ArgMaxLayer<Dtype>::top_k_grain(const Blob<Dtype>* bottom) const {
+  return std::max(1, kArgMaxChunkWork / axis_size(bottom));
+}
+
+template <typename Dtype>
+void ArgMaxLayer<Dtype>::forward_max_cpu(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* max_vals, int* max_ids, int dim, int axis_dist,
+    int begin, int end) {
+  // A running max over the axis, swept one contiguous slice of axis_dist
+  // values at a time. Ties go to the higher index, as with the
+  // (value, index) ordering used for top_k > 1.
+  for (int n = begin; n < end; ++n) {
+    const Dtype* data = bottom_data + n * dim * axis_dist;
+    Dtype* max_val = max_vals + n * axis_dist;
+    int* max_id = max_ids + n * axis_dist;
+    caffe_copy(axis_dist, data, max_val);
+    caffe_set(axis_dist, 0, max_id);
+    for (int j = 1; j < dim; ++j) {
+      const Dtype* slice = data + j * axis_dist;
+      for (int k = 0; k < axis_dist; ++k) {
+        if (slice[k] >= max_val[k]) {
+          max_val[k] = slice[k];
+          max_id[k] = j;
+        }
+      }
+    }
+    for (int k = 0; k < axis_dist; ++k) {
+      if (out_max_val_ && !has_axis_) {
+        // Produces max_ind and max_val
+        top_data[2 * n] = max_id[k];
+        top_data[2 * n + 1] = max_val[k];
+      } else {
+        // Produces max_val or max_ind per axis
+        top_data[n * axis_dist + k] = out_max_val_ ? max_val[k] : max_id[k];
+      }
+    }
   }
-  int num = bottom[0]->count() / dim;
-  std::vector<std::pair<Dtype, int> > bottom_data_vector(dim);
-  for (int i = 0; i < num; ++i) {
-    for (int j = 0; j < dim; ++j) {
-      bottom_data_vector[j] = std::make_pair(
-        bottom_data[(i / axis_dist * dim + j) * axis_dist + i % axis_dist], j);
+}
+
+template <typename Dtype>
+void ArgMaxLayer<Dtype>::forward_top_k_cpu(const Dtype* bottom_data,
+    Dtype* top_data, int dim, int axis_dist, int num, int num_chunks,
+    int chunk) {
+  // Keep the k largest (value, index) pairs in a fixed-size min-heap whose
+  // front is the smallest survivor, so each element costs one comparison
+  // unless it displaces the front. Every chunk has a heap of its own.
+  std::pair<Dtype, int>* heap = &top_k_buffer_[chunk * top_k_];
+  std::greater<std::pair<Dtype, int> > comp;
+  const int end = ParallelChunkBegin(0, num, num_chunks, chunk + 1);
+  for (int i = ParallelChunkBegin(0, num, num_chunks, chunk); i < end; ++i) {
+    const Dtype* data = bottom_data + i / axis_dist * dim * axis_dist
+        + i % axis_dist;
+    for (int j = 0; j < top_k_; ++j) {
+      heap[j] = std::make_pair(data[j * axis_dist], j);
+    }
+    std::make_heap(heap, heap + top_k_, comp);
+    for (int j = top_k_; j < dim; ++j) {
+      const std::pair<Dtype, int> candidate(data[j * axis_dist], j);
+      if (comp(candidate, heap[0])) {
+        std::pop_heap(heap, heap + top_k_, comp);
+        heap[top_k_ - 1] = candidate;
+        std::push_heap(heap, heap + top_k_, comp);
+      }
     }
-    std::partial_sort(
-        bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-        bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
+    // Sorted in descending order.
+    std::sort_heap(heap, heap + top_k_, comp);
     for (int j = 0; j < top_k_; ++j) {
       if (out_max_val_) {
         if (has_axis_) {
           // Produces max_val per axis
           top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-            = bottom_data_vector[j].first;
+            = heap[j].first;
         } else {
           // Produces max_ind and max_val
-          top_data[2 * i * top_k_ + j] = bottom_data_vector[j].second;
-          top_data[2 * i * top_k_ + top_k_ + j] = bottom_data_vector[j].first;
+          top_data[2 * i * top_k_ + j] = heap[j].second;
+          top_data[2 * i * top_k_ + top_k_ + j] = heap[j].first;
         }
       } else {
         // Produces max_ind per axis
         top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-          = bottom_data_vector[j].second;
+          = heap[j].second;
       }
     }
   }
 }
 
+template <typename Dtype>
+void ArgMaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int dim = axis_size(bottom[0]);
+  // Distance between values of axis in blob
+  const int axis_dist = has_axis_ ? bottom[0]->count(axis_) / dim : 1;
+  const int num = bottom[0]->count() / dim;
+  if (top_k_ == 1) {
+    parallel_for(0, num / axis_dist,
+        boost::bind(&ArgMaxLayer<Dtype>::forward_max_cpu, this, bottom_data,
+            top_data, max_val_.mutable_cpu_data(), max_id_.mutable_cpu_data(),
+            dim, axis_dist, _1, _2),
+        std::max(1, kArgMaxChunkWork / (dim * axis_dist)));
+    return;
+  }
+  const int num_chunks = ParallelNumChunks(num, top_k_grain(bottom[0]));
+  ParallelForChunks(num_chunks,
+      boost::bind(&ArgMaxLayer<Dtype>::forward_top_k_cpu, this, bottom_data,
+          top_data, dim, axis_dist, num, num_chunks, _1));
+}
+
 INSTANTIATE_CLASS(ArgMaxLayer);
 REGISTER_LAYER_CLASS(ArgMax);
 
@@ -1,10 +1,15 @@
+#include <boost/bind.hpp>
+#include <unistd.h>
+
 #include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/layout.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -187,6 +192,13 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   kernel_dim_ = this->blobs_[0]->count(1);
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
+  if (this->layout_ == CHANNELS_LAST) {
+    CHECK(!reverse_dimensions() && group_ == 1)
+        << "Channels-last convolution supports group 1 only.";
+    CHECK_LE(num_spatial_axes_, 3)
+        << "Channels-last convolution supports up to 3 spatial axes.";
+    channels_last_weights_.ReshapeLike(*this->blobs_[0]);
+  }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
@@ -234,17 +246,17 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   col_offset_ = kernel_dim_ * conv_out_spatial_dim_;
   output_offset_ = conv_out_channels_ * conv_out_spatial_dim_ / group_;
-  // Setup input dimensions (conv_input_shape_).
+  // Setup input dimensions (conv_input_shape_). It is only rewritten when
+  // the shape changes, so that its GPU copy stays valid across reshapes.
   vector<int> bottom_dim_blob_shape(1, num_spatial_axes_ + 1);
   conv_input_shape_.Reshape(bottom_dim_blob_shape);
-  int* conv_input_shape_data = conv_input_shape_.mutable_cpu_data();
-  for (int i = 0; i < num_spatial_axes_ + 1; ++i) {
-    if (reverse_dimensions()) {
-      conv_input_shape_data[i] = top[0]->shape(channel_axis_ + i + forced_3d_);
-    } else {
-      conv_input_shape_data[i] = bottom[0]->shape(channel_axis_ + i +
-          forced_3d_);
-    }
+  const Blob<Dtype>* input_blob = reverse_dimensions() ? top[0] : bottom[0];
+  const vector<int> input_dims(input_blob->shape().begin() + channel_axis_
+      + forced_3d_, input_blob->shape().end());
+  if (!std::equal(input_dims.begin(), input_dims.end(),
+      conv_input_shape_.cpu_data())) {
+    std::copy(input_dims.begin(), input_dims.end(),
+        conv_input_shape_.mutable_cpu_data());
   }
   // The im2col result buffer will only hold one image at a time to avoid
   // overly large memory usage. In the special case of 1x1 convolution
@@ -268,20 +280,35 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bias_term_) {
     vector<int> bias_multiplier_shape(1, out_spatial_dim_);
     bias_multiplier_.Reshape(bias_multiplier_shape);
-    caffe_set(bias_multiplier_.count(), Dtype(1),
-        bias_multiplier_.mutable_cpu_data());
+    if (bias_multiplier_.cpu_data()[out_spatial_dim_ - 1] != Dtype(1)) {
+      caffe_set(bias_multiplier_.count(), Dtype(1),
+          bias_multiplier_.mutable_cpu_data());
+    }
+  }
+  // The wide buffers of batched GEMMs, allocated on first use.
+  gemm_batch_ = gemm_batch_size();
+  if (gemm_batch_ > 1) {
+    vector<int> batch_shape(2);
+    batch_shape[0] = kernel_dim_ * group_;
+    batch_shape[1] = gemm_batch_ * conv_out_spatial_dim_;
+    batch_col_buffer_.Reshape(batch_shape);
+    batch_shape[0] = conv_out_channels_;
+    batch_output_buffer_.Reshape(batch_shape);
   }
 }
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
-  const Dtype* col_buff = input;
-  if (!is_1x1_) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, Dtype* col_buff) {
+  if (is_1x1_) {
+    col_buff = const_cast<Dtype*>(input);
+  } else {
+    if (!col_buff) {
+      col_buff = col_buffer_.mutable_cpu_data();
+    }
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -301,10 +328,11 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    const Dtype* weights, Dtype* input, Dtype* col_buff) {
   if (is_1x1_) {
     col_buff = input;
+  } else if (!col_buff) {
+    col_buff = col_buffer_.mutable_cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -340,6 +368,326 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+// Multiply-adds per thread at which BLAS alone keeps the threads busy.
+static const double kParallelImageWork = 1 << 22;
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::parallel_blocks_cpu() {
+  const int max_threads = Caffe::max_threads();
+  if (num_ < 2 || max_threads < 2) {
+    return 1;
+  }
+  const double image_work = static_cast<double>(conv_out_channels_) *
+      kernel_dim_ * conv_out_spatial_dim_;
+  if (image_work >= kParallelImageWork * max_threads) {
+    return 1;
+  }
+  int num_blocks = std::min(num_, max_threads);
+  if (!is_1x1_) {
+    // Each block has a column buffer of its own, within the workspace.
+    const double workspace_bytes = static_cast<double>(
+        this->layer_param_.convolution_param().gemm_batch_workspace()) *
+        (1 << 20);
+    const double col_bytes =
+        static_cast<double>(col_buffer_.count()) * sizeof(Dtype);
+    num_blocks = std::min(num_blocks,
+        static_cast<int>(std::min(workspace_bytes / col_bytes, 1e9)));
+  }
+  return std::max(num_blocks, 1);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::for_each_image_cpu(
+    const ImageFunction& image_cpu) {
+  const int num_blocks = parallel_blocks_cpu();
+  if (num_blocks < 2) {
+    for (int n = 0; n < num_; ++n) {
+      image_cpu(n, NULL);
+    }
+    return;
+  }
+  // Blocks of consecutive images, one per thread, share a column buffer.
+  Dtype* col_buffers = NULL;
+  if (!is_1x1_) {
+    vector<int> shape(2);
+    shape[0] = num_blocks;
+    shape[1] = col_buffer_.count();
+    parallel_col_buffer_.Reshape(shape);
+    col_buffers = parallel_col_buffer_.mutable_cpu_data();
+  }
+  parallel_for(0, num_blocks, boost::bind(
+      &BaseConvolutionLayer<Dtype>::images_cpu, this, boost::cref(image_cpu),
+      col_buffers, num_blocks, _1, _2));
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::images_cpu(const ImageFunction& image_cpu,
+    Dtype* col_buffers, int num_blocks, int block_begin, int block_end) {
+  for (int block = block_begin; block < block_end; ++block) {
+    Dtype* col_buff = col_buffers ?
+        col_buffers + block * col_buffer_.count() : NULL;
+    const int end = ParallelChunkBegin(0, num_, num_blocks, block + 1);
+    for (int n = ParallelChunkBegin(0, num_, num_blocks, block); n < end;
+        ++n) {
+      image_cpu(n, col_buff);
+    }
+  }
+}
+
+// The L2 cache size, or a common one when the system does not tell.
+static int L2CacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  const long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);  // NOLINT(runtime/int)
+  if (bytes > 0) {
+    return bytes;
+  }
+#endif
+  return 256 << 10;
+}
+
+// The depth of the GEMM panels that BLAS keeps in the L2 cache.
+static const int kGemmPanelDepth = 256;
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::gemm_batch_size() {
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  if (reverse_dimensions() || this->layout_ == CHANNELS_LAST || num_ < 2 ||
+      conv_param.gemm_batch() == 1) {
+    return 1;
+  }
+  if (conv_param.gemm_batch() > 1) {
+    return std::min<int>(conv_param.gemm_batch(), num_);
+  }
+  // Enough images that the panels of the GEMM columns fill the L2 cache,
+  // which BLAS needs to run at its peak...
+  const int target_columns =
+      L2CacheBytes() / (kGemmPanelDepth * static_cast<int>(sizeof(Dtype)));
+  int batch = std::min(num_, (target_columns + conv_out_spatial_dim_ - 1)
+      / conv_out_spatial_dim_);
+  // ...within the workspace.
+  const double image_bytes = static_cast<double>(kernel_dim_ * group_ +
+      conv_out_channels_) * conv_out_spatial_dim_ * sizeof(Dtype);
+  const double workspace_bytes =
+      static_cast<double>(conv_param.gemm_batch_workspace()) * (1 << 20);
+  batch = std::min(batch, static_cast<int>(workspace_bytes / image_bytes));
+  return std::max(batch, 1);
+}
+
+template <typename Dtype>
+bool BaseConvolutionLayer<Dtype>::batch_images_cpu() {
+  if (gemm_batch_ < 2) {
+    return false;
+  }
+  // Chosen batches give way to running the images in parallel, the other
+  // remedy for small GEMMs.
+  return this->layer_param_.convolution_param().gemm_batch() > 1 ||
+      parallel_blocks_cpu() < 2;
+}
+
+// Copies the rows x cols matrices of num_images images, image_stride apart,
+// side by side into a matrix of the given width.
+template <typename Dtype>
+static void gather_images(const int num_images, const int rows,
+    const int cols, const Dtype* images, const int image_stride,
+    const int width, Dtype* wide) {
+  for (int b = 0; b < num_images; ++b) {
+    for (int r = 0; r < rows; ++r) {
+      caffe_copy(cols, images + b * image_stride + r * cols,
+          wide + r * width + b * cols);
+    }
+  }
+}
+
+// Copies the rows x cols matrix of one image out of a matrix of the given
+// width.
+template <typename Dtype>
+static void scatter_image(const int rows, const int cols, const int width,
+    const Dtype* wide, Dtype* image) {
+  for (int r = 0; r < rows; ++r) {
+    caffe_copy(cols, wide + r * width, image + r * cols);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::gather_col_batch(const Dtype* input,
+    int num_images) {
+  const int rows = kernel_dim_ * group_;
+  const int width = num_images * conv_out_spatial_dim_;
+  Dtype* col_wide = batch_col_buffer_.mutable_cpu_data();
+  if (is_1x1_) {
+    gather_images(num_images, rows, conv_out_spatial_dim_, input,
+        bottom_dim_, width, col_wide);
+    return;
+  }
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  for (int b = 0; b < num_images; ++b) {
+    conv_im2col_cpu(input + b * bottom_dim_, col_buff);
+    gather_images(1, rows, conv_out_spatial_dim_, col_buff, 0, width,
+        col_wide + b * conv_out_spatial_dim_);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::gather_output_batch(const Dtype* output,
+    int num_images) {
+  gather_images(num_images, conv_out_channels_, conv_out_spatial_dim_,
+      output, top_dim_, num_images * conv_out_spatial_dim_,
+      batch_output_buffer_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, int num_images) {
+  gather_col_batch(input, num_images);
+  const int width = num_images * conv_out_spatial_dim_;
+  const Dtype* col_wide = batch_col_buffer_.cpu_data();
+  Dtype* output_wide = batch_output_buffer_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, width, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_wide + kernel_dim_ * width * g,
+        (Dtype)0., output_wide + conv_out_channels_ / group_ * width * g);
+  }
+  for (int b = 0; b < num_images; ++b) {
+    scatter_image(conv_out_channels_, conv_out_spatial_dim_, width,
+        output_wide + b * conv_out_spatial_dim_, output + b * top_dim_);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(
+    const Dtype* output, const Dtype* weights, Dtype* input,
+    int num_images) {
+  gather_output_batch(output, num_images);
+  const int width = num_images * conv_out_spatial_dim_;
+  const Dtype* output_wide = batch_output_buffer_.cpu_data();
+  Dtype* col_wide = batch_col_buffer_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        width, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        output_wide + conv_out_channels_ / group_ * width * g,
+        (Dtype)0., col_wide + kernel_dim_ * width * g);
+  }
+  for (int b = 0; b < num_images; ++b) {
+    const Dtype* col_image = col_wide + b * conv_out_spatial_dim_;
+    if (is_1x1_) {
+      scatter_image(kernel_dim_ * group_, conv_out_spatial_dim_, width,
+          col_image, input + b * bottom_dim_);
+    } else {
+      Dtype* col_buff = col_buffer_.mutable_cpu_data();
+      scatter_image(kernel_dim_ * group_, conv_out_spatial_dim_, width,
+          col_image, col_buff);
+      conv_col2im_cpu(col_buff, input + b * bottom_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output, Dtype* weights, int num_images) {
+  gather_col_batch(input, num_images);
+  gather_output_batch(output, num_images);
+  const int width = num_images * conv_out_spatial_dim_;
+  const Dtype* col_wide = batch_col_buffer_.cpu_data();
+  const Dtype* output_wide = batch_output_buffer_.cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, width,
+        (Dtype)1., output_wide + conv_out_channels_ / group_ * width * g,
+        col_wide + kernel_dim_ * width * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::channels_last_weights_cpu(
+    const Dtype* weights) {
+  planar_to_channels_last_cpu(conv_out_channels_, conv_in_channels_,
+      kernel_dim_ / conv_in_channels_, weights,
+      channels_last_weights_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_channels_last(
+    const Dtype* input, Dtype* output, Dtype* col_buff) {
+  if (is_1x1_) {
+    col_buff = const_cast<Dtype*>(input);
+  } else {
+    if (!col_buff) {
+      col_buff = col_buffer_.mutable_cpu_data();
+    }
+    conv_im2col_channels_last_cpu(input, col_buff);
+  }
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_spatial_dim_,
+      conv_out_channels_, kernel_dim_,
+      (Dtype)1., col_buff, channels_last_weights_.cpu_data(),
+      (Dtype)0., output);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias_channels_last(
+    Dtype* output, const Dtype* bias) {
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_spatial_dim_,
+      num_output_, 1, (Dtype)1., bias_multiplier_.cpu_data(), bias,
+      (Dtype)1., output);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_channels_last(
+    const Dtype* output, Dtype* input, Dtype* col_buff) {
+  if (is_1x1_) {
+    col_buff = input;
+  } else if (!col_buff) {
+    col_buff = col_buffer_.mutable_cpu_data();
+  }
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_spatial_dim_,
+      kernel_dim_, conv_out_channels_,
+      (Dtype)1., output, channels_last_weights_.cpu_data(),
+      (Dtype)0., col_buff);
+  if (!is_1x1_) {
+    conv_col2im_channels_last_cpu(col_buff, input);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_channels_last(
+    const Dtype* input, const Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_channels_last_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, conv_out_channels_,
+      kernel_dim_, conv_out_spatial_dim_,
+      (Dtype)1., output, col_buff,
+      (Dtype)1., channels_last_weights_.mutable_cpu_diff());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_bias_channels_last(
+    Dtype* bias, const Dtype* input) {
+  caffe_cpu_gemv<Dtype>(CblasTrans, out_spatial_dim_, num_output_, 1.,
+      input, bias_multiplier_.cpu_data(), 1., bias);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::add_channels_last_weight_diff_cpu(
+    Dtype* weight_diff) {
+  // The reordered weights are prepared again before they are used next, so
+  // their buffer holds the planar gradient here.
+  Dtype* planar_diff = channels_last_weights_.mutable_cpu_data();
+  channels_last_to_planar_cpu(conv_out_channels_, conv_in_channels_,
+      kernel_dim_ / conv_in_channels_, channels_last_weights_.cpu_diff(),
+      planar_diff);
+  caffe_axpy(channels_last_weights_.count(), Dtype(1), planar_diff,
+      weight_diff);
+  caffe_set(channels_last_weights_.count(), Dtype(0),
+      channels_last_weights_.mutable_cpu_diff());
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
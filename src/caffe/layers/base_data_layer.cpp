@@ -103,22 +103,53 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+int BasePrefetchingDataLayer<Dtype>::CopyBatchData(const Batch<Dtype>& batch,
+    const vector<Blob<Dtype>*>& top, const bool gpu) {
+  const Blob<Dtype>& data = batch.data_;
+  if (stacked_data_channels_.empty()) {
+    // Reshape to loaded data.
+    top[0]->ReshapeLike(data);
+    // Copy the data
+    caffe_copy(data.count(), gpu ? data.gpu_data() : data.cpu_data(),
+        gpu ? top[0]->mutable_gpu_data() : top[0]->mutable_cpu_data());
+    return 1;
+  }
+  // Each item of each top is a contiguous run of channels of the item.
+  const int num = data.shape(0);
+  const int inner_count = data.count(2);
+  const Dtype* data_data = gpu ? data.gpu_data() : data.cpu_data();
+  int channel = 0;
+  for (int i = 0; i < stacked_data_channels_.size(); ++i) {
+    vector<int> top_shape = data.shape();
+    top_shape[1] = stacked_data_channels_[i];
+    top[i]->Reshape(top_shape);
+    const int item_count = top[i]->count(1);
+    Dtype* top_data = gpu ? top[i]->mutable_gpu_data()
+                          : top[i]->mutable_cpu_data();
+    for (int n = 0; n < num; ++n) {
+      caffe_copy(item_count,
+          data_data + (n * data.shape(1) + channel) * inner_count,
+          top_data + n * item_count);
+    }
+    channel += top_shape[1];
+  }
+  CHECK_EQ(channel, data.shape(1)) << "Stacked channels must add up.";
+  return stacked_data_channels_.size();
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
-  // Reshape to loaded data.
-  top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
-             top[0]->mutable_cpu_data());
+  const int label_top = CopyBatchData(*batch, top, false);
   DLOG(INFO) << "Prefetch copied";
   if (this->output_labels_) {
     // Reshape to loaded labels.
-    top[1]->ReshapeLike(batch->label_);
+    top[label_top]->ReshapeLike(batch->label_);
     // Copy the labels.
     caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-        top[1]->mutable_cpu_data());
+        top[label_top]->mutable_cpu_data());
   }
 
   prefetch_free_.push(batch);
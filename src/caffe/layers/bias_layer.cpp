@@ -73,17 +73,8 @@ void BiasLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bias_data =
       ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  if (bottom[0] != top[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
-  for (int n = 0; n < outer_dim_; ++n) {
-    caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, bias_dim_,
-        inner_dim_, 1, Dtype(1), bias_data,
-        bias_multiplier_.cpu_data(), Dtype(1), top_data);
-    top_data += dim_;
-  }
+  caffe_cpu_channel_scale_bias<Dtype>(outer_dim_, bias_dim_, inner_dim_, NULL,
+      bias_data, bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
 }
 
 template <typename Dtype>
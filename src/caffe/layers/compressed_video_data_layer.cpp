@@ -0,0 +1,200 @@
+#if defined(USE_OPENCV) && defined(USE_FFMPEG)
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/layers/compressed_video_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/compressed_video.hpp"
+
+namespace caffe {
+
+// The channels of the I-frames, motion vectors and residuals in a batch.
+static const int kIFrameChannels = 3;
+static const int kMotionChannels = 2;
+static const int kResidualChannels = 1;
+
+// Reads the given frames of a clip, resized to new_height x new_width
+// unless they are 0.
+static void ReadCompressedClipOrDie(const string& path,
+    const vector<int>& frames, const int new_height, const int new_width,
+    CompressedFrames* compressed) {
+  CHECK(ReadCompressedVideo(path, frames, compressed))
+      << "Could not load " << path << " at frame " << frames[0] << ".";
+  if (new_height == 0) {
+    return;
+  }
+  const cv::Size size(new_width, new_height);
+  // The frames of a GOP share their I-frame, resized once.
+  const uchar* iframe_data = NULL;
+  cv::Mat iframe;
+  for (int i = 0; i < frames.size(); ++i) {
+    if (compressed->iframes[i].data != iframe_data) {
+      iframe_data = compressed->iframes[i].data;
+      iframe.release();
+      cv::resize(compressed->iframes[i], iframe, size);
+    }
+    compressed->iframes[i] = iframe;
+    const cv::Mat& motion = compressed->motion_vectors[i];
+    const cv::Scalar scale(static_cast<double>(new_width) / motion.cols,
+                           static_cast<double>(new_height) / motion.rows);
+    cv::Mat resized_motion;
+    cv::resize(motion, resized_motion, size);
+    cv::multiply(resized_motion, scale, resized_motion);
+    compressed->motion_vectors[i] = resized_motion;
+    cv::Mat residual;
+    cv::resize(compressed->residuals[i], residual, size);
+    compressed->residuals[i] = residual;
+  }
+}
+
+// Writes the crop of the motion vectors and residuals of a clip, mirrored
+// if need be, to the channels that follow its I-frames.
+template <typename Dtype>
+static void CopyMotionAndResiduals(const CompressedFrames& compressed,
+    const cv::Rect& crop, const bool mirror, Dtype* data) {
+  const int length = compressed.motion_vectors.size();
+  const int channel_count = length * crop.height * crop.width;
+  Dtype* dx_data = data;
+  Dtype* dy_data = data + channel_count;
+  Dtype* residual_data = data + kMotionChannels * channel_count;
+  for (int l = 0; l < length; ++l) {
+    const cv::Mat motion = compressed.motion_vectors[l](crop);
+    const cv::Mat residual = compressed.residuals[l](crop);
+    for (int h = 0; h < crop.height; ++h) {
+      const cv::Vec2f* motion_row = motion.ptr<cv::Vec2f>(h);
+      const int16_t* residual_row = residual.ptr<int16_t>(h);
+      for (int w = 0; w < crop.width; ++w) {
+        const int index = (l * crop.height + h) * crop.width +
+                          (mirror ? crop.width - 1 - w : w);
+        dx_data[index] = mirror ? -motion_row[w][0] : motion_row[w][0];
+        dy_data[index] = motion_row[w][1];
+        residual_data[index] = residual_row[w];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void CompressedVideoDataLayer<Dtype>::DataLayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int new_height = video_data_param.new_height();
+  const int new_width = video_data_param.new_width();
+  CHECK((new_height == 0 && new_width == 0) ||
+      (new_height > 0 && new_width > 0)) << "Current implementation requires "
+      "new_height and new_width to be set at the same time.";
+  CHECK(video_data_param.is_color()) << "The I-frames are read in colour.";
+  CHECK(!video_data_param.bucket_by_shape())
+      << "CompressedVideoData does not bucket clips by shape.";
+  this->output_labels_ = top.size() > 3;
+  this->LoadLines();
+  // Read a video clip, and use it to initialize the top blobs.
+  CompressedFrames compressed;
+  ReadCompressedClipOrDie(
+      video_data_param.root_folder() + this->lines_[this->lines_id_].first,
+      this->ClipFrames(this->lines_[this->lines_id_]), new_height, new_width,
+      &compressed);
+  const bool is_video = true;
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(
+      compressed.iframes, is_video);
+  const int batch_size = video_data_param.batch_size();
+  CHECK_GT(batch_size, 0) << "Positive batch size required";
+  top_shape[0] = batch_size;
+  this->stacked_data_channels_.clear();
+  this->stacked_data_channels_.push_back(kIFrameChannels);
+  this->stacked_data_channels_.push_back(kMotionChannels);
+  this->stacked_data_channels_.push_back(kResidualChannels);
+  for (int i = 0; i < this->stacked_data_channels_.size(); ++i) {
+    top_shape[1] = this->stacked_data_channels_[i];
+    top[i]->Reshape(top_shape);
+  }
+  top_shape[1] = kIFrameChannels + kMotionChannels + kResidualChannels;
+  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+    this->prefetch_[i].data_.Reshape(top_shape);
+  }
+  LOG(INFO) << "output data size: " << top_shape[0] << ",{"
+      << kIFrameChannels << "," << kMotionChannels << ","
+      << kResidualChannels << "}," << top_shape[2] << ","
+      << top_shape[3] << "," << top_shape[4];
+  if (this->output_labels_) {
+    vector<int> label_shape(1, batch_size);
+    top[3]->Reshape(label_shape);
+    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+      this->prefetch_[i].label_.Reshape(label_shape);
+    }
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void CompressedVideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  CHECK(batch->data_.count());
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int batch_size = video_data_param.batch_size();
+  const int crop_size = this->layer_param_.transform_param().crop_size();
+  vector<int> iframe_shape = batch->data_.shape();
+  iframe_shape[0] = 1;
+  iframe_shape[1] = kIFrameChannels;
+  this->transformed_data_.Reshape(iframe_shape);
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  Dtype* prefetch_label = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
+
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    timer.Start();
+    const triplet& line = this->lines_[this->lines_id_];
+    CompressedFrames compressed;
+    ReadCompressedClipOrDie(video_data_param.root_folder() + line.first,
+        this->ClipFrames(line), video_data_param.new_height(),
+        video_data_param.new_width(), &compressed);
+    read_time += timer.MicroSeconds();
+    timer.Start();
+    const int height = compressed.iframes[0].rows;
+    const int width = compressed.iframes[0].cols;
+    CHECK_EQ(compressed.iframes.size(), iframe_shape[2])
+        << "The clips must have the same length.";
+    CHECK_EQ(crop_size ? crop_size : height, iframe_shape[3])
+        << "The frames of the clips must have the same size.";
+    CHECK_EQ(crop_size ? crop_size : width, iframe_shape[4])
+        << "The frames of the clips must have the same size.";
+    // The mirroring and crop are picked in the order Transform picks them.
+    DataTransformer<Dtype>* transformer = this->data_transformer_.get();
+    const bool mirror = transformer->ChooseVideoMirror();
+    const cv::Rect crop = crop_size ?
+        transformer->ChooseVideoCrop(height, width) :
+        cv::Rect(0, 0, width, height);
+    Dtype* item_data = prefetch_data + batch->data_.offset(item_id);
+    this->transformed_data_.set_cpu_data(item_data);
+    transformer->TransformVideo(compressed.iframes,
+        &(this->transformed_data_), mirror, crop.y, crop.x);
+    CopyMotionAndResiduals(compressed, crop, mirror,
+                           item_data + this->transformed_data_.count());
+    trans_time += timer.MicroSeconds();
+
+    if (this->output_labels_) {
+      prefetch_label[item_id] = line.third;
+    }
+    this->NextLine();
+  }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+INSTANTIATE_CLASS(CompressedVideoDataLayer);
+REGISTER_LAYER_CLASS(CompressedVideoData);
+
+}  // namespace caffe
+#endif  // USE_OPENCV && USE_FFMPEG
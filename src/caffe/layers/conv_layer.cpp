@@ -1,3 +1,6 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
@@ -21,21 +24,65 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_image_cpu(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int n,
+    Dtype* col_buff) {
+  bottom_data += n * this->bottom_dim_;
+  top_data += n * this->top_dim_;
+  if (this->layout_ == CHANNELS_LAST) {
+    this->forward_cpu_gemm_channels_last(bottom_data, top_data, col_buff);
+    if (bias) {
+      this->forward_cpu_bias_channels_last(top_data, bias);
+    }
+  } else {
+    this->forward_cpu_gemm(bottom_data, weight, top_data, false, col_buff);
+    if (bias) {
+      this->forward_cpu_bias(top_data, bias);
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_image_cpu(const Dtype* top_diff,
+    const Dtype* weight, Dtype* bottom_diff, int n, Dtype* col_buff) {
+  top_diff += n * this->top_dim_;
+  bottom_diff += n * this->bottom_dim_;
+  if (this->layout_ == CHANNELS_LAST) {
+    this->backward_cpu_gemm_channels_last(top_diff, bottom_diff, col_buff);
+  } else {
+    this->backward_cpu_gemm(top_diff, weight, bottom_diff, col_buff);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  if (this->layout_ == CHANNELS_LAST) {
+    this->channels_last_weights_cpu(weight);
+  }
+  const bool batch_images = this->batch_images_cpu();
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
+    if (batch_images) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+        this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            weight, top_data + n * this->top_dim_,
+            std::min(this->gemm_batch_, this->num_ - n));
+      }
+      for (int n = 0; bias && n < this->num_; ++n) {
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
+      continue;
     }
+    // Images are independent, so they may run in parallel.
+    this->for_each_image_cpu(boost::bind(
+        &ConvolutionLayer<Dtype>::forward_image_cpu, this,
+        bottom[i]->cpu_data(), weight, bias, top[i]->mutable_cpu_data(),
+        _1, _2));
   }
 }
 
@@ -44,31 +91,62 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const bool channels_last = this->layout_ == CHANNELS_LAST;
+  if (channels_last) {
+    this->channels_last_weights_cpu(weight);
+  }
+  const bool batch_images = this->batch_images_cpu();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
       for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+        if (channels_last) {
+          this->backward_cpu_bias_channels_last(bias_diff,
+              top_diff + n * this->top_dim_);
+        } else {
+          this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+        }
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
+    // gradient w.r.t. weight. Note that we will accumulate diffs. The images
+    // add to the same diff, in order, so that the sum is reproducible.
+    if (this->param_propagate_down_[0] && batch_images) {
+      for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+        this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff,
+            std::min(this->gemm_batch_, this->num_ - n));
+      }
+    } else if (this->param_propagate_down_[0]) {
       for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
+        if (channels_last) {
+          this->weight_cpu_gemm_channels_last(
+              bottom_data + n * this->bottom_dim_,
+              top_diff + n * this->top_dim_);
+        } else {
           this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
               top_diff + n * this->top_dim_, weight_diff);
         }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
       }
     }
+    // gradient w.r.t. bottom data, if necessary, image by image in parallel.
+    if (propagate_down[i] && batch_images) {
+      Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+        this->backward_cpu_gemm_batch(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_,
+            std::min(this->gemm_batch_, this->num_ - n));
+      }
+    } else if (propagate_down[i]) {
+      this->for_each_image_cpu(boost::bind(
+          &ConvolutionLayer<Dtype>::backward_image_cpu, this, top_diff,
+          weight, bottom[i]->mutable_cpu_diff(), _1, _2));
+    }
+  }
+  if (channels_last && this->param_propagate_down_[0]) {
+    this->add_channels_last_weight_diff_cpu(weight_diff);
   }
 }
 
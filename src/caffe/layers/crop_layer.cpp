@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <functional>
 #include <map>
@@ -8,6 +10,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/crop_layer.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 
 namespace caffe {
@@ -66,47 +69,70 @@ void CropLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     offsets[i] = crop_offset;
   }
   top[0]->Reshape(new_shape);
+
+  // The axes after the last cropped one are kept whole, so the crop is made
+  // of contiguous rows, one per index of the axes up to that one.
+  copy_axis_ = 0;
+  for (int i = 0; i < input_dim; ++i) {
+    if (new_shape[i] != bottom[0]->shape(i)) {
+      copy_axis_ = i;
+    }
+  }
+  row_size_ = top[0]->count(copy_axis_);
+  row_shape_.assign(new_shape.begin(), new_shape.begin() + copy_axis_);
+  row_strides_.resize(copy_axis_);
+  for (int i = 0; i < copy_axis_; ++i) {
+    row_strides_[i] = bottom[0]->count(i + 1);
+  }
+  crop_offset_ = bottom[0]->offset(offsets);
+  is_view_ = top[0]->count(0, copy_axis_) == 1;
+  if (is_view_ || top_is_view_) {
+    // A view aliases the bottom through memory of exactly the crop's size,
+    // so syncs between devices stay within the bottom. Copies need memory of
+    // their own again, so as not to write into the bottom.
+    Blob<Dtype> top_data(new_shape);
+    top[0]->ShareData(top_data);
+    top_is_view_ = false;
+  }
 }
 
+// Values worth a parallel chunk of rows.
+static const int kCropChunkWork = 1 << 15;
+
 template <typename Dtype>
-void CropLayer<Dtype>::crop_copy(const vector<Blob<Dtype>*>& bottom,
-             const vector<Blob<Dtype>*>& top,
-             const vector<int>& offsets,
-             vector<int> indices,
-             int cur_dim,
-             const Dtype* src_data,
-             Dtype* dest_data,
-             bool is_forward) {
-  if (cur_dim + 1 < top[0]->num_axes()) {
-    // We are not yet at the final dimension, call copy recursively
-    for (int i = 0; i < top[0]->shape(cur_dim); ++i) {
-      indices[cur_dim] = i;
-      crop_copy(bottom, top, offsets, indices, cur_dim+1,
-                src_data, dest_data, is_forward);
+int CropLayer<Dtype>::row_grain() const {
+  return std::max(1, kCropChunkWork / std::max(1, row_size_));
+}
+
+template <typename Dtype>
+void CropLayer<Dtype>::crop_copy_rows(const Dtype* src_data, Dtype* dest_data,
+    bool is_forward, int begin, int end) {
+  // Find the bottom index of the first row once, then step it from row to
+  // row like an odometer.
+  const int num_axes = row_shape_.size();
+  vector<int> indices(num_axes);
+  int bottom_offset = crop_offset_;
+  for (int i = num_axes - 1, row = begin; i >= 0; --i) {
+    indices[i] = row % row_shape_[i];
+    row /= row_shape_[i];
+    bottom_offset += indices[i] * row_strides_[i];
+  }
+  for (int row = begin; row < end; ++row) {
+    const int top_offset = row * row_size_;
+    if (is_forward) {
+      caffe_copy(row_size_, src_data + bottom_offset, dest_data + top_offset);
+    } else {
+      // in the backwards pass the src_data is top_diff
+      // and the dest_data is bottom_diff
+      caffe_copy(row_size_, src_data + top_offset, dest_data + bottom_offset);
     }
-  } else {
-    // We are at the last dimensions, which is stored continously in memory
-    for (int i = 0; i < top[0]->shape(cur_dim); ++i) {
-      // prepare index vector reduced(red) and with offsets(off)
-      std::vector<int> ind_red(cur_dim, 0);
-      std::vector<int> ind_off(cur_dim+1, 0);
-      for (int j = 0; j < cur_dim; ++j) {
-          ind_red[j] = indices[j];
-          ind_off[j] = indices[j] + offsets[j];
-      }
-      ind_off[cur_dim] = offsets[cur_dim];
-      // do the copy
-      if (is_forward) {
-        caffe_copy(top[0]->shape(cur_dim),
-            src_data + bottom[0]->offset(ind_off),
-            dest_data + top[0]->offset(ind_red));
-      } else {
-        // in the backwards pass the src_data is top_diff
-        // and the dest_data is bottom_diff
-        caffe_copy(top[0]->shape(cur_dim),
-            src_data + top[0]->offset(ind_red),
-            dest_data + bottom[0]->offset(ind_off));
+    for (int i = num_axes - 1; i >= 0; --i) {
+      bottom_offset += row_strides_[i];
+      if (++indices[i] < row_shape_[i]) {
+        break;
       }
+      bottom_offset -= row_shape_[i] * row_strides_[i];
+      indices[i] = 0;
     }
   }
 }
@@ -114,10 +140,17 @@ void CropLayer<Dtype>::crop_copy(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  std::vector<int> indices(top[0]->num_axes(), 0);
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  crop_copy(bottom, top, offsets, indices, 0, bottom_data, top_data, true);
+  if (is_view_) {
+    // Like FlattenLayer, the top shares the bottom data: layers computing
+    // in place on the top write through to the bottom, which is therefore
+    // taken as mutable.
+    top[0]->set_cpu_data(bottom[0]->mutable_cpu_data() + crop_offset_);
+    top_is_view_ = true;
+    return;
+  }
+  parallel_for(0, top[0]->count(0, copy_axis_), boost::bind(
+      &CropLayer<Dtype>::crop_copy_rows, this, bottom[0]->cpu_data(),
+      top[0]->mutable_cpu_data(), true, _1, _2), row_grain());
 }
 
 template <typename Dtype>
@@ -128,8 +161,13 @@ void CropLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 
   if (propagate_down[0]) {
     caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
-    std::vector<int> indices(top[0]->num_axes(), 0);
-    crop_copy(bottom, top, offsets, indices, 0, top_diff, bottom_diff, false);
+    if (is_view_) {
+      caffe_copy(top[0]->count(), top_diff, bottom_diff + crop_offset_);
+      return;
+    }
+    parallel_for(0, top[0]->count(0, copy_axis_), boost::bind(
+        &CropLayer<Dtype>::crop_copy_rows, this, top_diff, bottom_diff,
+        false, _1, _2), row_grain());
   }
 }
 
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/layers/deconv_layer.hpp"
@@ -21,21 +23,37 @@ void DeconvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void DeconvolutionLayer<Dtype>::forward_image_cpu(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int n,
+    Dtype* col_buff) {
+  bottom_data += n * this->bottom_dim_;
+  top_data += n * this->top_dim_;
+  this->backward_cpu_gemm(bottom_data, weight, top_data, col_buff);
+  if (bias) {
+    this->forward_cpu_bias(top_data, bias);
+  }
+}
+
+template <typename Dtype>
+void DeconvolutionLayer<Dtype>::backward_image_cpu(const Dtype* top_diff,
+    const Dtype* weight, Dtype* bottom_diff, int n, Dtype* col_buff) {
+  top_diff += n * this->top_dim_;
+  bottom_diff += n * this->bottom_dim_;
+  this->forward_cpu_gemm(top_diff, weight, bottom_diff, false, col_buff);
+}
+
 template <typename Dtype>
 void DeconvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->backward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
-    }
+    // Images are independent, so they may run in parallel.
+    this->for_each_image_cpu(boost::bind(
+        &DeconvolutionLayer<Dtype>::forward_image_cpu, this,
+        bottom[i]->cpu_data(), weight, bias, top[i]->mutable_cpu_data(),
+        _1, _2));
   }
 }
 
@@ -44,6 +62,9 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  // In parallel, the bottom gradient gets a pass of its own rather than
+  // reusing the column buffer of the weight gradient.
+  const bool parallel = this->parallel_blocks_cpu() > 1;
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -55,7 +76,7 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
+    if (this->param_propagate_down_[0] || (propagate_down[i] && !parallel)) {
       for (int n = 0; n < this->num_; ++n) {
         // Gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
@@ -64,13 +85,18 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         }
         // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
         // we might have just computed above.
-        if (propagate_down[i]) {
+        if (propagate_down[i] && !parallel) {
           this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
               bottom_diff + n * this->bottom_dim_,
               this->param_propagate_down_[0]);
         }
       }
     }
+    if (propagate_down[i] && parallel) {
+      this->for_each_image_cpu(boost::bind(
+          &DeconvolutionLayer<Dtype>::backward_image_cpu, this, top_diff,
+          weight, bottom_diff, _1, _2));
+    }
   }
 }
 
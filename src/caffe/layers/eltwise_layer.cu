@@ -9,7 +9,7 @@ namespace caffe {
 template <typename Dtype>
 __global__ void MaxForward(const int nthreads, const Dtype* bottom_data_a,
     const Dtype* bottom_data_b, const int blob_idx, Dtype* top_data,
-    int* mask) {
+    uint8_t* mask) {
   CUDA_KERNEL_LOOP(index, nthreads) {
     Dtype maxval = -FLT_MAX;
     int maxidx = -1;
@@ -33,7 +33,7 @@ __global__ void MaxForward(const int nthreads, const Dtype* bottom_data_a,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  int* mask = NULL;
+  uint8_t* mask = NULL;
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_gpu_data();
   switch (op_) {
@@ -52,7 +52,7 @@ void EltwiseLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     }
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    mask = max_idx_.mutable_gpu_data();
+    mask = static_cast<uint8_t*>(max_idx_->mutable_gpu_data());
     // NOLINT_NEXT_LINE(whitespace/operators)
     MaxForward<Dtype> <<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
         count, bottom[0]->gpu_data(), bottom[1]->gpu_data(), 0, top_data, mask);
@@ -69,7 +69,7 @@ void EltwiseLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 __global__ void MaxBackward(const int nthreads, const Dtype* top_diff,
-    const int blob_idx, const int* mask, Dtype* bottom_diff) {
+    const int blob_idx, const uint8_t* mask, Dtype* bottom_diff) {
   CUDA_KERNEL_LOOP(index, nthreads) {
     Dtype gradient = 0;
     if (mask[index] == blob_idx) {
@@ -82,7 +82,7 @@ __global__ void MaxBackward(const int nthreads, const Dtype* top_diff,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const int* mask = NULL;
+  const uint8_t* mask = NULL;
   const int count = top[0]->count();
   const Dtype* top_data = top[0]->gpu_data();
   const Dtype* top_diff = top[0]->gpu_diff();
@@ -117,7 +117,7 @@ void EltwiseLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
         }
         break;
       case EltwiseParameter_EltwiseOp_MAX:
-        mask = max_idx_.gpu_data();
+        mask = static_cast<const uint8_t*>(max_idx_->gpu_data());
         MaxBackward<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
             <<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
             count, top_diff, i, mask, bottom_diff);
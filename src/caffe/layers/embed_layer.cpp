@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -14,6 +15,7 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   K_ = this->layer_param_.embed_param().input_dim();
   CHECK_GT(K_, 0) << "EmbedLayer input_dim must be positive.";
   bias_term_ = this->layer_param_.embed_param().bias_term();
+  sparse_gradient_ = this->layer_param_.embed_param().sparse_gradient();
   // Check if we need to set up the weights
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
@@ -57,7 +59,9 @@ void EmbedLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bias_term_) {
     vector<int> bias_shape(1, M_);
     bias_multiplier_.Reshape(bias_shape);
-    caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    if (M_ > 0 && bias_multiplier_.cpu_data()[M_ - 1] != Dtype(1)) {
+      caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    }
   }
 }
 
@@ -99,6 +103,14 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n])
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
+      if (sparse_gradient_) {
+        weight_diff_rows_.push_back(index);
+      }
+    }
+    if (sparse_gradient_) {
+      std::sort(weight_diff_rows_.begin(), weight_diff_rows_.end());
+      weight_diff_rows_.erase(std::unique(weight_diff_rows_.begin(),
+          weight_diff_rows_.end()), weight_diff_rows_.end());
     }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "hdf5.h"
@@ -12,15 +14,32 @@ template <typename Dtype>
 void HDF5OutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   file_name_ = this->layer_param_.hdf5_output_param().file_name();
-  file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-                       H5P_DEFAULT);
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                         H5P_DEFAULT);
+  }
   CHECK_GE(file_id_, 0) << "Failed to open HDF5 file" << file_name_;
   file_opened_ = true;
+  buffer_rows_ = this->layer_param_.hdf5_output_param().buffer_rows();
+  if (buffer_rows_ > 0) {
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      buffers_[i].rows_ = 0;
+      buffer_free_.push(&buffers_[i]);
+    }
+    DLOG(INFO) << "Initializing HDF5 writer thread";
+    StartInternalThread();
+  }
 }
 
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::~HDF5OutputLayer<Dtype>() {
+  if (is_started()) {
+    FlushBuffers();
+    StopInternalThread();
+  }
   if (file_opened_) {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
     herr_t status = H5Fclose(file_id_);
     CHECK_GE(status, 0) << "Failed to close HDF5 file " << file_name_;
   }
@@ -32,15 +51,100 @@ void HDF5OutputLayer<Dtype>::SaveBlobs() {
   LOG(INFO) << "Saving HDF5 file " << file_name_;
   CHECK_EQ(data_blob_.num(), label_blob_.num()) <<
       "data blob and label blob must have the same batch size";
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, data_blob_);
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, label_blob_);
   LOG(INFO) << "Successfully saved " << data_blob_.num() << " rows";
 }
 
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::BufferBatch(const Dtype* data,
+    const Dtype* label, const vector<Blob<Dtype>*>& bottom) {
+  const int num = bottom[0]->shape(0);
+  CHECK_EQ(num, bottom[1]->shape(0)) <<
+      "data blob and label blob must have the same batch size";
+  const int data_dim = bottom[0]->count(1);
+  const int label_dim = bottom[1]->count(1);
+  int offset = 0;
+  while (offset < num) {
+    if (current_buffer_ == NULL) {
+      current_buffer_ = buffer_free_.pop("Waiting for HDF5 writer");
+      vector<int> shape = bottom[0]->shape();
+      shape[0] = buffer_rows_;
+      current_buffer_->data_.Reshape(shape);
+      shape = bottom[1]->shape();
+      shape[0] = buffer_rows_;
+      current_buffer_->label_.Reshape(shape);
+      current_buffer_->rows_ = 0;
+    }
+    HDF5OutputBuffer<Dtype>* buffer = current_buffer_;
+    CHECK_EQ(data_dim, buffer->data_.count(1))
+        << "data shape changed between forward passes";
+    CHECK_EQ(label_dim, buffer->label_.count(1))
+        << "label shape changed between forward passes";
+    const int rows = std::min(num - offset, buffer_rows_ - buffer->rows_);
+    caffe_copy(rows * data_dim, data + offset * data_dim,
+        buffer->data_.mutable_cpu_data() + buffer->rows_ * data_dim);
+    caffe_copy(rows * label_dim, label + offset * label_dim,
+        buffer->label_.mutable_cpu_data() + buffer->rows_ * label_dim);
+    buffer->rows_ += rows;
+    offset += rows;
+    if (buffer->rows_ == buffer_rows_) {
+      buffer_full_.push(buffer);
+      current_buffer_ = NULL;
+    }
+  }
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::FlushBuffers() {
+  if (current_buffer_ != NULL) {
+    if (current_buffer_->rows_ > 0) {
+      buffer_full_.push(current_buffer_);
+    } else {
+      buffer_free_.push(current_buffer_);
+    }
+    current_buffer_ = NULL;
+  }
+  // The writer returns each buffer once its rows are on disk.
+  vector<HDF5OutputBuffer<Dtype>*> buffers;
+  for (int i = 0; i < BUFFER_COUNT; ++i) {
+    buffers.push_back(buffer_free_.pop("Flushing HDF5 output"));
+  }
+  for (int i = 0; i < BUFFER_COUNT; ++i) {
+    buffer_free_.push(buffers[i]);
+  }
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      HDF5OutputBuffer<Dtype>* buffer = buffer_full_.pop();
+      {
+        boost::mutex::scoped_lock lock(hdf5_mutex());
+        hdf5_append_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME,
+            buffer->data_, buffer->rows_, buffer_rows_);
+        hdf5_append_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME,
+            buffer->label_, buffer->rows_, buffer_rows_);
+      }
+      DLOG(INFO) << "Appended " << buffer->rows_ << " rows to " << file_name_;
+      buffer->rows_ = 0;
+      buffer_free_.push(buffer);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 void HDF5OutputLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom.size(), 2);
+  if (buffer_rows_ > 0) {
+    BufferBatch(bottom[0]->cpu_data(), bottom[1]->cpu_data(), bottom);
+    return;
+  }
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
   data_blob_.Reshape(bottom[0]->num(), bottom[0]->channels(),
                      bottom[0]->height(), bottom[0]->width());
@@ -11,6 +11,10 @@ template <typename Dtype>
 void HDF5OutputLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom.size(), 2);
+  if (buffer_rows_ > 0) {
+    BufferBatch(bottom[0]->gpu_data(), bottom[1]->gpu_data(), bottom);
+    return;
+  }
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
   data_blob_.Reshape(bottom[0]->num(), bottom[0]->channels(),
                      bottom[0]->height(), bottom[0]->width());
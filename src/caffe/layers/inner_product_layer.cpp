@@ -76,7 +76,9 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bias_term_) {
     vector<int> bias_shape(1, M_);
     bias_multiplier_.Reshape(bias_shape);
-    caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    if (M_ > 0 && bias_multiplier_.cpu_data()[M_ - 1] != Dtype(1)) {
+      caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    }
   }
 }
 
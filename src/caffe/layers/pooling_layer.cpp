@@ -1,9 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -85,6 +88,8 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   channels_ = bottom[0]->channels();
   height_ = bottom[0]->height();
   width_ = bottom[0]->width();
+  // Clips are pooled frame by frame.
+  length_ = bottom[0]->length();
   if (global_pooling_) {
     kernel_h_ = bottom[0]->height();
     kernel_w_ = bottom[0]->width();
@@ -105,7 +110,7 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
-  top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
+  top[0]->Reshape(bottom[0]->num(), channels_, length_, pooled_height_,
       pooled_width_);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
@@ -113,14 +118,12 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   // If max pooling, we will initialize the vector index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
-    max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-        pooled_width_);
+    max_idx_.Reshape(top[0]->shape());
   }
   // If stochastic pooling, we will initialize the random index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_STOCHASTIC) {
-    rand_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-      pooled_width_);
+    rand_idx_.ReshapeLike(*top[0]);
   }
 }
 
@@ -129,6 +132,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (this->layout_ == CHANNELS_LAST) {
+    ForwardChannelsLast_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int top_count = top[0]->count();
@@ -150,75 +157,15 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     }
     caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
-    }
+    parallel_for(0, bottom[0]->num() * channels_ * length_, boost::bind(
+        &PoolingLayer<Dtype>::ForwardMaxPlanes_cpu, this, bottom_data,
+        top_data, mask, top_mask, _1, _2), plane_grain());
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    parallel_for(0, bottom[0]->num() * channels_ * length_, boost::bind(
+        &PoolingLayer<Dtype>::ForwardAvePlanes_cpu, this, bottom_data,
+        top_data, _1, _2), plane_grain());
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -234,6 +181,10 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
+  if (this->layout_ == CHANNELS_LAST) {
+    BackwardChannelsLast_cpu(top, bottom);
+    return;
+  }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   // Different pooling methods. We explicitly do the switch outside the for
@@ -251,63 +202,315 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     } else {
       mask = max_idx_.cpu_data();
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
+    parallel_for(0, top[0]->num() * channels_ * length_, boost::bind(
+        &PoolingLayer<Dtype>::BackwardMaxPlanes_cpu, this, top_diff, mask,
+        top_mask, bottom_diff, _1, _2), plane_grain());
+    break;
+  case PoolingParameter_PoolMethod_AVE:
+    // The main loop
+    parallel_for(0, top[0]->num() * channels_ * length_, boost::bind(
+        &PoolingLayer<Dtype>::BackwardAvePlanes_cpu, this, top_diff,
+        bottom_diff, _1, _2), plane_grain());
+    break;
+  case PoolingParameter_PoolMethod_STOCHASTIC:
+    NOT_IMPLEMENTED;
+    break;
+  default:
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+}
+
+// Multiply-adds worth a parallel chunk of planes.
+static const int kPoolingChunkWork = 1 << 14;
+
+template <typename Dtype>
+int PoolingLayer<Dtype>::plane_grain() const {
+  return std::max(1, kPoolingChunkWork /
+      std::max(1, pooled_height_ * pooled_width_ * kernel_h_ * kernel_w_));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardMaxPlanes_cpu(const Dtype* bottom_data,
+    Dtype* top_data, int* mask, Dtype* top_mask, int begin, int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  bottom_data += begin * bottom_plane;
+  top_data += begin * top_plane;
+  if (top_mask) {
+    top_mask += begin * top_plane;
+  } else {
+    mask += begin * top_plane;
+  }
+  for (int plane = begin; plane < end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_);
+        int wend = min(wstart + kernel_w_, width_);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        const int pool_index = ph * pooled_width_ + pw;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            if (bottom_data[index] > top_data[pool_index]) {
+              top_data[pool_index] = bottom_data[index];
+              if (top_mask) {
+                top_mask[pool_index] = static_cast<Dtype>(index);
+              } else {
+                mask[pool_index] = index;
+              }
+            }
           }
         }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
+      }
+    }
+    // compute offset
+    bottom_data += bottom_plane;
+    top_data += top_plane;
+    if (top_mask) {
+      top_mask += top_plane;
+    } else {
+      mask += top_plane;
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardAvePlanes_cpu(const Dtype* bottom_data,
+    Dtype* top_data, int begin, int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  bottom_data += begin * bottom_plane;
+  top_data += begin * top_plane;
+  for (int plane = begin; plane < end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        Dtype sum = 0;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            sum += bottom_data[h * width_ + w];
+          }
         }
+        top_data[ph * pooled_width_ + pw] = sum / pool_size;
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
+    // compute offset
+    bottom_data += bottom_plane;
+    top_data += top_plane;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardMaxPlanes_cpu(const Dtype* top_diff,
+    const int* mask, const Dtype* top_mask, Dtype* bottom_diff, int begin,
+    int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  top_diff += begin * top_plane;
+  bottom_diff += begin * bottom_plane;
+  if (top_mask) {
+    top_mask += begin * top_plane;
+  } else {
+    mask += begin * top_plane;
+  }
+  for (int plane = begin; plane < end; ++plane) {
+    for (int index = 0; index < top_plane; ++index) {
+      const int bottom_index = top_mask ? top_mask[index] : mask[index];
+      bottom_diff[bottom_index] += top_diff[index];
+    }
+    bottom_diff += bottom_plane;
+    top_diff += top_plane;
+    if (top_mask) {
+      top_mask += top_plane;
+    } else {
+      mask += top_plane;
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardAvePlanes_cpu(const Dtype* top_diff,
+    Dtype* bottom_diff, int begin, int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  top_diff += begin * top_plane;
+  bottom_diff += begin * bottom_plane;
+  for (int plane = begin; plane < end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            bottom_diff[h * width_ + w] +=
+              top_diff[ph * pooled_width_ + pw] / pool_size;
+          }
+        }
+      }
+    }
+    // offset
+    bottom_diff += bottom_plane;
+    top_diff += top_plane;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardChannelsLast_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int top_count = top[0]->count();
+  const bool use_top_mask = top.size() > 1;
+  const bool is_max = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  int* mask = NULL;
+  Dtype* top_mask = NULL;
+  if (is_max) {
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_cpu_data();
+      caffe_set(top_count, Dtype(-1), top_mask);
+    } else {
+      mask = max_idx_.mutable_cpu_data();
+      caffe_set(top_count, -1, mask);
+    }
+    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
+  } else {
+    caffe_set(top_count, Dtype(0), top_data);
+  }
+  const int frames = bottom[0]->num() * length_;
+  const int bottom_frame = height_ * width_ * channels_;
+  const int top_frame = pooled_height_ * pooled_width_ * channels_;
+  for (int frame = 0; frame < frames; ++frame) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        const int pool_index = (ph * pooled_width_ + pw) * channels_;
+        Dtype* top_row = top_data + pool_index;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            const Dtype* bottom_row = bottom_data + index * channels_;
+            if (!is_max) {
+              caffe_add(channels_, top_row, bottom_row, top_row);
+            } else if (!use_top_mask) {
+              caffe_cpu_max_update(channels_, bottom_row, index, top_row,
+                  mask + pool_index);
+            } else {
+              for (int c = 0; c < channels_; ++c) {
+                if (bottom_row[c] > top_row[c]) {
+                  top_row[c] = bottom_row[c];
+                  top_mask[pool_index + c] = static_cast<Dtype>(index);
+                }
               }
             }
           }
         }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
+        if (!is_max) {
+          for (int c = 0; c < channels_; ++c) {
+            top_row[c] /= pool_size;
+          }
+        }
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
+    bottom_data += bottom_frame;
+    top_data += top_frame;
+    if (use_top_mask) {
+      top_mask += top_frame;
+    } else if (is_max) {
+      mask += top_frame;
+    }
   }
 }
 
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardChannelsLast_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const bool use_top_mask = top.size() > 1;
+  const bool is_max = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const int* mask = NULL;
+  const Dtype* top_mask = NULL;
+  if (is_max) {
+    if (use_top_mask) {
+      top_mask = top[1]->cpu_data();
+    } else {
+      mask = max_idx_.cpu_data();
+    }
+  }
+  const int frames = top[0]->num() * length_;
+  const int bottom_frame = height_ * width_ * channels_;
+  const int top_frame = pooled_height_ * pooled_width_ * channels_;
+  for (int frame = 0; frame < frames; ++frame) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        const int pool_index = (ph * pooled_width_ + pw) * channels_;
+        const Dtype* top_row = top_diff + pool_index;
+        if (is_max) {
+          for (int c = 0; c < channels_; ++c) {
+            const int bottom_index = use_top_mask ?
+                static_cast<int>(top_mask[pool_index + c]) :
+                mask[pool_index + c];
+            bottom_diff[bottom_index * channels_ + c] += top_row[c];
+          }
+          continue;
+        }
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            Dtype* bottom_row = bottom_diff + (h * width_ + w) * channels_;
+            for (int c = 0; c < channels_; ++c) {
+              bottom_row[c] += top_row[c] / pool_size;
+            }
+          }
+        }
+      }
+    }
+    bottom_diff += bottom_frame;
+    top_diff += top_frame;
+    if (use_top_mask) {
+      top_mask += top_frame;
+    } else if (is_max) {
+      mask += top_frame;
+    }
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +7,7 @@
 
 #include "caffe/layers/neuron_layer.hpp"
 #include "caffe/layers/prelu_layer.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -61,6 +64,51 @@ void PReLULayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     // For in-place computation
     bottom_memory_.ReshapeLike(*bottom[0]);
   }
+  channels_ = bottom[0]->channels();
+  dim_ = bottom[0]->count(2);
+}
+
+// Values worth a parallel chunk of runs.
+static const int kPReLUChunkWork = 1 << 14;
+
+template <typename Dtype>
+void PReLULayer<Dtype>::forward_runs_cpu(const Dtype* bottom_data,
+    const Dtype* slope_data, Dtype* top_data, int begin, int end) {
+  for (int run = begin; run < end; ++run) {
+    const int c = channel_shared_ ? 0 : run % channels_;
+    caffe_cpu_relu(dim_, bottom_data + run * dim_, slope_data[c],
+        top_data + run * dim_);
+  }
+}
+
+template <typename Dtype>
+void PReLULayer<Dtype>::backward_runs_cpu(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* slope_data, Dtype* bottom_diff,
+    int begin, int end) {
+  for (int run = begin; run < end; ++run) {
+    const int c = channel_shared_ ? 0 : run % channels_;
+    caffe_cpu_relu_backward(dim_, top_diff + run * dim_,
+        bottom_data + run * dim_, slope_data[c], bottom_diff + run * dim_);
+  }
+}
+
+template <typename Dtype>
+void PReLULayer<Dtype>::slope_diff_cpu(const Dtype* top_diff,
+    const Dtype* bottom_data, Dtype* slope_diff, int num_runs, int begin,
+    int end) {
+  // A shared slope takes every run, in order; otherwise the runs of channel
+  // c are c, c + channels_, ...
+  const int run_step = channel_shared_ ? 1 : channels_;
+  for (int c = begin; c < end; ++c) {
+    for (int run = c; run < num_runs; run += run_step) {
+      const Dtype* top_diff_run = top_diff + run * dim_;
+      const Dtype* bottom_data_run = bottom_data + run * dim_;
+      for (int i = 0; i < dim_; ++i) {
+        slope_diff[c] += top_diff_run[i] * bottom_data_run[i]
+            * (bottom_data_run[i] <= 0);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
@@ -69,8 +117,6 @@ void PReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  const int dim = bottom[0]->count(2);
-  const int channels = bottom[0]->channels();
   const Dtype* slope_data = this->blobs_[0]->cpu_data();
 
   // For in-place computation
@@ -78,14 +124,9 @@ void PReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     caffe_copy(count, bottom_data, bottom_memory_.mutable_cpu_data());
   }
 
-  // if channel_shared, channel index in the following computation becomes
-  // always zero.
-  const int div_factor = channel_shared_ ? channels : 1;
-  for (int i = 0; i < count; ++i) {
-    int c = (i / dim) % channels / div_factor;
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + slope_data[c] * std::min(bottom_data[i], Dtype(0));
-  }
+  parallel_for(0, count / std::max(1, dim_), boost::bind(
+      &PReLULayer<Dtype>::forward_runs_cpu, this, bottom_data, slope_data,
+      top_data, _1, _2), std::max(1, kPReLUChunkWork / std::max(1, dim_)));
 }
 
 template <typename Dtype>
@@ -95,38 +136,34 @@ void PReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* slope_data = this->blobs_[0]->cpu_data();
   const Dtype* top_diff = top[0]->cpu_diff();
-  const int count = bottom[0]->count();
-  const int dim = bottom[0]->count(2);
-  const int channels = bottom[0]->channels();
+  const int num_runs = bottom[0]->count() / std::max(1, dim_);
 
   // For in-place computation
   if (top[0] == bottom[0]) {
     bottom_data = bottom_memory_.cpu_data();
   }
 
-  // if channel_shared, channel index in the following computation becomes
-  // always zero.
-  const int div_factor = channel_shared_ ? channels : 1;
-
   // Propagte to param
   // Since to write bottom diff will affect top diff if top and bottom blobs
   // are identical (in-place computaion), we first compute param backward to
   // keep top_diff unchanged.
   if (this->param_propagate_down_[0]) {
     Dtype* slope_diff = this->blobs_[0]->mutable_cpu_diff();
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      slope_diff[c] += top_diff[i] * bottom_data[i] * (bottom_data[i] <= 0);
-    }
+    // Each channel sums its own runs, so the channels run in parallel.
+    const int num_slopes = this->blobs_[0]->count();
+    const int slope_work = std::max(1, bottom[0]->count() / num_slopes);
+    parallel_for(0, num_slopes, boost::bind(
+        &PReLULayer<Dtype>::slope_diff_cpu, this, top_diff, bottom_data,
+        slope_diff, num_runs, _1, _2),
+        std::max(1, kPReLUChunkWork / slope_work));
   }
   // Propagate to bottom
   if (propagate_down[0]) {
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + slope_data[c] * (bottom_data[i] <= 0));
-    }
+    parallel_for(0, num_runs, boost::bind(
+        &PReLULayer<Dtype>::backward_runs_cpu, this, top_diff, bottom_data,
+        slope_data, bottom_diff, _1, _2),
+        std::max(1, kPReLUChunkWork / std::max(1, dim_)));
   }
 }
 
@@ -0,0 +1,132 @@
+#ifdef WITH_PYTHON_LAYER
+// Make sure we include Python.h before any system header
+// to avoid _POSIX_C_SOURCE redefinition
+#include <boost/python.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/layers/python_data_layer.hpp"
+#include "caffe/layers/python_layer.hpp"
+
+namespace caffe {
+
+// Seconds the prefetch thread waits for a batch before checking whether it
+// has to stop.
+static const double kBatchWaitSeconds = 0.1;
+
+// Whether the calling thread holds the GIL.
+static bool HoldsGIL() {
+#if PY_VERSION_HEX >= 0x03040000
+  return PyGILState_Check();
+#else
+  PyThreadState* state = PyGILState_GetThisThreadState();
+  return state != NULL && state == _PyThreadState_Current;
+#endif
+}
+
+template <typename Dtype>
+PythonDataLayer<Dtype>::PythonDataLayer(const LayerParameter& param)
+    : BasePrefetchingDataLayer<Dtype>(param) {
+  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+    slot_[i] = -1;
+  }
+}
+
+template <typename Dtype>
+PythonDataLayer<Dtype>::~PythonDataLayer<Dtype>() {
+  // The prefetch thread may be waiting for the GIL, so do not hold it while
+  // joining the thread.
+  PyThreadState* state = HoldsGIL() ? PyEval_SaveThread() : NULL;
+  this->StopInternalThread();
+  if (state) {
+    PyEval_RestoreThread(state);
+  }
+  ScopedGILAcquire gil;
+  if (prefetcher_) {
+    try {
+      prefetcher_->attr("close")();
+    } catch (bp::error_already_set) {
+      PyErr_Print();
+    }
+    prefetcher_.reset();
+  }
+}
+
+template <typename Dtype>
+void PythonDataLayer<Dtype>::DataLayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const PythonParameter& param = this->layer_param_.python_param();
+  CHECK_GT(param.num_workers(), 0) << "PythonData needs at least one worker";
+  // Every prefetch batch holds a slot; each worker may fill one more slot
+  // and have another queued.
+  const int num_slots = this->PREFETCH_COUNT + 2 * param.num_workers();
+  InitPython();
+  ScopedGILAcquire gil;
+  try {
+    bp::object prefetch = bp::import("caffe.prefetch");
+    prefetcher_.reset(new bp::object(prefetch.attr("BatchPrefetcher")(
+        param.module(), param.layer(), param.param_str(),
+        param.num_workers(), num_slots,
+        sizeof(Dtype) == sizeof(float) ? "float32" : "float64")));
+    bp::object shapes = prefetcher_->attr("shapes");
+    CHECK_EQ(bp::len(shapes), top.size())
+        << "top_shapes() must give one shape per top blob";
+    for (int i = 0; i < top.size(); ++i) {
+      vector<int> shape(bp::len(shapes[i]));
+      for (int j = 0; j < shape.size(); ++j) {
+        shape[j] = bp::extract<int>(shapes[i][j]);
+      }
+      top[i]->Reshape(shape);
+      for (int k = 0; k < this->PREFETCH_COUNT; ++k) {
+        (i == 0 ? this->prefetch_[k].data_ : this->prefetch_[k].label_)
+            .Reshape(shape);
+      }
+      LOG(INFO) << "output " << (i == 0 ? "data" : "label") << " size: "
+                << top[i]->shape_string();
+    }
+  } catch (bp::error_already_set) {
+    PyErr_Print();
+    throw;
+  }
+}
+
+// This function is called on the prefetch thread
+template <typename Dtype>
+void PythonDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  const int index = batch - this->prefetch_;
+  ScopedGILAcquire gil;
+  try {
+    if (slot_[index] >= 0) {
+      // The batch was copied to the tops, so its slot can be filled again.
+      prefetcher_->attr("release")(slot_[index]);
+      slot_[index] = -1;
+    }
+    bp::object next;
+    // BatchPrefetcher.next waits without the GIL and gives None on timeout.
+    while ((next = prefetcher_->attr("next")(kBatchWaitSeconds)).is_none()) {
+      if (this->must_stop()) {
+        throw boost::thread_interrupted();
+      }
+    }
+    slot_[index] = bp::extract<int>(next[0]);
+    bp::object addresses = next[1];
+    batch->data_.set_cpu_data(reinterpret_cast<Dtype*>(static_cast<uintptr_t>(
+        bp::extract<uint64_t>(addresses[0])())));
+    if (this->output_labels_) {
+      batch->label_.set_cpu_data(reinterpret_cast<Dtype*>(
+          static_cast<uintptr_t>(bp::extract<uint64_t>(addresses[1])())));
+    }
+  } catch (bp::error_already_set) {
+    PyErr_Print();
+    LOG(FATAL) << "PythonData layer " << this->layer_param_.name()
+               << " failed to load a batch";
+  }
+}
+
+INSTANTIATE_CLASS(PythonDataLayer);
+REGISTER_LAYER_CLASS(PythonData);
+
+}  // namespace caffe
+#endif  // WITH_PYTHON_LAYER
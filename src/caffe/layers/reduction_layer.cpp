@@ -1,7 +1,11 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/reduction_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -11,26 +15,105 @@ void ReductionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   op_ = this->layer_param_.reduction_param().operation();
 }
 
+// The offsets of all the positions in a set of axis groups, with the last
+// group varying fastest.
+static vector<int> AxisGroupOffsets(const vector<int>& sizes,
+    const vector<int>& strides) {
+  vector<int> offsets(1, 0);
+  for (int g = 0; g < sizes.size(); ++g) {
+    vector<int> expanded;
+    expanded.reserve(offsets.size() * sizes[g]);
+    for (int i = 0; i < offsets.size(); ++i) {
+      for (int j = 0; j < sizes[g]; ++j) {
+        expanded.push_back(offsets[i] + j * strides[g]);
+      }
+    }
+    offsets.swap(expanded);
+  }
+  return offsets;
+}
+
 template <typename Dtype>
 void ReductionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  axis_ = bottom[0]->CanonicalAxisIndex(
-      this->layer_param_.reduction_param().axis());
-  // In the output, we'll keep all axes up to the reduction axis, but
-  // throw away any after that.
-  // Note: currently reducing along non-tail axes is not supported; otherwise,
-  // we'd need to also copy any axes following an "end_axis".
-  vector<int> top_shape(bottom[0]->shape().begin(),
-                        bottom[0]->shape().begin() + axis_);
+  const ReductionParameter& reduction_param =
+      this->layer_param_.reduction_param();
+  const int num_axes = bottom[0]->num_axes();
+  vector<bool> reduced(num_axes, false);
+  if (reduction_param.reduce_axis_size() > 0) {
+    for (int i = 0; i < reduction_param.reduce_axis_size(); ++i) {
+      const int axis =
+          bottom[0]->CanonicalAxisIndex(reduction_param.reduce_axis(i));
+      CHECK(!reduced[axis]) << "reduce_axis " << axis << " given twice.";
+      reduced[axis] = true;
+    }
+  } else {
+    // In the output, we'll keep all axes up to the reduction axis, but
+    // throw away any after that.
+    axis_ = bottom[0]->CanonicalAxisIndex(reduction_param.axis());
+    std::fill(reduced.begin() + axis_, reduced.end(), true);
+  }
+  // The output keeps the other axes in order. Consecutive kept axes, and
+  // consecutive reduced ones, merge into groups with a single stride; axes
+  // of size 1 take no part.
+  vector<int> top_shape;
+  vector<int> group_sizes, group_strides;
+  vector<bool> group_reduced;
+  dim_ = 1;
+  for (int i = 0; i < num_axes; ++i) {
+    const int size = bottom[0]->shape(i);
+    if (!reduced[i]) {
+      top_shape.push_back(size);
+    } else {
+      dim_ *= size;
+      if (reduction_param.keep_dims()) {
+        top_shape.push_back(1);
+      }
+    }
+    if (size == 1) {
+      continue;
+    }
+    if (!group_sizes.empty() && group_reduced.back() == reduced[i]) {
+      group_sizes.back() *= size;
+    } else {
+      group_sizes.push_back(size);
+      group_strides.push_back(0);
+      group_reduced.push_back(reduced[i]);
+    }
+    group_strides.back() = bottom[0]->count(i + 1);
+  }
   top[0]->Reshape(top_shape);
-  num_ = bottom[0]->count(0, axis_);
-  dim_ = bottom[0]->count(axis_);
-  CHECK_EQ(num_, top[0]->count());
+  // The last group is contiguous: the outputs of a row when it is kept, the
+  // inputs of a segment when it is reduced.
+  inner_ = 1;
+  segment_ = 1;
+  if (!group_sizes.empty()) {
+    (group_reduced.back() ? segment_ : inner_) = group_sizes.back();
+    group_sizes.pop_back();
+    group_strides.pop_back();
+    group_reduced.pop_back();
+  }
+  vector<int> kept_sizes, kept_strides, reduced_sizes, reduced_strides;
+  for (int g = 0; g < group_sizes.size(); ++g) {
+    (group_reduced[g] ? reduced_sizes : kept_sizes).push_back(group_sizes[g]);
+    (group_reduced[g] ? reduced_strides : kept_strides).push_back(
+        group_strides[g]);
+  }
+  row_offsets_ = AxisGroupOffsets(kept_sizes, kept_strides);
+  reduce_offsets_ = AxisGroupOffsets(reduced_sizes, reduced_strides);
+  CHECK_EQ(static_cast<int>(row_offsets_.size()) * inner_, top[0]->count());
+  tail_reduction_ = reduced_sizes.empty() &&
+      op_ != ReductionParameter_ReductionOp_MAX;
+  num_ = top[0]->count();
   if (op_ == ReductionParameter_ReductionOp_SUM ||
       op_ == ReductionParameter_ReductionOp_MEAN) {
-    vector<int> sum_mult_shape(1, dim_);
+    // A tail reduction has a single segment of all dim_ inputs.
+    vector<int> sum_mult_shape(1, segment_);
     sum_multiplier_.Reshape(sum_mult_shape);
-    caffe_set(dim_, Dtype(1), sum_multiplier_.mutable_cpu_data());
+    caffe_set(segment_, Dtype(1), sum_multiplier_.mutable_cpu_data());
+  }
+  if (op_ == ReductionParameter_ReductionOp_MAX) {
+    max_idx_.Reshape(top_shape);
   }
   coeff_ = this->layer_param().reduction_param().coeff();
   if (op_ == ReductionParameter_ReductionOp_MEAN) {
@@ -38,38 +121,190 @@ void ReductionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Reduced inputs worth a parallel chunk of rows.
+static const int kReductionChunkWork = 1 << 14;
+
+template <typename Dtype>
+void ReductionLayer<Dtype>::forward_rows_cpu(const Dtype* bottom_data,
+    const Dtype* mult_data, Dtype* top_data, int* max_idx, int begin,
+    int end) {
+  const int num_positions = reduce_offsets_.size();
+  for (int r = begin; r < end; ++r) {
+    const Dtype* row_data = bottom_data + row_offsets_[r];
+    Dtype* y = top_data + r * inner_;
+    if (segment_ == 1) {
+      // Reduce a whole row of outputs per reduced position.
+      const Dtype* x = row_data + reduce_offsets_[0];
+      switch (op_) {
+      case ReductionParameter_ReductionOp_SUM:
+      case ReductionParameter_ReductionOp_MEAN:
+        caffe_copy(inner_, x, y);
+        break;
+      case ReductionParameter_ReductionOp_ASUM:
+        caffe_abs(inner_, x, y);
+        break;
+      case ReductionParameter_ReductionOp_SUMSQ:
+        caffe_sqr(inner_, x, y);
+        break;
+      case ReductionParameter_ReductionOp_MAX:
+        caffe_copy(inner_, x, y);
+        caffe_set(inner_, 0, max_idx + r * inner_);
+        break;
+      default:
+        LOG(FATAL) << "Unknown reduction op: "
+            << ReductionParameter_ReductionOp_Name(op_);
+      }
+      for (int p = 1; p < num_positions; ++p) {
+        x = row_data + reduce_offsets_[p];
+        switch (op_) {
+        case ReductionParameter_ReductionOp_SUM:
+        case ReductionParameter_ReductionOp_MEAN:
+          caffe_add(inner_, y, x, y);
+          break;
+        case ReductionParameter_ReductionOp_ASUM:
+          caffe_cpu_asum_update(inner_, x, y);
+          break;
+        case ReductionParameter_ReductionOp_SUMSQ:
+          caffe_cpu_sumsq_update(inner_, x, y);
+          break;
+        case ReductionParameter_ReductionOp_MAX:
+          caffe_cpu_max_update(inner_, x, p, y, max_idx + r * inner_);
+          break;
+        default:
+          LOG(FATAL) << "Unknown reduction op: "
+              << ReductionParameter_ReductionOp_Name(op_);
+        }
+      }
+    } else {
+      // Reduce contiguous segments into a single output.
+      Dtype result = 0;
+      int max_position = 0;
+      for (int p = 0; p < num_positions; ++p) {
+        const Dtype* x = row_data + reduce_offsets_[p];
+        switch (op_) {
+        case ReductionParameter_ReductionOp_SUM:
+        case ReductionParameter_ReductionOp_MEAN:
+          result += caffe_cpu_dot(segment_, mult_data, x);
+          break;
+        case ReductionParameter_ReductionOp_ASUM:
+          result += caffe_cpu_asum(segment_, x);
+          break;
+        case ReductionParameter_ReductionOp_SUMSQ:
+          result += caffe_cpu_dot(segment_, x, x);
+          break;
+        case ReductionParameter_ReductionOp_MAX:
+          for (int j = 0; j < segment_; ++j) {
+            if ((p == 0 && j == 0) || x[j] > result) {
+              result = x[j];
+              max_position = p * segment_ + j;
+            }
+          }
+          break;
+        default:
+          LOG(FATAL) << "Unknown reduction op: "
+              << ReductionParameter_ReductionOp_Name(op_);
+        }
+      }
+      *y = result;
+      if (max_idx) {
+        max_idx[r] = max_position;
+      }
+    }
+    if (coeff_ != Dtype(1)) {
+      caffe_scal(inner_, coeff_, y);
+    }
+  }
+}
+
 template <typename Dtype>
 void ReductionLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* mult_data = NULL;
   if (sum_multiplier_.count() > 0) {
     mult_data = sum_multiplier_.cpu_data();
   }
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  for (int i = 0; i < num_; ++i) {
-    switch (op_) {
-    case ReductionParameter_ReductionOp_SUM:
-    case ReductionParameter_ReductionOp_MEAN:
-      *top_data = caffe_cpu_dot(dim_, mult_data, bottom_data);
-      break;
-    case ReductionParameter_ReductionOp_ASUM:
-      *top_data = caffe_cpu_asum(dim_, bottom_data);
-      break;
-    case ReductionParameter_ReductionOp_SUMSQ:
-      *top_data = caffe_cpu_dot(dim_, bottom_data, bottom_data);
-      break;
-    default:
-      LOG(FATAL) << "Unknown reduction op: "
-          << ReductionParameter_ReductionOp_Name(op_);
+  int* max_idx = (op_ == ReductionParameter_ReductionOp_MAX) ?
+      max_idx_.mutable_cpu_data() : NULL;
+  // Rows of outputs reduce independently, so they run in parallel.
+  parallel_for(0, row_offsets_.size(), boost::bind(
+      &ReductionLayer<Dtype>::forward_rows_cpu, this, bottom[0]->cpu_data(),
+      mult_data, top[0]->mutable_cpu_data(), max_idx, _1, _2),
+      std::max(1, kReductionChunkWork / std::max(1, dim_ * inner_)));
+}
+
+template <typename Dtype>
+void ReductionLayer<Dtype>::backward_rows_cpu(const Dtype* top_diff,
+    const Dtype* bottom_data, const int* max_idx, Dtype* bottom_diff,
+    int begin, int end) {
+  const int num_positions = reduce_offsets_.size();
+  for (int r = begin; r < end; ++r) {
+    const Dtype* row_top_diff = top_diff + r * inner_;
+    const int row_offset = row_offsets_[r];
+    if (segment_ == 1) {
+      for (int p = 0; p < num_positions; ++p) {
+        const int offset = row_offset + reduce_offsets_[p];
+        Dtype* x_diff = bottom_diff + offset;
+        switch (op_) {
+        case ReductionParameter_ReductionOp_SUM:
+        case ReductionParameter_ReductionOp_MEAN:
+          caffe_cpu_scale(inner_, coeff_, row_top_diff, x_diff);
+          break;
+        case ReductionParameter_ReductionOp_ASUM:
+          caffe_cpu_sign(inner_, bottom_data + offset, x_diff);
+          caffe_mul(inner_, x_diff, row_top_diff, x_diff);
+          caffe_scal(inner_, coeff_, x_diff);
+          break;
+        case ReductionParameter_ReductionOp_SUMSQ:
+          caffe_mul(inner_, row_top_diff, bottom_data + offset, x_diff);
+          caffe_scal(inner_, 2 * coeff_, x_diff);
+          break;
+        case ReductionParameter_ReductionOp_MAX:
+          caffe_set(inner_, Dtype(0), x_diff);
+          break;
+        default:
+          LOG(FATAL) << "Unknown reduction op: "
+              << ReductionParameter_ReductionOp_Name(op_);
+        }
+      }
+      if (max_idx) {
+        const int* row_max_idx = max_idx + r * inner_;
+        for (int i = 0; i < inner_; ++i) {
+          bottom_diff[row_offset + reduce_offsets_[row_max_idx[i]] + i] =
+              row_top_diff[i] * coeff_;
+        }
+      }
+    } else {
+      const Dtype bottom_coeff = (*row_top_diff) * coeff_;
+      for (int p = 0; p < num_positions; ++p) {
+        const int offset = row_offset + reduce_offsets_[p];
+        Dtype* x_diff = bottom_diff + offset;
+        switch (op_) {
+        case ReductionParameter_ReductionOp_SUM:
+        case ReductionParameter_ReductionOp_MEAN:
+          caffe_set(segment_, bottom_coeff, x_diff);
+          break;
+        case ReductionParameter_ReductionOp_ASUM:
+          caffe_cpu_sign(segment_, bottom_data + offset, x_diff);
+          caffe_scal(segment_, bottom_coeff, x_diff);
+          break;
+        case ReductionParameter_ReductionOp_SUMSQ:
+          caffe_cpu_scale(segment_, 2 * bottom_coeff, bottom_data + offset,
+              x_diff);
+          break;
+        case ReductionParameter_ReductionOp_MAX:
+          caffe_set(segment_, Dtype(0), x_diff);
+          break;
+        default:
+          LOG(FATAL) << "Unknown reduction op: "
+              << ReductionParameter_ReductionOp_Name(op_);
+        }
+      }
+      if (max_idx) {
+        const int position = max_idx[r];
+        bottom_diff[row_offset + reduce_offsets_[position / segment_] +
+            position % segment_] = bottom_coeff;
+      }
     }
-    bottom_data += dim_;
-    ++top_data;
-  }
-  if (coeff_ != Dtype(1)) {
-    // Reset the top_data pointer.
-    top_data = top[0]->mutable_cpu_data();
-    caffe_scal(num_, coeff_, top_data);
   }
 }
 
@@ -79,6 +314,7 @@ void ReductionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) { return; }
   // Get bottom_data, if needed.
   const Dtype* bottom_data = NULL;
+  const int* max_idx = NULL;
   switch (op_) {
   // Operations that don't need bottom_data
   case ReductionParameter_ReductionOp_SUM:
@@ -89,34 +325,19 @@ void ReductionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   case ReductionParameter_ReductionOp_SUMSQ:
     bottom_data = bottom[0]->cpu_data();
     break;
+  // Operations that need the positions of the outputs
+  case ReductionParameter_ReductionOp_MAX:
+    max_idx = max_idx_.cpu_data();
+    break;
   default:
     LOG(FATAL) << "Unknown reduction op: "
         << ReductionParameter_ReductionOp_Name(op_);
   }
-  const Dtype* top_diff = top[0]->cpu_diff();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  for (int i = 0; i < num_; ++i) {
-    const Dtype bottom_coeff = (*top_diff) * coeff_;
-    switch (op_) {
-    case ReductionParameter_ReductionOp_SUM:
-    case ReductionParameter_ReductionOp_MEAN:
-      caffe_set(dim_, bottom_coeff, bottom_diff);
-      break;
-    case ReductionParameter_ReductionOp_ASUM:
-      caffe_cpu_sign(dim_, bottom_data, bottom_diff);
-      caffe_scal(dim_, bottom_coeff, bottom_diff);
-      break;
-    case ReductionParameter_ReductionOp_SUMSQ:
-      caffe_cpu_scale(dim_, 2 * bottom_coeff, bottom_data, bottom_diff);
-      break;
-    default:
-      LOG(FATAL) << "Unknown reduction op: "
-          << ReductionParameter_ReductionOp_Name(op_);
-    }
-    bottom_data += dim_;
-    bottom_diff += dim_;
-    ++top_diff;
-  }
+  // Each row writes the diffs of its own inputs.
+  parallel_for(0, row_offsets_.size(), boost::bind(
+      &ReductionLayer<Dtype>::backward_rows_cpu, this, top[0]->cpu_diff(),
+      bottom_data, max_idx, bottom[0]->mutable_cpu_diff(), _1, _2),
+      std::max(1, kReductionChunkWork / std::max(1, dim_ * inner_)));
 }
 
 #ifdef CPU_ONLY
@@ -8,6 +8,10 @@ namespace caffe {
 template <typename Dtype>
 void ReductionLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!tail_reduction_) {
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   const Dtype* mult_data = NULL;
   if (sum_multiplier_.count() > 0) {
@@ -44,6 +48,10 @@ template <typename Dtype>
 void ReductionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
+  if (!tail_reduction_) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
   // Get bottom_data, if needed.
   const Dtype* bottom_data = NULL;
   switch (op_) {
@@ -0,0 +1,62 @@
+#include <vector>
+
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/layout.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "Reorder needs num and channel axes.";
+  top[0]->ReshapeLike(*bottom[0]);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (bottom[0]->layout() == this->layout_) {
+    top[0]->ShareData(*bottom[0]);
+    return;
+  }
+  const int num = bottom[0]->shape(0);
+  const int channels = bottom[0]->shape(1);
+  const int spatial = bottom[0]->count(2);
+  if (this->layout_ == CHANNELS_LAST) {
+    planar_to_channels_last_cpu(num, channels, spatial, bottom[0]->cpu_data(),
+        top[0]->mutable_cpu_data());
+  } else {
+    channels_last_to_planar_cpu(num, channels, spatial, bottom[0]->cpu_data(),
+        top[0]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  if (bottom[0]->layout() == this->layout_) {
+    bottom[0]->ShareDiff(*top[0]);
+    return;
+  }
+  const int num = bottom[0]->shape(0);
+  const int channels = bottom[0]->shape(1);
+  const int spatial = bottom[0]->count(2);
+  if (this->layout_ == CHANNELS_LAST) {
+    channels_last_to_planar_cpu(num, channels, spatial, top[0]->cpu_diff(),
+        bottom[0]->mutable_cpu_diff());
+  } else {
+    planar_to_channels_last_cpu(num, channels, spatial, top[0]->cpu_diff(),
+        bottom[0]->mutable_cpu_diff());
+  }
+}
+
+INSTANTIATE_CLASS(ReorderLayer);
+REGISTER_LAYER_CLASS(Reorder);
+
+}  // namespace caffe
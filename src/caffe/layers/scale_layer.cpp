@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +7,7 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/layers/scale_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -102,6 +105,7 @@ void ScaleLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bias_layer_) {
     bias_bottom_vec_[0] = top[0];
     bias_layer_->Reshape(bias_bottom_vec_, top);
+    CHECK_EQ(scale_dim_, this->blobs_[bias_param_id_]->count());
   }
 }
 
@@ -109,27 +113,58 @@ template <typename Dtype>
 void ScaleLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* scale_data =
+      ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
+  recompute_bottom_ = false;
   if (bottom[0] == top[0]) {
-    // In-place computation; need to store bottom data before overwriting it.
+    // In-place computation; need to store bottom data before overwriting it,
+    // unless Backward may recover it from the top.
     // Note that this is only necessary for Backward; we could skip this if not
     // doing Backward, but Caffe currently provides no way of knowing whether
     // we'll need to do Backward at the time of the Forward call.
-    caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
-               temp_.mutable_cpu_data());
-  }
-  const Dtype* scale_data =
-      ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < outer_dim_; ++n) {
-    for (int d = 0; d < scale_dim_; ++d) {
-      const Dtype factor = scale_data[d];
-      caffe_cpu_scale(inner_dim_, factor, bottom_data, top_data);
-      bottom_data += inner_dim_;
-      top_data += inner_dim_;
+    recompute_bottom_ = this->layer_param_.scale_param().in_place_recompute()
+        && std::count(scale_data, scale_data + scale_dim_, Dtype(0)) == 0;
+    if (!recompute_bottom_) {
+      caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
+                 temp_.mutable_cpu_data());
     }
   }
-  if (bias_layer_) {
-    bias_layer_->Forward(bias_bottom_vec_, top);
+  // The bias is added in the same pass rather than by bias_layer_.
+  const Dtype* bias_data =
+      bias_layer_ ? this->blobs_[bias_param_id_]->cpu_data() : NULL;
+  caffe_cpu_channel_scale_bias(outer_dim_, scale_dim_, inner_dim_,
+      scale_data, bias_data, bottom_data, top[0]->mutable_cpu_data());
+}
+
+// Scale diffs worth a parallel chunk, in products.
+static const int kScaleChunkWork = 1 << 14;
+
+// Avoids the BLAS call overhead for the single products of an elementwise
+// scale.
+template <typename Dtype>
+static inline Dtype dot(const int n, const Dtype* x, const Dtype* y) {
+  return n == 1 ? x[0] * y[0] : caffe_cpu_dot(n, x, y);
+}
+
+template <typename Dtype>
+void ScaleLayer<Dtype>::scale_diff_cpu(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* scale_data, const Dtype* bias_data,
+    Dtype* scale_diff, bool accumulate, int begin, int end) {
+  const Dtype* sum_mult = sum_multiplier_.cpu_data();
+  for (int d = begin; d < end; ++d) {
+    Dtype sum = 0;
+    for (int n = 0; n < outer_dim_; ++n) {
+      const int offset = (n * scale_dim_ + d) * inner_dim_;
+      sum += dot(inner_dim_, top_diff + offset, bottom_data + offset);
+      if (bias_data) {
+        sum -= bias_data[d] * dot(inner_dim_, top_diff + offset, sum_mult);
+      }
+    }
+    if (recompute_bottom_) {
+      // bottom = (top - bias) / scale
+      sum /= scale_data[d];
+    }
+    scale_diff[d] = accumulate ? scale_diff[d] + sum : sum;
   }
 }
 
@@ -144,68 +179,23 @@ void ScaleLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Blob<Dtype>* scale = scale_param ? this->blobs_[0].get() : bottom[1];
   if ((!scale_param && propagate_down[1]) ||
       (scale_param && this->param_propagate_down_[0])) {
-    const Dtype* top_diff = top[0]->cpu_diff();
+    // Each scale diff sums the products of its runs of top diff and bottom
+    // data directly, without materializing the products.
     const bool in_place = (bottom[0] == top[0]);
-    const Dtype* bottom_data = (in_place ? &temp_ : bottom[0])->cpu_data();
-    // Hack: store big eltwise product in bottom[0] diff, except in the special
-    // case where this layer itself does the eltwise product, in which case we
-    // can store it directly in the scale diff, and we're done.
-    // If we're computing in-place (and not doing eltwise computation), this
-    // hack doesn't work and we store the product in temp_.
-    const bool is_eltwise = (bottom[0]->count() == scale->count());
-    Dtype* product = (is_eltwise ? scale->mutable_cpu_diff() :
-        (in_place ? temp_.mutable_cpu_data() : bottom[0]->mutable_cpu_diff()));
-    caffe_mul(top[0]->count(), top_diff, bottom_data, product);
-    if (!is_eltwise) {
-      Dtype* sum_result = NULL;
-      if (inner_dim_ == 1) {
-        sum_result = product;
-      } else if (sum_result_.count() == 1) {
-        const Dtype* sum_mult = sum_multiplier_.cpu_data();
-        Dtype* scale_diff = scale->mutable_cpu_diff();
-        if (scale_param) {
-          Dtype result = caffe_cpu_dot(inner_dim_, product, sum_mult);
-          *scale_diff += result;
-        } else {
-          *scale_diff = caffe_cpu_dot(inner_dim_, product, sum_mult);
-        }
-      } else {
-        const Dtype* sum_mult = sum_multiplier_.cpu_data();
-        sum_result = (outer_dim_ == 1) ?
-            scale->mutable_cpu_diff() : sum_result_.mutable_cpu_data();
-        caffe_cpu_gemv(CblasNoTrans, sum_result_.count(), inner_dim_,
-                       Dtype(1), product, sum_mult, Dtype(0), sum_result);
-      }
-      if (outer_dim_ != 1) {
-        const Dtype* sum_mult = sum_multiplier_.cpu_data();
-        Dtype* scale_diff = scale->mutable_cpu_diff();
-        if (scale_dim_ == 1) {
-          if (scale_param) {
-            Dtype result = caffe_cpu_dot(outer_dim_, sum_mult, sum_result);
-            *scale_diff += result;
-          } else {
-            *scale_diff = caffe_cpu_dot(outer_dim_, sum_mult, sum_result);
-          }
-        } else {
-          caffe_cpu_gemv(CblasTrans, outer_dim_, scale_dim_,
-                         Dtype(1), sum_result, sum_mult, Dtype(scale_param),
-                         scale_diff);
-        }
-      }
-    }
+    const Dtype* bottom_data = !in_place ? bottom[0]->cpu_data() :
+        (recompute_bottom_ ? top[0]->cpu_data() : temp_.cpu_data());
+    const Dtype* bias_data = (recompute_bottom_ && bias_layer_) ?
+        this->blobs_[bias_param_id_]->cpu_data() : NULL;
+    parallel_for(0, scale_dim_, boost::bind(
+        &ScaleLayer<Dtype>::scale_diff_cpu, this, top[0]->cpu_diff(),
+        bottom_data, scale->cpu_data(), bias_data, scale->mutable_cpu_diff(),
+        scale_param, _1, _2),
+        std::max(1, kScaleChunkWork / std::max(1, outer_dim_ * inner_dim_)));
   }
   if (propagate_down[0]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* scale_data = scale->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    for (int n = 0; n < outer_dim_; ++n) {
-      for (int d = 0; d < scale_dim_; ++d) {
-        const Dtype factor = scale_data[d];
-        caffe_cpu_scale(inner_dim_, factor, top_diff, bottom_diff);
-        bottom_diff += inner_dim_;
-        top_diff += inner_dim_;
-      }
-    }
+    caffe_cpu_channel_scale_bias<Dtype>(outer_dim_, scale_dim_, inner_dim_,
+        scale->cpu_data(), NULL, top[0]->cpu_diff(),
+        bottom[0]->mutable_cpu_diff());
   }
 }
 
@@ -1,9 +1,13 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
+#include <utility>
 #include <vector>
 
 #include "caffe/layers/softmax_loss_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -85,17 +89,26 @@ Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
   return std::max(Dtype(1.0), normalizer);
 }
 
+// Label positions worth a parallel chunk of samples.
+static const int kLossChunkWork = 1 << 12;
+
 template <typename Dtype>
-void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
-  const Dtype* label = bottom[1]->cpu_data();
+static std::pair<Dtype, int> add_loss(const std::pair<Dtype, int>& a,
+    const std::pair<Dtype, int>& b) {
+  return std::make_pair(a.first + b.first, a.second + b.second);
+}
+
+static int add_count(const int& a, const int& b) {
+  return a + b;
+}
+
+template <typename Dtype>
+std::pair<Dtype, int> SoftmaxWithLossLayer<Dtype>::sample_loss_cpu(
+    const Dtype* prob_data, const Dtype* label, int begin, int end) {
   int dim = prob_.count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
-  for (int i = 0; i < outer_num_; ++i) {
+  for (int i = begin; i < end; ++i) {
     for (int j = 0; j < inner_num_; j++) {
       const int label_value = static_cast<int>(label[i * inner_num_ + j]);
       if (has_ignore_label_ && label_value == ignore_label_) {
@@ -108,12 +121,47 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
       ++count;
     }
   }
-  top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
+  return std::make_pair(loss, count);
+}
+
+template <typename Dtype>
+void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // The forward pass computes the softmax prob values.
+  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+  const std::pair<Dtype, int> loss = parallel_reduce<std::pair<Dtype, int> >(
+      0, outer_num_, std::make_pair(Dtype(0), 0),
+      boost::bind(&SoftmaxWithLossLayer<Dtype>::sample_loss_cpu, this,
+          prob_.cpu_data(), bottom[1]->cpu_data(), _1, _2),
+      add_loss<Dtype>, std::max(1, kLossChunkWork / inner_num_));
+  top[0]->mutable_cpu_data()[0] = loss.first /
+      get_normalizer(normalization_, loss.second);
   if (top.size() == 2) {
     top[1]->ShareData(prob_);
   }
 }
 
+template <typename Dtype>
+int SoftmaxWithLossLayer<Dtype>::sample_diff_cpu(const Dtype* label,
+    Dtype* bottom_diff, int begin, int end) {
+  int dim = prob_.count() / outer_num_;
+  int count = 0;
+  for (int i = begin; i < end; ++i) {
+    for (int j = 0; j < inner_num_; ++j) {
+      const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        for (int c = 0; c < prob_.shape(softmax_axis_); ++c) {
+          bottom_diff[i * dim + c * inner_num_ + j] = 0;
+        }
+      } else {
+        bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -125,22 +173,10 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const Dtype* prob_data = prob_.cpu_data();
     caffe_copy(prob_.count(), prob_data, bottom_diff);
-    const Dtype* label = bottom[1]->cpu_data();
-    int dim = prob_.count() / outer_num_;
-    int count = 0;
-    for (int i = 0; i < outer_num_; ++i) {
-      for (int j = 0; j < inner_num_; ++j) {
-        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-        if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
-            bottom_diff[i * dim + c * inner_num_ + j] = 0;
-          }
-        } else {
-          bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-          ++count;
-        }
-      }
-    }
+    const int count = parallel_reduce<int>(0, outer_num_, 0,
+        boost::bind(&SoftmaxWithLossLayer<Dtype>::sample_diff_cpu, this,
+            bottom[1]->cpu_data(), bottom_diff, _1, _2),
+        add_count, std::max(1, kLossChunkWork / inner_num_));
     // Scale gradient
     Dtype loss_weight = top[0]->cpu_diff()[0] /
                         get_normalizer(normalization_, count);
@@ -38,14 +38,13 @@ void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
     return;
   }
-  caffe_add(count_, top[0]->cpu_diff(), top[1]->cpu_diff(),
-            bottom[0]->mutable_cpu_diff());
-  // Add remaining top blob diffs.
-  for (int i = 2; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_axpy(count_, Dtype(1.), top_diff, bottom_diff);
+  // Sum all the top diffs in one pass.
+  vector<const Dtype*> top_diff(top.size());
+  for (int i = 0; i < top.size(); ++i) {
+    top_diff[i] = top[i]->cpu_diff();
   }
+  caffe_cpu_sum_n<Dtype>(count_, top.size(), &top_diff[0], NULL,
+      bottom[0]->mutable_cpu_diff());
 }
 
 
@@ -1,12 +1,10 @@
 #include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "caffe/layer.hpp"
-#include "caffe/layers/concat_layer.hpp"
-#include "caffe/layers/flatten_layer.hpp"
-#include "caffe/layers/pooling_layer.hpp"
-#include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -14,191 +12,238 @@ using std::min;
 using std::max;
 
 template <typename Dtype>
-LayerParameter SPPLayer<Dtype>::GetPoolingParam(const int pyramid_level,
-      const int bottom_h, const int bottom_w, const SPPParameter spp_param) {
-  LayerParameter pooling_param;
-  int num_bins = pow(2, pyramid_level);
+bool SPPLayer<Dtype>::AxisFitsBins(const int size, const int num_bins) {
+  const int kernel = ceil(size / static_cast<double>(num_bins));
+  return (kernel * num_bins - size + 1) / 2 < kernel;
+}
 
+template <typename Dtype>
+void SPPLayer<Dtype>::GetBinGeometry(const int size, const int num_bins,
+      int* pooled, int* kernel, int* pad) {
   // find padding and kernel size so that the pooling is
-  // performed across the entire image
-  int kernel_h = ceil(bottom_h / static_cast<double>(num_bins));
-  // remainder_h is the min number of pixels that need to be padded before
-  // entire image height is pooled over with the chosen kernel dimension
-  int remainder_h = kernel_h * num_bins - bottom_h;
-  // pooling layer pads (2 * pad_h) pixels on the top and bottom of the
-  // image.
-  int pad_h = (remainder_h + 1) / 2;
-
-  // similar logic for width
-  int kernel_w = ceil(bottom_w / static_cast<double>(num_bins));
-  int remainder_w = kernel_w * num_bins - bottom_w;
-  int pad_w = (remainder_w + 1) / 2;
-
-  pooling_param.mutable_pooling_param()->set_pad_h(pad_h);
-  pooling_param.mutable_pooling_param()->set_pad_w(pad_w);
-  pooling_param.mutable_pooling_param()->set_kernel_h(kernel_h);
-  pooling_param.mutable_pooling_param()->set_kernel_w(kernel_w);
-  pooling_param.mutable_pooling_param()->set_stride_h(kernel_h);
-  pooling_param.mutable_pooling_param()->set_stride_w(kernel_w);
+  // performed across the entire axis
+  *kernel = ceil(size / static_cast<double>(num_bins));
+  // remainder is the min number of pixels that need to be padded before
+  // the entire axis is pooled over with the chosen kernel dimension
+  const int remainder = *kernel * num_bins - size;
+  // pooling pads (2 * pad) pixels on both ends of the axis.
+  *pad = (remainder + 1) / 2;
+  // The kernel doubles as the stride; the output size then follows
+  // PoolingLayer, which clips the last window if it starts in the padding.
+  *pooled = static_cast<int>(ceil(static_cast<float>(
+      size + 2 * *pad - *kernel) / *kernel)) + 1;
+  if (*pad) {
+    CHECK_LT(*pad, *kernel) << "An axis of size " << size
+        << " cannot be split into " << num_bins << " bins; lower "
+        << "pyramid_height.";
+    if ((*pooled - 1) * *kernel >= size + *pad) {
+      --*pooled;
+    }
+    CHECK_LT((*pooled - 1) * *kernel, size + *pad);
+  }
+}
 
+template <typename Dtype>
+void SPPLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  SPPParameter spp_param = this->layer_param_.spp_param();
+  pyramid_height_ = spp_param.pyramid_height();
+  CHECK_GT(pyramid_height_, 0) << "pyramid_height must be positive.";
+  temporal_pyramid_ = spp_param.temporal_pyramid();
+  if (temporal_pyramid_ && bottom[0]->num_axes() == 5) {
+    // Level i splits the clip into 2^i bins, which a short clip cannot fill.
+    const int length = bottom[0]->length();
+    for (int i = 1; i < pyramid_height_; ++i) {
+      CHECK(AxisFitsBins(length, pow(2, i))) << "A clip of " << length
+          << " frames cannot be split into " << pow(2, i) << " temporal "
+          << "bins: use a pyramid_height of at most " << i << " with "
+          << "temporal_pyramid, or unset temporal_pyramid.";
+    }
+  }
   switch (spp_param.pool()) {
   case SPPParameter_PoolMethod_MAX:
-    pooling_param.mutable_pooling_param()->set_pool(
-        PoolingParameter_PoolMethod_MAX);
-    break;
   case SPPParameter_PoolMethod_AVE:
-    pooling_param.mutable_pooling_param()->set_pool(
-        PoolingParameter_PoolMethod_AVE);
     break;
   case SPPParameter_PoolMethod_STOCHASTIC:
-    pooling_param.mutable_pooling_param()->set_pool(
-        PoolingParameter_PoolMethod_STOCHASTIC);
+    NOT_IMPLEMENTED;
     break;
   default:
     LOG(FATAL) << "Unknown pooling method.";
   }
-
-  return pooling_param;
-}
-
-template <typename Dtype>
-void SPPLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
-  SPPParameter spp_param = this->layer_param_.spp_param();
-
-  num_ = bottom[0]->num();
-  channels_ = bottom[0]->channels();
-  bottom_h_ = bottom[0]->height();
-  bottom_w_ = bottom[0]->width();
   reshaped_first_time_ = false;
-  CHECK_GT(bottom_h_, 0) << "Input dimensions cannot be zero.";
-  CHECK_GT(bottom_w_, 0) << "Input dimensions cannot be zero.";
-
-  pyramid_height_ = spp_param.pyramid_height();
-  split_top_vec_.clear();
-  pooling_bottom_vecs_.clear();
-  pooling_layers_.clear();
-  pooling_top_vecs_.clear();
-  pooling_outputs_.clear();
-  flatten_layers_.clear();
-  flatten_top_vecs_.clear();
-  flatten_outputs_.clear();
-  concat_bottom_vec_.clear();
-
-  if (pyramid_height_ == 1) {
-    // pooling layer setup
-    LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
-        spp_param);
-    pooling_layers_.push_back(shared_ptr<PoolingLayer<Dtype> > (
-        new PoolingLayer<Dtype>(pooling_param)));
-    pooling_layers_[0]->SetUp(bottom, top);
-    return;
-  }
-  // split layer output holders setup
-  for (int i = 0; i < pyramid_height_; i++) {
-    split_top_vec_.push_back(new Blob<Dtype>());
-  }
-
-  // split layer setup
-  LayerParameter split_param;
-  split_layer_.reset(new SplitLayer<Dtype>(split_param));
-  split_layer_->SetUp(bottom, split_top_vec_);
-
-  for (int i = 0; i < pyramid_height_; i++) {
-    // pooling layer input holders setup
-    pooling_bottom_vecs_.push_back(new vector<Blob<Dtype>*>);
-    pooling_bottom_vecs_[i]->push_back(split_top_vec_[i]);
-
-    // pooling layer output holders setup
-    pooling_outputs_.push_back(new Blob<Dtype>());
-    pooling_top_vecs_.push_back(new vector<Blob<Dtype>*>);
-    pooling_top_vecs_[i]->push_back(pooling_outputs_[i]);
-
-    // pooling layer setup
-    LayerParameter pooling_param = GetPoolingParam(
-        i, bottom_h_, bottom_w_, spp_param);
-
-    pooling_layers_.push_back(shared_ptr<PoolingLayer<Dtype> > (
-        new PoolingLayer<Dtype>(pooling_param)));
-    pooling_layers_[i]->SetUp(*pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
-
-    // flatten layer output holders setup
-    flatten_outputs_.push_back(new Blob<Dtype>());
-    flatten_top_vecs_.push_back(new vector<Blob<Dtype>*>);
-    flatten_top_vecs_[i]->push_back(flatten_outputs_[i]);
-
-    // flatten layer setup
-    LayerParameter flatten_param;
-    flatten_layers_.push_back(new FlattenLayer<Dtype>(flatten_param));
-    flatten_layers_[i]->SetUp(*pooling_top_vecs_[i], *flatten_top_vecs_[i]);
-
-    // concat layer input holders setup
-    concat_bottom_vec_.push_back(flatten_outputs_[i]);
-  }
-
-  // concat layer setup
-  LayerParameter concat_param;
-  concat_layer_.reset(new ConcatLayer<Dtype>(concat_param));
-  concat_layer_->SetUp(concat_bottom_vec_, top);
 }
 
 template <typename Dtype>
 void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(5, bottom[0]->num_axes()) << "Input must have 5 axes, "
-      << "corresponding to (num, channels, length, height, width)";
+  CHECK(bottom[0]->num_axes() == 4 || bottom[0]->num_axes() == 5)
+      << "Input must have 4 or 5 axes, corresponding to (num, channels, "
+      << "[optional length,] height, width)";
   // Do nothing if bottom shape is unchanged since last Reshape
   if (num_ == bottom[0]->num() && channels_ == bottom[0]->channels() &&
-      bottom_h_ == bottom[0]->height() && bottom_w_ == bottom[0]->width() &&
-      reshaped_first_time_) {
+      bottom_l_ == bottom[0]->length() && bottom_h_ == bottom[0]->height() &&
+      bottom_w_ == bottom[0]->width() && reshaped_first_time_) {
     return;
   }
   num_ = bottom[0]->num();
   channels_ = bottom[0]->channels();
+  bottom_l_ = bottom[0]->length();
   bottom_h_ = bottom[0]->height();
   bottom_w_ = bottom[0]->width();
+  CHECK_GT(bottom_l_, 0) << "Input dimensions cannot be zero.";
+  CHECK_GT(bottom_h_, 0) << "Input dimensions cannot be zero.";
+  CHECK_GT(bottom_w_, 0) << "Input dimensions cannot be zero.";
   reshaped_first_time_ = true;
-  SPPParameter spp_param = this->layer_param_.spp_param();
-  if (pyramid_height_ == 1) {
-    LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
-        spp_param);
-    pooling_layers_[0].reset(new PoolingLayer<Dtype>(pooling_param));
-    pooling_layers_[0]->SetUp(bottom, top);
-    pooling_layers_[0]->Reshape(bottom, top);
-    return;
+
+  vector<int> info_shape(2);
+  info_shape[0] = pyramid_height_;
+  info_shape[1] = LEVEL_INFO_SIZE;
+  level_info_.Reshape(info_shape);
+  vector<int> index_shape(2);
+  index_shape[0] = pyramid_height_;
+  index_shape[1] = bottom_l_ + bottom_h_ + bottom_w_;
+  bin_index_.Reshape(index_shape);
+  int* info = level_info_.mutable_cpu_data();
+  int* index = bin_index_.mutable_cpu_data();
+  const int sizes[3] = { bottom_l_, bottom_h_, bottom_w_ };
+  total_bins_ = 0;
+  for (int i = 0; i < pyramid_height_; ++i) {
+    const int num_bins = pow(2, i);
+    info[LEVEL_OFFSET] = total_bins_;
+    int level_bins = 1;
+    for (int axis = 0; axis < 3; ++axis) {
+      const int axis_bins = (axis == 0 && !temporal_pyramid_) ? 1 : num_bins;
+      int pooled, kernel, pad;
+      GetBinGeometry(sizes[axis], axis_bins, &pooled, &kernel, &pad);
+      info[LEVEL_POOLED + axis] = pooled;
+      info[LEVEL_KERNEL + axis] = kernel;
+      info[LEVEL_PAD + axis] = pad;
+      level_bins *= pooled;
+      for (int j = 0; j < sizes[axis]; ++j) {
+        const int bin = (j + pad) / kernel;
+        index[j] = bin < pooled ? bin : -1;
+      }
+      index += sizes[axis];
+    }
+    total_bins_ += level_bins;
+    info += LEVEL_INFO_SIZE;
+  }
+
+  // AVE pooling divides by the window size including padding, as
+  // PoolingLayer does.
+  vector<int> scale_shape(1, total_bins_);
+  bin_scale_.Reshape(scale_shape);
+  Dtype* scale = bin_scale_.mutable_cpu_data();
+  info = level_info_.mutable_cpu_data();
+  for (int i = 0; i < pyramid_height_; ++i, info += LEVEL_INFO_SIZE) {
+    for (int bl = 0; bl < info[LEVEL_POOLED]; ++bl) {
+      for (int bh = 0; bh < info[LEVEL_POOLED + 1]; ++bh) {
+        for (int bw = 0; bw < info[LEVEL_POOLED + 2]; ++bw) {
+          const int b[3] = { bl, bh, bw };
+          int pool_size = 1;
+          for (int axis = 0; axis < 3; ++axis) {
+            const int kernel = info[LEVEL_KERNEL + axis];
+            const int pad = info[LEVEL_PAD + axis];
+            const int start = b[axis] * kernel - pad;
+            const int end = min(start + kernel, sizes[axis] + pad);
+            pool_size *= end - start;
+          }
+          *scale++ = Dtype(1) / pool_size;
+        }
+      }
+    }
   }
-  split_layer_->Reshape(bottom, split_top_vec_);
-  for (int i = 0; i < pyramid_height_; i++) {
-    LayerParameter pooling_param = GetPoolingParam(
-        i, bottom_h_, bottom_w_, spp_param);
 
-    pooling_layers_[i].reset(
-        new PoolingLayer<Dtype>(pooling_param));
-    pooling_layers_[i]->SetUp(
-        *pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
-    pooling_layers_[i]->Reshape(
-        *pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
-    flatten_layers_[i]->Reshape(
-        *pooling_top_vecs_[i], *flatten_top_vecs_[i]);
+  vector<int> top_shape(2);
+  top_shape[0] = num_;
+  top_shape[1] = channels_ * total_bins_;
+  top[0]->Reshape(top_shape);
+  if (this->layer_param_.spp_param().pool() == SPPParameter_PoolMethod_MAX) {
+    max_idx_.Reshape(top_shape);
   }
-  concat_layer_->Reshape(concat_bottom_vec_, top);
 }
 
 template <typename Dtype>
 void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (pyramid_height_ == 1) {
-    pooling_layers_[0]->Forward(bottom, top);
-    return;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int* info = level_info_.cpu_data();
+  const int* index = bin_index_.cpu_data();
+  const int index_size = bin_index_.shape(1);
+  const bool is_max =
+      this->layer_param_.spp_param().pool() == SPPParameter_PoolMethod_MAX;
+  int* mask = NULL;
+  if (is_max) {
+    mask = max_idx_.mutable_cpu_data();
+    caffe_set(top[0]->count(), Dtype(-FLT_MAX), top_data);
+    caffe_set(top[0]->count(), -1, mask);
+  } else {
+    caffe_set(top[0]->count(), Dtype(0), top_data);
+  }
+  // For each level, the offset of the current channel's bins in top_data
+  // and of the current (length, height) row within those bins.
+  vector<int> channel_offset(pyramid_height_), row_offset(pyramid_height_);
+  for (int n = 0; n < num_; ++n) {
+    for (int c = 0; c < channels_; ++c) {
+      for (int i = 0; i < pyramid_height_; ++i) {
+        const int* level = info + i * LEVEL_INFO_SIZE;
+        channel_offset[i] = n * top[0]->shape(1) +
+            channels_ * level[LEVEL_OFFSET] + c * level[LEVEL_POOLED] *
+            level[LEVEL_POOLED + 1] * level[LEVEL_POOLED + 2];
+      }
+      // Visit every input once, adding it to its bin in each level. Inputs
+      // are visited in the same order as PoolingLayer scans a window, so
+      // ties resolve to the same argmax.
+      int bottom_index = 0;
+      for (int l = 0; l < bottom_l_; ++l) {
+        for (int h = 0; h < bottom_h_; ++h) {
+          for (int i = 0; i < pyramid_height_; ++i) {
+            const int* level = info + i * LEVEL_INFO_SIZE;
+            const int* level_index = index + i * index_size;
+            const int bl = level_index[l];
+            const int bh = level_index[bottom_l_ + h];
+            row_offset[i] = (bl < 0 || bh < 0) ? -1 : channel_offset[i] +
+                (bl * level[LEVEL_POOLED + 1] + bh) * level[LEVEL_POOLED + 2];
+          }
+          for (int w = 0; w < bottom_w_; ++w, ++bottom_index) {
+            const Dtype value = bottom_data[bottom_index];
+            for (int i = 0; i < pyramid_height_; ++i) {
+              const int bw = index[i * index_size + bottom_l_ + bottom_h_ + w];
+              if (row_offset[i] < 0 || bw < 0) {
+                continue;
+              }
+              const int top_index = row_offset[i] + bw;
+              if (is_max) {
+                if (value > top_data[top_index]) {
+                  top_data[top_index] = value;
+                  mask[top_index] = bottom_index;
+                }
+              } else {
+                top_data[top_index] += value;
+              }
+            }
+          }
+        }
+      }
+      bottom_data += bottom_index;
+    }
   }
-  split_layer_->Forward(bottom, split_top_vec_);
-  for (int i = 0; i < pyramid_height_; i++) {
-    pooling_layers_[i]->Forward(
-        *pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
-    flatten_layers_[i]->Forward(
-        *pooling_top_vecs_[i], *flatten_top_vecs_[i]);
+  if (!is_max) {
+    const Dtype* scale = bin_scale_.cpu_data();
+    for (int n = 0; n < num_; ++n) {
+      for (int i = 0; i < pyramid_height_; ++i) {
+        const int* level = info + i * LEVEL_INFO_SIZE;
+        const int level_bins = level[LEVEL_POOLED] * level[LEVEL_POOLED + 1] *
+            level[LEVEL_POOLED + 2];
+        for (int c = 0; c < channels_; ++c) {
+          caffe_mul(level_bins, top_data, scale + level[LEVEL_OFFSET],
+              top_data);
+          top_data += level_bins;
+        }
+      }
+    }
   }
-  concat_layer_->Forward(concat_bottom_vec_, top);
 }
 
 template <typename Dtype>
@@ -207,21 +252,82 @@ void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
-  if (pyramid_height_ == 1) {
-    pooling_layers_[0]->Backward(top, propagate_down, bottom);
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int* info = level_info_.cpu_data();
+  const int* index = bin_index_.cpu_data();
+  const int index_size = bin_index_.shape(1);
+  const int top_dim = top[0]->shape(1);
+  const int plane_size = bottom_l_ * bottom_h_ * bottom_w_;
+  if (this->layer_param_.spp_param().pool() == SPPParameter_PoolMethod_MAX) {
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+    const int* mask = max_idx_.cpu_data();
+    for (int n = 0; n < num_; ++n) {
+      for (int i = 0; i < pyramid_height_; ++i) {
+        const int* level = info + i * LEVEL_INFO_SIZE;
+        const int level_bins = level[LEVEL_POOLED] * level[LEVEL_POOLED + 1] *
+            level[LEVEL_POOLED + 2];
+        const int top_offset = n * top_dim + channels_ * level[LEVEL_OFFSET];
+        for (int c = 0; c < channels_; ++c) {
+          Dtype* bottom_plane = bottom_diff + (n * channels_ + c) * plane_size;
+          for (int b = 0; b < level_bins; ++b) {
+            const int top_index = top_offset + c * level_bins + b;
+            if (mask[top_index] >= 0) {
+              bottom_plane[mask[top_index]] += top_diff[top_index];
+            }
+          }
+        }
+      }
+    }
     return;
   }
-  vector<bool> concat_propagate_down(pyramid_height_, true);
-  concat_layer_->Backward(top, concat_propagate_down, concat_bottom_vec_);
-  for (int i = 0; i < pyramid_height_; i++) {
-    flatten_layers_[i]->Backward(
-        *flatten_top_vecs_[i], propagate_down, *pooling_top_vecs_[i]);
-    pooling_layers_[i]->Backward(
-        *pooling_top_vecs_[i], propagate_down, *pooling_bottom_vecs_[i]);
+  // AVE: each input gathers the scaled gradient of its bin in every level,
+  // again in a single pass that writes every bottom diff exactly once.
+  const Dtype* scale = bin_scale_.cpu_data();
+  vector<int> channel_offset(pyramid_height_), row_offset(pyramid_height_);
+  vector<int> row_bin(pyramid_height_);
+  for (int n = 0; n < num_; ++n) {
+    for (int c = 0; c < channels_; ++c) {
+      for (int i = 0; i < pyramid_height_; ++i) {
+        const int* level = info + i * LEVEL_INFO_SIZE;
+        channel_offset[i] = n * top_dim +
+            channels_ * level[LEVEL_OFFSET] + c * level[LEVEL_POOLED] *
+            level[LEVEL_POOLED + 1] * level[LEVEL_POOLED + 2];
+      }
+      for (int l = 0; l < bottom_l_; ++l) {
+        for (int h = 0; h < bottom_h_; ++h) {
+          for (int i = 0; i < pyramid_height_; ++i) {
+            const int* level = info + i * LEVEL_INFO_SIZE;
+            const int* level_index = index + i * index_size;
+            const int bl = level_index[l];
+            const int bh = level_index[bottom_l_ + h];
+            row_bin[i] = (bl < 0 || bh < 0) ? -1 :
+                (bl * level[LEVEL_POOLED + 1] + bh) * level[LEVEL_POOLED + 2];
+            row_offset[i] = channel_offset[i] + row_bin[i];
+          }
+          for (int w = 0; w < bottom_w_; ++w) {
+            Dtype diff = 0;
+            for (int i = 0; i < pyramid_height_; ++i) {
+              const int bw = index[i * index_size + bottom_l_ + bottom_h_ + w];
+              if (row_bin[i] < 0 || bw < 0) {
+                continue;
+              }
+              diff += top_diff[row_offset[i] + bw] *
+                  scale[info[i * LEVEL_INFO_SIZE + LEVEL_OFFSET] +
+                        row_bin[i] + bw];
+            }
+            *bottom_diff++ = diff;
+          }
+        }
+      }
+    }
   }
-  split_layer_->Backward(split_top_vec_, propagate_down, bottom);
 }
 
+#ifdef CPU_ONLY
+STUB_GPU(SPPLayer);
+#endif
+
 INSTANTIATE_CLASS(SPPLayer);
 REGISTER_LAYER_CLASS(SPP);
 
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Finds the level that holds element r of a top row and turns r into the
+// channel c and bin b within that level. Returns the level's info.
+template <typename Dtype>
+__device__ const int* SPPFindLevel(const int* const level_info,
+    const int pyramid_height, const int channels, int r, int* c, int* b) {
+  int i = 0;
+  while (i + 1 < pyramid_height && r >= channels * level_info[
+         (i + 1) * SPPLayer<Dtype>::LEVEL_INFO_SIZE +
+         SPPLayer<Dtype>::LEVEL_OFFSET]) {
+    ++i;
+  }
+  const int* const level = level_info + i * SPPLayer<Dtype>::LEVEL_INFO_SIZE;
+  const int level_bins = level[SPPLayer<Dtype>::LEVEL_POOLED] *
+      level[SPPLayer<Dtype>::LEVEL_POOLED + 1] *
+      level[SPPLayer<Dtype>::LEVEL_POOLED + 2];
+  r -= channels * level[SPPLayer<Dtype>::LEVEL_OFFSET];
+  *c = r / level_bins;
+  *b = r % level_bins;
+  return level;
+}
+
+template <typename Dtype>
+__global__ void SPPForward(const int nthreads,
+    const Dtype* const bottom_data, const int channels, const int length,
+    const int height, const int width, const int top_dim,
+    const int pyramid_height, const int* const level_info,
+    const Dtype* const bin_scale, const bool is_max,
+    Dtype* const top_data, int* const mask) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int n = index / top_dim;
+    int c, b;
+    const int* const level = SPPFindLevel<Dtype>(level_info, pyramid_height,
+        channels, index % top_dim, &c, &b);
+    const int* const pooled = level + SPPLayer<Dtype>::LEVEL_POOLED;
+    const int* const kernel = level + SPPLayer<Dtype>::LEVEL_KERNEL;
+    const int* const pad = level + SPPLayer<Dtype>::LEVEL_PAD;
+    const int bw = b % pooled[2];
+    const int bh = (b / pooled[2]) % pooled[1];
+    const int bl = b / pooled[2] / pooled[1];
+    int lstart = bl * kernel[0] - pad[0];
+    int hstart = bh * kernel[1] - pad[1];
+    int wstart = bw * kernel[2] - pad[2];
+    const int lend = min(lstart + kernel[0], length);
+    const int hend = min(hstart + kernel[1], height);
+    const int wend = min(wstart + kernel[2], width);
+    lstart = max(lstart, 0);
+    hstart = max(hstart, 0);
+    wstart = max(wstart, 0);
+    const Dtype* const bottom_slice =
+        bottom_data + (n * channels + c) * length * height * width;
+    if (is_max) {
+      Dtype maxval = -FLT_MAX;
+      int maxidx = -1;
+      for (int l = lstart; l < lend; ++l) {
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int bottom_index = (l * height + h) * width + w;
+            if (bottom_slice[bottom_index] > maxval) {
+              maxidx = bottom_index;
+              maxval = bottom_slice[maxidx];
+            }
+          }
+        }
+      }
+      top_data[index] = maxval;
+      mask[index] = maxidx;
+    } else {
+      Dtype aveval = 0;
+      for (int l = lstart; l < lend; ++l) {
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            aveval += bottom_slice[(l * height + h) * width + w];
+          }
+        }
+      }
+      top_data[index] =
+          aveval * bin_scale[level[SPPLayer<Dtype>::LEVEL_OFFSET] + b];
+    }
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  const int count = top[0]->count();
+  const bool is_max =
+      this->layer_param_.spp_param().pool() == SPPParameter_PoolMethod_MAX;
+  int* mask = is_max ? max_idx_.mutable_gpu_data() : NULL;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  SPPForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, bottom_data, channels_, bottom_l_, bottom_h_, bottom_w_,
+      top[0]->shape(1), pyramid_height_, level_info_.gpu_data(),
+      bin_scale_.gpu_data(), is_max, top_data, mask);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template <typename Dtype>
+__global__ void SPPBackward(const int nthreads, const Dtype* const top_diff,
+    const int* const mask, const int channels, const int length,
+    const int height, const int width, const int top_dim,
+    const int pyramid_height, const int* const level_info,
+    const int* const bin_index, const Dtype* const bin_scale,
+    const bool is_max, Dtype* const bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    // Every input gathers the gradient of its bin in each level.
+    const int plane_index = index % (length * height * width);
+    const int w = index % width;
+    const int h = (index / width) % height;
+    const int l = (index / width / height) % length;
+    const int c = (index / width / height / length) % channels;
+    const int n = index / width / height / length / channels;
+    const int index_size = length + height + width;
+    Dtype gradient = 0;
+    for (int i = 0; i < pyramid_height; ++i) {
+      const int* const level =
+          level_info + i * SPPLayer<Dtype>::LEVEL_INFO_SIZE;
+      const int* const pooled = level + SPPLayer<Dtype>::LEVEL_POOLED;
+      const int bl = bin_index[i * index_size + l];
+      const int bh = bin_index[i * index_size + length + h];
+      const int bw = bin_index[i * index_size + length + height + w];
+      if (bl < 0 || bh < 0 || bw < 0) {
+        continue;
+      }
+      const int b = (bl * pooled[1] + bh) * pooled[2] + bw;
+      const int top_index = n * top_dim +
+          channels * level[SPPLayer<Dtype>::LEVEL_OFFSET] +
+          c * pooled[0] * pooled[1] * pooled[2] + b;
+      if (is_max) {
+        if (mask[top_index] == plane_index) {
+          gradient += top_diff[top_index];
+        }
+      } else {
+        gradient += top_diff[top_index] *
+            bin_scale[level[SPPLayer<Dtype>::LEVEL_OFFSET] + b];
+      }
+    }
+    bottom_diff[index] = gradient;
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->gpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+  const int count = bottom[0]->count();
+  const bool is_max =
+      this->layer_param_.spp_param().pool() == SPPParameter_PoolMethod_MAX;
+  const int* mask = is_max ? max_idx_.gpu_data() : NULL;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  SPPBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, top_diff, mask, channels_, bottom_l_, bottom_h_, bottom_w_,
+      top[0]->shape(1), pyramid_height_, level_info_.gpu_data(),
+      bin_index_.gpu_data(), bin_scale_.gpu_data(), is_max, bottom_diff);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(SPPLayer);
+
+}  // namespace caffe
@@ -0,0 +1,224 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/layers/two_stream_video_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+// The channels of the flow: x, then y.
+static const int kFlowChannels = 2;
+
+template <typename Dtype>
+void TwoStreamVideoDataLayer<Dtype>::DataLayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int new_height = video_data_param.new_height();
+  const int new_width = video_data_param.new_width();
+  CHECK((new_height == 0 && new_width == 0) ||
+      (new_height > 0 && new_width > 0)) << "Current implementation requires "
+      "new_height and new_width to be set at the same time.";
+  CHECK(!video_data_param.bucket_by_shape())
+      << "TwoStreamVideoData does not bucket clips by shape.";
+  this->output_labels_ = top.size() > 2;
+  this->LoadLines();
+  const TransformationParameter& transform_param =
+      this->layer_param_.transform_param();
+  // The flow shares the crop and scale of the frames, but not their mean.
+  TransformationParameter flow_transform_param;
+  flow_transform_param.set_scale(transform_param.scale());
+  flow_transform_param.set_mirror(transform_param.mirror());
+  flow_transform_param.set_crop_size(transform_param.crop_size());
+  flow_transform_param.add_mean_value(video_data_param.flow_mean_value());
+  flow_transformer_.reset(
+      new DataTransformer<Dtype>(flow_transform_param, this->phase_));
+  // Read a whole video clip, and use it to initialize the top blobs.
+  vector<Clip> clips(1);
+  clips[0].path =
+      video_data_param.root_folder() + this->lines_[this->lines_id_].first;
+  clips[0].frames = this->ClipFrames(this->lines_[this->lines_id_]);
+  this->crop_before_decode_ = false;
+  ReadClips(&clips, 0, 1);
+  // As in VideoDataLayer, the crop can only be picked on the frames as they
+  // are stored, and the mean_file covers the whole frames.
+  this->crop_before_decode_ = video_data_param.crop_before_decode() &&
+      transform_param.crop_size() > 0 && new_height == 0 &&
+      !transform_param.has_mean_file();
+  const bool is_video = true;
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(
+      clips[0].rgb, is_video);
+  const int batch_size = video_data_param.batch_size();
+  CHECK_GT(batch_size, 0) << "Positive batch size required";
+  top_shape[0] = batch_size;
+  this->stacked_data_channels_.clear();
+  this->stacked_data_channels_.push_back(top_shape[1]);
+  this->stacked_data_channels_.push_back(kFlowChannels);
+  top[0]->Reshape(top_shape);
+  top_shape[1] = kFlowChannels;
+  top[1]->Reshape(top_shape);
+  top_shape[1] = this->stacked_data_channels_[0] + kFlowChannels;
+  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+    this->prefetch_[i].data_.Reshape(top_shape);
+  }
+  LOG(INFO) << "output data size: " << top[0]->shape_string() << " and "
+            << top[1]->shape_string();
+  if (this->output_labels_) {
+    vector<int> label_shape(1, batch_size);
+    top[2]->Reshape(label_shape);
+    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+      this->prefetch_[i].label_.Reshape(label_shape);
+    }
+  }
+}
+
+template <typename Dtype>
+int TwoStreamVideoDataLayer<Dtype>::CountFrames(const string& path) {
+  return std::min(CountVideoFrames(path), CountFlowFrames(path));
+}
+
+template <typename Dtype>
+void TwoStreamVideoDataLayer<Dtype>::ReadClips(vector<Clip>* clips,
+    const int begin, const int end) {
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int new_height = video_data_param.new_height();
+  const int new_width = video_data_param.new_width();
+  const bool is_color = video_data_param.is_color();
+  for (int i = begin; i < end; ++i) {
+    Clip& clip = (*clips)[i];
+    bool read_video_result, read_flow_result;
+    if (this->crop_before_decode_) {
+      read_video_result = ReadVideoCropToCVMat(clip.path, clip.frames,
+          clip.crop, is_color, &clip.rgb);
+      read_flow_result = ReadFlowCropToCVMat(clip.path, clip.frames,
+          clip.crop, &clip.flow);
+    } else {
+      read_video_result = ReadVideoToCVMat(clip.path, clip.frames,
+          new_height, new_width, is_color, &clip.rgb);
+      read_flow_result = ReadFlowToCVMat(clip.path, clip.frames,
+          new_height, new_width, &clip.flow);
+    }
+    CHECK(read_video_result && read_flow_result) << "Could not load "
+        << clip.path << " at frame " << clip.frames[0] << ".";
+    CHECK_EQ(clip.rgb.size(), clip.frames.size());
+    CHECK_EQ(clip.flow.size(), clip.frames.size());
+    for (int j = 0; j < clip.frames.size(); ++j) {
+      CHECK(clip.rgb[j].size() == clip.flow[j].size())
+          << "The flow of " << clip.path << " at frame " << clip.frames[j]
+          << " does not have the size of the frame.";
+    }
+  }
+}
+
+template <typename Dtype>
+void TwoStreamVideoDataLayer<Dtype>::TransformClips(const vector<Clip>& clips,
+    Blob<Dtype>* data, const int begin, const int end) {
+  vector<int> rgb_shape = data->shape();
+  rgb_shape[0] = 1;
+  rgb_shape[1] = this->stacked_data_channels_[0];
+  vector<int> flow_shape = rgb_shape;
+  flow_shape[1] = kFlowChannels;
+  // Views of the items of the batch, one per call so that calls can run
+  // concurrently.
+  Blob<Dtype> rgb(rgb_shape);
+  Blob<Dtype> flow(flow_shape);
+  for (int i = begin; i < end; ++i) {
+    const Clip& clip = clips[i];
+    Dtype* item_data = data->mutable_cpu_data() + data->offset(i);
+    rgb.set_cpu_data(item_data);
+    this->data_transformer_->TransformVideo(clip.rgb, &rgb, clip.mirror,
+                                            clip.crop.y, clip.crop.x);
+    flow.set_cpu_data(item_data + rgb.count());
+    flow_transformer_->TransformVideo(clip.flow, &flow, clip.mirror,
+                                      clip.crop.y, clip.crop.x);
+    if (clip.mirror) {
+      // Mirroring reverses the flow along x.
+      caffe_scal(flow.count(2), Dtype(-1), flow.mutable_cpu_data());
+    }
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void TwoStreamVideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  CPUTimer timer;
+  CHECK(batch->data_.count());
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int batch_size = video_data_param.batch_size();
+  const int crop_size = this->layer_param_.transform_param().crop_size();
+  DataTransformer<Dtype>* transformer = this->data_transformer_.get();
+  // The clips and their random choices are picked in order, so that they do
+  // not depend on the parallel reads.
+  vector<Clip> clips(batch_size);
+  Dtype* prefetch_label = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const triplet& line = this->lines_[this->lines_id_];
+    Clip& clip = clips[item_id];
+    clip.path = video_data_param.root_folder() + line.first;
+    clip.frames = this->ClipFrames(line);
+    // The mirroring and crop are picked in the order Transform picks them.
+    clip.mirror = transformer->ChooseVideoMirror();
+    if (this->crop_before_decode_) {
+      int height, width;
+      CHECK(ReadVideoFrameSize(clip.path, clip.frames[0], &height, &width))
+          << "Could not load " << clip.path << ".";
+      clip.crop = transformer->ChooseVideoCrop(height, width);
+    }
+    if (this->output_labels_) {
+      prefetch_label[item_id] = line.third;
+    }
+    this->NextLine();
+  }
+  timer.Start();
+  parallel_for(0, batch_size, boost::bind(
+      &TwoStreamVideoDataLayer<Dtype>::ReadClips, this, &clips, _1, _2));
+  const double read_time = timer.MicroSeconds();
+  timer.Start();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    Clip& clip = clips[item_id];
+    const int height = clip.rgb[0].rows;
+    const int width = clip.rgb[0].cols;
+    CHECK_EQ(clip.frames.size(), batch->data_.shape(2))
+        << "The clips must have the same length.";
+    if (this->crop_before_decode_) {
+      // The frames read are the crop.
+      clip.crop = cv::Rect(0, 0, width, height);
+    } else if (crop_size) {
+      clip.crop = transformer->ChooseVideoCrop(height, width);
+    } else {
+      clip.crop = cv::Rect(0, 0, width, height);
+    }
+  }
+  // Each item is transformed once, so the first call to mutable_cpu_data
+  // must not race.
+  batch->data_.mutable_cpu_data();
+  parallel_for(0, batch_size, boost::bind(
+      &TwoStreamVideoDataLayer<Dtype>::TransformClips, this,
+      boost::cref(clips), &batch->data_, _1, _2));
+  const double trans_time = timer.MicroSeconds();
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+INSTANTIATE_CLASS(TwoStreamVideoDataLayer);
+REGISTER_LAYER_CLASS(TwoStreamVideoData);
+
+}  // namespace caffe
+#endif  // USE_OPENCV
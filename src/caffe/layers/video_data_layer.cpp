@@ -1,8 +1,11 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -17,6 +20,30 @@
 
 namespace caffe {
 
+// Reads the given frames of a clip. Given a crop_transformer, reads the
+// crop it picks alone.
+template <typename Dtype>
+static void ReadClipOrDie(const string& path, const vector<int>& frames,
+    const int new_height, const int new_width, const bool is_color,
+    DataTransformer<Dtype>* crop_transformer, std::vector<cv::Mat>* cv_imgs) {
+  bool read_video_result;
+  if (crop_transformer) {
+    int height, width;
+    CHECK(ReadVideoFrameSize(path, frames[0], &height, &width))
+        << "Could not load " << path << ".";
+    read_video_result = ReadVideoCropToCVMat(path, frames,
+        crop_transformer->ChooseVideoCrop(height, width), is_color, cv_imgs);
+  } else {
+    read_video_result = ReadVideoToCVMat(path, frames, new_height, new_width,
+                                         is_color, cv_imgs);
+  }
+  CHECK(read_video_result) << "Could not load " << path <<
+                              " at frame " << frames[0] << ".";
+  CHECK_EQ(cv_imgs->size(), frames.size()) << "Could not load " << path <<
+                                              " at frame " << frames[0] <<
+                                              " correctly.";
+}
+
 template <typename Dtype>
 VideoDataLayer<Dtype>::~VideoDataLayer<Dtype>() {
   this->StopInternalThread();
@@ -25,7 +52,6 @@ VideoDataLayer<Dtype>::~VideoDataLayer<Dtype>() {
 template <typename Dtype>
 void VideoDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>&
       bottom, const vector<Blob<Dtype>*>& top) {
-  const int new_length = this->layer_param_.video_data_param().new_length();
   const int new_height = this->layer_param_.video_data_param().new_height();
   const int new_width  = this->layer_param_.video_data_param().new_width();
   const bool is_color  = this->layer_param_.video_data_param().is_color();
@@ -34,53 +60,21 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>&
   CHECK((new_height == 0 && new_width == 0) ||
       (new_height > 0 && new_width > 0)) << "Current implementation requires "
       "new_height and new_width to be set at the same time.";
-  // Read the file with filenames and labels
-  const string& source = this->layer_param_.video_data_param().source();
-  LOG(INFO) << "Opening file " << source;
-  std::ifstream infile(source.c_str());
-  string filename;
-  int frame_num, label;
-  while (infile >> filename >> frame_num >> label) {
-    triplet video_and_label;
-    video_and_label.first = filename;
-    video_and_label.second = frame_num;
-    video_and_label.third = label;
-    lines_.push_back(video_and_label);
-  }
-
-  if (this->layer_param_.video_data_param().shuffle()) {
-    // randomly shuffle data
-    LOG(INFO) << "Shuffling data";
-    const unsigned int prefetch_rng_seed = caffe_rng_rand();
-    prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
-    ShuffleVideos();
-  }
-  LOG(INFO) << "A total of " << lines_.size() << " video chunks.";
-
-  lines_id_ = 0;
-  // Check if we would need to randomly skip a few data points
-  if (this->layer_param_.video_data_param().rand_skip()) {
-    unsigned int skip = caffe_rng_rand() %
-        this->layer_param_.video_data_param().rand_skip();
-    LOG(INFO) << "Skipping first " << skip << " data points.";
-    CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
-    lines_id_ = skip;
-  }
+  LoadLines();
+  num_pending_ = 0;
+  // The crop can only be picked on the frames as they are stored, and the
+  // mean_file covers the whole frames.
+  const TransformationParameter& transform_param =
+      this->layer_param_.transform_param();
+  crop_before_decode_ =
+      this->layer_param_.video_data_param().crop_before_decode() &&
+      transform_param.crop_size() > 0 && new_height == 0 &&
+      !transform_param.has_mean_file();
   // Read a video clip, and use it to initialize the top blob.
   std::vector<cv::Mat> cv_imgs;
-  bool read_video_result = ReadVideoToCVMat(root_folder +
-                                            lines_[lines_id_].first,
-                                            lines_[lines_id_].second,
-                                            new_length, new_height, new_width,
-                                            is_color,
-                                            &cv_imgs);
-  CHECK(read_video_result) << "Could not load " << lines_[lines_id_].first <<
-                              " at frame " << lines_[lines_id_].second << ".";
-  CHECK_EQ(cv_imgs.size(), new_length) << "Could not load " <<
-                                          lines_[lines_id_].first <<
-                                          " at frame " <<
-                                          lines_[lines_id_].second <<
-                                          " correctly.";
+  ReadClipOrDie(root_folder + lines_[lines_id_].first,
+      ClipFrames(lines_[lines_id_]), new_height, new_width, is_color,
+      CropTransformer(), &cv_imgs);
   // Use data_transformer to infer the expected blob shape from a cv_image.
   const bool is_video = true;
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_imgs,
@@ -106,6 +100,67 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>&
   }
 }
 
+template <typename Dtype>
+void VideoDataLayer<Dtype>::LoadLines() {
+  CHECK_GT(this->layer_param_.video_data_param().temporal_stride(), 0)
+      << "temporal_stride must be positive.";
+  // Read the file with filenames and labels
+  const string& source = this->layer_param_.video_data_param().source();
+  LOG(INFO) << "Opening file " << source;
+  std::ifstream infile(source.c_str());
+  if (this->layer_param_.video_data_param().bucket_by_shape()) {
+    // One clip per line, with an optional length.
+    string line;
+    while (std::getline(infile, line)) {
+      std::istringstream line_stream(line);
+      triplet video_and_label;
+      if (!(line_stream >> video_and_label.first >> video_and_label.second
+            >> video_and_label.third)) {
+        continue;
+      }
+      if (!(line_stream >> video_and_label.length)) {
+        video_and_label.length = 0;
+      }
+      lines_.push_back(video_and_label);
+    }
+  } else {
+    string filename;
+    int frame_num, label;
+    while (infile >> filename >> frame_num >> label) {
+      triplet video_and_label;
+      video_and_label.first = filename;
+      video_and_label.second = frame_num;
+      video_and_label.third = label;
+      video_and_label.length = 0;
+      lines_.push_back(video_and_label);
+    }
+  }
+
+  if (this->layer_param_.video_data_param().shuffle()) {
+    // randomly shuffle data
+    LOG(INFO) << "Shuffling data";
+    const unsigned int prefetch_rng_seed = caffe_rng_rand();
+    prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+    ShuffleVideos();
+  }
+  LOG(INFO) << "A total of " << lines_.size() << " video chunks.";
+
+  lines_id_ = 0;
+  // Check if we would need to randomly skip a few data points
+  if (this->layer_param_.video_data_param().rand_skip()) {
+    unsigned int skip = caffe_rng_rand() %
+        this->layer_param_.video_data_param().rand_skip();
+    LOG(INFO) << "Skipping first " << skip << " data points.";
+    CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
+    lines_id_ = skip;
+  }
+  if (this->layer_param_.video_data_param().num_segments() > 0 &&
+      this->phase_ == TRAIN) {
+    const unsigned int segment_rng_seed = caffe_rng_rand();
+    segment_rng_.reset(new Caffe::RNG(segment_rng_seed));
+  }
+}
+
 template <typename Dtype>
 void VideoDataLayer<Dtype>::ShuffleVideos() {
   caffe::rng_t* prefetch_rng =
@@ -113,9 +168,178 @@ void VideoDataLayer<Dtype>::ShuffleVideos() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+DataTransformer<Dtype>* VideoDataLayer<Dtype>::CropTransformer() {
+  return crop_before_decode_ ? this->data_transformer_.get() : NULL;
+}
+
+template <typename Dtype>
+int VideoDataLayer<Dtype>::CountFrames(const string& path) {
+  return CountVideoFrames(path);
+}
+
+template <typename Dtype>
+vector<int> VideoDataLayer<Dtype>::ClipFrames(const triplet& line) {
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int length = line.length > 0 ? line.length
+                                     : video_data_param.new_length();
+  const int stride = video_data_param.temporal_stride();
+  const int num_segments = video_data_param.num_segments();
+  vector<int> frames;
+  if (num_segments == 0) {
+    for (int i = 0; i < length; ++i) {
+      frames.push_back(line.second + i * stride);
+    }
+    return frames;
+  }
+  CHECK_EQ(length % num_segments, 0)
+      << "The clip length must be a multiple of num_segments.";
+  const int snippet_length = length / num_segments;
+  const int snippet_span = (snippet_length - 1) * stride + 1;
+  const string path = video_data_param.root_folder() + line.first;
+  std::map<string, int>::iterator num_frames = num_frames_.find(path);
+  if (num_frames == num_frames_.end()) {
+    num_frames = num_frames_.insert(
+        std::make_pair(path, CountFrames(path))).first;
+  }
+  // The snippets start within the segments of the starting frames that
+  // leave room for a whole snippet, so neighbouring snippets may overlap
+  // when the segments are shorter than them. Videos shorter than a snippet
+  // repeat their last frame.
+  const int last_frame = num_frames->second;
+  CHECK_GE(last_frame, line.second) << "No frame " << line.second << " in "
+                                    << line.first << ".";
+  const int num_starts = std::max(last_frame - line.second + 1 -
+                                  snippet_span + 1, 1);
+  for (int segment = 0; segment < num_segments; ++segment) {
+    const int begin = static_cast<int64_t>(num_starts) * segment /
+                      num_segments;
+    const int end = std::max(static_cast<int>(
+        static_cast<int64_t>(num_starts) * (segment + 1) / num_segments),
+        begin + 1);
+    int start = begin + (end - begin) / 2;
+    if (segment_rng_) {
+      caffe::rng_t* segment_rng =
+          static_cast<caffe::rng_t*>(segment_rng_->generator());
+      start = begin + (*segment_rng)() % (end - begin);
+    }
+    for (int i = 0; i < snippet_length; ++i) {
+      frames.push_back(std::min(line.second + start + i * stride,
+                                last_frame));
+    }
+  }
+  return frames;
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::NextLine() {
+  lines_id_++;
+  if (lines_id_ >= lines_.size()) {
+    // We have reached the end. Restart from the first.
+    DLOG(INFO) << "Restarting data prefetching from start.";
+    lines_id_ = 0;
+    if (this->layer_param_.video_data_param().shuffle()) {
+      ShuffleVideos();
+    }
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void VideoDataLayer<Dtype>::load_bucketed_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  const int batch_size = video_data_param.batch_size();
+  const int max_pending = video_data_param.max_pending_clips() > 0 ?
+      video_data_param.max_pending_clips() : 4 * batch_size;
+  CHECK_GE(max_pending, batch_size)
+      << "max_pending_clips must be at least batch_size.";
+  typedef typename std::map<vector<int>, std::deque<PendingClip> >::iterator
+      BucketIterator;
+  // Every clip of an epoch goes to exactly one batch, in the order of the
+  // (shuffled) list, so the labels of the batches follow the distribution
+  // of the data whatever the shapes. Bounding the pending clips keeps clips
+  // of rare shapes from waiting indefinitely.
+  BucketIterator bucket = buckets_.end();
+  while (bucket == buckets_.end()) {
+    if (num_pending_ >= max_pending) {
+      bucket = buckets_.begin();
+      for (BucketIterator it = buckets_.begin(); it != buckets_.end(); ++it) {
+        if (it->second.size() > bucket->second.size()) {
+          bucket = it;
+        }
+      }
+      break;
+    }
+    timer.Start();
+    std::vector<cv::Mat> cv_imgs;
+    ReadClipOrDie(video_data_param.root_folder() + lines_[lines_id_].first,
+        ClipFrames(lines_[lines_id_]), video_data_param.new_height(),
+        video_data_param.new_width(), video_data_param.is_color(),
+        CropTransformer(), &cv_imgs);
+    read_time += timer.MicroSeconds();
+    timer.Start();
+    shared_ptr<Blob<Dtype> > clip;
+    if (free_clips_.empty()) {
+      clip.reset(new Blob<Dtype>());
+    } else {
+      clip = free_clips_.back();
+      free_clips_.pop_back();
+    }
+    const bool is_video = true;
+    const vector<int> clip_shape =
+        this->data_transformer_->InferBlobShape(cv_imgs, is_video);
+    clip->Reshape(clip_shape);
+    this->data_transformer_->Transform(cv_imgs, clip.get(), is_video);
+    trans_time += timer.MicroSeconds();
+    std::deque<PendingClip>& pending = buckets_[clip_shape];
+    pending.push_back(PendingClip(clip, lines_[lines_id_].third));
+    ++num_pending_;
+    NextLine();
+    if (pending.size() >= batch_size) {
+      bucket = buckets_.find(clip_shape);
+    }
+  }
+  std::deque<PendingClip>& pending = bucket->second;
+  const int num = std::min<int>(batch_size, pending.size());
+  vector<int> top_shape = bucket->first;
+  top_shape[0] = num;
+  batch->data_.Reshape(top_shape);
+  batch->label_.Reshape(vector<int>(1, num));
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  for (int item_id = 0; item_id < num; ++item_id) {
+    const shared_ptr<Blob<Dtype> > clip = pending.front().first;
+    caffe_copy(clip->count(), clip->cpu_data(),
+        prefetch_data + batch->data_.offset(item_id));
+    prefetch_label[item_id] = pending.front().second;
+    free_clips_.push_back(clip);
+    pending.pop_front();
+    --num_pending_;
+  }
+  if (pending.empty()) {
+    buckets_.erase(bucket);
+  }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch of shape " << batch->data_.shape_string()
+             << ": " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  if (this->layer_param_.video_data_param().bucket_by_shape()) {
+    load_bucketed_batch(batch);
+    return;
+  }
   CPUTimer batch_timer;
   batch_timer.Start();
   double read_time = 0;
@@ -125,7 +349,6 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   VideoDataParameter video_data_param = this->layer_param_.video_data_param();
   const int batch_size = video_data_param.batch_size();
-  const int new_length = video_data_param.new_length();
   const int new_height = video_data_param.new_height();
   const int new_width = video_data_param.new_width();
   const bool is_color = video_data_param.is_color();
@@ -134,19 +357,9 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
   std::vector<cv::Mat> cv_imgs;
-  bool read_video_result = ReadVideoToCVMat(root_folder +
-                                             lines_[lines_id_].first,
-                                             lines_[lines_id_].second,
-                                             new_length, new_height, new_width,
-                                             is_color,
-                                             &cv_imgs);
-  CHECK(read_video_result) << "Could not load " << lines_[lines_id_].first <<
-                              " at frame " << lines_[lines_id_].second << ".";
-  CHECK_EQ(cv_imgs.size(), new_length) << "Could not load " <<
-                                          lines_[lines_id_].first <<
-                                          " at frame " <<
-                                          lines_[lines_id_].second <<
-                                          " correctly.";
+  ReadClipOrDie(root_folder + lines_[lines_id_].first,
+      ClipFrames(lines_[lines_id_]), new_height, new_width, is_color,
+      CropTransformer(), &cv_imgs);
   // Use data_transformer to infer the expected blob shape from a cv_imgs.
   bool is_video = true;
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_imgs,
@@ -166,18 +379,9 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     timer.Start();
     CHECK_GT(lines_size, lines_id_);
     std::vector<cv::Mat> cv_imgs;
-    bool read_video_result = ReadVideoToCVMat(root_folder +
-                                               lines_[lines_id_].first,
-                                               lines_[lines_id_].second,
-                                               new_length, new_height,
-                                               new_width, is_color, &cv_imgs);
-    CHECK(read_video_result) << "Could not load " << lines_[lines_id_].first <<
-                                " at frame " << lines_[lines_id_].second << ".";
-    CHECK_EQ(cv_imgs.size(), new_length) << "Could not load " <<
-                                             lines_[lines_id_].first <<
-                                            " at frame " <<
-                                            lines_[lines_id_].second <<
-                                            " correctly.";
+    ReadClipOrDie(root_folder + lines_[lines_id_].first,
+        ClipFrames(lines_[lines_id_]), new_height, new_width, is_color,
+        CropTransformer(), &cv_imgs);
     read_time += timer.MicroSeconds();
     timer.Start();
     // Apply transformations (mirror, crop...) to the image
@@ -190,15 +394,7 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
     prefetch_label[item_id] = lines_[lines_id_].third;
     // go to the next iter
-    lines_id_++;
-    if (lines_id_ >= lines_size) {
-      // We have reached the end. Restart from the first.
-      DLOG(INFO) << "Restarting data prefetching from start.";
-      lines_id_ = 0;
-      if (this->layer_param_.video_data_param().shuffle()) {
-        ShuffleVideos();
-      }
-    }
+    NextLine();
   }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <map>
 #include <set>
@@ -13,6 +14,7 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
@@ -50,13 +52,17 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
   // Create a copy of filtered_param with splits added where necessary.
+  NetParameter split_param;
+  InsertSplits(filtered_param, &split_param);
+  // Add reorders between layers that run in different blob layouts.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  InsertReorders<Dtype>(split_param, &param);
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  sparse_param_updates_ = false;
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -138,6 +144,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
+    layer_bottom_shapes_.push_back(vector<vector<int> >());
+    layer_top_shapes_.push_back(vector<vector<int> >());
+    RecordLayerShapes(layer_id);
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -473,6 +482,8 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
     has_params_decay_.push_back(param_spec->has_decay_mult());
     params_lr_.push_back(param_spec->lr_mult());
     params_weight_decay_.push_back(param_spec->decay_mult());
+    learnable_param_diff_rows_.push_back(
+        layers_[layer_id]->param_diff_rows(param_id));
   } else {
     // Named param blob with name we've seen before: share params
     const int owner_net_param_id = param_names_index_[param_name];
@@ -509,6 +520,11 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
     }
     const int learnable_param_id = learnable_param_ids_[owner_net_param_id];
     learnable_param_ids_.push_back(learnable_param_id);
+    CHECK(!learnable_param_diff_rows_[learnable_param_id] &&
+          !layers_[layer_id]->param_diff_rows(param_id))
+        << "Cannot share param '" << param_name << "' with layer '"
+        << layer_names_[layer_id] << "'; params with sparse gradients "
+        << "cannot be shared.";
     if (param_spec->has_lr_mult()) {
       if (has_params_lr_[learnable_param_id]) {
         CHECK_EQ(param_spec->lr_mult(), params_lr_[learnable_param_id])
@@ -539,6 +555,8 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    // Layer::Forward reshapes the layer first.
+    RecordLayerShapes(i);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -733,10 +751,55 @@ void Net<Dtype>::Backward() {
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
+    // Reshape is usually a function of the bottom shapes, so a layer that
+    // has already shaped its tops for the current bottoms has nothing to do.
+    // Layers without bottoms (data and Python input layers), and those that
+    // say their tops depend on other state, always run.
+    if (!bottom_vecs_[i].empty() &&
+        layers_[i]->ReshapeDependsOnlyOnBottomShapes() &&
+        !LayerShapesChanged(i)) {
+      continue;
+    }
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    RecordLayerShapes(i);
+  }
+}
+
+template <typename Dtype>
+static bool ShapesEqual(const vector<Blob<Dtype>*>& blobs,
+    const vector<vector<int> >& shapes) {
+  if (blobs.size() != shapes.size()) {
+    return false;
+  }
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i]->shape() != shapes[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+static void CopyShapes(const vector<Blob<Dtype>*>& blobs,
+    vector<vector<int> >* shapes) {
+  shapes->resize(blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    (*shapes)[i] = blobs[i]->shape();
   }
 }
 
+template <typename Dtype>
+bool Net<Dtype>::LayerShapesChanged(const int layer_id) const {
+  return !ShapesEqual(bottom_vecs_[layer_id], layer_bottom_shapes_[layer_id])
+      || !ShapesEqual(top_vecs_[layer_id], layer_top_shapes_[layer_id]);
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecordLayerShapes(const int layer_id) {
+  CopyShapes(bottom_vecs_[layer_id], &layer_bottom_shapes_[layer_id]);
+  CopyShapes(top_vecs_[layer_id], &layer_top_shapes_[layer_id]);
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   int num_source_layers = param.layer_size();
@@ -795,6 +858,7 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -857,6 +921,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -915,7 +980,19 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+    const vector<int>* rows = learnable_param_diff_rows(i);
+    if (rows) {
+      Blob<Dtype>* blob = learnable_params_[i];
+      const int row_dim = blob->count(1);
+      const Dtype* diff = blob->cpu_diff();
+      Dtype* data = blob->mutable_cpu_data();
+      for (int j = 0; j < rows->size(); ++j) {
+        const int offset = (*rows)[j] * row_dim;
+        caffe_axpy(row_dim, Dtype(-1), diff + offset, data + offset);
+      }
+    } else {
+      learnable_params_[i]->Update();
+    }
   }
 }
 
@@ -923,6 +1000,17 @@ template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
+    vector<int>* rows = learnable_param_diff_rows_[i];
+    if (rows && sparse_param_updates_) {
+      const int row_dim = blob->count(1);
+      Dtype* diff = blob->mutable_cpu_diff();
+      for (int j = 0; j < rows->size(); ++j) {
+        caffe_set(row_dim, Dtype(0), diff + (*rows)[j] * row_dim);
+      }
+      rows->clear();
+      continue;
+    }
+    if (rows) { rows->clear(); }
     switch (Caffe::mode()) {
     case Caffe::CPU:
       caffe_set(blob->count(), static_cast<Dtype>(0),
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/codebook.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -197,6 +198,8 @@ void Solver<Dtype>::Step(int iters) {
   int average_loss = this->param_.average_loss();
   losses_.clear();
   smoothed_loss_ = 0;
+  net_->set_sparse_param_updates(Caffe::mode() == Caffe::CPU
+      && SupportsSparseParamUpdates());
 
   while (iter_ < stop_iter) {
     // zero-init the params
@@ -204,6 +207,7 @@ void Solver<Dtype>::Step(int iters) {
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())
         && Caffe::root_solver()) {
+      ApplyPendingUpdates();
       TestAll();
       if (requested_early_exit_) {
         // Break out of the while loop because stop was requested while testing.
@@ -271,6 +275,7 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
   }
+  ApplyPendingUpdates();
 }
 
 template <typename Dtype>
@@ -409,6 +414,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  ApplyPendingUpdates();
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -417,6 +423,9 @@ void Solver<Dtype>::Snapshot() {
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
     break;
+  case caffe::SolverParameter_SnapshotFormat_CODEBOOK:
+    model_filename = SnapshotToCodebook();
+    break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
@@ -466,6 +475,18 @@ string Solver<Dtype>::SnapshotToHDF5() {
   return model_filename;
 }
 
+template <typename Dtype>
+string Solver<Dtype>::SnapshotToCodebook() {
+  string model_filename = SnapshotFilename(".caffemodel");
+  LOG(INFO) << "Snapshotting to codebook-compressed binary proto file "
+      << model_filename;
+  NetParameter net_param;
+  net_->ToProto(&net_param, param_.snapshot_diff());
+  CodebookCompressNet(param_.snapshot_codebook_bits(), &net_param);
+  WriteProtoToBinaryFile(net_param, model_filename);
+  return model_filename;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
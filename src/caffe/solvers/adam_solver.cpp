@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -44,33 +45,33 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 
   switch (Caffe::mode()) {
     case Caffe::CPU: {
-    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
-    caffe_cpu_axpby(N, Dtype(1)-beta1,
-        net_params[param_id]->cpu_diff(), beta1,
-        val_m->mutable_cpu_data());
+    // With lazy_adam and a row-sparse gradient only the touched rows are
+    // updated; idle rows and their moments stay as they are.
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+    const int num_spans = rows ? rows->size() : 1;
+    const int span = rows ? net_params[param_id]->count(1) : N;
+    for (int i = 0; i < num_spans; ++i) {
+      const int offset = rows ? (*rows)[i] * span : 0;
+      const Dtype* g = net_params[param_id]->cpu_diff() + offset;
+      Dtype* m = val_m->mutable_cpu_data() + offset;
+      Dtype* v = val_v->mutable_cpu_data() + offset;
+      Dtype* update = val_t->mutable_cpu_data() + offset;
 
-    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
-    caffe_mul(N,
-        net_params[param_id]->cpu_diff(),
-        net_params[param_id]->cpu_diff(),
-    val_t->mutable_cpu_data());
-    caffe_cpu_axpby(N, Dtype(1)-beta2,
-        val_t->cpu_data(), beta2,
-        val_v->mutable_cpu_data());
+      // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
+      caffe_cpu_axpby(span, Dtype(1)-beta1, g, beta1, m);
 
-    // set update
-    caffe_powx(N,
-        val_v->cpu_data(), Dtype(0.5),
-        val_t->mutable_cpu_data());
-    caffe_add_scalar(N, eps_hat, val_t->mutable_cpu_data());
-    caffe_div(N,
-        val_m->cpu_data(),
-        val_t->cpu_data(),
-        val_t->mutable_cpu_data());
+      // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
+      caffe_mul(span, g, g, update);
+      caffe_cpu_axpby(span, Dtype(1)-beta2, update, beta2, v);
 
-    caffe_cpu_scale(N, local_rate*correction,
-        val_t->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+      // set update
+      caffe_powx(span, v, Dtype(0.5), update);
+      caffe_add_scalar(span, eps_hat, update);
+      caffe_div(span, m, update, update);
+
+      caffe_cpu_scale(span, local_rate*correction, update,
+          net_params[param_id]->mutable_cpu_diff() + offset);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -8,6 +10,11 @@
 
 namespace caffe {
 
+// The number of iterations for which the updates of idle rows of params with
+// row-sparse gradients may be deferred before all rows are brought up to date.
+// Bounds both the rate history and the per-iteration cost of catching up.
+static const int kMaxPendingIters = 1000;
+
 // Return the current learning rate. The currently implemented learning rate
 // policies are as follows:
 //    - fixed: always return base_lr.
@@ -69,6 +76,9 @@ void SGDSolver<Dtype>::PreSolve() {
   history_.clear();
   update_.clear();
   temp_.clear();
+  row_iters_.clear();
+  lazy_rates_.clear();
+  lazy_rates_start_ = 0;
   for (int i = 0; i < net_params.size(); ++i) {
     const vector<int>& shape = net_params[i]->shape();
     history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
@@ -84,7 +94,17 @@ void SGDSolver<Dtype>::ClipGradients() {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(i);
+    if (rows) {
+      const int row_dim = net_params[i]->count(1);
+      const Dtype* diff = net_params[i]->cpu_diff();
+      for (int j = 0; j < rows->size(); ++j) {
+        const Dtype* row_diff = diff + (*rows)[j] * row_dim;
+        sumsq_diff += caffe_cpu_dot(row_dim, row_diff, row_diff);
+      }
+    } else {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -93,7 +113,16 @@ void SGDSolver<Dtype>::ClipGradients() {
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      const vector<int>* rows = this->net_->learnable_param_diff_rows(i);
+      if (rows) {
+        const int row_dim = net_params[i]->count(1);
+        Dtype* diff = net_params[i]->mutable_cpu_diff();
+        for (int j = 0; j < rows->size(); ++j) {
+          caffe_scal(row_dim, scale_factor, diff + (*rows)[j] * row_dim);
+        }
+      } else {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -106,15 +135,107 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
   ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  bool has_sparse_params = false;
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    has_sparse_params |= (this->net_->learnable_param_diff_rows(param_id) !=
+                          NULL);
+  }
+  if (has_sparse_params) {
+    // Record the rate so idle rows can replay this iteration later.
+    if (lazy_rates_.size() >= kMaxPendingIters) {
+      ApplyPendingUpdates();
+    }
+    if (lazy_rates_.empty()) {
+      lazy_rates_start_ = this->iter_;
+    }
+    lazy_rates_.push_back(rate);
+    row_iters_.resize(net_params.size());
+  }
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+    if (rows) {
+      if (row_iters_[param_id].empty()) {
+        row_iters_[param_id].resize(net_params[param_id]->shape(0),
+                                    lazy_rates_start_);
+      }
+      CatchUpRows(param_id, *rows);
+    }
     Normalize(param_id);
     Regularize(param_id);
     ComputeUpdateValue(param_id, rate);
+    if (rows) {
+      for (int i = 0; i < rows->size(); ++i) {
+        row_iters_[param_id][(*rows)[i]] = this->iter_ + 1;
+      }
+    }
   }
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyPendingUpdates() {
+  if (lazy_rates_.empty()) { return; }
+  for (int param_id = 0; param_id < row_iters_.size(); ++param_id) {
+    if (row_iters_[param_id].empty()) { continue; }
+    vector<int> rows(row_iters_[param_id].size());
+    for (int i = 0; i < rows.size(); ++i) {
+      rows[i] = i;
+    }
+    CatchUpRows(param_id, rows);
+  }
+  lazy_rates_.clear();
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::CatchUpRows(int param_id, const vector<int>& rows) {
+  const int end_iter = this->iter_;
+  const int num_iters = end_iter - lazy_rates_start_;
+  if (num_iters <= 0) { return; }
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const Dtype lr_mult = this->net_->params_lr()[param_id];
+  CHECK(local_decay == 0 || this->param_.regularization_type() == "L2")
+      << "Only L2 regularization can be applied lazily to params with "
+      << "sparse gradients.";
+  // With no gradient, iteration s updates a row by the linear map
+  //   h <- momentum * h + rate_s * decay * w,  w <- w - h
+  // on (w, h). Precompute the products of these maps from every pending
+  // iteration up to end_iter, so that each row costs a single 2x2 transform
+  // of its data and history no matter how long it has been idle.
+  vector<Dtype> transitions(4 * num_iters);
+  Dtype m[4] = {1, 0, 0, 1};
+  for (int i = num_iters - 1; i >= 0; --i) {
+    const Dtype a = lazy_rates_[i] * lr_mult * local_decay;
+    const Dtype m0 = m[0] * (1 - a) + m[1] * a;
+    const Dtype m2 = m[2] * (1 - a) + m[3] * a;
+    m[1] = (m[1] - m[0]) * momentum;
+    m[3] = (m[3] - m[2]) * momentum;
+    m[0] = m0;
+    m[2] = m2;
+    std::copy(m, m + 4, transitions.begin() + 4 * i);
+  }
+  const int row_dim = param->count(1);
+  Dtype* data = param->mutable_cpu_data();
+  Dtype* history = history_[param_id]->mutable_cpu_data();
+  vector<int>& row_iter = row_iters_[param_id];
+  for (int i = 0; i < rows.size(); ++i) {
+    const int row = rows[i];
+    if (row_iter[row] >= end_iter) { continue; }
+    const Dtype* t = &transitions[4 * (row_iter[row] - lazy_rates_start_)];
+    Dtype* w = data + row * row_dim;
+    Dtype* h = history + row * row_dim;
+    for (int j = 0; j < row_dim; ++j) {
+      const Dtype w_j = w[j];
+      w[j] = t[0] * w_j + t[1] * h[j];
+      h[j] = t[2] * w_j + t[3] * h[j];
+    }
+    row_iter[row] = end_iter;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -123,6 +244,15 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
   const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+    if (rows) {
+      const int row_dim = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      for (int i = 0; i < rows->size(); ++i) {
+        caffe_scal(row_dim, accum_normalization, diff + (*rows)[i] * row_dim);
+      }
+      break;
+    }
     caffe_scal(net_params[param_id]->count(), accum_normalization,
         net_params[param_id]->mutable_cpu_diff());
     break;
@@ -151,7 +281,20 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    if (local_decay) {
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+    if (local_decay && rows) {
+      // Only the touched rows; CatchUpRows decays the others later.
+      const int row_dim = net_params[param_id]->count(1);
+      const Dtype* data = net_params[param_id]->cpu_data();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      CHECK(regularization_type == "L2")
+          << "Only L2 regularization can be applied lazily to params with "
+          << "sparse gradients.";
+      for (int i = 0; i < rows->size(); ++i) {
+        const int offset = (*rows)[i] * row_dim;
+        caffe_axpy(row_dim, local_decay, data + offset, diff + offset);
+      }
+    } else if (local_decay) {
       if (regularization_type == "L2") {
         // add weight decay
         caffe_axpy(net_params[param_id]->count(),
@@ -218,6 +361,19 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+    if (rows) {
+      const int row_dim = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* history = history_[param_id]->mutable_cpu_data();
+      for (int i = 0; i < rows->size(); ++i) {
+        const int offset = (*rows)[i] * row_dim;
+        caffe_cpu_axpby(row_dim, local_rate, diff + offset, momentum,
+            history + offset);
+        caffe_copy(row_dim, history + offset, diff + offset);
+      }
+      break;
+    }
     caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
               net_params[param_id]->cpu_diff(), momentum,
               history_[param_id]->mutable_cpu_data());
@@ -246,6 +402,8 @@ template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    // The history stays exact for codebook snapshots.
+    case caffe::SolverParameter_SnapshotFormat_CODEBOOK:
       SnapshotSolverStateToBinaryProto(model_filename);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
@@ -281,6 +439,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -307,6 +466,9 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   SolverState state;
   ReadProtoFromBinaryFile(state_file, &state);
   this->iter_ = state.iter();
+  // Snapshots hold fully updated weights; restart lazy tracking from here.
+  row_iters_.clear();
+  lazy_rates_.clear();
   if (state.has_learned_net()) {
     NetParameter net_param;
     ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
@@ -323,9 +485,13 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
+  // Snapshots hold fully updated weights; restart lazy tracking from here.
+  row_iters_.clear();
+  lazy_rates_.clear();
   if (H5LTfind_dataset(file_hid, "learned_net")) {
     string learned_net = hdf5_load_string(file_hid, "learned_net");
     this->net_->CopyTrainedLayersFrom(learned_net);
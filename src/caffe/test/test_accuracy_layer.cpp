@@ -246,6 +246,47 @@ TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopK) {
               num_correct_labels / 100.0, 1e-4);
 }
 
+TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopKWithSpatialAxes) {
+  this->blob_bottom_data_->Reshape(2, 10, 4, 5);
+  vector<int> label_shape(3);
+  label_shape[0] = 2; label_shape[1] = 4; label_shape[2] = 5;
+  this->blob_bottom_label_->Reshape(label_shape);
+  this->FillBottoms();
+  LayerParameter layer_param;
+  AccuracyParameter* accuracy_param = layer_param.mutable_accuracy_param();
+  accuracy_param->set_axis(1);
+  accuracy_param->set_top_k(this->top_k_);
+  AccuracyLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  const int num_labels = this->blob_bottom_label_->count();
+  int num_correct_labels = 0;
+  vector<int> label_offset(3);
+  for (int n = 0; n < this->blob_bottom_data_->num(); ++n) {
+    for (int h = 0; h < this->blob_bottom_data_->height(); ++h) {
+      for (int w = 0; w < this->blob_bottom_data_->width(); ++w) {
+        label_offset[0] = n; label_offset[1] = h; label_offset[2] = w;
+        const int correct_label =
+            static_cast<int>(this->blob_bottom_label_->data_at(label_offset));
+        const TypeParam correct_value =
+            this->blob_bottom_data_->data_at(n, correct_label, h, w);
+        int current_rank = 0;
+        for (int c = 0; c < this->blob_bottom_data_->channels(); ++c) {
+          if (this->blob_bottom_data_->data_at(n, c, h, w) > correct_value) {
+            ++current_rank;
+          }
+        }
+        if (current_rank < this->top_k_) {
+          ++num_correct_labels;
+        }
+      }
+    }
+  }
+  EXPECT_NEAR(this->blob_top_->data_at(0, 0, 0, 0),
+              num_correct_labels / TypeParam(num_labels), 1e-4);
+}
+
 TYPED_TEST(AccuracyLayerTest, TestForwardCPUPerClass) {
   LayerParameter layer_param;
   AccuracyLayer<TypeParam> layer(layer_param);
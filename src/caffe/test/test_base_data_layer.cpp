@@ -0,0 +1,153 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Loads batches of 2 items of the given channels stacked along axis 1, each
+// value counting up from 1000 times the index of the batch.
+template <typename Dtype>
+class StackedDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  StackedDataLayer(const LayerParameter& param, const vector<int>& channels,
+      const bool stacked)
+      : BasePrefetchingDataLayer<Dtype>(param), channels_(channels),
+        stacked_(stacked), num_batches_(0) {}
+  virtual ~StackedDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    const int num_data_tops = stacked_ ? channels_.size() : 1;
+    this->output_labels_ = top.size() > num_data_tops;
+    if (stacked_) {
+      this->stacked_data_channels_ = channels_;
+    }
+    for (int i = 0; i < BasePrefetchingDataLayer<Dtype>::PREFETCH_COUNT;
+         ++i) {
+      this->prefetch_[i].data_.Reshape(DataShape());
+      this->prefetch_[i].label_.Reshape(vector<int>(1, 2));
+    }
+  }
+  virtual inline const char* type() const { return "StackedData"; }
+
+  // The shape of the stacked data.
+  vector<int> DataShape() const {
+    vector<int> shape(4);
+    shape[0] = 2;
+    shape[1] = 0;
+    for (int i = 0; i < channels_.size(); ++i) {
+      shape[1] += channels_[i];
+    }
+    shape[2] = 3;
+    shape[3] = 4;
+    return shape;
+  }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    batch->data_.Reshape(DataShape());
+    batch->label_.Reshape(vector<int>(1, 2));
+    Dtype* data = batch->data_.mutable_cpu_data();
+    for (int i = 0; i < batch->data_.count(); ++i) {
+      data[i] = 1000 * num_batches_ + i;
+    }
+    Dtype* label = batch->label_.mutable_cpu_data();
+    for (int n = 0; n < 2; ++n) {
+      label[n] = 1000 * num_batches_ + n;
+    }
+    ++num_batches_;
+  }
+
+  vector<int> channels_;
+  bool stacked_;
+  int num_batches_;
+};
+
+template <typename TypeParam>
+class BaseDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  BaseDataLayerTest() {
+    channels_.push_back(3);
+    channels_.push_back(2);
+    channels_.push_back(1);
+    for (int i = 0; i < 4; ++i) {
+      blob_top_vec_.push_back(new Blob<Dtype>());
+    }
+  }
+  virtual ~BaseDataLayerTest() {
+    for (int i = 0; i < blob_top_vec_.size(); ++i) {
+      delete blob_top_vec_[i];
+    }
+  }
+
+  // Runs a few batches through a layer with the given tops, and checks that
+  // each data top holds its channels of each item and the label top the
+  // labels.
+  void TestSplit(const bool stacked, const int num_tops) {
+    vector<Blob<Dtype>*> top(blob_top_vec_.begin(),
+        blob_top_vec_.begin() + num_tops);
+    LayerParameter param;
+    StackedDataLayer<Dtype> layer(param, channels_, stacked);
+    layer.SetUp(blob_bottom_vec_, top);
+    const vector<int> data_shape = layer.DataShape();
+    const int num_data_tops = stacked ? channels_.size() : 1;
+    const int inner_count = data_shape[2] * data_shape[3];
+    for (int iter = 0; iter < 5; ++iter) {
+      layer.Forward(blob_bottom_vec_, top);
+      int channel = 0;
+      for (int i = 0; i < num_data_tops; ++i) {
+        const int channels = stacked ? channels_[i] : data_shape[1];
+        ASSERT_EQ(4, top[i]->num_axes());
+        EXPECT_EQ(2, top[i]->shape(0));
+        EXPECT_EQ(channels, top[i]->shape(1));
+        EXPECT_EQ(data_shape[2], top[i]->shape(2));
+        EXPECT_EQ(data_shape[3], top[i]->shape(3));
+        for (int n = 0; n < 2; ++n) {
+          for (int c = 0; c < channels; ++c) {
+            for (int j = 0; j < inner_count; ++j) {
+              EXPECT_EQ(1000 * iter +
+                  (n * data_shape[1] + channel + c) * inner_count + j,
+                  top[i]->cpu_data()[(n * channels + c) * inner_count + j]);
+            }
+          }
+        }
+        channel += channels;
+      }
+      if (num_tops > num_data_tops) {
+        const Blob<Dtype>& label = *top[num_data_tops];
+        ASSERT_EQ(2, label.count());
+        for (int n = 0; n < 2; ++n) {
+          EXPECT_EQ(1000 * iter + n, label.cpu_data()[n]);
+        }
+      }
+    }
+  }
+
+  vector<int> channels_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BaseDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BaseDataLayerTest, TestUnstacked) {
+  this->TestSplit(false, 2);
+}
+
+TYPED_TEST(BaseDataLayerTest, TestStackedSplit) {
+  this->TestSplit(true, 4);
+}
+
+TYPED_TEST(BaseDataLayerTest, TestStackedSplitWithoutLabels) {
+  this->TestSplit(true, 3);
+}
+
+}  // namespace caffe
@@ -59,6 +59,22 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareDataAfterLargerShape) {
+  // The preshaped blob's own memory holds 120; shrink it and share a 60.
+  this->blob_preshaped_->mutable_cpu_data();
+  this->blob_preshaped_->Reshape(1, 3, 4, 5);
+  Blob<TypeParam> other(1, 3, 4, 5);
+  this->blob_preshaped_->ShareData(other);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(),
+            other.count() * sizeof(TypeParam));
+  EXPECT_EQ(this->blob_preshaped_->cpu_data(), other.cpu_data());
+  // Growing again must not write into the smaller shared memory.
+  this->blob_preshaped_->Reshape(2, 3, 4, 5);
+  EXPECT_NE(this->blob_preshaped_->data(), other.data());
+  EXPECT_EQ(this->blob_preshaped_->data()->size(),
+            this->blob_preshaped_->count() * sizeof(TypeParam));
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/codebook.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class CodebookTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  CodebookTest() : num_threads_(Caffe::num_threads()) {}
+  virtual ~CodebookTest() {
+    Caffe::set_num_threads(num_threads_);
+  }
+
+  // A blob of gaussian weights.
+  void FillGaussian(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    filler_param.set_std(0.05);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Compresses blob with the given bits, and decompresses it into result
+  // through Blob::FromProto.
+  void RoundTrip(const Blob<Dtype>& blob, const int bits,
+      Blob<Dtype>* result, BlobProto* proto) {
+    blob.ToProto(proto);
+    CodebookCompress(bits, proto);
+    EXPECT_TRUE(IsCodebookCompressed(*proto));
+    EXPECT_EQ(0, proto->data_size());
+    EXPECT_EQ(0, proto->double_data_size());
+    EXPECT_LE(proto->codebook_size(), 1 << bits);
+    result->FromProto(*proto);
+    EXPECT_TRUE(result->shape() == blob.shape());
+  }
+
+  const int num_threads_;
+};
+
+TYPED_TEST_CASE(CodebookTest, TestDtypesAndDevices);
+
+TYPED_TEST(CodebookTest, TestFewValuesAreExact) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> blob(10, 3, 5, 7);
+  const Dtype kValues[] = {-0.5, 0, 0.25, 0.75, 3};
+  // Skewed frequencies give codes of different lengths.
+  for (int i = 0; i < blob.count(); ++i) {
+    blob.mutable_cpu_data()[i] = kValues[i % 7 % 5];
+  }
+  Blob<Dtype> result;
+  BlobProto proto;
+  this->RoundTrip(blob, 3, &result, &proto);
+  EXPECT_EQ(5, proto.codebook_size());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(blob.cpu_data()[i], result.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(CodebookTest, TestSingleValue) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> blob(4, 3, 2, 2);
+  caffe_set(blob.count(), Dtype(0.125), blob.mutable_cpu_data());
+  Blob<Dtype> result;
+  BlobProto proto;
+  this->RoundTrip(blob, 4, &result, &proto);
+  EXPECT_EQ(1, proto.codebook_size());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(Dtype(0.125), result.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(CodebookTest, TestNearestCodebookValue) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Several chunks, the last one partial, decoded in parallel.
+  Blob<Dtype> blob(3 * kCodebookChunkSize / 100 + 1, 10, 1, 10);
+  this->FillGaussian(&blob);
+  Caffe::set_num_threads(4);
+  for (int bits = 2; bits <= 8; bits += 2) {
+    Blob<Dtype> result;
+    BlobProto proto;
+    this->RoundTrip(blob, bits, &result, &proto);
+    EXPECT_EQ(4, proto.chunk_offsets_size());
+    vector<Dtype> codebook(proto.codebook().begin(), proto.codebook().end());
+    for (int j = 1; j < codebook.size(); ++j) {
+      EXPECT_LT(codebook[j - 1], codebook[j]);
+    }
+    for (int i = 0; i < blob.count(); ++i) {
+      const Dtype value = blob.cpu_data()[i];
+      const Dtype decoded = result.cpu_data()[i];
+      ASSERT_TRUE(std::binary_search(codebook.begin(), codebook.end(),
+          decoded));
+      // No other codebook value is nearer.
+      const int j = std::lower_bound(codebook.begin(), codebook.end(), value)
+          - codebook.begin();
+      Dtype nearest = fabs(value - codebook[std::min<int>(j,
+          codebook.size() - 1)]);
+      if (j > 0) {
+        nearest = std::min<Dtype>(nearest, fabs(value - codebook[j - 1]));
+      }
+      ASSERT_NEAR(nearest, fabs(value - decoded), 1e-6);
+    }
+  }
+}
+
+TYPED_TEST(CodebookTest, TestEntropyCoding) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> blob(64, 32, 3, 3);
+  this->FillGaussian(&blob);
+  const int kBits = 6;
+  Blob<Dtype> result;
+  BlobProto proto;
+  this->RoundTrip(blob, kBits, &result, &proto);
+  // The gaussian indices take fewer bits than fixed-length ones.
+  EXPECT_LT(proto.coded_indices().size() * 8, blob.count() * kBits);
+  double error = 0;
+  double norm = 0;
+  for (int i = 0; i < blob.count(); ++i) {
+    const double value = blob.cpu_data()[i];
+    error += (value - result.cpu_data()[i]) * (value - result.cpu_data()[i]);
+    norm += value * value;
+  }
+  EXPECT_LT(std::sqrt(error / norm), 0.05);
+}
+
+TYPED_TEST(CodebookTest, TestCompressNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> weights(32, 16, 3, 3);
+  Blob<Dtype> bias(1, 1, 1, 32);
+  this->FillGaussian(&weights);
+  this->FillGaussian(&bias);
+  NetParameter param;
+  LayerParameter* layer = param.add_layer();
+  weights.ToProto(layer->add_blobs());
+  bias.ToProto(layer->add_blobs());
+  const int kBits = 4;
+  CodebookCompressNet(kBits, &param);
+  EXPECT_TRUE(IsCodebookCompressed(layer->blobs(0)));
+  // The bias is too small to compress.
+  EXPECT_FALSE(IsCodebookCompressed(layer->blobs(1)));
+  Blob<Dtype> result;
+  result.FromProto(layer->blobs(1));
+  for (int i = 0; i < bias.count(); ++i) {
+    EXPECT_EQ(bias.cpu_data()[i], result.cpu_data()[i]);
+  }
+  result.FromProto(layer->blobs(0));
+  std::set<Dtype> values(result.cpu_data(),
+      result.cpu_data() + result.count());
+  EXPECT_LE(values.size(), 1 << kBits);
+}
+
+}  // namespace caffe
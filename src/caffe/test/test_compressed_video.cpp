@@ -0,0 +1,163 @@
+#if defined(USE_OPENCV) && defined(USE_FFMPEG)
+#include <opencv2/core/core.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/compressed_video_data_layer.hpp"
+#include "caffe/util/compressed_video.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CompressedVideoTest : public ::testing::Test {
+ protected:
+  CompressedVideoTest()
+      : path_(CMAKE_SOURCE_DIR
+              "caffe/test/test_data/UCF-101_Rowing_g16_c03.avi") {}
+
+  string path_;
+};
+
+TEST_F(CompressedVideoTest, TestReadCompressedVideo) {
+  // Repeated and out of order.
+  const int kFrames[] = {1, 3, 2, 3};
+  vector<int> frames(kFrames, kFrames + 4);
+  CompressedFrames compressed;
+  ASSERT_TRUE(ReadCompressedVideo(path_, frames, &compressed));
+  ASSERT_EQ(frames.size(), compressed.iframes.size());
+  ASSERT_EQ(frames.size(), compressed.motion_vectors.size());
+  ASSERT_EQ(frames.size(), compressed.residuals.size());
+  std::vector<cv::Mat> cv_imgs;
+  ASSERT_TRUE(ReadVideoToCVMat(path_, frames, 0, 0, true, &cv_imgs));
+  for (int i = 0; i < frames.size(); ++i) {
+    EXPECT_EQ(CV_8UC3, compressed.iframes[i].type());
+    EXPECT_EQ(CV_32FC2, compressed.motion_vectors[i].type());
+    EXPECT_EQ(CV_16SC1, compressed.residuals[i].type());
+    EXPECT_EQ(cv_imgs[i].size(), compressed.iframes[i].size());
+    EXPECT_EQ(cv_imgs[i].size(), compressed.motion_vectors[i].size());
+    EXPECT_EQ(cv_imgs[i].size(), compressed.residuals[i].size());
+    // The first frame starts the GOP of the others.
+    EXPECT_EQ(compressed.iframes[0].data, compressed.iframes[i].data);
+  }
+  // The first frame is its own I-frame.
+  EXPECT_EQ(0, cv::norm(compressed.motion_vectors[0], cv::NORM_L1));
+  EXPECT_EQ(0, cv::norm(compressed.residuals[0], cv::NORM_L1));
+  EXPECT_LT(cv::norm(cv_imgs[0], compressed.iframes[0], cv::NORM_L1) /
+            cv_imgs[0].total() / cv_imgs[0].channels(), 2);
+  EXPECT_EQ(0, cv::norm(compressed.motion_vectors[1],
+                        compressed.motion_vectors[3], cv::NORM_L1));
+  EXPECT_EQ(0, cv::norm(compressed.residuals[1], compressed.residuals[3],
+                        cv::NORM_L1));
+  frames.push_back(100000);
+  EXPECT_FALSE(ReadCompressedVideo(path_, frames, &compressed));
+}
+
+class CompressedVideoDataLayerTest : public ::testing::Test {
+ protected:
+  CompressedVideoDataLayerTest() {
+    for (int i = 0; i < 4; ++i) {
+      blob_top_vec_.push_back(new Blob<float>());
+      mirrored_top_vec_.push_back(new Blob<float>());
+    }
+  }
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    for (int i = 0; i < 4; ++i) {
+      outfile << CMAKE_SOURCE_DIR "caffe/test/test_data/"
+          "UCF-101_Rowing_g16_c03.avi " << 2 * i << " " << i << "\n";
+    }
+    outfile.close();
+  }
+  virtual ~CompressedVideoDataLayerTest() {
+    for (int i = 0; i < 4; ++i) {
+      delete blob_top_vec_[i];
+      delete mirrored_top_vec_[i];
+    }
+  }
+
+  LayerParameter LayerParam(const bool mirror) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    VideoDataParameter* video_data_param = param.mutable_video_data_param();
+    video_data_param->set_source(filename_);
+    video_data_param->set_batch_size(4);
+    video_data_param->set_new_length(4);
+    video_data_param->set_new_height(24);
+    video_data_param->set_new_width(32);
+    param.mutable_transform_param()->set_mirror(mirror);
+    return param;
+  }
+
+  string filename_;
+  vector<Blob<float>*> blob_bottom_vec_;
+  vector<Blob<float>*> blob_top_vec_;
+  vector<Blob<float>*> mirrored_top_vec_;
+};
+
+TEST_F(CompressedVideoDataLayerTest, TestMirrorNegatesDx) {
+  CompressedVideoDataLayer<float> layer(LayerParam(false));
+  layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+  Caffe::set_random_seed(1701);
+  CompressedVideoDataLayer<float> mirrored_layer(LayerParam(true));
+  mirrored_layer.SetUp(blob_bottom_vec_, mirrored_top_vec_);
+  int num_mirrored = 0;
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    mirrored_layer.Forward(blob_bottom_vec_, mirrored_top_vec_);
+    const Blob<float>& iframes = *blob_top_vec_[0];
+    const Blob<float>& motion = *blob_top_vec_[1];
+    const Blob<float>& residuals = *blob_top_vec_[2];
+    const Blob<float>& mirrored_iframes = *mirrored_top_vec_[0];
+    const Blob<float>& mirrored_motion = *mirrored_top_vec_[1];
+    const Blob<float>& mirrored_residuals = *mirrored_top_vec_[2];
+    ASSERT_EQ(motion.shape(), mirrored_motion.shape());
+    ASSERT_EQ(2, motion.shape(1));
+    const int length = motion.shape(2);
+    const int height = motion.shape(3);
+    const int width = motion.shape(4);
+    for (int n = 0; n < 4; ++n) {
+      EXPECT_EQ(blob_top_vec_[3]->cpu_data()[n],
+                mirrored_top_vec_[3]->cpu_data()[n]);
+      // An item is mirrored when its I-frames differ.
+      bool mirror = false;
+      for (int i = 0; i < iframes.count(1); ++i) {
+        mirror |= iframes.cpu_data()[n * iframes.count(1) + i] !=
+            mirrored_iframes.cpu_data()[n * iframes.count(1) + i];
+      }
+      num_mirrored += mirror;
+      for (int l = 0; l < length; ++l) {
+        for (int h = 0; h < height; ++h) {
+          for (int w = 0; w < width; ++w) {
+            const int mirrored_w = mirror ? width - 1 - w : w;
+            const float dx = motion.data_at(n, 0, l, h, w);
+            const float dy = motion.data_at(n, 1, l, h, w);
+            EXPECT_EQ(mirror ? -dx : dx,
+                mirrored_motion.data_at(n, 0, l, h, mirrored_w));
+            EXPECT_EQ(dy, mirrored_motion.data_at(n, 1, l, h, mirrored_w));
+            EXPECT_EQ(residuals.data_at(n, 0, l, h, w),
+                mirrored_residuals.data_at(n, 0, l, h, mirrored_w));
+            for (int c = 0; c < 3; ++c) {
+              EXPECT_EQ(iframes.data_at(n, c, l, h, w),
+                  mirrored_iframes.data_at(n, c, l, h, mirrored_w));
+            }
+          }
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, 8);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV && USE_FFMPEG
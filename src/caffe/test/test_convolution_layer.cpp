@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/layout.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -822,6 +823,286 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestChannelsLastAgainstPlanar) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 3-D, 2-D and 1x1 convolution.
+  const int lengths[] = {5, 1, 3};
+  const int kernels[] = {3, 3, 1};
+  const int pads[] = {1, 0, 0};
+  const int strides[] = {2, 1, 1};
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int config = 0; config < 3; ++config) {
+    vector<int> bottom_shape(5);
+    bottom_shape[0] = 2;
+    bottom_shape[1] = 3;
+    bottom_shape[2] = lengths[config];
+    bottom_shape[3] = 6;
+    bottom_shape[4] = 4;
+    Blob<Dtype> bottom(bottom_shape);
+    filler.Fill(&bottom);
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kernels[config]);
+    convolution_param->add_pad(pads[config]);
+    convolution_param->add_stride(strides[config]);
+    convolution_param->set_num_output(4);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, this->blob_top_);
+    ConvolutionLayer<Dtype> planar_layer(layer_param);
+    planar_layer.SetUp(bottom_vec, top_vec);
+    filler.Fill(this->blob_top_);
+    caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    planar_layer.Forward(bottom_vec, top_vec);
+    vector<bool> propagate_down(1, true);
+    planar_layer.Backward(top_vec, propagate_down, bottom_vec);
+    const int num = bottom.shape(0);
+    const int top_spatial = this->blob_top_->count(2);
+    const int bottom_spatial = bottom.count(2);
+    // Run the same convolution on channels-last copies of the blobs.
+    Blob<Dtype> cl_bottom(bottom_shape);
+    Blob<Dtype> cl_top;
+    planar_to_channels_last_cpu(num, 3, bottom_spatial, bottom.cpu_data(),
+        cl_bottom.mutable_cpu_data());
+    cl_bottom.set_layout(CHANNELS_LAST);
+    layer_param.set_layout(CHANNELS_LAST);
+    ConvolutionLayer<Dtype> cl_layer(layer_param);
+    vector<Blob<Dtype>*> cl_bottom_vec(1, &cl_bottom);
+    vector<Blob<Dtype>*> cl_top_vec(1, &cl_top);
+    cl_layer.SetUp(cl_bottom_vec, cl_top_vec);
+    EXPECT_EQ(cl_top.layout(), CHANNELS_LAST);
+    ASSERT_EQ(cl_top.shape(), this->blob_top_->shape());
+    for (int i = 0; i < 2; ++i) {
+      cl_layer.blobs()[i]->CopyFrom(*planar_layer.blobs()[i]);
+    }
+    planar_to_channels_last_cpu(num, 4, top_spatial,
+        this->blob_top_->cpu_diff(), cl_top.mutable_cpu_diff());
+    cl_layer.Forward(cl_bottom_vec, cl_top_vec);
+    cl_layer.Backward(cl_top_vec, propagate_down, cl_bottom_vec);
+    Blob<Dtype> result;
+    result.ReshapeLike(cl_top);
+    channels_last_to_planar_cpu(num, 4, top_spatial, cl_top.cpu_data(),
+        result.mutable_cpu_data());
+    for (int i = 0; i < result.count(); ++i) {
+      EXPECT_NEAR(result.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-4);
+    }
+    result.ReshapeLike(bottom);
+    channels_last_to_planar_cpu(num, 3, bottom_spatial, cl_bottom.cpu_diff(),
+        result.mutable_cpu_data());
+    for (int i = 0; i < result.count(); ++i) {
+      EXPECT_NEAR(result.cpu_data()[i], bottom.cpu_diff()[i], 1e-4);
+    }
+    for (int i = 0; i < 2; ++i) {
+      const Blob<Dtype>& planar_param = *planar_layer.blobs()[i];
+      const Blob<Dtype>& cl_param = *cl_layer.blobs()[i];
+      for (int j = 0; j < planar_param.count(); ++j) {
+        EXPECT_NEAR(cl_param.cpu_diff()[j], planar_param.cpu_diff()[j],
+            1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientChannelsLast) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_layout(CHANNELS_LAST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  vector<int> bottom_shape = this->blob_bottom_->shape();
+  bottom_shape[2] = 4;
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestMultiThreadedAgainstSerial) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 3;
+  bottom_shape[2] = 6;
+  bottom_shape[3] = 4;
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  const int num_threads = Caffe::num_threads();
+  vector<shared_ptr<Blob<Dtype> > > results;
+  for (int run = 0; run < 2; ++run) {
+    // Images run in parallel on the second run.
+    Caffe::set_num_threads(run == 0 ? 1 : 4);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (run == 0) {
+      filler.Fill(this->blob_top_);
+      caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+          this->blob_top_->mutable_cpu_diff());
+      results.push_back(layer.blobs()[0]);
+      results.push_back(layer.blobs()[1]);
+    } else {
+      layer.blobs()[0]->CopyFrom(*results[0]);
+      layer.blobs()[1]->CopyFrom(*results[1]);
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<bool> propagate_down(1, true);
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    Blob<Dtype>* outputs[] = {this->blob_top_, this->blob_bottom_,
+        layer.blobs()[0].get(), layer.blobs()[1].get()};
+    for (int i = 0; i < 4; ++i) {
+      if (run == 0) {
+        results.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        results.back()->CopyFrom(*outputs[i], false, true);
+        results.back()->CopyFrom(*outputs[i], true);
+        continue;
+      }
+      const Blob<Dtype>& expected = *results[2 + i];
+      const Dtype* data = i == 0 ? outputs[i]->cpu_data()
+          : outputs[i]->cpu_diff();
+      const Dtype* expected_data = i == 0 ? expected.cpu_data()
+          : expected.cpu_diff();
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_NEAR(data[j], expected_data[j], 1e-5);
+      }
+    }
+  }
+  Caffe::set_num_threads(num_threads);
+}
+
+// Exposes the number of image blocks run in parallel.
+template <typename Dtype>
+class ParallelBlocksConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit ParallelBlocksConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  using ConvolutionLayer<Dtype>::parallel_blocks_cpu;
+};
+
+TYPED_TEST(ConvolutionLayerTest, TestParallelBlocksWithinWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 8;
+  bottom_shape[1] = 16;
+  bottom_shape[2] = 32;
+  bottom_shape[3] = 32;
+  this->blob_bottom_->Reshape(bottom_shape);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  const int num_threads = Caffe::num_threads();
+  Caffe::set_num_threads(4);
+  // A column buffer takes 16 * 9 * 32 * 32 values, 576 KB in float: all four
+  // threads get one in 4 MB, three in 2 MB, and the images run serially when
+  // none fits.
+  const int workspaces[] = {4, 2, 0};
+  const int float_blocks[] = {4, 3, 1};
+  const int double_blocks[] = {3, 1, 1};
+  for (int i = 0; i < 3; ++i) {
+    convolution_param->set_gemm_batch_workspace(workspaces[i]);
+    ParallelBlocksConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(sizeof(Dtype) == 4 ? float_blocks[i] : double_blocks[i],
+        layer.parallel_blocks_cpu());
+  }
+  Caffe::set_num_threads(num_threads);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGemmBatchAgainstPerImage) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 6;
+  bottom_shape[3] = 4;
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // A strided convolution, and a grouped 1x1 one that needs no im2col.
+  for (int config = 0; config < 2; ++config) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(config == 0 ? 3 : 1);
+    convolution_param->add_stride(config == 0 ? 2 : 1);
+    convolution_param->set_group(config == 0 ? 1 : 2);
+    convolution_param->set_num_output(4);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    vector<shared_ptr<Blob<Dtype> > > results;
+    // One GEMM per image, then blocks of 2 images (and a last one of 1).
+    for (int run = 0; run < 2; ++run) {
+      convolution_param->set_gemm_batch(run == 0 ? 1 : 2);
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      if (run == 0) {
+        filler.Fill(this->blob_top_);
+        caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+            this->blob_top_->mutable_cpu_diff());
+        results.push_back(layer.blobs()[0]);
+        results.push_back(layer.blobs()[1]);
+      } else {
+        layer.blobs()[0]->CopyFrom(*results[0]);
+        layer.blobs()[1]->CopyFrom(*results[1]);
+        caffe_set(layer.blobs()[0]->count(), Dtype(0),
+            layer.blobs()[0]->mutable_cpu_diff());
+        caffe_set(layer.blobs()[1]->count(), Dtype(0),
+            layer.blobs()[1]->mutable_cpu_diff());
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      vector<bool> propagate_down(1, true);
+      layer.Backward(this->blob_top_vec_, propagate_down,
+          this->blob_bottom_vec_);
+      Blob<Dtype>* outputs[] = {this->blob_top_, this->blob_bottom_,
+          layer.blobs()[0].get(), layer.blobs()[1].get()};
+      for (int i = 0; i < 4; ++i) {
+        if (run == 0) {
+          results.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          results.back()->CopyFrom(*outputs[i], false, true);
+          results.back()->CopyFrom(*outputs[i], true);
+          continue;
+        }
+        const Blob<Dtype>& expected = *results[2 + i];
+        const Dtype* data = i == 0 ? outputs[i]->cpu_data()
+            : outputs[i]->cpu_diff();
+        const Dtype* expected_data = i == 0 ? expected.cpu_data()
+            : expected.cpu_diff();
+        for (int j = 0; j < expected.count(); ++j) {
+          EXPECT_NEAR(data[j], expected_data[j], 1e-4);
+        }
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
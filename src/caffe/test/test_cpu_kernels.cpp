@@ -0,0 +1,221 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpu_isa.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Checks that the kernels of every instruction set the CPU supports give
+// bitwise the same results as the generic ones.
+class CpuKernelsTest : public ::testing::Test {
+ protected:
+  // Odd so that the vector kernels also run their scalar remainder.
+  CpuKernelsTest() : n_(1003), a_(n_), b_(n_), bytes_(n_) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    caffe_rng_gaussian<float>(n_, 0, 1, &a_[0]);
+    caffe_rng_uniform<float>(n_, 0.5, 2, &b_[0]);
+    // Values whose handling differs between careless implementations.
+    a_[3] = 0;
+    a_[4] = -0.f;
+    a_[5] = std::numeric_limits<float>::quiet_NaN();
+    a_[6] = -std::numeric_limits<float>::infinity();
+    a_[n_ - 1] = std::numeric_limits<float>::quiet_NaN();
+    for (int i = 0; i < n_; ++i) {
+      bytes_[i] = static_cast<uint8_t>(i * 37);
+    }
+  }
+
+  // Instruction sets to compare with the generic kernels.
+  vector<CpuIsa> VectorIsas() {
+    vector<CpuIsa> isas;
+    for (int isa = CPU_ISA_SSE42; isa <= DetectCpuIsa(); ++isa) {
+      isas.push_back(static_cast<CpuIsa>(isa));
+    }
+    return isas;
+  }
+
+  void ExpectSame(const vector<float>& expected, const vector<float>& actual,
+      const CpuIsa isa) {
+    for (int i = 0; i < n_; ++i) {
+      EXPECT_EQ(0, memcmp(&expected[i], &actual[i], sizeof(float)))
+          << CpuIsaName(isa) << " at " << i << ": " << expected[i]
+          << " vs " << actual[i];
+    }
+  }
+
+  const int n_;
+  vector<float> a_;
+  vector<float> b_;
+  vector<uint8_t> bytes_;
+};
+
+TEST_F(CpuKernelsTest, TestBinary) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  vector<float> expected(n_), actual(n_);
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    generic.add(n_, &a_[0], &b_[0], &expected[0]);
+    kernels.add(n_, &a_[0], &b_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.sub(n_, &a_[0], &b_[0], &expected[0]);
+    kernels.sub(n_, &a_[0], &b_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.mul(n_, &a_[0], &b_[0], &expected[0]);
+    kernels.mul(n_, &a_[0], &b_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.div(n_, &a_[0], &b_[0], &expected[0]);
+    kernels.div(n_, &a_[0], &b_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+  }
+}
+
+TEST_F(CpuKernelsTest, TestUnary) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  vector<float> expected(n_), actual(n_);
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    generic.sqr(n_, &a_[0], &expected[0]);
+    kernels.sqr(n_, &a_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.sqrt(n_, &b_[0], &expected[0]);
+    kernels.sqrt(n_, &b_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.scale(n_, 1.5f, &a_[0], &expected[0]);
+    kernels.scale(n_, 1.5f, &a_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.scale_bias(n_, 1.5f, -0.25f, &a_[0], &expected[0]);
+    kernels.scale_bias(n_, 1.5f, -0.25f, &a_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+  }
+}
+
+TEST_F(CpuKernelsTest, TestReLU) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  vector<float> expected(n_), actual(n_);
+  const float slopes[] = {0, 0.25};
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    for (int s = 0; s < 2; ++s) {
+      generic.relu(n_, &a_[0], slopes[s], &expected[0]);
+      kernels.relu(n_, &a_[0], slopes[s], &actual[0]);
+      ExpectSame(expected, actual, isas[i]);
+      generic.relu_backward(n_, &b_[0], &a_[0], slopes[s], &expected[0]);
+      kernels.relu_backward(n_, &b_[0], &a_[0], slopes[s], &actual[0]);
+      ExpectSame(expected, actual, isas[i]);
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestMaxUpdate) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    vector<float> expected(n_, -1), actual(n_, -1);
+    vector<int> expected_mask(n_, -1), actual_mask(n_, -1);
+    generic.max_update(n_, &a_[0], 7, &expected[0], &expected_mask[0]);
+    kernels.max_update(n_, &a_[0], 7, &actual[0], &actual_mask[0]);
+    generic.max_update(n_, &b_[0], 9, &expected[0], &expected_mask[0]);
+    kernels.max_update(n_, &b_[0], 9, &actual[0], &actual_mask[0]);
+    ExpectSame(expected, actual, isas[i]);
+    for (int j = 0; j < n_; ++j) {
+      EXPECT_EQ(expected_mask[j], actual_mask[j]) << CpuIsaName(isas[i]);
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestReductionUpdates) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    vector<float> expected(b_), actual(b_);
+    generic.asum_update(n_, &a_[0], &expected[0]);
+    kernels.asum_update(n_, &a_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    expected = b_;
+    actual = b_;
+    generic.sumsq_update(n_, &a_[0], &expected[0]);
+    kernels.sumsq_update(n_, &a_[0], &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+  }
+}
+
+TEST_F(CpuKernelsTest, TestTransformU8) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  vector<float> expected(n_), actual(n_);
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    generic.transform_u8(n_, &bytes_[0], &b_[0], 0, 0.5, &expected[0]);
+    kernels.transform_u8(n_, &bytes_[0], &b_[0], 0, 0.5, &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+    generic.transform_u8(n_, &bytes_[0], NULL, 104, 0.017, &expected[0]);
+    kernels.transform_u8(n_, &bytes_[0], NULL, 104, 0.017, &actual[0]);
+    ExpectSame(expected, actual, isas[i]);
+  }
+}
+
+TEST_F(CpuKernelsTest, TestNary) {
+  const CpuKernels& generic = GetCpuKernels(CPU_ISA_GENERIC);
+  vector<float> c(n_);
+  caffe_rng_gaussian<float>(n_, 0, 1, &c[0]);
+  // Ties between the inputs exercise the choice of the winner.
+  c[10] = a_[10];
+  c[11] = b_[11];
+  const float* x[] = {&a_[0], &b_[0], &c[0], &a_[0]};
+  const float coeffs[] = {0.5, -1, 2, 3};
+  const vector<CpuIsa> isas = VectorIsas();
+  for (int i = 0; i < isas.size(); ++i) {
+    const CpuKernels& kernels = GetCpuKernels(isas[i]);
+    for (int num_inputs = 2; num_inputs <= 4; ++num_inputs) {
+      vector<float> expected(n_), actual(n_);
+      generic.sum_n(1, n_, num_inputs, x, NULL, &expected[0]);
+      kernels.sum_n(1, n_, num_inputs, x, NULL, &actual[0]);
+      ExpectSame(expected, actual, isas[i]);
+      generic.sum_n(0, n_, num_inputs, x, coeffs, &expected[0]);
+      kernels.sum_n(0, n_, num_inputs, x, coeffs, &actual[0]);
+      ExpectSame(expected, actual, isas[i]);
+      generic.prod_n(0, n_, num_inputs, x, &expected[0]);
+      kernels.prod_n(0, n_, num_inputs, x, &actual[0]);
+      ExpectSame(expected, actual, isas[i]);
+      vector<uint8_t> expected_mask(n_), actual_mask(n_);
+      generic.max_n(0, n_, num_inputs, x, &expected[0], &expected_mask[0]);
+      kernels.max_n(0, n_, num_inputs, x, &actual[0], &actual_mask[0]);
+      ExpectSame(expected, actual, isas[i]);
+      for (int j = 0; j < n_; ++j) {
+        EXPECT_EQ(expected_mask[j], actual_mask[j]) << CpuIsaName(isas[i]);
+      }
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestDispatch) {
+  const CpuIsa saved = cpu_isa();
+  vector<float> expected(n_), actual(n_);
+  caffe_cpu_relu<float>(n_, &a_[0], 0.25, &expected[0]);
+  for (int isa = CPU_ISA_GENERIC; isa <= DetectCpuIsa(); ++isa) {
+    SetCpuIsa(static_cast<CpuIsa>(isa));
+    EXPECT_EQ(isa, cpu_isa());
+    caffe_cpu_relu<float>(n_, &a_[0], 0.25, &actual[0]);
+    ExpectSame(expected, actual, static_cast<CpuIsa>(isa));
+  }
+  SetCpuIsa(saved);
+}
+
+}  // namespace caffe
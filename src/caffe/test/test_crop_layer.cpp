@@ -247,6 +247,115 @@ TYPED_TEST(CropLayerTest, TestCrop5D) {
   }
 }
 
+TYPED_TEST(CropLayerTest, TestCropOuterAxesView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  this->blob_bottom_1_->Reshape(1, 2, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The crop is contiguous, so the top aliases the bottom.
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(this->blob_bottom_0_->cpu_data() +
+        this->blob_bottom_0_->offset(0, 1), this->blob_top_->cpu_data());
+  }
+  for (int c = 0; c < 2; ++c) {
+    for (int h = 0; h < 5; ++h) {
+      for (int w = 0; w < 4; ++w) {
+        EXPECT_EQ(this->blob_bottom_0_->data_at(0, c + 1, h, w),
+            this->blob_top_->data_at(0, c, h, w));
+      }
+    }
+  }
+  // Cropping both images needs a copy, which must not write into the bottom.
+  this->blob_bottom_1_->Reshape(2, 2, 5, 4);
+  Blob<Dtype> bottom_copy;
+  bottom_copy.CopyFrom(*this->blob_bottom_0_, false, true);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 2; ++c) {
+      for (int h = 0; h < 5; ++h) {
+        for (int w = 0; w < 4; ++w) {
+          EXPECT_EQ(this->blob_bottom_0_->data_at(n, c + 1, h, w),
+              this->blob_top_->data_at(n, c, h, w));
+        }
+      }
+    }
+  }
+  caffe_set(this->blob_top_->count(), Dtype(0),
+      this->blob_top_->mutable_cpu_data());
+  for (int i = 0; i < bottom_copy.count(); ++i) {
+    EXPECT_EQ(bottom_copy.cpu_data()[i], this->blob_bottom_0_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(CropLayerTest, TestCropOuterAxesViewSync) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  // Crop both images first, so the top memory is larger than the view.
+  this->blob_bottom_1_->Reshape(2, 2, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->blob_bottom_1_->Reshape(1, 2, 5, 4);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The view spans the crop only, which syncs between devices read or write.
+  EXPECT_EQ(this->blob_top_->count() * sizeof(Dtype),
+      this->blob_top_->data()->size());
+  Blob<Dtype> bottom_copy;
+  bottom_copy.CopyFrom(*this->blob_bottom_0_, false, true);
+#ifndef CPU_ONLY
+  // Round trip the view through the other device.
+  if (Caffe::mode() == Caffe::CPU) {
+    this->blob_top_->mutable_gpu_data();
+  } else {
+    this->blob_top_->mutable_cpu_data();
+    this->blob_top_->gpu_data();
+  }
+#endif
+  for (int c = 0; c < 2; ++c) {
+    for (int h = 0; h < 5; ++h) {
+      for (int w = 0; w < 4; ++w) {
+        EXPECT_EQ(bottom_copy.data_at(0, c + 1, h, w),
+            this->blob_top_->data_at(0, c, h, w));
+      }
+    }
+  }
+  for (int i = 0; i < bottom_copy.count(); ++i) {
+    EXPECT_EQ(bottom_copy.cpu_data()[i], this->blob_bottom_0_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(CropLayerTest, TestCropOuterAxesViewGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  this->blob_bottom_1_->Reshape(1, 2, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(CropLayerTest, TestCropAllGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/deconv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -302,4 +303,73 @@ TYPED_TEST(DeconvolutionLayerTest, TestGradient3D) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(DeconvolutionLayerTest, Test3DAgainstND) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A 2x upsampling and a stride-1 setting through the 3-D im2col and
+  // col2im must both match the generic ND path.
+  const int kernel_sizes[2] = { 4, 3 };
+  const int strides[2] = { 2, 1 };
+  const int groups[2] = { 2, 1 };
+  vector<int> bottom_shape(5);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 3;
+  bottom_shape[3] = 4;
+  bottom_shape[4] = 5;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_vec_.resize(1);
+  this->blob_top_vec_.resize(1);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  vector<bool> propagate_down(1, true);
+  for (int t = 0; t < 2; ++t) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kernel_sizes[t]);
+    convolution_param->add_stride(strides[t]);
+    convolution_param->add_pad(1);
+    convolution_param->set_group(groups[t]);
+    convolution_param->set_num_output(6);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    Blob<Dtype> top_diff;
+    Blob<Dtype> results[2][4];
+    for (int nd = 0; nd < 2; ++nd) {
+      convolution_param->set_force_nd_im2col(nd == 1);
+      Caffe::set_random_seed(1701);
+      DeconvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      if (nd == 0) {
+        top_diff.ReshapeLike(*this->blob_top_);
+        filler.Fill(&top_diff);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      caffe_copy(top_diff.count(), top_diff.cpu_data(),
+                 this->blob_top_->mutable_cpu_diff());
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        caffe_set(layer.blobs()[i]->count(), Dtype(0),
+                  layer.blobs()[i]->mutable_cpu_diff());
+      }
+      layer.Backward(this->blob_top_vec_, propagate_down,
+                     this->blob_bottom_vec_);
+      results[nd][0].CopyFrom(*this->blob_top_, false, true);
+      results[nd][1].CopyFrom(*this->blob_bottom_, true, true);
+      results[nd][2].CopyFrom(*layer.blobs()[0], true, true);
+      results[nd][3].CopyFrom(*layer.blobs()[1], true, true);
+    }
+    for (int r = 0; r < 4; ++r) {
+      ASSERT_EQ(results[0][r].count(), results[1][r].count());
+      const Dtype* expected = (r == 0) ? results[1][r].cpu_data() :
+          results[1][r].cpu_diff();
+      const Dtype* actual = (r == 0) ? results[0][r].cpu_data() :
+          results[0][r].cpu_diff();
+      for (int i = 0; i < results[0][r].count(); ++i) {
+        EXPECT_NEAR(expected[i], actual[i], 1e-4);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -176,4 +176,42 @@ TYPED_TEST(EmbedLayerTest, TestGradientWithBias) {
       this->blob_top_vec_, -2);
 }
 
+TYPED_TEST(EmbedLayerTest, TestSparseGradientRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  EmbedParameter* embed_param = layer_param.mutable_embed_param();
+  embed_param->set_num_output(10);
+  embed_param->set_input_dim(6);
+  embed_param->set_bias_term(false);
+  embed_param->set_sparse_gradient(true);
+  embed_param->mutable_weight_filler()->set_type("uniform");
+  EmbedLayer<Dtype> layer(layer_param);
+  this->blob_bottom_->mutable_cpu_data()[0] = 4;
+  this->blob_bottom_->mutable_cpu_data()[1] = 2;
+  this->blob_bottom_->mutable_cpu_data()[2] = 2;
+  this->blob_bottom_->mutable_cpu_data()[3] = 3;
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_TRUE(layer.param_diff_rows(0) != NULL);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_set(this->blob_top_->count(), Dtype(1),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, false);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  if (Caffe::mode() == Caffe::GPU) {
+    // Rows are only recorded by the CPU implementation.
+    return;
+  }
+  const vector<int>& rows = *layer.param_diff_rows(0);
+  ASSERT_EQ(3, rows.size());
+  EXPECT_EQ(2, rows[0]);
+  EXPECT_EQ(3, rows[1]);
+  EXPECT_EQ(4, rows[2]);
+  // Rows accumulate across passes until cleared, without duplicates.
+  this->blob_bottom_->mutable_cpu_data()[0] = 0;
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  ASSERT_EQ(4, rows.size());
+  EXPECT_EQ(0, rows[0]);
+  EXPECT_EQ(4, rows[3]);
+}
+
 }  // namespace caffe
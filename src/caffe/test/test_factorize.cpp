@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/factorize.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FactorizeTest : public ::testing::Test {
+ protected:
+  FactorizeTest() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+  }
+
+  // A random m x n matrix of rank r.
+  vector<double> LowRankMatrix(const int m, const int n, const int r) {
+    vector<double> u(m * r), v(r * n), a(m * n);
+    caffe_rng_gaussian<double>(m * r, 0, 1, &u[0]);
+    caffe_rng_gaussian<double>(r * n, 0, 1, &v[0]);
+    caffe_cpu_gemm<double>(CblasNoTrans, CblasNoTrans, m, n, r, 1., &u[0],
+        &v[0], 0., &a[0]);
+    return a;
+  }
+
+  // The n x n Householder reflection through a random vector.
+  vector<double> Reflection(const int n) {
+    vector<double> x(n), h(n * n);
+    caffe_rng_gaussian<double>(n, 0, 1, &x[0]);
+    const double norm = caffe_cpu_dot<double>(n, &x[0], &x[0]);
+    for (int i = 0; i < n; ++i) {
+      for (int j = 0; j < n; ++j) {
+        h[i * n + j] = (i == j) - 2 * x[i] * x[j] / norm;
+      }
+    }
+    return h;
+  }
+
+  void CheckLowRankExact(const int m, const int n) {
+    const vector<double> a = LowRankMatrix(m, n, 2);
+    vector<double> left, right;
+    int rank;
+    const double error = LowRankFactor(a, m, n, 0, 1, &left, &right, &rank);
+    EXPECT_EQ(2, rank);
+    EXPECT_LT(error, 1e-10);
+    vector<double> product(m * n);
+    caffe_cpu_gemm<double>(CblasNoTrans, CblasNoTrans, m, n, rank, 1.,
+        &left[0], &right[0], 0., &product[0]);
+    for (int i = 0; i < m * n; ++i) {
+      EXPECT_NEAR(a[i], product[i], 1e-8);
+    }
+  }
+
+  // A net of an Input of the given shape and a 3-D convolution, conv.
+  NetParameter ConvNet(const vector<int>& shape, const int num_output) {
+    NetParameter param;
+    LayerParameter* input = param.add_layer();
+    input->set_name("data");
+    input->set_type("Input");
+    input->add_top("data");
+    BlobShape* input_shape = input->mutable_input_param()->add_shape();
+    for (int i = 0; i < shape.size(); ++i) {
+      input_shape->add_dim(shape[i]);
+    }
+    LayerParameter* conv = param.add_layer();
+    conv->set_name("conv");
+    conv->set_type("Convolution");
+    conv->add_bottom("data");
+    conv->add_top("conv");
+    ConvolutionParameter* conv_param = conv->mutable_convolution_param();
+    conv_param->set_num_output(num_output);
+    conv_param->add_kernel_size(3);
+    conv_param->add_pad(1);
+    conv_param->mutable_weight_filler()->set_type("gaussian");
+    conv_param->mutable_bias_filler()->set_type("gaussian");
+    return param;
+  }
+
+  // Factorizes conv at the given rank, checks the shapes of the rewritten
+  // layers, and returns the largest difference of their output from conv's.
+  double FactorizeAndCompare(const FactorizationMethod method,
+      const int rank, const vector<int>& first_shape,
+      const vector<int>& second_shape) {
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    shape[3] = 5;
+    shape[4] = 6;
+    const NetParameter param = ConvNet(shape, 4);
+    Net<float> net(param);
+    Blob<float>* data = net.blob_by_name("data").get();
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(data);
+    net.Forward();
+    const Blob<float>& weights = *net.layer_by_name("conv")->blobs()[0];
+    ConvFactorization factorization;
+    FactorizeConvolution(param.layer(1), weights, method, rank, 1,
+        &factorization);
+    EXPECT_EQ(first_shape, factorization.first_shape);
+    EXPECT_EQ(second_shape, factorization.second_shape);
+    EXPECT_EQ(first_shape[0],
+        factorization.first.convolution_param().num_output());
+    EXPECT_FALSE(factorization.first.convolution_param().bias_term());
+    EXPECT_EQ("conv", factorization.second.top(0));
+
+    NetParameter factorized_param;
+    factorized_param.add_layer()->CopyFrom(param.layer(0));
+    factorized_param.add_layer()->CopyFrom(factorization.first);
+    factorized_param.add_layer()->CopyFrom(factorization.second);
+    Net<float> factorized_net(factorized_param);
+    const vector<shared_ptr<Blob<float> > >& first =
+        factorized_net.layers()[1]->blobs();
+    const vector<shared_ptr<Blob<float> > >& second =
+        factorized_net.layers()[2]->blobs();
+    EXPECT_EQ(1, first.size());
+    EXPECT_EQ(2, second.size());
+    EXPECT_EQ(first_shape, first[0]->shape());
+    EXPECT_EQ(second_shape, second[0]->shape());
+    caffe_copy(first[0]->count(), &factorization.first_weights[0],
+        first[0]->mutable_cpu_data());
+    caffe_copy(second[0]->count(), &factorization.second_weights[0],
+        second[0]->mutable_cpu_data());
+    second[1]->CopyFrom(*net.layer_by_name("conv")->blobs()[1]);
+    factorized_net.blob_by_name("data")->CopyFrom(*data);
+    factorized_net.Forward();
+    const Blob<float>& top = *net.blob_by_name("conv");
+    const Blob<float>& factorized_top = *factorized_net.blob_by_name("conv");
+    EXPECT_EQ(top.shape(), factorized_top.shape());
+    double max_diff = 0;
+    for (int i = 0; i < top.count(); ++i) {
+      max_diff = std::max(max_diff, static_cast<double>(
+          std::fabs(top.cpu_data()[i] - factorized_top.cpu_data()[i])));
+    }
+    return max_diff;
+  }
+};
+
+TEST_F(FactorizeTest, TestSymmetricEigen) {
+  const int n = 5;
+  const double eigenvalues[] = {3, -1, 0.5, 2, 0};
+  // q diag(eigenvalues) q^T for an orthogonal q.
+  const vector<double> q = Reflection(n);
+  vector<double> a(n * n, 0);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      for (int k = 0; k < n; ++k) {
+        a[i * n + j] += q[i * n + k] * eigenvalues[k] * q[j * n + k];
+      }
+    }
+  }
+  const vector<double> original = a;
+  vector<double> v;
+  SymmetricEigen(n, &a, &v);
+  // a v = v diag(a) for each eigenpair, and v is orthogonal.
+  for (int k = 0; k < n; ++k) {
+    for (int i = 0; i < n; ++i) {
+      double av = 0;
+      for (int j = 0; j < n; ++j) {
+        av += original[i * n + j] * v[j * n + k];
+      }
+      EXPECT_NEAR(a[k * n + k] * v[i * n + k], av, 1e-10);
+    }
+    for (int l = 0; l < n; ++l) {
+      double dot = 0;
+      for (int i = 0; i < n; ++i) {
+        dot += v[i * n + k] * v[i * n + l];
+      }
+      EXPECT_NEAR(k == l ? 1 : 0, dot, 1e-10);
+    }
+  }
+  double sum = 0;
+  for (int k = 0; k < n; ++k) {
+    sum += a[k * n + k];
+  }
+  EXPECT_NEAR(4.5, sum, 1e-10);
+}
+
+TEST_F(FactorizeTest, TestLowRankExactTall) {
+  CheckLowRankExact(9, 6);
+}
+
+TEST_F(FactorizeTest, TestLowRankExactWide) {
+  CheckLowRankExact(6, 9);
+}
+
+TEST_F(FactorizeTest, TestTruncationError) {
+  // a = h1 diag(4, 3, 2, 1) h2 for orthogonal h1 and h2, which has those
+  // singular values.
+  const int n = 4;
+  const double singular_values[] = {4, 3, 2, 1};
+  const vector<double> h1 = Reflection(n);
+  const vector<double> h2 = Reflection(n);
+  vector<double> a(n * n, 0);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      for (int k = 0; k < n; ++k) {
+        a[i * n + j] += h1[i * n + k] * singular_values[k] * h2[k * n + j];
+      }
+    }
+  }
+  // Truncation drops the smallest singular values out of a total energy of
+  // 16 + 9 + 4 + 1 = 30.
+  vector<double> left, right;
+  int rank;
+  double error = LowRankFactor(a, n, n, 2, 1, &left, &right, &rank);
+  EXPECT_EQ(2, rank);
+  EXPECT_NEAR(std::sqrt(5. / 30), error, 1e-10);
+  error = LowRankFactor(a, n, n, 3, 1, &left, &right, &rank);
+  EXPECT_EQ(3, rank);
+  EXPECT_NEAR(std::sqrt(1. / 30), error, 1e-10);
+  // Keeping 80% of the energy takes 25 / 30, and 90% takes 29 / 30.
+  error = LowRankFactor(a, n, n, 0, 0.8, &left, &right, &rank);
+  EXPECT_EQ(2, rank);
+  EXPECT_NEAR(std::sqrt(5. / 30), error, 1e-10);
+  error = LowRankFactor(a, n, n, 0, 0.9, &left, &right, &rank);
+  EXPECT_EQ(3, rank);
+  error = LowRankFactor(a, n, n, 0, 1, &left, &right, &rank);
+  EXPECT_EQ(4, rank);
+  EXPECT_LT(error, 1e-10);
+}
+
+TEST_F(FactorizeTest, TestSeparableFullRank) {
+  // The (o, t) x (c, h, w) matrix of 4 x 3 x 3 x 3 x 3 filters is 12 x 27.
+  vector<int> first_shape(5), second_shape(5);
+  first_shape[0] = 12;
+  first_shape[1] = 3;
+  first_shape[2] = 1;
+  first_shape[3] = 3;
+  first_shape[4] = 3;
+  second_shape[0] = 4;
+  second_shape[1] = 12;
+  second_shape[2] = 3;
+  second_shape[3] = 1;
+  second_shape[4] = 1;
+  EXPECT_LT(FactorizeAndCompare(SEPARABLE_FACTORIZATION, 0, first_shape,
+      second_shape), 1e-4);
+}
+
+TEST_F(FactorizeTest, TestChannelFullRank) {
+  vector<int> first_shape(5, 3), second_shape(5, 1);
+  first_shape[0] = 4;
+  second_shape[0] = 4;
+  second_shape[1] = 4;
+  EXPECT_LT(FactorizeAndCompare(CHANNEL_FACTORIZATION, 0, first_shape,
+      second_shape), 1e-4);
+}
+
+TEST_F(FactorizeTest, TestSeparableTruncated) {
+  vector<int> first_shape(5, 3), second_shape(5, 1);
+  first_shape[0] = 2;
+  first_shape[2] = 1;
+  second_shape[0] = 4;
+  second_shape[1] = 2;
+  second_shape[2] = 3;
+  EXPECT_GT(FactorizeAndCompare(SEPARABLE_FACTORIZATION, 2, first_shape,
+      second_shape), 1e-4);
+}
+
+}  // namespace caffe
@@ -119,4 +119,59 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestForwardBuffered) {
+  typedef typename TypeParam::Dtype Dtype;
+  hid_t file_id = H5Fopen(this->input_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->input_file_name_;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 5,
+                       this->blob_data_);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 5,
+                       this->blob_label_);
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0)<< "Failed to close HDF5 file " <<
+      this->input_file_name_;
+  this->blob_bottom_vec_.push_back(this->blob_data_);
+  this->blob_bottom_vec_.push_back(this->blob_label_);
+
+  // Use a buffer size that does not divide the batch size, so that batches
+  // straddle buffers and the last buffer is only partially filled.
+  const int num_forward = 3;
+  const int num = this->blob_data_->shape(0);
+  LayerParameter param;
+  param.mutable_hdf5_output_param()->set_file_name(this->output_file_name_);
+  param.mutable_hdf5_output_param()->set_buffer_rows(num - 1);
+  {
+    HDF5OutputLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < num_forward; ++i) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    }
+  }
+  file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                    H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data, blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 5, &blob_data);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 5, &blob_label);
+  status = H5Fclose(file_id);
+  EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+      this->output_file_name_;
+
+  ASSERT_EQ(num * num_forward, blob_data.shape(0));
+  ASSERT_EQ(num * num_forward, blob_label.shape(0));
+  ASSERT_EQ(this->blob_data_->count() * num_forward, blob_data.count());
+  ASSERT_EQ(this->blob_label_->count() * num_forward, blob_label.count());
+  for (int i = 0; i < blob_data.count(); ++i) {
+    EXPECT_EQ(this->blob_data_->cpu_data()[i % this->blob_data_->count()],
+              blob_data.cpu_data()[i]);
+  }
+  for (int i = 0; i < blob_label.count(); ++i) {
+    EXPECT_EQ(this->blob_label_->cpu_data()[i % this->blob_label_->count()],
+              blob_label.cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
@@ -49,5 +49,33 @@ TEST_F(InternalThreadTest, TestRandomSeed) {
   t3.StopInternalThread();
 }
 
+class TestThreadBudget : public InternalThread {
+ public:
+  int max_threads_;
+ protected:
+  void InternalThreadEntry() { max_threads_ = Caffe::max_threads(); }
+};
+
+class TestDataThreadBudget : public TestThreadBudget {
+ protected:
+  void InternalThreadSetUp() { Caffe::EnterDataThread(); }
+};
+
+TEST_F(InternalThreadTest, TestThreadBudget) {
+  const int num_threads = Caffe::num_threads();
+  Caffe::set_num_threads(8);
+  // Only threads entering as data threads get the data share.
+  TestThreadBudget plain;
+  plain.StartInternalThread();
+  plain.StopInternalThread();
+  EXPECT_EQ(8, plain.max_threads_);
+  TestDataThreadBudget data;
+  data.StartInternalThread();
+  data.StopInternalThread();
+  EXPECT_EQ(Caffe::data_threads(), data.max_threads_);
+  EXPECT_LT(data.max_threads_, 8);
+  Caffe::set_num_threads(num_threads);
+}
+
 }  // namespace caffe
 
@@ -529,5 +529,126 @@ TEST_F(IOTest, TestReadVideoToCVMatFromAviResizeAndGrayscale) {
   EXPECT_EQ(cv_imgs[0].cols, 100);
 }
 */
+
+TEST_F(IOTest, TestReadVideoCropToCVMat) {
+  string path = CMAKE_SOURCE_DIR \
+                "caffe/test/test_data/youtube_objects_dog_v0002_s006";
+  int height, width;
+  EXPECT_TRUE(ReadVideoFrameSize(path, 1, &height, &width));
+  EXPECT_EQ(720, height);
+  EXPECT_EQ(1280, width);
+  std::vector<cv::Mat> cv_imgs;
+  EXPECT_TRUE(ReadVideoToCVMat(path, 1, 4, 0, 0, true, &cv_imgs));
+  // Not aligned to the iMCUs of the frames.
+  const cv::Rect roi(501, 203, 112, 112);
+  std::vector<cv::Mat> cv_crops;
+  EXPECT_TRUE(ReadVideoCropToCVMat(path, 1, 4, roi, true, &cv_crops));
+  ASSERT_EQ(4, cv_crops.size());
+  for (int i = 0; i < cv_crops.size(); ++i) {
+    ASSERT_EQ(3, cv_crops[i].channels());
+    ASSERT_EQ(112, cv_crops[i].rows);
+    ASSERT_EQ(112, cv_crops[i].cols);
+    const cv::Mat cv_img = cv_imgs[i](roi);
+    // Chroma upsampling may differ slightly at the edges of the decoded
+    // region.
+    for (int h = 0; h < roi.height; ++h) {
+      for (int w = 0; w < roi.width; ++w) {
+        for (int c = 0; c < 3; ++c) {
+          EXPECT_NEAR(cv_img.at<cv::Vec3b>(h, w)[c],
+              cv_crops[i].at<cv::Vec3b>(h, w)[c], 8);
+        }
+      }
+    }
+  }
+  EXPECT_FALSE(ReadVideoCropToCVMat(path, 2, 16, roi, true, &cv_crops));
+}
+
+TEST_F(IOTest, TestReadVideoToCVMatFrames) {
+  string path = CMAKE_SOURCE_DIR \
+                "caffe/test/test_data/youtube_objects_dog_v0002_s006";
+  EXPECT_EQ(16, CountVideoFrames(path));
+  std::vector<cv::Mat> cv_imgs;
+  EXPECT_TRUE(ReadVideoToCVMat(path, 1, 16, 80, 100, true, &cv_imgs));
+  // Strided, repeated and out of order.
+  const int kFrames[] = {1, 5, 9, 9, 16, 3};
+  vector<int> frames(kFrames, kFrames + 6);
+  std::vector<cv::Mat> cv_frames;
+  EXPECT_TRUE(ReadVideoToCVMat(path, frames, 80, 100, true, &cv_frames));
+  ASSERT_EQ(frames.size(), cv_frames.size());
+  for (int i = 0; i < frames.size(); ++i) {
+    const cv::Mat& expected = cv_imgs[frames[i] - 1];
+    ASSERT_EQ(expected.rows, cv_frames[i].rows);
+    ASSERT_EQ(expected.cols, cv_frames[i].cols);
+    EXPECT_EQ(0, cv::norm(expected, cv_frames[i], cv::NORM_L1));
+  }
+  frames.push_back(17);
+  EXPECT_FALSE(ReadVideoToCVMat(path, frames, 80, 100, true, &cv_frames));
+}
+
+TEST_F(IOTest, TestReadVideoToCVMatFromAviFrames) {
+  string path = CMAKE_SOURCE_DIR \
+                "caffe/test/test_data/UCF-101_Rowing_g16_c03.avi";
+  // The frames skipped between those of the list are grabbed, and must
+  // leave the capture where reading every frame does.
+  for (int start = 1; start <= 6; start += 5) {
+    std::vector<cv::Mat> cv_imgs;
+    EXPECT_TRUE(ReadVideoToCVMat(path, start, 13, 0, 0, true, &cv_imgs));
+    ASSERT_EQ(13, cv_imgs.size());
+    const int kOffsets[] = {8, 0, 3, 12, 3, 9};
+    vector<int> frames;
+    for (int i = 0; i < 6; ++i) {
+      frames.push_back(start + kOffsets[i]);
+    }
+    std::vector<cv::Mat> cv_frames;
+    EXPECT_TRUE(ReadVideoToCVMat(path, frames, 0, 0, true, &cv_frames));
+    ASSERT_EQ(frames.size(), cv_frames.size());
+    for (int i = 0; i < frames.size(); ++i) {
+      const cv::Mat& expected = cv_imgs[kOffsets[i]];
+      ASSERT_EQ(expected.size(), cv_frames[i].size());
+      EXPECT_EQ(0, cv::norm(expected, cv_frames[i], cv::NORM_L1));
+    }
+  }
+}
+
+TEST_F(IOTest, TestReadFlowToCVMat) {
+  string path;
+  MakeTempDir(&path);
+  // Flat flow, which JPEG keeps, along x and y.
+  for (int frame = 1; frame <= 4; ++frame) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/flow_x_%04d.jpg", path.c_str(),
+             frame);
+    cv::imwrite(filename, cv::Mat(48, 64, CV_8UC1, cv::Scalar(100 + frame)));
+    snprintf(filename, sizeof(filename), "%s/flow_y_%04d.jpg", path.c_str(),
+             frame);
+    cv::imwrite(filename, cv::Mat(48, 64, CV_8UC1, cv::Scalar(150 - frame)));
+  }
+  EXPECT_EQ(4, CountFlowFrames(path));
+  const int kFrames[] = {3, 1, 3};
+  vector<int> frames(kFrames, kFrames + 3);
+  std::vector<cv::Mat> cv_flows;
+  EXPECT_TRUE(ReadFlowToCVMat(path, frames, 24, 32, &cv_flows));
+  ASSERT_EQ(frames.size(), cv_flows.size());
+  for (int i = 0; i < frames.size(); ++i) {
+    EXPECT_EQ(CV_8UC2, cv_flows[i].type());
+    EXPECT_EQ(24, cv_flows[i].rows);
+    EXPECT_EQ(32, cv_flows[i].cols);
+    const cv::Scalar mean = cv::mean(cv_flows[i]);
+    EXPECT_NEAR(100 + frames[i], mean[0], 1);
+    EXPECT_NEAR(150 - frames[i], mean[1], 1);
+  }
+  const cv::Rect roi(8, 16, 40, 24);
+  std::vector<cv::Mat> cv_crops;
+  EXPECT_TRUE(ReadFlowCropToCVMat(path, frames, roi, &cv_crops));
+  ASSERT_EQ(frames.size(), cv_crops.size());
+  for (int i = 0; i < frames.size(); ++i) {
+    EXPECT_EQ(CV_8UC2, cv_crops[i].type());
+    EXPECT_EQ(roi.size(), cv_crops[i].size());
+    EXPECT_NEAR(100 + frames[i], cv::mean(cv_crops[i])[0], 1);
+  }
+  frames.push_back(5);
+  EXPECT_FALSE(ReadFlowToCVMat(path, frames, 0, 0, &cv_flows));
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
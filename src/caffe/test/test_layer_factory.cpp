@@ -26,8 +26,8 @@ TYPED_TEST(LayerFactoryTest, TestCreateLayer) {
   shared_ptr<Layer<Dtype> > layer;
   for (typename LayerRegistry<Dtype>::CreatorRegistry::iterator iter =
        registry.begin(); iter != registry.end(); ++iter) {
-    // Special case: PythonLayer is checked by pytest
-    if (iter->first == "Python") { continue; }
+    // Special case: PythonLayer and PythonDataLayer are checked by pytest
+    if (iter->first == "Python" || iter->first == "PythonData") { continue; }
     LayerParameter layer_param;
     // Data layers expect a DB
     if (iter->first == "Data") {
@@ -48,4 +48,42 @@ TYPED_TEST(LayerFactoryTest, TestCreateLayer) {
   }
 }
 
+TYPED_TEST(LayerFactoryTest, TestLayouts) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_type("ReLU");
+  EXPECT_TRUE(LayerRegistry<Dtype>::LayoutAgnostic(layer_param));
+  EXPECT_TRUE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  layer_param.set_type("PReLU");
+  EXPECT_FALSE(LayerRegistry<Dtype>::LayoutAgnostic(layer_param));
+  EXPECT_FALSE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  EXPECT_TRUE(LayerRegistry<Dtype>::SupportsLayout(layer_param, PLANAR));
+  layer_param.set_type("Convolution");
+  layer_param.mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_CAFFE);
+  EXPECT_FALSE(LayerRegistry<Dtype>::LayoutAgnostic(layer_param));
+  EXPECT_TRUE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  layer_param.mutable_convolution_param()->set_group(2);
+  EXPECT_FALSE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  layer_param.set_type("Pooling");
+  layer_param.mutable_pooling_param()->set_engine(
+      PoolingParameter_Engine_CAFFE);
+  layer_param.mutable_pooling_param()->set_pool(
+      PoolingParameter_PoolMethod_STOCHASTIC);
+  EXPECT_FALSE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  layer_param.mutable_pooling_param()->set_pool(
+      PoolingParameter_PoolMethod_AVE);
+  EXPECT_TRUE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+  // Layer types without registered layouts run in PLANAR only.
+  layer_param.set_type("Softmax");
+  EXPECT_FALSE(LayerRegistry<Dtype>::SupportsLayout(layer_param,
+      CHANNELS_LAST));
+}
+
 }  // namespace caffe
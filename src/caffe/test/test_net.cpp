@@ -8,6 +8,8 @@
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/neuron_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -16,6 +18,45 @@
 
 namespace caffe {
 
+// Passes its bottom through and counts its Reshape calls.
+template <typename Dtype>
+class ReshapeCountingLayer : public NeuronLayer<Dtype> {
+ public:
+  explicit ReshapeCountingLayer(const LayerParameter& param)
+      : NeuronLayer<Dtype>(param), reshapes_(0), only_bottom_shapes_(true) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    ++reshapes_;
+    NeuronLayer<Dtype>::Reshape(bottom, top);
+  }
+  virtual inline const char* type() const { return "ReshapeCounting"; }
+  virtual inline bool ReshapeDependsOnlyOnBottomShapes() const {
+    return only_bottom_shapes_;
+  }
+  int reshapes() const { return reshapes_; }
+  void set_only_bottom_shapes(const bool only) { only_bottom_shapes_ = only; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
+        top[0]->mutable_cpu_data());
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+    if (propagate_down[0]) {
+      caffe_copy(top[0]->count(), top[0]->cpu_diff(),
+          bottom[0]->mutable_cpu_diff());
+    }
+  }
+
+  int reshapes_;
+  bool only_bottom_shapes_;
+};
+
+REGISTER_LAYER_CLASS(ReshapeCounting);
+
 template <typename TypeParam>
 class NetTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -2378,6 +2419,74 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestReshapeSkipsUnchangedLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReshapableNet();
+  shared_ptr<Blob<Dtype> > input_blob = this->net_->blob_by_name("data");
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  input_blob->Reshape(2, 3, 12, 10);
+  this->net_->Reshape();
+  const vector<int> small_shape = output_blob->shape();
+  // Unchanged shapes: nothing to do.
+  this->net_->Reshape();
+  EXPECT_EQ(small_shape, output_blob->shape());
+  // A top reshaped behind the net's back is shaped again.
+  output_blob->Reshape(1, 1, 1, 1);
+  this->net_->Reshape();
+  EXPECT_EQ(small_shape, output_blob->shape());
+  // Shapes set up by a forward pass are tracked too.
+  input_blob->Reshape(4, 3, 9, 11);
+  this->net_->Forward();
+  const vector<int> large_shape = output_blob->shape();
+  EXPECT_NE(small_shape, large_shape);
+  input_blob->Reshape(2, 3, 12, 10);
+  this->net_->Reshape();
+  EXPECT_EQ(small_shape, output_blob->shape());
+  input_blob->Reshape(4, 3, 9, 11);
+  this->net_->Reshape();
+  EXPECT_EQ(large_shape, output_blob->shape());
+}
+
+TYPED_TEST(NetTest, TestReshapeCallsOnlyChangedLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'ReshapeCountingNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 1 dim: 3 dim: 4 dim: 5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'count' "
+      "  type: 'ReshapeCounting' "
+      "  bottom: 'data' "
+      "  top: 'count' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  ReshapeCountingLayer<Dtype>* layer =
+      static_cast<ReshapeCountingLayer<Dtype>*>(
+      this->net_->layer_by_name("count").get());
+  const int reshapes = layer->reshapes();
+  // Unchanged shapes: the layer is skipped.
+  this->net_->Reshape();
+  this->net_->Reshape();
+  EXPECT_EQ(reshapes, layer->reshapes());
+  // A new bottom shape: the layer is reshaped, once.
+  this->net_->blob_by_name("data")->Reshape(2, 3, 4, 5);
+  this->net_->Reshape();
+  EXPECT_EQ(reshapes + 1, layer->reshapes());
+  this->net_->Reshape();
+  EXPECT_EQ(reshapes + 1, layer->reshapes());
+  // A layer that opts out of the skip is reshaped every time.
+  layer->set_only_bottom_shapes(false);
+  this->net_->Reshape();
+  this->net_->Reshape();
+  EXPECT_EQ(reshapes + 3, layer->reshapes());
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -2473,4 +2582,98 @@ TYPED_TEST(NetTest, TestForcePropagateDown) {
   }
 }
 
+TYPED_TEST(NetTest, TestChannelsLastLayout) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'LayoutTestNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 8 dim: 8 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' std: 0.1 } } "
+      "} "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+      "layer { "
+      "  name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' type: 'Convolution' bottom: 'pool1' top: 'conv2' "
+      "  convolution_param { num_output: 5 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } } "
+      "} "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' } "
+      "layer { "
+      "  name: 'pool2' type: 'Pooling' bottom: 'conv2' top: 'pool2' "
+      "  pooling_param { pool: AVE kernel_size: 2 } "
+      "} "
+      "layer { "
+      "  name: 'ip' type: 'InnerProduct' bottom: 'conv2' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } } "
+      "} "
+      "layer { "
+      "  name: 'loss' type: 'Reduction' bottom: 'ip' top: 'loss' "
+      "  reduction_param { operation: SUMSQ } loss_weight: 1 "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> planar_net(param);
+  param.set_layout(CHANNELS_LAST);
+  Net<Dtype> cl_net(param);
+  NetParameter trained;
+  planar_net.ToProto(&trained);
+  cl_net.CopyTrainedLayersFrom(trained);
+  // Data enters, the inner product leaves and pool2 is handed out through a
+  // reorder; everything in between runs channels-last.
+  int num_reorders = 0;
+  for (int i = 0; i < cl_net.layers().size(); ++i) {
+    const Layer<Dtype>& layer = *cl_net.layers()[i];
+    if (string(layer.type()) == "Reorder") {
+      ++num_reorders;
+    } else if (layer.type() == string("InnerProduct") ||
+               layer.type() == string("Input") ||
+               layer.type() == string("Reduction")) {
+      EXPECT_EQ(layer.layout(), PLANAR);
+    } else {
+      EXPECT_EQ(layer.layout(), CHANNELS_LAST) << layer.type();
+    }
+  }
+  EXPECT_EQ(num_reorders, 3);
+  EXPECT_EQ(cl_net.blob_by_name("pool2")->layout(), PLANAR);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(planar_net.input_blobs()[0]);
+  cl_net.input_blobs()[0]->CopyFrom(*planar_net.input_blobs()[0]);
+  planar_net.ForwardBackward();
+  cl_net.ForwardBackward();
+  const char* outputs[] = {"loss", "ip", "pool2"};
+  for (int i = 0; i < 3; ++i) {
+    const Blob<Dtype>& expected = *planar_net.blob_by_name(outputs[i]);
+    const Blob<Dtype>& actual = *cl_net.blob_by_name(outputs[i]);
+    ASSERT_EQ(expected.shape(), actual.shape());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_data()[j], actual.cpu_data()[j], 1e-4);
+    }
+  }
+  const Blob<Dtype>& expected_diff = *planar_net.input_blobs()[0];
+  const Blob<Dtype>& actual_diff = *cl_net.input_blobs()[0];
+  for (int j = 0; j < expected_diff.count(); ++j) {
+    EXPECT_NEAR(expected_diff.cpu_diff()[j], actual_diff.cpu_diff()[j], 1e-4);
+  }
+  const Blob<Dtype>& expected_weight_diff =
+      *planar_net.layer_by_name("conv1")->blobs()[0];
+  const Blob<Dtype>& actual_weight_diff =
+      *cl_net.layer_by_name("conv1")->blobs()[0];
+  for (int j = 0; j < expected_weight_diff.count(); ++j) {
+    EXPECT_NEAR(expected_weight_diff.cpu_diff()[j],
+        actual_weight_diff.cpu_diff()[j], 1e-4);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,132 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ParallelForTest : public ::testing::Test {
+ public:
+  void Visit(int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      ++visits_[i];
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    ++num_chunks_;
+    smallest_chunk_ = std::min(smallest_chunk_, end - begin);
+  }
+
+  void VisitNested(int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      parallel_for(i * 10, i * 10 + 10,
+          boost::bind(&ParallelForTest::Visit, this, _1, _2));
+    }
+  }
+
+  static double Sum(const vector<double>* values, int begin, int end) {
+    double sum = 0;
+    for (int i = begin; i < end; ++i) {
+      sum += (*values)[i];
+    }
+    return sum;
+  }
+
+  static double Add(const double& a, const double& b) {
+    return a + b;
+  }
+
+ protected:
+  ParallelForTest() : num_threads_(Caffe::num_threads()) {}
+  virtual ~ParallelForTest() {
+    Caffe::set_num_threads(num_threads_);
+  }
+
+  void Reset(int n) {
+    visits_.assign(n, 0);
+    num_chunks_ = 0;
+    smallest_chunk_ = n;
+  }
+
+  const int num_threads_;
+  boost::mutex mutex_;
+  vector<int> visits_;
+  int num_chunks_;
+  int smallest_chunk_;
+};
+
+TEST_F(ParallelForTest, TestVisitsAllIndicesOnce) {
+  const int thread_counts[] = {1, 2, 4};
+  for (int t = 0; t < 3; ++t) {
+    Caffe::set_num_threads(thread_counts[t]);
+    Reset(1000);
+    parallel_for(0, 1000, boost::bind(&ParallelForTest::Visit, this, _1, _2));
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_EQ(1, visits_[i]);
+    }
+    EXPECT_EQ(Caffe::num_threads(), Caffe::max_threads());
+  }
+}
+
+TEST_F(ParallelForTest, TestEmptyRange) {
+  Caffe::set_num_threads(4);
+  Reset(0);
+  parallel_for(5, 5, boost::bind(&ParallelForTest::Visit, this, _1, _2));
+  EXPECT_EQ(0, num_chunks_);
+}
+
+TEST_F(ParallelForTest, TestGrain) {
+  Caffe::set_num_threads(4);
+  Reset(1000);
+  parallel_for(0, 1000, boost::bind(&ParallelForTest::Visit, this, _1, _2),
+      300);
+  EXPECT_EQ(ParallelNumChunks(1000, 300), num_chunks_);
+  EXPECT_EQ(4, num_chunks_);
+  EXPECT_GE(smallest_chunk_, 250);
+  Reset(10);
+  parallel_for(0, 10, boost::bind(&ParallelForTest::Visit, this, _1, _2),
+      100);
+  EXPECT_EQ(1, num_chunks_);
+}
+
+TEST_F(ParallelForTest, TestNested) {
+  Caffe::set_num_threads(4);
+  Reset(1000);
+  parallel_for(0, 100,
+      boost::bind(&ParallelForTest::VisitNested, this, _1, _2));
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(1, visits_[i]);
+  }
+  EXPECT_EQ(4, Caffe::max_threads());
+}
+
+TEST_F(ParallelForTest, TestReduceIsReproducible) {
+  vector<double> values(10000);
+  for (int i = 0; i < values.size(); ++i) {
+    // Mixed magnitudes make the sum depend on the order of the additions.
+    values[i] = (i % 7 == 0 ? 1e10 : 1e-3) * (i % 2 ? 1 : -1);
+  }
+  double sums[3];
+  const int thread_counts[] = {1, 2, 4};
+  for (int t = 0; t < 3; ++t) {
+    Caffe::set_num_threads(thread_counts[t]);
+    sums[t] = parallel_reduce<double>(0, values.size(), 0,
+        boost::bind(&ParallelForTest::Sum, &values, _1, _2),
+        &ParallelForTest::Add, 100);
+  }
+  EXPECT_EQ(sums[0], sums[1]);
+  EXPECT_EQ(sums[0], sums[2]);
+  EXPECT_NEAR(Sum(&values, 0, values.size()), sums[0], 1e-1);
+  EXPECT_EQ(7, parallel_reduce<double>(3, 3, 7,
+      boost::bind(&ParallelForTest::Sum, &values, _1, _2),
+      &ParallelForTest::Add));
+}
+
+}  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/layout.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -609,6 +610,169 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestChannelsLastAgainstPlanar) {
+  typedef typename TypeParam::Dtype Dtype;
+  const PoolingParameter_PoolMethod pools[] = {
+      PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE};
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  const int num = this->blob_bottom_->num();
+  const int channels = this->blob_bottom_->channels();
+  // A single frame and a clip, which is pooled frame by frame.
+  for (int length = 1; length <= 3; length += 2) {
+    this->blob_bottom_->Reshape(num, channels, length, 6, 5);
+    filler.Fill(this->blob_bottom_);
+    const int bottom_spatial = this->blob_bottom_->count(2);
+    for (int i = 0; i < 2; ++i) {
+      for (int pad = 0; pad < 2; ++pad) {
+        LayerParameter layer_param;
+        PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+        pooling_param->set_kernel_size(3);
+        pooling_param->set_stride(2);
+        pooling_param->set_pad(pad);
+        pooling_param->set_pool(pools[i]);
+        PoolingLayer<Dtype> planar_layer(layer_param);
+        planar_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        filler.Fill(this->blob_top_);
+        caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+            this->blob_top_->mutable_cpu_diff());
+        planar_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        vector<bool> propagate_down(1, true);
+        planar_layer.Backward(this->blob_top_vec_, propagate_down,
+            this->blob_bottom_vec_);
+        const int top_spatial = this->blob_top_->count(2);
+        Blob<Dtype> cl_bottom;
+        Blob<Dtype> cl_top;
+        cl_bottom.ReshapeLike(*this->blob_bottom_);
+        planar_to_channels_last_cpu(num, channels, bottom_spatial,
+            this->blob_bottom_->cpu_data(), cl_bottom.mutable_cpu_data());
+        layer_param.set_layout(CHANNELS_LAST);
+        PoolingLayer<Dtype> cl_layer(layer_param);
+        vector<Blob<Dtype>*> cl_bottom_vec(1, &cl_bottom);
+        vector<Blob<Dtype>*> cl_top_vec(1, &cl_top);
+        cl_layer.SetUp(cl_bottom_vec, cl_top_vec);
+        ASSERT_EQ(cl_top.shape(), this->blob_top_->shape());
+        planar_to_channels_last_cpu(num, channels, top_spatial,
+            this->blob_top_->cpu_diff(), cl_top.mutable_cpu_diff());
+        cl_layer.Forward(cl_bottom_vec, cl_top_vec);
+        cl_layer.Backward(cl_top_vec, propagate_down, cl_bottom_vec);
+        Blob<Dtype> result;
+        result.ReshapeLike(cl_top);
+        channels_last_to_planar_cpu(num, channels, top_spatial,
+            cl_top.cpu_data(), result.mutable_cpu_data());
+        for (int j = 0; j < result.count(); ++j) {
+          EXPECT_NEAR(result.cpu_data()[j], this->blob_top_->cpu_data()[j],
+              1e-5);
+        }
+        result.ReshapeLike(cl_bottom);
+        channels_last_to_planar_cpu(num, channels, bottom_spatial,
+            cl_bottom.cpu_diff(), result.mutable_cpu_data());
+        for (int j = 0; j < result.count(); ++j) {
+          EXPECT_NEAR(result.cpu_data()[j], this->blob_bottom_->cpu_diff()[j],
+              1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestClipPoolsEachFrame) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num = 2, channels = 3, length = 4;
+  this->blob_bottom_->Reshape(num, channels, length, 6, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), num);
+  EXPECT_EQ(this->blob_top_->channels(), channels);
+  EXPECT_EQ(this->blob_top_->length(), length);
+  EXPECT_EQ(this->blob_top_->height(), 3);
+  EXPECT_EQ(this->blob_top_->width(), 2);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Pool every frame on its own and compare.
+  Blob<Dtype> frame(num, channels, 6, 5);
+  Blob<Dtype> frame_top;
+  vector<Blob<Dtype>*> frame_bottom_vec(1, &frame);
+  vector<Blob<Dtype>*> frame_top_vec(1, &frame_top);
+  PoolingLayer<Dtype> frame_layer(layer_param);
+  frame_layer.SetUp(frame_bottom_vec, frame_top_vec);
+  for (int l = 0; l < length; ++l) {
+    for (int n = 0; n < num; ++n) {
+      for (int c = 0; c < channels; ++c) {
+        caffe_copy(6 * 5, this->blob_bottom_->cpu_data() +
+            this->blob_bottom_->offset(n, c, l, 0, 0),
+            frame.mutable_cpu_data() + frame.offset(n, c));
+      }
+    }
+    frame_layer.Forward(frame_bottom_vec, frame_top_vec);
+    for (int n = 0; n < num; ++n) {
+      for (int c = 0; c < channels; ++c) {
+        for (int i = 0; i < 3 * 2; ++i) {
+          EXPECT_EQ(frame_top.cpu_data()[frame_top.offset(n, c) + i],
+              this->blob_top_->cpu_data()[
+              this->blob_top_->offset(n, c, l, 0, 0) + i]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestMultiThreadedAgainstSerial) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough planes for several parallel chunks.
+  this->blob_bottom_->Reshape(4, 128, 9, 7);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const PoolingParameter_PoolMethod methods[] = {
+      PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE};
+  const int num_threads = Caffe::num_threads();
+  for (int m = 0; m < 2; ++m) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(methods[m]);
+    Blob<Dtype> top_data;
+    Blob<Dtype> bottom_diff;
+    for (int run = 0; run < 2; ++run) {
+      Caffe::set_num_threads(run == 0 ? 1 : 4);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      if (run == 0) {
+        filler.Fill(this->blob_top_);
+        caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+            this->blob_top_->mutable_cpu_diff());
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      vector<bool> propagate_down(1, true);
+      layer.Backward(this->blob_top_vec_, propagate_down,
+          this->blob_bottom_vec_);
+      if (run == 0) {
+        top_data.CopyFrom(*this->blob_top_, false, true);
+        bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+        continue;
+      }
+      // Planes are pooled independently, so the results match exactly.
+      for (int i = 0; i < top_data.count(); ++i) {
+        EXPECT_EQ(top_data.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+      }
+      for (int i = 0; i < bottom_diff.count(); ++i) {
+        EXPECT_EQ(bottom_diff.cpu_diff()[i],
+            this->blob_bottom_->cpu_diff()[i]);
+      }
+    }
+  }
+  Caffe::set_num_threads(num_threads);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -91,6 +93,96 @@ class ReductionLayerTest : public MultiDeviceTest<TypeParam> {
         this->blob_top_vec_);
   }
 
+  // Reduces the given axes and checks the result against a direct
+  // computation over the bottom.
+  void TestForwardAxes(ReductionParameter_ReductionOp op,
+                       const vector<int>& axes, float coeff = 1) {
+    LayerParameter layer_param;
+    ReductionParameter* reduction_param = layer_param.mutable_reduction_param();
+    reduction_param->set_operation(op);
+    reduction_param->set_coeff(coeff);
+    const Blob<Dtype>& bottom = *this->blob_bottom_;
+    vector<bool> reduced(bottom.num_axes(), false);
+    int dim = 1;
+    for (int i = 0; i < axes.size(); ++i) {
+      reduction_param->add_reduce_axis(axes[i]);
+      reduced[bottom.CanonicalAxisIndex(axes[i])] = true;
+      dim *= bottom.shape(axes[i]);
+    }
+    ReductionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<Dtype> expected(this->blob_top_->count(), 0);
+    vector<bool> seen(this->blob_top_->count(), false);
+    for (int index = 0; index < bottom.count(); ++index) {
+      // The output of an input is indexed by its coordinates on the kept
+      // axes.
+      int top_index = 0;
+      for (int i = 0; i < bottom.num_axes(); ++i) {
+        if (!reduced[i]) {
+          top_index = top_index * bottom.shape(i) +
+              index / bottom.count(i + 1) % bottom.shape(i);
+        }
+      }
+      const Dtype value = bottom.cpu_data()[index];
+      Dtype& result = expected[top_index];
+      switch (op) {
+        case ReductionParameter_ReductionOp_SUM:
+          result += value;
+          break;
+        case ReductionParameter_ReductionOp_MEAN:
+          result += value / dim;
+          break;
+        case ReductionParameter_ReductionOp_ASUM:
+          result += fabs(value);
+          break;
+        case ReductionParameter_ReductionOp_SUMSQ:
+          result += value * value;
+          break;
+        case ReductionParameter_ReductionOp_MAX:
+          result = seen[top_index] ? std::max(result, value) : value;
+          break;
+        default:
+          LOG(FATAL) << "Unknown reduction op: "
+              << ReductionParameter_ReductionOp_Name(op);
+      }
+      seen[top_index] = true;
+    }
+    for (int i = 0; i < expected.size(); ++i) {
+      const Dtype expected_result = expected[i] * coeff;
+      EXPECT_NEAR(expected_result, this->blob_top_->cpu_data()[i],
+          1e-5 * std::max(Dtype(1), Dtype(fabs(expected_result))))
+          << "Incorrect result computed with op "
+          << ReductionParameter_ReductionOp_Name(op) << ", coeff " << coeff;
+    }
+  }
+
+  void TestGradientAxes(ReductionParameter_ReductionOp op,
+                        const vector<int>& axes, float coeff = 1) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    ReductionParameter* reduction_param = layer_param.mutable_reduction_param();
+    reduction_param->set_operation(op);
+    reduction_param->set_coeff(coeff);
+    for (int i = 0; i < axes.size(); ++i) {
+      reduction_param->add_reduce_axis(axes[i]);
+    }
+    ReductionLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 2e-3);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+
+  // Gives the inputs distinct values, further apart than the gradient
+  // checker steps, so that the maxima stay put.
+  void FillDistinct() {
+    Dtype* data = this->blob_bottom_->mutable_cpu_data();
+    const int count = this->blob_bottom_->count();
+    for (int i = 0; i < count; ++i) {
+      data[i] = Dtype(i * 37 % count) / 10;
+    }
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_top_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
@@ -293,4 +385,122 @@ TYPED_TEST(ReductionLayerTest, TestSumOfSquaresCoeffAxis1Gradient) {
   this->TestGradient(kOp, kCoeff, kAxis);
 }
 
+TYPED_TEST(ReductionLayerTest, TestSetUpWithReduceAxis) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_reduction_param()->add_reduce_axis(1);
+  layer_param.mutable_reduction_param()->add_reduce_axis(-1);
+  shared_ptr<ReductionLayer<Dtype> > layer(
+      new ReductionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<int> expected_shape = this->blob_bottom_->shape();
+  expected_shape.erase(expected_shape.begin() + 4);
+  expected_shape.erase(expected_shape.begin() + 1);
+  EXPECT_TRUE(this->blob_top_->shape() == expected_shape);
+  layer_param.mutable_reduction_param()->set_keep_dims(true);
+  layer.reset(new ReductionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  expected_shape = this->blob_bottom_->shape();
+  expected_shape[1] = 1;
+  expected_shape[4] = 1;
+  EXPECT_TRUE(this->blob_top_->shape() == expected_shape);
+}
+
+TYPED_TEST(ReductionLayerTest, TestSumReduceAxis1) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_SUM;
+  this->TestForwardAxes(kOp, vector<int>(1, 1));
+}
+
+TYPED_TEST(ReductionLayerTest, TestMeanCoeffReduceAxes0And4) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_MEAN;
+  const float kCoeff = 2.3;
+  vector<int> axes(1, 4);
+  axes.push_back(0);
+  this->TestForwardAxes(kOp, axes, kCoeff);
+}
+
+TYPED_TEST(ReductionLayerTest, TestAbsSumReduceAxes1And3) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_ASUM;
+  vector<int> axes(1, 1);
+  axes.push_back(3);
+  this->TestForwardAxes(kOp, axes);
+}
+
+TYPED_TEST(ReductionLayerTest, TestSumOfSquaresReduceAxes1And4) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_SUMSQ;
+  vector<int> axes(1, 1);
+  axes.push_back(4);
+  this->TestForwardAxes(kOp, axes);
+}
+
+TYPED_TEST(ReductionLayerTest, TestMaxReduceAxis1) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_MAX;
+  this->TestForwardAxes(kOp, vector<int>(1, 1));
+}
+
+TYPED_TEST(ReductionLayerTest, TestMaxReduceAxes0And4) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_MAX;
+  vector<int> axes(1, 0);
+  axes.push_back(4);
+  this->TestForwardAxes(kOp, axes);
+}
+
+TYPED_TEST(ReductionLayerTest, TestMaxCoeffTail) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_MAX;
+  const float kCoeff = 2.3;
+  vector<int> axes;
+  for (int i = 1; i < this->blob_bottom_->num_axes(); ++i) {
+    axes.push_back(i);
+  }
+  this->TestForwardAxes(kOp, axes, kCoeff);
+}
+
+TYPED_TEST(ReductionLayerTest, TestSumGradientReduceAxis1) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_SUM;
+  this->TestGradientAxes(kOp, vector<int>(1, 1));
+}
+
+TYPED_TEST(ReductionLayerTest, TestMeanCoeffGradientReduceAxes0And4) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_MEAN;
+  const float kCoeff = 2.3;
+  vector<int> axes(1, 0);
+  axes.push_back(4);
+  this->TestGradientAxes(kOp, axes, kCoeff);
+}
+
+TYPED_TEST(ReductionLayerTest, TestAbsSumGradientReduceAxes1And3) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_ASUM;
+  vector<int> axes(1, 1);
+  axes.push_back(3);
+  this->TestGradientAxes(kOp, axes);
+}
+
+TYPED_TEST(ReductionLayerTest, TestSumOfSquaresGradientReduceAxes1And4) {
+  const ReductionParameter_ReductionOp kOp =
+      ReductionParameter_ReductionOp_SUMSQ;
+  vector<int> axes(1, 1);
+  axes.push_back(4);
+  this->TestGradientAxes(kOp, axes);
+}
+
+TYPED_TEST(ReductionLayerTest, TestMaxGradientReduceAxis1) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_MAX;
+  this->FillDistinct();
+  this->TestGradientAxes(kOp, vector<int>(1, 1));
+}
+
+TYPED_TEST(ReductionLayerTest, TestMaxCoeffGradientReduceAxes0And4) {
+  const ReductionParameter_ReductionOp kOp = ReductionParameter_ReductionOp_MAX;
+  const float kCoeff = 2.3;
+  this->FillDistinct();
+  vector<int> axes(1, 0);
+  axes.push_back(4);
+  this->TestGradientAxes(kOp, axes, kCoeff);
+}
+
 }  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -290,6 +291,61 @@ TYPED_TEST(ScaleLayerTest, TestBackwardBroadcastMiddleInPlace) {
   }
 }
 
+TYPED_TEST(ScaleLayerTest, TestBackwardInPlaceRecomputeWithParamAndBias) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ScaleParameter* scale_param = layer_param.mutable_scale_param();
+  scale_param->set_axis(1);
+  scale_param->set_num_axes(2);
+  // Scales away from zero, which the bottom is recovered by dividing by.
+  scale_param->mutable_filler()->set_type("uniform");
+  scale_param->mutable_filler()->set_min(0.5);
+  scale_param->mutable_filler()->set_max(2);
+  scale_param->set_bias_term(true);
+  scale_param->mutable_bias_filler()->set_type("gaussian");
+  scale_param->set_in_place_recompute(true);
+  shared_ptr<ScaleLayer<Dtype> > layer(new ScaleLayer<Dtype>(layer_param));
+  Blob<Dtype> top_diff(this->blob_bottom_->shape());
+  FillerParameter filler_param;
+  filler_param.set_type("gaussian");
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&top_diff);
+  vector<bool> propagate_down(1, true);
+  // Run forward + backward without in-place computation;
+  // save resulting diffs.
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_top_->mutable_cpu_diff());
+  layer->Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const bool kReshape = true;
+  const bool kCopyDiff = true;
+  Blob<Dtype> orig_bottom_diff;
+  orig_bottom_diff.CopyFrom(*this->blob_bottom_, kCopyDiff, kReshape);
+  Blob<Dtype> orig_scale_diff;
+  orig_scale_diff.CopyFrom(*layer->blobs()[0], kCopyDiff, kReshape);
+  caffe_set(layer->blobs()[0]->count(), Dtype(0),
+            layer->blobs()[0]->mutable_cpu_diff());
+  // Rerun forward + backward in place, where the scale diff is computed from
+  // the top rather than from a copy of the bottom; check that the resulting
+  // diffs are the same.
+  this->blob_top_vec_[0] = this->blob_bottom_;  // in-place computation
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_bottom_->mutable_cpu_diff());
+  layer->Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(orig_bottom_diff.cpu_diff()[i],
+                this->blob_bottom_->cpu_diff()[i], 1e-5);
+  }
+  for (int i = 0; i < orig_scale_diff.count(); ++i) {
+    const Dtype expected = orig_scale_diff.cpu_diff()[i];
+    EXPECT_NEAR(expected, layer->blobs()[0]->cpu_diff()[i],
+                1e-4 * std::max(Dtype(1), std::fabs(expected)));
+  }
+}
+
 TYPED_TEST(ScaleLayerTest, TestForwardBroadcastMiddleWithParam) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -38,6 +38,79 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
     solver_.reset(new SGDSolver<Dtype>(param));
   }
 
+  // The weights of an Embed layer of 5 rows after iters iterations of the
+  // given solver, of which rows 1 and 3 are looked up in every iteration and
+  // the others never are.
+  shared_ptr<Blob<Dtype> > SparseEmbedWeights(const string& type,
+      const bool sparse, const bool lazy_adam, const int iters) {
+    ostringstream proto;
+    proto <<
+       "type: '" << type << "' "
+       "base_lr: 0.1 "
+       "lr_policy: 'step' "
+       "gamma: 0.5 "
+       "stepsize: 3 "
+       "momentum: 0.9 "
+       "weight_decay: 0.1 "
+       "lazy_adam: " << lazy_adam << " "
+       "random_seed: 1701 "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      shape { dim: 2 } "
+       "      shape { dim: 2 } "
+       "      shape { dim: 4 dim: 3 } "
+       "      data_filler { type: 'constant' value: 1 } "
+       "      data_filler { type: 'constant' value: 3 } "
+       "      data_filler { type: 'gaussian' } "
+       "    } "
+       "    top: 'index1' "
+       "    top: 'index2' "
+       "    top: 'target' "
+       "  } "
+       "  layer { "
+       "    name: 'concat' "
+       "    type: 'Concat' "
+       "    bottom: 'index1' "
+       "    bottom: 'index2' "
+       "    top: 'index' "
+       "    concat_param { axis: 0 } "
+       "  } "
+       "  layer { "
+       "    name: 'embed' "
+       "    type: 'Embed' "
+       "    bottom: 'index' "
+       "    top: 'embed' "
+       "    embed_param { "
+       "      num_output: 3 "
+       "      input_dim: 5 "
+       "      bias_term: false "
+       "      sparse_gradient: " << sparse << " "
+       "      weight_filler { type: 'gaussian' } "
+       "    } "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'embed' "
+       "    bottom: 'target' "
+       "  } "
+       "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    param.set_solver_mode(Caffe::mode() == Caffe::CPU ?
+        SolverParameter_SolverMode_CPU : SolverParameter_SolverMode_GPU);
+    shared_ptr<Solver<Dtype> > solver(
+        SolverRegistry<Dtype>::CreateSolver(param));
+    solver->Step(iters);
+    shared_ptr<Blob<Dtype> > weights(new Blob<Dtype>());
+    weights->CopyFrom(*solver->net()->learnable_params()[0], false, true);
+    return weights;
+  }
+
   shared_ptr<Solver<Dtype> > solver_;
 };
 
@@ -106,4 +179,53 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestSparseEmbedUpdatesMatchDense) {
+  typedef typename TypeParam::Dtype Dtype;
+  // SGD catches idle rows up on momentum and weight decay, so the sparse
+  // updates follow the dense ones exactly. Adam without lazy_adam updates
+  // every row densely.
+  const char* solver_types[] = { "SGD", "Adam" };
+  for (int t = 0; t < 2; ++t) {
+    shared_ptr<Blob<Dtype> > dense =
+        this->SparseEmbedWeights(solver_types[t], false, false, 10);
+    shared_ptr<Blob<Dtype> > sparse =
+        this->SparseEmbedWeights(solver_types[t], true, false, 10);
+    ASSERT_EQ(dense->count(), sparse->count());
+    for (int i = 0; i < dense->count(); ++i) {
+      EXPECT_NEAR(dense->cpu_data()[i], sparse->cpu_data()[i], 1e-4)
+          << solver_types[t] << " weight " << i;
+    }
+  }
+}
+
+TYPED_TEST(SolverTest, TestLazyAdamLeavesIdleRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() == Caffe::GPU) {
+    // Lazy updates are CPU only.
+    return;
+  }
+  shared_ptr<Blob<Dtype> > initial =
+      this->SparseEmbedWeights("Adam", true, true, 0);
+  shared_ptr<Blob<Dtype> > dense =
+      this->SparseEmbedWeights("Adam", false, false, 10);
+  shared_ptr<Blob<Dtype> > lazy =
+      this->SparseEmbedWeights("Adam", true, true, 10);
+  // The touched rows follow dense Adam, weight decay included, and the idle
+  // rows keep their initial weights where dense Adam decays them.
+  for (int row = 0; row < 5; ++row) {
+    for (int j = 0; j < 3; ++j) {
+      const int i = row * 3 + j;
+      if (row == 1 || row == 3) {
+        EXPECT_NEAR(dense->cpu_data()[i], lazy->cpu_data()[i], 1e-4)
+            << "weight " << i;
+      } else {
+        EXPECT_EQ(initial->cpu_data()[i], lazy->cpu_data()[i])
+            << "weight " << i;
+        EXPECT_NE(initial->cpu_data()[i], dense->cpu_data()[i])
+            << "weight " << i;
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -5,10 +5,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
-#include "caffe/layers/concat_layer.hpp"
-#include "caffe/layers/flatten_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
-#include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
 
 
@@ -130,5 +127,167 @@ TYPED_TEST(SPPLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SPPLayerTest, TestForwardMatchesPooling) {
+  typedef typename TypeParam::Dtype Dtype;
+  const SPPParameter_PoolMethod methods[2] =
+      { SPPParameter_PoolMethod_MAX, SPPParameter_PoolMethod_AVE };
+  const PoolingParameter_PoolMethod pool_methods[2] =
+      { PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE };
+  const int pyramid_height = 3;
+  const int num = this->blob_bottom_->num();
+  const int channels = this->blob_bottom_->channels();
+  const int height = this->blob_bottom_->height();
+  const int width = this->blob_bottom_->width();
+  for (int m = 0; m < 2; ++m) {
+    LayerParameter layer_param;
+    layer_param.mutable_spp_param()->set_pyramid_height(pyramid_height);
+    layer_param.mutable_spp_param()->set_pool(methods[m]);
+    SPPLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Every level must equal a PoolingLayer whose window tiles the input
+    // with 2^i bins, flattened and concatenated along the channels.
+    int level_offset = 0;
+    for (int i = 0; i < pyramid_height; ++i) {
+      const int num_bins = 1 << i;
+      const int kernel_h = (height + num_bins - 1) / num_bins;
+      const int kernel_w = (width + num_bins - 1) / num_bins;
+      LayerParameter pooling_layer_param;
+      PoolingParameter* pooling_param =
+          pooling_layer_param.mutable_pooling_param();
+      pooling_param->set_pool(pool_methods[m]);
+      pooling_param->set_kernel_h(kernel_h);
+      pooling_param->set_kernel_w(kernel_w);
+      pooling_param->set_stride_h(kernel_h);
+      pooling_param->set_stride_w(kernel_w);
+      pooling_param->set_pad_h((kernel_h * num_bins - height + 1) / 2);
+      pooling_param->set_pad_w((kernel_w * num_bins - width + 1) / 2);
+      PoolingLayer<Dtype> pooling_layer(pooling_layer_param);
+      Blob<Dtype> pooled;
+      vector<Blob<Dtype>*> pooled_vec(1, &pooled);
+      pooling_layer.SetUp(this->blob_bottom_vec_, pooled_vec);
+      pooling_layer.Forward(this->blob_bottom_vec_, pooled_vec);
+      const int level_dim = pooled.count() / num;
+      for (int n = 0; n < num; ++n) {
+        for (int j = 0; j < level_dim; ++j) {
+          EXPECT_NEAR(pooled.cpu_data()[n * level_dim + j],
+              this->blob_top_->cpu_data()[n * this->blob_top_->shape(1) +
+                                          level_offset + j], 1e-5);
+        }
+      }
+      level_offset += level_dim;
+    }
+    EXPECT_EQ(channels * 21, level_offset);
+  }
+}
+
+TYPED_TEST(SPPLayerTest, TestGradientAve) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SPPParameter* spp_param = layer_param.mutable_spp_param();
+  spp_param->set_pyramid_height(3);
+  spp_param->set_pool(SPPParameter_PoolMethod_AVE);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(SPPLayerTest, TestSetupTemporal) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5);
+  shape[0] = 2;
+  shape[1] = 3;
+  shape[2] = 4;
+  shape[3] = 8;
+  shape[4] = 8;
+  this->blob_bottom_->Reshape(shape);
+  LayerParameter layer_param;
+  layer_param.mutable_spp_param()->set_pyramid_height(3);
+  {
+    // Without a temporal pyramid every bin spans the whole clip: 3 * 21.
+    SPPLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_->num(), 2);
+    EXPECT_EQ(this->blob_top_->channels(), 63);
+  }
+  {
+    // Level i has 8^i bins: 3 * (1 + 8 + 64) = 219.
+    layer_param.mutable_spp_param()->set_temporal_pyramid(true);
+    SPPLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_->num(), 2);
+    EXPECT_EQ(this->blob_top_->channels(), 219);
+  }
+}
+
+TYPED_TEST(SPPLayerTest, TestTemporalBinsFit) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A clip fills 2^i temporal bins only if the padding stays below the
+  // kernel; SetUp rejects a pyramid_height whose levels it cannot fill.
+  EXPECT_TRUE(SPPLayer<Dtype>::AxisFitsBins(1, 1));
+  EXPECT_FALSE(SPPLayer<Dtype>::AxisFitsBins(1, 2));
+  EXPECT_FALSE(SPPLayer<Dtype>::AxisFitsBins(1, 4));
+  EXPECT_FALSE(SPPLayer<Dtype>::AxisFitsBins(3, 4));
+  EXPECT_TRUE(SPPLayer<Dtype>::AxisFitsBins(4, 4));
+  EXPECT_FALSE(SPPLayer<Dtype>::AxisFitsBins(5, 4));
+  EXPECT_TRUE(SPPLayer<Dtype>::AxisFitsBins(7, 4));
+  EXPECT_TRUE(SPPLayer<Dtype>::AxisFitsBins(16, 4));
+}
+
+TYPED_TEST(SPPLayerTest, TestForwardTemporal) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5);
+  shape[0] = 1;
+  shape[1] = 2;
+  shape[2] = 3;
+  shape[3] = 2;
+  shape[4] = 2;
+  this->blob_bottom_->Reshape(shape);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    this->blob_bottom_->mutable_cpu_data()[i] = i;
+  }
+  LayerParameter layer_param;
+  layer_param.mutable_spp_param()->set_pyramid_height(2);
+  layer_param.mutable_spp_param()->set_pool(SPPParameter_PoolMethod_AVE);
+  SPPLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Level 0 averages each 12-element channel; level 1 averages each
+  // (h, w) position over the 3 frames.
+  ASSERT_EQ(2 * (1 + 4), this->blob_top_->count());
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  EXPECT_NEAR(5.5, top_data[0], 1e-5);
+  EXPECT_NEAR(17.5, top_data[1], 1e-5);
+  for (int c = 0; c < 2; ++c) {
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_NEAR(12 * c + j + 4, top_data[2 + c * 4 + j], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(SPPLayerTest, TestGradientTemporal) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5);
+  shape[0] = 2;
+  shape[1] = 2;
+  shape[2] = 3;
+  shape[3] = 4;
+  shape[4] = 5;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SPPParameter* spp_param = layer_param.mutable_spp_param();
+  spp_param->set_pyramid_height(2);
+  spp_param->set_temporal_pyramid(true);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
 
 }  // namespace caffe
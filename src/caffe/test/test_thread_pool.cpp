@@ -0,0 +1,71 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  void Count() {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++count_;
+    in_worker_ += ThreadPool::InWorker();
+    max_threads_ = std::max(max_threads_, Caffe::max_threads());
+  }
+
+ protected:
+  ThreadPoolTest() : count_(0), in_worker_(0), max_threads_(0) {}
+
+  boost::mutex mutex_;
+  int count_;
+  int in_worker_;
+  int max_threads_;
+};
+
+TEST_F(ThreadPoolTest, TestRunsAllTasks) {
+  {
+    ThreadPool pool(3);
+    EXPECT_EQ(3, pool.num_threads());
+    for (int i = 0; i < 100; ++i) {
+      pool.Schedule(boost::bind(&ThreadPoolTest::Count, this));
+    }
+    // The destructor runs the scheduled tasks before joining.
+  }
+  EXPECT_EQ(100, count_);
+  EXPECT_EQ(100, in_worker_);
+  // BLAS calls of the workers stay serial.
+  EXPECT_EQ(1, max_threads_);
+  EXPECT_FALSE(ThreadPool::InWorker());
+}
+
+TEST_F(ThreadPoolTest, TestBudget) {
+  const int num_threads = Caffe::num_threads();
+  Caffe::set_num_threads(4);
+  EXPECT_EQ(4, Caffe::num_threads());
+  EXPECT_EQ(3, Caffe::thread_pool().num_threads());
+  EXPECT_EQ(4, Caffe::max_threads());
+  EXPECT_EQ(1, Caffe::data_threads());
+  Caffe::set_num_threads(num_threads);
+  EXPECT_EQ(num_threads - 1, Caffe::thread_pool().num_threads());
+}
+
+TEST_F(ThreadPoolTest, TestParseCpuList) {
+  const vector<int> cpus = ParseCpuList("0-2,5,7-8");
+  const int expected[] = {0, 1, 2, 5, 7, 8};
+  ASSERT_EQ(6, cpus.size());
+  for (int i = 0; i < cpus.size(); ++i) {
+    EXPECT_EQ(expected[i], cpus[i]);
+  }
+  EXPECT_TRUE(ParseCpuList("").empty());
+}
+
+}  // namespace caffe
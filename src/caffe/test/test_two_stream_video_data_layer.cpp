@@ -0,0 +1,208 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/two_stream_video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class TwoStreamVideoDataLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  TwoStreamVideoDataLayerTest()
+      : num_threads_(Caffe::num_threads()) {
+    for (int i = 0; i < 3; ++i) {
+      blob_top_vec_.push_back(new Blob<Dtype>());
+    }
+  }
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    // A directory of 4 frames of 8 x 16, whose values ramp along the
+    // width for the frames and the flow-x, and along the height for the
+    // flow-y, and rise with the frame. JPEG keeps them within 2.
+    MakeTempDir(&dir_);
+    vector<int> params;
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(100);
+    for (int frame = 1; frame <= 4; ++frame) {
+      cv::Mat image(8, 16, CV_8UC3);
+      cv::Mat flow_x(8, 16, CV_8UC1);
+      cv::Mat flow_y(8, 16, CV_8UC1);
+      for (int h = 0; h < 8; ++h) {
+        for (int w = 0; w < 16; ++w) {
+          image.at<cv::Vec3b>(h, w) = cv::Vec3b::all(ImageValue(frame, w));
+          flow_x.at<uchar>(h, w) = FlowXValue(frame, w);
+          flow_y.at<uchar>(h, w) = FlowYValue(frame, h);
+        }
+      }
+      char filename[256];
+      snprintf(filename, sizeof(filename), "%s/image_%04d.jpg", dir_.c_str(),
+               frame);
+      cv::imwrite(filename, image, params);
+      snprintf(filename, sizeof(filename), "%s/flow_x_%04d.jpg",
+               dir_.c_str(), frame);
+      cv::imwrite(filename, flow_x, params);
+      snprintf(filename, sizeof(filename), "%s/flow_y_%04d.jpg",
+               dir_.c_str(), frame);
+      cv::imwrite(filename, flow_y, params);
+    }
+    // Clips of 3 frames from frames 1 and 2, labelled by their first frame.
+    MakeTempFilename(&source_);
+    std::ofstream outfile(source_.c_str(), std::ofstream::out);
+    outfile << dir_ << " 1 1\n" << dir_ << " 2 2\n";
+    outfile.close();
+  }
+  virtual ~TwoStreamVideoDataLayerTest() {
+    Caffe::set_num_threads(num_threads_);
+    for (int i = 0; i < blob_top_vec_.size(); ++i) {
+      delete blob_top_vec_[i];
+    }
+  }
+
+  static int ImageValue(const int frame, const int w) {
+    return 20 + 10 * w + 5 * frame;
+  }
+  static int FlowXValue(const int frame, const int w) {
+    return 40 + 10 * w + 2 * frame;
+  }
+  static int FlowYValue(const int frame, const int h) {
+    return 100 + 10 * h + 2 * frame;
+  }
+
+  // Random 8 x 8 crops of the 8 x 16 frames, so along the width alone,
+  // mirrored at random.
+  LayerParameter LayerParam() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    VideoDataParameter* video_data_param = param.mutable_video_data_param();
+    video_data_param->set_source(source_);
+    video_data_param->set_batch_size(4);
+    video_data_param->set_new_length(3);
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(8);
+    transform_param->set_mirror(true);
+    return param;
+  }
+
+  int num_threads_;
+  string dir_;
+  string source_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(TwoStreamVideoDataLayerTest, TestDtypes);
+
+TYPED_TEST(TwoStreamVideoDataLayerTest, TestSharedFramesCropAndMirror) {
+  TwoStreamVideoDataLayer<TypeParam> layer(this->LayerParam());
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Blob<TypeParam>& rgb = *this->blob_top_vec_[0];
+  const Blob<TypeParam>& flow = *this->blob_top_vec_[1];
+  const Blob<TypeParam>& label = *this->blob_top_vec_[2];
+  int num_mirrored = 0;
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // The stacked batch splits into the tops.
+    vector<int> shape(5);
+    shape[0] = 4;
+    shape[1] = 3;
+    shape[2] = 3;
+    shape[3] = 8;
+    shape[4] = 8;
+    EXPECT_EQ(shape, rgb.shape());
+    shape[1] = 2;
+    EXPECT_EQ(shape, flow.shape());
+    EXPECT_EQ(vector<int>(1, 4), label.shape());
+    for (int n = 0; n < 4; ++n) {
+      const int start = label.cpu_data()[n];
+      EXPECT_EQ(n % 2 + 1, start);
+      // The offset of the crop of the frames, from their mean, and their
+      // mirroring, from their slope.
+      TypeParam sum = 0;
+      for (int i = 0; i < 64; ++i) {
+        sum += rgb.cpu_data()[rgb.offset(n, 0, 0) + i];
+      }
+      const int w_off = std::floor(
+          (sum / 64 - this->ImageValue(start, 0)) / 10 - 3.5 + 0.5);
+      EXPECT_GE(w_off, 0);
+      EXPECT_LE(w_off, 8);
+      const bool mirror =
+          rgb.data_at(n, 0, 0, 0, 7) < rgb.data_at(n, 0, 0, 0, 0);
+      num_mirrored += mirror;
+      for (int l = 0; l < 3; ++l) {
+        const int frame = start + l;
+        for (int h = 0; h < 8; ++h) {
+          for (int w = 0; w < 8; ++w) {
+            const int x = w_off + (mirror ? 7 - w : w);
+            for (int c = 0; c < 3; ++c) {
+              EXPECT_NEAR(this->ImageValue(frame, x),
+                  rgb.data_at(n, c, l, h, w), 2);
+            }
+            // The flow is less flow_mean_value, and mirroring negates the
+            // flow-x alone.
+            const int flow_x = this->FlowXValue(frame, x) - 128;
+            EXPECT_NEAR(mirror ? -flow_x : flow_x,
+                flow.data_at(n, 0, l, h, w), 2);
+            EXPECT_NEAR(this->FlowYValue(frame, h) - 128,
+                flow.data_at(n, 1, l, h, w), 2);
+          }
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, 8);
+}
+
+TYPED_TEST(TwoStreamVideoDataLayerTest, TestWithoutLabels) {
+  vector<Blob<TypeParam>*> top(this->blob_top_vec_.begin(),
+                               this->blob_top_vec_.begin() + 2);
+  TwoStreamVideoDataLayer<TypeParam> layer(this->LayerParam());
+  layer.SetUp(this->blob_bottom_vec_, top);
+  layer.Forward(this->blob_bottom_vec_, top);
+  EXPECT_EQ(3, top[0]->shape(1));
+  EXPECT_EQ(2, top[1]->shape(1));
+  EXPECT_EQ(4, top[1]->shape(0));
+}
+
+TYPED_TEST(TwoStreamVideoDataLayerTest, TestParallelDeterministic) {
+  // The batches of a seed do not depend on the threads reading and
+  // transforming their clips.
+  vector<vector<TypeParam> > batches[2];
+  const int kNumThreads[] = {1, 16};
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_num_threads(kNumThreads[run]);
+    Caffe::set_random_seed(1701);
+    TwoStreamVideoDataLayer<TypeParam> layer(this->LayerParam());
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+        const Blob<TypeParam>& top = *this->blob_top_vec_[i];
+        batches[run].push_back(vector<TypeParam>(top.cpu_data(),
+            top.cpu_data() + top.count()));
+      }
+    }
+  }
+  ASSERT_EQ(batches[0].size(), batches[1].size());
+  for (int i = 0; i < batches[0].size(); ++i) {
+    EXPECT_TRUE(batches[0][i] == batches[1][i]);
+  }
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
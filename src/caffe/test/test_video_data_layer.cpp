@@ -1,4 +1,9 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
 #include <vector>
@@ -9,6 +14,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/video_data_layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
 
@@ -57,6 +63,63 @@ class VideoDataLayerTest : public MultiDeviceTest<TypeParam> {
     delete blob_top_label_;
   }
 
+  // Makes a directory of 20 frames of the given size, where every value of
+  // frame f is 10 * f, and returns its path.
+  string MakeFrameDir(const int height, const int width) {
+    string path;
+    MakeTempDir(&path);
+    for (int frame = 1; frame <= 20; ++frame) {
+      char filename[256];
+      snprintf(filename, sizeof(filename), "%s/image_%04d.jpg", path.c_str(),
+               frame);
+      cv::imwrite(filename,
+          cv::Mat(height, width, CV_8UC3, cv::Scalar::all(10 * frame)));
+    }
+    return path;
+  }
+
+  // Writes the lines of a list of clips to a new file, and returns its name.
+  string MakeList(const vector<string>& lines) {
+    string filename;
+    MakeTempFilename(&filename);
+    std::ofstream outfile(filename.c_str(), std::ofstream::out);
+    for (int i = 0; i < lines.size(); ++i) {
+      outfile << lines[i] << "\n";
+    }
+    outfile.close();
+    return filename;
+  }
+
+  // Lists clips of 4 frames of two frame directories of distinct sizes,
+  // alternately, with labels 0, 1, 2, 3 and starting at frames 1, 1, 5, 5.
+  vector<string> BucketLines() {
+    const string large_dir = MakeFrameDir(12, 16);
+    const string small_dir = MakeFrameDir(8, 10);
+    vector<string> lines;
+    lines.push_back(large_dir + " 1 0 4");
+    lines.push_back(small_dir + " 1 1 4");
+    lines.push_back(large_dir + " 5 2 4");
+    lines.push_back(small_dir + " 5 3 4");
+    return lines;
+  }
+
+  // Checks that item n of the data holds the given frames of a directory
+  // made by MakeFrameDir, up to the JPEG error.
+  void CheckFrames(const Blob<Dtype>& data, const int n,
+      const vector<int>& frames) {
+    ASSERT_EQ(5, data.num_axes());
+    ASSERT_EQ(frames.size(), data.shape(2));
+    for (int c = 0; c < data.shape(1); ++c) {
+      for (int l = 0; l < frames.size(); ++l) {
+        for (int h = 0; h < data.shape(3); ++h) {
+          for (int w = 0; w < data.shape(4); ++w) {
+            EXPECT_NEAR(10 * frames[l], data.data_at(n, c, l, h, w), 2);
+          }
+        }
+      }
+    }
+  }
+
   int seed_;
   string filename_;
   string filename_reshape_;
@@ -68,6 +131,288 @@ class VideoDataLayerTest : public MultiDeviceTest<TypeParam> {
 
 TYPED_TEST_CASE(VideoDataLayerTest, TestDtypesAndDevices);
 
+// Exposes the sampling of the frames of clips, from videos of a given
+// number of frames.
+template <typename Dtype>
+class ClipFramesVideoDataLayer : public VideoDataLayer<Dtype> {
+ public:
+  ClipFramesVideoDataLayer(const LayerParameter& param, const int num_frames)
+      : VideoDataLayer<Dtype>(param), num_frames_(num_frames) {}
+  using VideoDataLayer<Dtype>::ClipFrames;
+  using VideoDataLayer<Dtype>::LoadLines;
+
+ protected:
+  virtual int CountFrames(const string& path) { return num_frames_; }
+
+  int num_frames_;
+};
+
+// The frames ClipFrames samples from a line of a video of num_frames frames.
+template <typename Dtype>
+vector<int> SampleClipFrames(const LayerParameter& param,
+    const int num_frames, const int start_frame) {
+  ClipFramesVideoDataLayer<Dtype> layer(param, num_frames);
+  triplet line;
+  line.first = "video";
+  line.second = start_frame;
+  line.third = 0;
+  line.length = 0;
+  return layer.ClipFrames(line);
+}
+
+TYPED_TEST(VideoDataLayerTest, TestClipFramesStride) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_new_length(4);
+  video_data_param->set_temporal_stride(3);
+  const int kFrames[] = {5, 8, 11, 14};
+  EXPECT_EQ(vector<int>(kFrames, kFrames + 4),
+      SampleClipFrames<Dtype>(param, 30, 5));
+}
+
+TYPED_TEST(VideoDataLayerTest, TestClipFramesSegments) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_new_length(6);
+  video_data_param->set_temporal_stride(2);
+  video_data_param->set_num_segments(3);
+  // Snippets of 2 frames span 3 frames, so they may start at the first 28
+  // frames, in segments [0, 9), [9, 18) and [18, 28); testing takes the
+  // middle of each.
+  const int kFrames[] = {5, 7, 14, 16, 24, 26};
+  EXPECT_EQ(vector<int>(kFrames, kFrames + 6),
+      SampleClipFrames<Dtype>(param, 30, 1));
+  // From frame 11, the snippets of 2 consecutive frames may start at the
+  // next 19 frames, in segments [0, 9) and [9, 19).
+  video_data_param->set_new_length(4);
+  video_data_param->set_temporal_stride(1);
+  video_data_param->set_num_segments(2);
+  const int kOffsetFrames[] = {15, 16, 25, 26};
+  EXPECT_EQ(vector<int>(kOffsetFrames, kOffsetFrames + 4),
+      SampleClipFrames<Dtype>(param, 30, 11));
+}
+
+TYPED_TEST(VideoDataLayerTest, TestClipFramesClampToLastFrame) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_new_length(6);
+  video_data_param->set_temporal_stride(2);
+  video_data_param->set_num_segments(2);
+  // Snippets span 5 frames of a video of 4: both start at the first frame,
+  // and repeat the last one.
+  const int kFrames[] = {1, 3, 4, 1, 3, 4};
+  EXPECT_EQ(vector<int>(kFrames, kFrames + 6),
+      SampleClipFrames<Dtype>(param, 4, 1));
+  // A clip starting at the last frame repeats it.
+  EXPECT_EQ(vector<int>(6, 4), SampleClipFrames<Dtype>(param, 4, 4));
+}
+
+TYPED_TEST(VideoDataLayerTest, TestClipFramesRandomSegments) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TRAIN);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_source(this->MakeList(vector<string>(1, "v 1 0")));
+  video_data_param->set_new_length(6);
+  video_data_param->set_temporal_stride(2);
+  video_data_param->set_num_segments(3);
+  ClipFramesVideoDataLayer<Dtype> layer(param, 30);
+  layer.LoadLines();
+  triplet line;
+  line.first = "v";
+  line.second = 1;
+  line.third = 0;
+  line.length = 0;
+  // Training draws the start of each snippet from its segment, as laid out
+  // in TestClipFramesSegments.
+  const int kBegin[] = {0, 9, 18};
+  const int kEnd[] = {9, 18, 28};
+  vector<int> min_start(kEnd, kEnd + 3);
+  vector<int> max_start(kBegin, kBegin + 3);
+  for (int i = 0; i < 200; ++i) {
+    const vector<int> frames = layer.ClipFrames(line);
+    ASSERT_EQ(6, frames.size());
+    for (int segment = 0; segment < 3; ++segment) {
+      const int start = frames[2 * segment] - 1;
+      EXPECT_GE(start, kBegin[segment]);
+      EXPECT_LT(start, kEnd[segment]);
+      EXPECT_EQ(frames[2 * segment] + 2, frames[2 * segment + 1]);
+      min_start[segment] = std::min(min_start[segment], start);
+      max_start[segment] = std::max(max_start[segment], start);
+    }
+  }
+  for (int segment = 0; segment < 3; ++segment) {
+    EXPECT_EQ(kBegin[segment], min_start[segment]);
+    EXPECT_EQ(kEnd[segment] - 1, max_start[segment]);
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestReadStrided) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string dir = this->MakeFrameDir(12, 16);
+  vector<string> lines;
+  lines.push_back(dir + " 1 7");
+  lines.push_back(dir + " 2 8");
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_source(this->MakeList(lines));
+  video_data_param->set_batch_size(2);
+  video_data_param->set_new_length(4);
+  video_data_param->set_temporal_stride(3);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<int> shape(5);
+  shape[0] = 2;
+  shape[1] = 3;
+  shape[2] = 4;
+  shape[3] = 12;
+  shape[4] = 16;
+  EXPECT_EQ(shape, this->blob_top_data_->shape());
+  const int kFrames[][4] = {{1, 4, 7, 10}, {2, 5, 8, 11}};
+  for (int n = 0; n < 2; ++n) {
+    EXPECT_EQ(7 + n, this->blob_top_label_->cpu_data()[n]);
+    this->CheckFrames(*this->blob_top_data_, n,
+        vector<int>(kFrames[n], kFrames[n] + 4));
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestReadSegments) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string dir = this->MakeFrameDir(12, 16);
+  vector<string> lines;
+  lines.push_back(dir + " 1 7");
+  lines.push_back(dir + " 2 8");
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_source(this->MakeList(lines));
+  video_data_param->set_batch_size(2);
+  video_data_param->set_new_length(4);
+  video_data_param->set_temporal_stride(2);
+  video_data_param->set_num_segments(2);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4, this->blob_top_data_->shape(2));
+  // Snippets of 2 frames, 2 apart, in the middle of the segments of the
+  // 18 starts [0, 9) and [9, 18) from frame 1, and of the 17 starts
+  // [0, 8) and [8, 17) from frame 2.
+  const int kFrames[][4] = {{5, 7, 14, 16}, {6, 8, 14, 16}};
+  for (int n = 0; n < 2; ++n) {
+    EXPECT_EQ(7 + n, this->blob_top_label_->cpu_data()[n]);
+    this->CheckFrames(*this->blob_top_data_, n,
+        vector<int>(kFrames[n], kFrames[n] + 4));
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestBucketFill) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_source(
+      this->MakeList(this->BucketLines()));
+  video_data_param->set_batch_size(2);
+  video_data_param->set_bucket_by_shape(true);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Each batch is the first bucket to fill up, in the order of the list.
+  const int kLabels[][2] = {{0, 2}, {1, 3}, {0, 2}};
+  const int kHeights[] = {12, 8, 12};
+  for (int iter = 0; iter < 3; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(2, this->blob_top_data_->shape(0));
+    EXPECT_EQ(4, this->blob_top_data_->shape(2));
+    EXPECT_EQ(kHeights[iter], this->blob_top_data_->shape(3));
+    ASSERT_EQ(2, this->blob_top_label_->count());
+    for (int n = 0; n < 2; ++n) {
+      const int label = kLabels[iter][n];
+      EXPECT_EQ(label, this->blob_top_label_->cpu_data()[n]);
+      const int start = label < 2 ? 1 : 5;
+      const int kFrames[] = {start, start + 1, start + 2, start + 3};
+      this->CheckFrames(*this->blob_top_data_, n,
+          vector<int>(kFrames, kFrames + 4));
+    }
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestBucketFlushAtMaxPendingClips) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TEST);
+  VideoDataParameter* video_data_param = param.mutable_video_data_param();
+  video_data_param->set_source(
+      this->MakeList(this->BucketLines()));
+  video_data_param->set_batch_size(2);
+  video_data_param->set_bucket_by_shape(true);
+  video_data_param->set_max_pending_clips(2);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Once 2 clips of distinct shapes are pending, the fullest bucket goes
+  // out as a short batch; of equally full buckets, that of the smaller
+  // shape. Reading goes on from where it left off.
+  const int kNums[] = {1, 2, 1, 1, 2};
+  const int kLabels[][2] = {{1, -1}, {0, 2}, {3, -1}, {1, -1}, {0, 2}};
+  for (int iter = 0; iter < 5; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int num = kNums[iter];
+    EXPECT_EQ(num, this->blob_top_data_->shape(0));
+    ASSERT_EQ(num, this->blob_top_label_->count());
+    for (int n = 0; n < num; ++n) {
+      const int label = kLabels[iter][n];
+      EXPECT_EQ(label, this->blob_top_label_->cpu_data()[n]);
+      EXPECT_EQ(label % 2 ? 8 : 12, this->blob_top_data_->shape(3));
+      EXPECT_EQ(label % 2 ? 10 : 16, this->blob_top_data_->shape(4));
+    }
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestBucketReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string source = this->MakeList(this->BucketLines());
+  // The net reshapes to the shape of each batch.
+  NetParameter param;
+  param.set_name("bucket");
+  param.mutable_state()->set_phase(TEST);
+  LayerParameter* data_layer = param.add_layer();
+  data_layer->set_name("data");
+  data_layer->set_type("VideoData");
+  data_layer->add_top("data");
+  data_layer->add_top("label");
+  VideoDataParameter* video_data_param =
+      data_layer->mutable_video_data_param();
+  video_data_param->set_source(source);
+  video_data_param->set_batch_size(2);
+  video_data_param->set_bucket_by_shape(true);
+  LayerParameter* power_layer = param.add_layer();
+  power_layer->set_name("double");
+  power_layer->set_type("Power");
+  power_layer->add_bottom("data");
+  power_layer->add_top("double");
+  power_layer->mutable_power_param()->set_scale(2);
+  Net<Dtype> net(param);
+  const Blob<Dtype>& data = *net.blob_by_name("data");
+  const Blob<Dtype>& doubled = *net.blob_by_name("double");
+  const int kHeights[] = {12, 8, 12};
+  const int kWidths[] = {16, 10, 16};
+  for (int iter = 0; iter < 3; ++iter) {
+    net.Forward();
+    EXPECT_EQ(kHeights[iter], data.shape(3));
+    EXPECT_EQ(kWidths[iter], data.shape(4));
+    EXPECT_EQ(data.shape(), doubled.shape());
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_EQ(2 * data.cpu_data()[i], doubled.cpu_data()[i]);
+    }
+  }
+}
+
 /*
 TYPED_TEST(VideoDataLayerTest, TestRead) {
   typedef typename TypeParam::Dtype Dtype;
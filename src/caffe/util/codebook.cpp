@@ -0,0 +1,405 @@
+#include <boost/bind.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/codebook.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+// Huffman codes are kept short enough to peek at in one go.
+static const int kMaxCodeLength = 24;
+// Codes up to this long decode with a single table lookup.
+static const int kLookupBits = 10;
+static const int kMaxKMeansIterations = 50;
+
+// Clusters the sorted values into at most k centroids by Lloyd's algorithm,
+// which in one dimension assigns contiguous runs of the sorted values to
+// the centroids. Starts from centroids spread linearly over the range of
+// the values, which keeps the rare large weights represented. Returns the
+// sorted centroids of the non-empty clusters.
+static vector<float> KMeans(const vector<float>& sorted, const int k) {
+  vector<float> distinct;
+  for (int i = 0; i < sorted.size() && distinct.size() <= k; ++i) {
+    if (distinct.empty() || sorted[i] != distinct.back()) {
+      distinct.push_back(sorted[i]);
+    }
+  }
+  if (distinct.size() <= k) {
+    return distinct;
+  }
+  const int n = sorted.size();
+  vector<double> prefix(n + 1, 0);
+  for (int i = 0; i < n; ++i) {
+    prefix[i + 1] = prefix[i] + sorted[i];
+  }
+  const double low = sorted.front();
+  const double high = sorted.back();
+  vector<double> centroids(k);
+  for (int j = 0; j < k; ++j) {
+    centroids[j] = low + (high - low) * (j + 0.5) / k;
+  }
+  vector<int> ends(k);
+  for (int iteration = 0; iteration < kMaxKMeansIterations; ++iteration) {
+    // Each cluster ends at the midpoint to the next centroid.
+    for (int j = 0; j < k - 1; ++j) {
+      const float boundary = (centroids[j] + centroids[j + 1]) / 2;
+      ends[j] = std::upper_bound(sorted.begin(), sorted.end(), boundary) -
+          sorted.begin();
+    }
+    ends[k - 1] = n;
+    bool changed = false;
+    for (int j = 0, begin = 0; j < k; begin = ends[j++]) {
+      if (ends[j] > begin) {
+        const double mean = (prefix[ends[j]] - prefix[begin]) /
+            (ends[j] - begin);
+        changed |= mean != centroids[j];
+        centroids[j] = mean;
+      }
+    }
+    if (!changed) { break; }
+  }
+  vector<float> codebook;
+  for (int j = 0, begin = 0; j < k; begin = ends[j++]) {
+    if (ends[j] > begin) {
+      codebook.push_back(centroids[j]);
+    }
+  }
+  return codebook;
+}
+
+// Computes the Huffman code length of each symbol from its frequency, 0 for
+// unused symbols. Flattens the frequencies until no code is longer than
+// kMaxCodeLength.
+static vector<int> HuffmanCodeLengths(vector<int64_t> frequencies) {
+  const int k = frequencies.size();
+  vector<int> lengths(k, 0);
+  while (true) {
+    typedef std::pair<int64_t, int> Node;
+    std::priority_queue<Node, vector<Node>, std::greater<Node> > queue;
+    vector<int> parents(k, -1);
+    for (int i = 0; i < k; ++i) {
+      if (frequencies[i] > 0) {
+        queue.push(Node(frequencies[i], i));
+      }
+    }
+    if (queue.size() == 1) {
+      lengths[queue.top().second] = 1;
+      return lengths;
+    }
+    while (queue.size() > 1) {
+      const Node first = queue.top();
+      queue.pop();
+      const Node second = queue.top();
+      queue.pop();
+      const int parent = parents.size();
+      parents.push_back(-1);
+      parents[first.second] = parent;
+      parents[second.second] = parent;
+      queue.push(Node(first.first + second.first, parent));
+    }
+    int max_length = 0;
+    for (int i = 0; i < k; ++i) {
+      lengths[i] = 0;
+      for (int node = i; frequencies[i] > 0 && parents[node] >= 0;
+           node = parents[node]) {
+        ++lengths[i];
+      }
+      max_length = std::max(max_length, lengths[i]);
+    }
+    if (max_length <= kMaxCodeLength) {
+      return lengths;
+    }
+    for (int i = 0; i < k; ++i) {
+      if (frequencies[i] > 0) {
+        frequencies[i] = (frequencies[i] + 1) / 2;
+      }
+    }
+  }
+}
+
+// Canonical Huffman codes: the used symbols, ordered by code length and
+// then by symbol, take consecutive codes of each length.
+class CanonicalCode {
+ public:
+  explicit CanonicalCode(const vector<int>& lengths)
+      : lengths_(lengths), codes_(lengths.size(), 0),
+        counts_(kMaxCodeLength + 1, 0), first_codes_(kMaxCodeLength + 1, 0),
+        first_symbols_(kMaxCodeLength + 1, 0), max_length_(0) {
+    for (int i = 0; i < lengths_.size(); ++i) {
+      CHECK_LE(lengths_[i], kMaxCodeLength);
+      ++counts_[lengths_[i]];
+      max_length_ = std::max(max_length_, lengths_[i]);
+    }
+    counts_[0] = 0;
+    uint32_t code = 0;
+    int symbol = 0;
+    for (int length = 1; length <= kMaxCodeLength; ++length) {
+      code = (code + counts_[length - 1]) << 1;
+      first_codes_[length] = code;
+      first_symbols_[length] = symbol;
+      symbol += counts_[length];
+    }
+    vector<uint32_t> next_codes(first_codes_);
+    for (int length = 1; length <= kMaxCodeLength; ++length) {
+      for (int i = 0; i < lengths_.size(); ++i) {
+        if (lengths_[i] == length) {
+          codes_[i] = next_codes[length]++;
+          sorted_symbols_.push_back(i);
+        }
+      }
+    }
+    // Every code of up to kLookupBits bits fills the table entries that
+    // start with it.
+    table_.resize(1 << kLookupBits, std::make_pair(0, 0));
+    for (int i = 0; i < lengths_.size(); ++i) {
+      if (lengths_[i] > 0 && lengths_[i] <= kLookupBits) {
+        const int shift = kLookupBits - lengths_[i];
+        for (int j = 0; j < (1 << shift); ++j) {
+          table_[(codes_[i] << shift) | j] = std::make_pair(i, lengths_[i]);
+        }
+      }
+    }
+  }
+
+  int length(const int symbol) const { return lengths_[symbol]; }
+  uint32_t code(const int symbol) const { return codes_[symbol]; }
+
+  // Decodes the symbol whose code starts the kMaxCodeLength bits given,
+  // and sets its length.
+  int Decode(const uint32_t bits, int* length) const {
+    const std::pair<int, int>& entry =
+        table_[bits >> (kMaxCodeLength - kLookupBits)];
+    if (entry.second > 0) {
+      *length = entry.second;
+      return entry.first;
+    }
+    for (int l = kLookupBits + 1; l <= max_length_; ++l) {
+      const uint32_t offset = (bits >> (kMaxCodeLength - l)) -
+          first_codes_[l];
+      if (offset < counts_[l]) {
+        *length = l;
+        return sorted_symbols_[first_symbols_[l] + offset];
+      }
+    }
+    LOG(FATAL) << "Corrupt codebook indices.";
+    return 0;
+  }
+
+ private:
+  vector<int> lengths_;
+  vector<uint32_t> codes_;
+  vector<uint32_t> counts_;
+  vector<uint32_t> first_codes_;
+  vector<int> first_symbols_;
+  vector<int> sorted_symbols_;
+  // (symbol, length) by the first kLookupBits bits, length 0 for longer
+  // codes.
+  vector<std::pair<int, int> > table_;
+  int max_length_;
+};
+
+// Appends codes to a string, most significant bit first.
+class BitWriter {
+ public:
+  explicit BitWriter(string* out) : out_(out), buffer_(0), bits_(0) {}
+
+  void Write(const uint32_t code, const int length) {
+    buffer_ = (buffer_ << length) | code;
+    bits_ += length;
+    while (bits_ >= 8) {
+      bits_ -= 8;
+      out_->push_back(static_cast<char>(buffer_ >> bits_));
+    }
+  }
+  // Pads the last byte with zeros.
+  void Flush() {
+    if (bits_ > 0) {
+      out_->push_back(static_cast<char>(buffer_ << (8 - bits_)));
+      bits_ = 0;
+    }
+  }
+
+ private:
+  string* out_;
+  uint64_t buffer_;
+  int bits_;
+};
+
+// Reads codes from a byte range, reading zeros past its end.
+class BitReader {
+ public:
+  BitReader(const uint8_t* begin, const uint8_t* end)
+      : next_(begin), end_(end), buffer_(0), bits_(0) {}
+
+  // The next kMaxCodeLength bits.
+  uint32_t Peek() {
+    while (bits_ <= 56) {
+      const uint64_t byte = next_ < end_ ? *next_++ : 0;
+      buffer_ |= byte << (56 - bits_);
+      bits_ += 8;
+    }
+    return buffer_ >> (64 - kMaxCodeLength);
+  }
+  void Skip(const int length) {
+    buffer_ <<= length;
+    bits_ -= length;
+  }
+
+ private:
+  const uint8_t* next_;
+  const uint8_t* end_;
+  uint64_t buffer_;
+  int bits_;
+};
+
+void CodebookCompress(const int bits, BlobProto* proto) {
+  CHECK_GE(bits, 1) << "Codebooks need at least 1 bit.";
+  CHECK_LE(bits, 8) << "Codebooks take at most 8 bits.";
+  vector<float> values;
+  if (proto->double_data_size() > 0) {
+    values.assign(proto->double_data().begin(), proto->double_data().end());
+  } else {
+    values.assign(proto->data().begin(), proto->data().end());
+  }
+  CHECK(!values.empty()) << "No data to compress.";
+  vector<float> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+  const vector<float> codebook = KMeans(sorted, 1 << bits);
+  // Each value takes the nearest entry of the sorted codebook.
+  vector<float> boundaries(codebook.size() - 1);
+  for (int j = 0; j < boundaries.size(); ++j) {
+    boundaries[j] = (codebook[j] + codebook[j + 1]) / 2;
+  }
+  vector<uint8_t> indices(values.size());
+  vector<int64_t> frequencies(codebook.size(), 0);
+  for (int i = 0; i < values.size(); ++i) {
+    indices[i] = std::upper_bound(boundaries.begin(), boundaries.end(),
+        values[i]) - boundaries.begin();
+    ++frequencies[indices[i]];
+  }
+  const vector<int> lengths = HuffmanCodeLengths(frequencies);
+  const CanonicalCode code(lengths);
+
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->clear_codebook();
+  proto->clear_chunk_offsets();
+  string* coded = proto->mutable_coded_indices();
+  coded->clear();
+  string* code_lengths = proto->mutable_code_lengths();
+  code_lengths->clear();
+  for (int j = 0; j < codebook.size(); ++j) {
+    proto->add_codebook(codebook[j]);
+    code_lengths->push_back(static_cast<char>(lengths[j]));
+  }
+  BitWriter writer(coded);
+  for (int i = 0; i < indices.size(); ++i) {
+    if (i % kCodebookChunkSize == 0) {
+      writer.Flush();
+      proto->add_chunk_offsets(coded->size());
+    }
+    writer.Write(code.code(indices[i]), code.length(indices[i]));
+  }
+  writer.Flush();
+}
+
+// Decodes chunks of codebook indices into values.
+template <typename Dtype>
+class CodebookDecoder {
+ public:
+  CodebookDecoder(const BlobProto& proto, const CanonicalCode& code,
+      const int count, Dtype* data)
+      : proto_(proto), code_(code), count_(count), data_(data) {}
+
+  void DecodeChunks(const int begin, const int end) const {
+    const uint8_t* coded =
+        reinterpret_cast<const uint8_t*>(proto_.coded_indices().data());
+    const int coded_size = proto_.coded_indices().size();
+    for (int chunk = begin; chunk < end; ++chunk) {
+      const int chunk_end = chunk + 1 < proto_.chunk_offsets_size() ?
+          proto_.chunk_offsets(chunk + 1) : coded_size;
+      CHECK_LE(proto_.chunk_offsets(chunk), chunk_end);
+      CHECK_LE(chunk_end, coded_size);
+      BitReader reader(coded + proto_.chunk_offsets(chunk),
+          coded + chunk_end);
+      const int first = chunk * kCodebookChunkSize;
+      const int last = std::min(count_, first + kCodebookChunkSize);
+      for (int i = first; i < last; ++i) {
+        int length;
+        const int symbol = code_.Decode(reader.Peek(), &length);
+        reader.Skip(length);
+        data_[i] = proto_.codebook(symbol);
+      }
+    }
+  }
+
+ private:
+  const BlobProto& proto_;
+  const CanonicalCode& code_;
+  const int count_;
+  Dtype* data_;
+};
+
+template <typename Dtype>
+void CodebookDecompress(const BlobProto& proto, const int count,
+    Dtype* data) {
+  const string& code_lengths = proto.code_lengths();
+  CHECK_EQ(code_lengths.size(), proto.codebook_size())
+      << "Need a code length per codebook entry.";
+  const int num_chunks = (count + kCodebookChunkSize - 1) /
+      kCodebookChunkSize;
+  CHECK_EQ(num_chunks, proto.chunk_offsets_size())
+      << "Codebook indices of the wrong size.";
+  vector<int> lengths(code_lengths.size());
+  for (int j = 0; j < lengths.size(); ++j) {
+    lengths[j] = static_cast<uint8_t>(code_lengths[j]);
+  }
+  const CanonicalCode code(lengths);
+  const CodebookDecoder<Dtype> decoder(proto, code, count, data);
+  parallel_for(0, num_chunks, boost::bind(
+      &CodebookDecoder<Dtype>::DecodeChunks, &decoder, _1, _2));
+}
+
+template void CodebookDecompress<float>(const BlobProto& proto,
+    const int count, float* data);
+template void CodebookDecompress<double>(const BlobProto& proto,
+    const int count, double* data);
+// Blob<int> and Blob<unsigned int> share Blob::FromProto.
+template void CodebookDecompress<int>(const BlobProto& proto,
+    const int count, int* data);
+template void CodebookDecompress<unsigned int>(const BlobProto& proto,
+    const int count, unsigned int* data);
+
+static void CompressBlobs(const int bits, const vector<BlobProto*>& blobs,
+    const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    CodebookCompress(bits, blobs[i]);
+  }
+}
+
+void CodebookCompressNet(const int bits, NetParameter* param) {
+  vector<BlobProto*> blobs;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer = param->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      const int count = std::max(blob->data_size(),
+          blob->double_data_size());
+      if (blob->shape().dim_size() >= 2 && count >= (16 << bits)) {
+        blobs.push_back(blob);
+      }
+    }
+  }
+  parallel_for(0, blobs.size(), boost::bind(&CompressBlobs, bits,
+      boost::cref(blobs), _1, _2));
+}
+
+}  // namespace caffe
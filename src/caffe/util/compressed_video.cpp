@@ -0,0 +1,411 @@
+#if defined(USE_OPENCV) && defined(USE_FFMPEG)
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/motion_vector.h>
+#include <libswscale/swscale.h>
+}
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/compressed_video.hpp"
+
+namespace caffe {
+
+// Decodes the frames of the video stream of a file, with their motion
+// vectors, and numbers them from 1.
+class CompressedVideoReader {
+ public:
+  CompressedVideoReader()
+      : format_(NULL), codec_(NULL), frame_(NULL), iframe_(NULL),
+        packet_(NULL), bgr_sws_(NULL), luma_sws_(NULL), stream_index_(-1),
+        frame_num_(0), draining_(false), numbered_by_timestamp_(false) {}
+  ~CompressedVideoReader() {
+    sws_freeContext(luma_sws_);
+    sws_freeContext(bgr_sws_);
+    av_packet_free(&packet_);
+    av_frame_free(&iframe_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&codec_);
+    avformat_close_input(&format_);
+  }
+
+  bool Open(const string& path) {
+    if (avformat_open_input(&format_, path.c_str(), NULL, NULL) < 0 ||
+        avformat_find_stream_info(format_, NULL) < 0) {
+      LOG(ERROR) << "Cannot open a video file=" << path;
+      return false;
+    }
+    stream_index_ = av_find_best_stream(format_, AVMEDIA_TYPE_VIDEO, -1, -1,
+                                        NULL, 0);
+    if (stream_index_ < 0) {
+      LOG(ERROR) << "No video stream in " << path;
+      return false;
+    }
+    const AVCodec* decoder = avcodec_find_decoder(
+        format_->streams[stream_index_]->codecpar->codec_id);
+    if (!decoder) {
+      LOG(ERROR) << "No decoder for " << path;
+      return false;
+    }
+    codec_ = avcodec_alloc_context3(decoder);
+    AVDictionary* options = NULL;
+    av_dict_set(&options, "flags2", "+export_mvs", 0);
+    const bool opened = avcodec_parameters_to_context(codec_,
+        format_->streams[stream_index_]->codecpar) >= 0 &&
+        avcodec_open2(codec_, decoder, &options) >= 0;
+    av_dict_free(&options);
+    if (!opened) {
+      LOG(ERROR) << "Cannot open the decoder of " << path;
+      return false;
+    }
+    frame_ = av_frame_alloc();
+    iframe_ = av_frame_alloc();
+    packet_ = av_packet_alloc();
+    return true;
+  }
+
+  // Seeks to the last key frame at or before frame. The frames are then
+  // numbered from the timestamp of the first one decoded.
+  void SeekBefore(const int frame) {
+    const AVStream* stream = format_->streams[stream_index_];
+    const AVRational rate = stream->avg_frame_rate;
+    if (frame <= 1 || rate.num <= 0 || rate.den <= 0) {
+      return;
+    }
+    const int64_t timestamp = StartTime() +
+        av_rescale_q(frame - 1, av_inv_q(rate), stream->time_base);
+    if (av_seek_frame(format_, stream_index_, timestamp,
+                      AVSEEK_FLAG_BACKWARD) >= 0) {
+      avcodec_flush_buffers(codec_);
+      draining_ = false;
+      numbered_by_timestamp_ = true;
+    }
+  }
+
+  // Goes back to the first frame.
+  bool Rewind() {
+    if (av_seek_frame(format_, stream_index_, StartTime(),
+                      AVSEEK_FLAG_BACKWARD) < 0) {
+      return false;
+    }
+    avcodec_flush_buffers(codec_);
+    draining_ = false;
+    numbered_by_timestamp_ = false;
+    frame_num_ = 0;
+    return true;
+  }
+
+  // Decodes the next frame, false at the end of the video or on errors.
+  bool NextFrame() {
+    while (true) {
+      const int result = avcodec_receive_frame(codec_, frame_);
+      if (result == 0) {
+        ++frame_num_;
+        if (numbered_by_timestamp_) {
+          numbered_by_timestamp_ = false;
+          const AVStream* stream = format_->streams[stream_index_];
+          const int64_t timestamp = frame_->best_effort_timestamp;
+          if (timestamp == AV_NOPTS_VALUE) {
+            return Rewind() && NextFrame();
+          }
+          frame_num_ = 1 + av_rescale_q(timestamp - StartTime(),
+              stream->time_base, av_inv_q(stream->avg_frame_rate));
+        }
+        return true;
+      }
+      if (result != AVERROR(EAGAIN) || draining_) {
+        return false;
+      }
+      if (av_read_frame(format_, packet_) < 0) {
+        // Flush the frames the decoder still holds.
+        avcodec_send_packet(codec_, NULL);
+        draining_ = true;
+        continue;
+      }
+      if (packet_->stream_index == stream_index_) {
+        avcodec_send_packet(codec_, packet_);
+      }
+      av_packet_unref(packet_);
+    }
+  }
+
+  const AVFrame* frame() const { return frame_; }
+  int frame_num() const { return frame_num_; }
+  // How many past frames the blocks of a frame may refer to.
+  int num_refs() const { return codec_->refs; }
+  bool is_iframe() const { return frame_->pict_type == AV_PICTURE_TYPE_I; }
+
+  // Keeps the current frame as the I-frame of the following frames.
+  void KeepIFrame() {
+    av_frame_unref(iframe_);
+    av_frame_ref(iframe_, frame_);
+  }
+
+  // The kept I-frame as BGR.
+  cv::Mat IFrameToBGR() {
+    cv::Mat bgr(iframe_->height, iframe_->width, CV_8UC3);
+    Convert(iframe_, AV_PIX_FMT_BGR24, &bgr_sws_, &bgr);
+    return bgr;
+  }
+
+  // The luma of the current frame, which shares the data of the frame when
+  // it is planar.
+  cv::Mat Luma() {
+    switch (frame_->format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_GRAY8:
+      return cv::Mat(frame_->height, frame_->width, CV_8UC1, frame_->data[0],
+                     frame_->linesize[0]);
+    default:
+      cv::Mat luma(frame_->height, frame_->width, CV_8UC1);
+      Convert(frame_, AV_PIX_FMT_GRAY8, &luma_sws_, &luma);
+      return luma;
+    }
+  }
+
+ private:
+  int64_t StartTime() const {
+    const int64_t start_time = format_->streams[stream_index_]->start_time;
+    return start_time == AV_NOPTS_VALUE ? 0 : start_time;
+  }
+
+  static void Convert(const AVFrame* frame, const AVPixelFormat format,
+      SwsContext** sws, cv::Mat* image) {
+    *sws = sws_getCachedContext(*sws, frame->width, frame->height,
+        static_cast<AVPixelFormat>(frame->format), frame->width,
+        frame->height, format, SWS_BILINEAR, NULL, NULL, NULL);
+    CHECK(*sws) << "Unsupported pixel format " << frame->format;
+    uint8_t* data[1] = {image->data};
+    int linesize[1] = {static_cast<int>(image->step)};
+    sws_scale(*sws, frame->data, frame->linesize, 0, frame->height, data,
+              linesize);
+  }
+
+  AVFormatContext* format_;
+  AVCodecContext* codec_;
+  AVFrame* frame_;
+  AVFrame* iframe_;
+  AVPacket* packet_;
+  SwsContext* bgr_sws_;
+  SwsContext* luma_sws_;
+  int stream_index_;
+  int frame_num_;
+  bool draining_;
+  bool numbered_by_timestamp_;
+};
+
+// Motion is traced on a grid of 4x4 pixel cells, the smallest blocks codecs
+// predict, so that tracing a frame costs its motion vectors, not its pixels.
+static const int kMotionCell = 4;
+
+static inline int Clamp(const int value, const int size) {
+  return std::min(std::max(value, 0), size - 1);
+}
+
+// The cell of a pixel position, clamped to the grid.
+static inline int Cell(const float position, const int cells) {
+  return Clamp(cvFloor(position / kMotionCell), cells);
+}
+
+// The offset from a block to where it is predicted from, in pixels, with
+// the sub-pixel precision of the codec when libavcodec exports it.
+static inline cv::Vec2f MotionOffset(const AVMotionVector& mv) {
+  if (mv.motion_scale > 0) {
+    return cv::Vec2f(static_cast<float>(mv.motion_x) / mv.motion_scale,
+                     static_cast<float>(mv.motion_y) / mv.motion_scale);
+  }
+  return cv::Vec2f(mv.src_x - mv.dst_x, mv.src_y - mv.dst_y);
+}
+
+// Adds the motion of a frame with respect to the previous one to the motion
+// accumulated back to the I-frame, a cell at a time: a cell moves by the
+// motion of its block, and then by the accumulated motion of the cell it
+// comes from. Cells without motion (intra blocks) keep theirs. next is
+// scratch space for the new grid.
+static void AccumulateMotion(const AVFrame* frame, cv::Mat* accumulated,
+    cv::Mat* next) {
+  const AVFrameSideData* side_data =
+      av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
+  if (!side_data) {
+    return;
+  }
+  const int rows = accumulated->rows;
+  const int cols = accumulated->cols;
+  accumulated->copyTo(*next);
+  const AVMotionVector* mvs =
+      reinterpret_cast<const AVMotionVector*>(side_data->data);
+  const int num_mvs = side_data->size / sizeof(AVMotionVector);
+  for (int i = 0; i < num_mvs; ++i) {
+    const AVMotionVector& mv = mvs[i];
+    if (mv.source > 0) {
+      continue;
+    }
+    // dst_x and dst_y are the center of the block.
+    const int col_begin = std::max(mv.dst_x - mv.w / 2, 0) / kMotionCell;
+    const int col_end = std::min((mv.dst_x + (mv.w + 1) / 2 + kMotionCell - 1)
+                                 / kMotionCell, cols);
+    const int row_begin = std::max(mv.dst_y - mv.h / 2, 0) / kMotionCell;
+    const int row_end = std::min((mv.dst_y + (mv.h + 1) / 2 + kMotionCell - 1)
+                                 / kMotionCell, rows);
+    const cv::Vec2f offset = MotionOffset(mv);
+    for (int row = row_begin; row < row_end; ++row) {
+      const cv::Vec2f* source_row = accumulated->ptr<cv::Vec2f>(
+          Cell((row + 0.5f) * kMotionCell + offset[1], rows));
+      cv::Vec2f* next_row = next->ptr<cv::Vec2f>(row);
+      for (int col = col_begin; col < col_end; ++col) {
+        next_row[col] = offset + source_row[
+            Cell((col + 0.5f) * kMotionCell + offset[0], cols)];
+      }
+    }
+  }
+  cv::swap(*accumulated, *next);
+}
+
+// The motion of every pixel of a height x width frame, from that of its
+// cell.
+static cv::Mat PixelMotion(const cv::Mat& accumulated, const int height,
+    const int width) {
+  cv::Mat motion;
+  cv::resize(accumulated, motion, cv::Size(), kMotionCell, kMotionCell,
+             cv::INTER_NEAREST);
+  if (motion.rows == height && motion.cols == width) {
+    return motion;
+  }
+  return motion(cv::Rect(0, 0, width, height)).clone();
+}
+
+// The luma of a frame minus that of the I-frame displaced by the motion,
+// which moves each cell by whole pixels.
+static cv::Mat Residual(const cv::Mat& luma, const cv::Mat& iframe_luma,
+    const cv::Mat& accumulated) {
+  const int height = luma.rows;
+  const int width = luma.cols;
+  cv::Mat displaced(height, width, CV_8UC1);
+  for (int row = 0; row < accumulated.rows; ++row) {
+    const cv::Vec2f* motion_row = accumulated.ptr<cv::Vec2f>(row);
+    const int y_begin = row * kMotionCell;
+    const int y_end = std::min(y_begin + kMotionCell, height);
+    for (int col = 0; col < accumulated.cols; ++col) {
+      const int dx = cvRound(motion_row[col][0]);
+      const int dy = cvRound(motion_row[col][1]);
+      const int x_begin = col * kMotionCell;
+      const int x_end = std::min(x_begin + kMotionCell, width);
+      const bool inside = x_begin + dx >= 0 && x_end + dx <= width;
+      for (int y = y_begin; y < y_end; ++y) {
+        const uchar* source_row = iframe_luma.ptr<uchar>(Clamp(y + dy, height));
+        uchar* displaced_row = displaced.ptr<uchar>(y);
+        if (inside) {
+          memcpy(displaced_row + x_begin, source_row + x_begin + dx,
+                 x_end - x_begin);
+        } else {
+          for (int x = x_begin; x < x_end; ++x) {
+            displaced_row[x] = source_row[Clamp(x + dx, width)];
+          }
+        }
+      }
+    }
+  }
+  cv::Mat residual;
+  cv::subtract(luma, displaced, residual, cv::noArray(), CV_16S);
+  return residual;
+}
+
+bool ReadCompressedVideo(const string& path, const vector<int>& frames,
+    CompressedFrames* compressed) {
+  CHECK(!frames.empty()) << "No frames to read";
+  vector<int> sorted_frames(frames);
+  std::sort(sorted_frames.begin(), sorted_frames.end());
+  sorted_frames.erase(std::unique(sorted_frames.begin(), sorted_frames.end()),
+                      sorted_frames.end());
+  CompressedVideoReader reader;
+  if (!reader.Open(path)) {
+    return false;
+  }
+  reader.SeekBefore(sorted_frames.front());
+  vector<cv::Mat> iframes(sorted_frames.size());
+  vector<cv::Mat> motion_vectors(sorted_frames.size());
+  vector<cv::Mat> residuals(sorted_frames.size());
+  // The I-frame of the current GOP, converted once a frame needs it, and
+  // the motion accumulated back to it on the cell grid.
+  cv::Mat iframe, iframe_luma, accumulated, next_accumulated;
+  bool has_iframe = false;
+  bool rewound = false;
+  int next = 0;
+  while (next < sorted_frames.size() && reader.NextFrame()) {
+    if (reader.frame_num() > sorted_frames[next] && !has_iframe) {
+      // The seek went past the frame; start over.
+      if (rewound || !reader.Rewind()) {
+        break;
+      }
+      rewound = true;
+      continue;
+    }
+    if (reader.is_iframe()) {
+      reader.KeepIFrame();
+      iframe.release();
+      iframe_luma = reader.Luma().clone();
+      accumulated = cv::Mat(
+          (iframe_luma.rows + kMotionCell - 1) / kMotionCell,
+          (iframe_luma.cols + kMotionCell - 1) / kMotionCell, CV_32FC2,
+          cv::Scalar(0, 0));
+      has_iframe = true;
+    } else if (has_iframe) {
+      if (reader.num_refs() > 1) {
+        LOG_FIRST_N(WARNING, 1) << "A video file=" << path << " has "
+            << reader.num_refs() << " reference frames; its motion is traced "
+            << "as if every block referred to the previous frame.";
+      }
+      AccumulateMotion(reader.frame(), &accumulated, &next_accumulated);
+    }
+    if (reader.frame_num() != sorted_frames[next]) {
+      continue;
+    }
+    if (!has_iframe) {
+      LOG(ERROR) << "No I-frame before frame=" << sorted_frames[next] <<
+                    " of a video file=" << path;
+      return false;
+    }
+    if (iframe.empty()) {
+      iframe = reader.IFrameToBGR();
+    }
+    iframes[next] = iframe;
+    motion_vectors[next] = PixelMotion(accumulated, iframe_luma.rows,
+                                       iframe_luma.cols);
+    residuals[next] = reader.is_iframe() ?
+        cv::Mat(iframe_luma.rows, iframe_luma.cols, CV_16SC1, cv::Scalar(0)) :
+        Residual(reader.Luma(), iframe_luma, accumulated);
+    ++next;
+  }
+  if (next < sorted_frames.size()) {
+    LOG(ERROR) << "Could not read frame=" << sorted_frames[next] <<
+                  " from a video file=" << path;
+    return false;
+  }
+  compressed->iframes.clear();
+  compressed->motion_vectors.clear();
+  compressed->residuals.clear();
+  for (int i = 0; i < frames.size(); ++i) {
+    const int index = std::lower_bound(sorted_frames.begin(),
+        sorted_frames.end(), frames[i]) - sorted_frames.begin();
+    compressed->iframes.push_back(iframes[index]);
+    compressed->motion_vectors.push_back(motion_vectors[index]);
+    compressed->residuals.push_back(residuals[index]);
+  }
+  return true;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV && USE_FFMPEG
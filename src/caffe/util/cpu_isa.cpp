@@ -0,0 +1,120 @@
+#include <boost/thread.hpp>
+
+#include <string>
+
+#include "caffe/util/cpu_isa.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#define CAFFE_X86_CPUID
+#endif
+
+DEFINE_string(cpu_isa, "",
+    "Optional; the instruction set of the CPU kernels: "
+    "generic, sse4.2, avx2 or avx512. Defaults to the best one supported.");
+
+namespace caffe {
+
+#ifdef CAFFE_X86_CPUID
+// The register state the OS saves on context switches.
+static uint64_t ReadXCR0() {
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+#endif
+
+CpuIsa DetectCpuIsa() {
+  CpuIsa isa = CPU_ISA_GENERIC;
+#ifdef CAFFE_X86_CPUID
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return isa;
+  }
+  const bool sse42 = ecx & bit_SSE4_2;
+  const bool osxsave = ecx & bit_OSXSAVE;
+  const bool avx = ecx & bit_AVX;
+  if (!sse42) {
+    return isa;
+  }
+  isa = CPU_ISA_SSE42;
+  // AVX registers need OS support as well: XMM and YMM state.
+  if (!osxsave || !avx || (ReadXCR0() & 0x6) != 0x6 ||
+      !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return isa;
+  }
+  if (ebx & bit_AVX2) {
+    isa = CPU_ISA_AVX2;
+    // Opmask and ZMM state for AVX-512.
+    if ((ebx & bit_AVX512F) && (ReadXCR0() & 0xe6) == 0xe6) {
+      isa = CPU_ISA_AVX512;
+    }
+  }
+#endif
+  return isa;
+}
+
+string CpuIsaName(const CpuIsa isa) {
+  switch (isa) {
+  case CPU_ISA_GENERIC:
+    return "generic";
+  case CPU_ISA_SSE42:
+    return "sse4.2";
+  case CPU_ISA_AVX2:
+    return "avx2";
+  case CPU_ISA_AVX512:
+    return "avx512";
+  default:
+    LOG(FATAL) << "Unknown CPU instruction set: " << isa;
+  }
+  return "";
+}
+
+CpuIsa CpuIsaFromName(const string& name) {
+  for (int i = CPU_ISA_GENERIC; i <= CPU_ISA_AVX512; ++i) {
+    if (name == CpuIsaName(static_cast<CpuIsa>(i))) {
+      return static_cast<CpuIsa>(i);
+    }
+  }
+  LOG(FATAL) << "Unknown CPU instruction set: " << name
+             << " (use generic, sse4.2, avx2 or avx512)";
+  return CPU_ISA_GENERIC;
+}
+
+static CpuIsa selected_isa_ = CPU_ISA_GENERIC;
+static const CpuKernels* selected_kernels_ = NULL;
+static boost::once_flag select_once_ = BOOST_ONCE_INIT;
+
+static void SelectCpuIsa(const CpuIsa isa) {
+  const CpuIsa detected = DetectCpuIsa();
+  CHECK_LE(isa, detected) << "The CPU does not support "
+      << CpuIsaName(isa) << " (best supported: " << CpuIsaName(detected)
+      << ")";
+  selected_isa_ = isa;
+  selected_kernels_ = &GetCpuKernels(isa);
+  LOG(INFO) << "Using " << CpuIsaName(isa) << " CPU kernels"
+            << (isa == detected ? "" : " (detected " +
+                CpuIsaName(detected) + ")");
+}
+
+static void InitCpuIsa() {
+  SelectCpuIsa(FLAGS_cpu_isa.empty() ? DetectCpuIsa() :
+      CpuIsaFromName(FLAGS_cpu_isa));
+}
+
+CpuIsa cpu_isa() {
+  boost::call_once(select_once_, InitCpuIsa);
+  return selected_isa_;
+}
+
+void SetCpuIsa(const CpuIsa isa) {
+  boost::call_once(select_once_, InitCpuIsa);
+  SelectCpuIsa(isa);
+}
+
+const CpuKernels& cpu_kernels() {
+  boost::call_once(select_once_, InitCpuIsa);
+  return *selected_kernels_;
+}
+
+}  // namespace caffe
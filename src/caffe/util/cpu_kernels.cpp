@@ -0,0 +1,508 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "caffe/util/cpu_isa.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CAFFE_X86_KERNELS
+#endif
+
+namespace caffe {
+
+// The scalar kernels, also used for the remainder of the vector kernels.
+// The vector kernels do the same operations in the same order, so all
+// implementations give bitwise identical results.
+namespace generic {
+
+inline void add(const int n, const float* a, const float* b, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = a[i] + b[i]; }
+}
+inline void sub(const int n, const float* a, const float* b, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = a[i] - b[i]; }
+}
+inline void mul(const int n, const float* a, const float* b, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = a[i] * b[i]; }
+}
+inline void div(const int n, const float* a, const float* b, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = a[i] / b[i]; }
+}
+inline void sqr(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = a[i] * a[i]; }
+}
+inline void sqrt(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = ::sqrtf(a[i]); }
+}
+inline void relu(const int n, const float* x, const float negative_slope,
+    float* y) {
+  for (int i = 0; i < n; ++i) {
+    // Same operand order as the vector max/min, which matters for NaN.
+    y[i] = (0 > x[i] ? 0 : x[i]) + negative_slope * (0 < x[i] ? 0 : x[i]);
+  }
+}
+inline void relu_backward(const int n, const float* top_diff,
+    const float* bottom_data, const float negative_slope,
+    float* bottom_diff) {
+  for (int i = 0; i < n; ++i) {
+    // NaN inputs get no gradient, as in ReLULayer.
+    bottom_diff[i] = top_diff[i] * (bottom_data[i] > 0 ? 1 :
+        (bottom_data[i] <= 0 ? negative_slope : 0));
+  }
+}
+inline void max_update(const int n, const float* x, const int index,
+    float* y, int* mask) {
+  for (int i = 0; i < n; ++i) {
+    if (x[i] > y[i]) {
+      y[i] = x[i];
+      mask[i] = index;
+    }
+  }
+}
+inline void transform_u8(const int n, const uint8_t* x, const float* mean,
+    const float mean_value, const float scale, float* y) {
+  if (mean) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = (static_cast<float>(x[i]) - mean[i]) * scale;
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = (static_cast<float>(x[i]) - mean_value) * scale;
+    }
+  }
+}
+inline void sum_n(const int begin, const int end, const int num_inputs,
+    const float* const* x, const float* coeffs, float* y) {
+  for (int i = begin; i < end; ++i) {
+    float sum = coeffs ? coeffs[0] * x[0][i] : x[0][i];
+    for (int j = 1; j < num_inputs; ++j) {
+      sum += coeffs ? coeffs[j] * x[j][i] : x[j][i];
+    }
+    y[i] = sum;
+  }
+}
+inline void prod_n(const int begin, const int end, const int num_inputs,
+    const float* const* x, float* y) {
+  for (int i = begin; i < end; ++i) {
+    float prod = x[0][i];
+    for (int j = 1; j < num_inputs; ++j) {
+      prod *= x[j][i];
+    }
+    y[i] = prod;
+  }
+}
+inline void max_n(const int begin, const int end, const int num_inputs,
+    const float* const* x, float* y, uint8_t* mask) {
+  for (int i = begin; i < end; ++i) {
+    const bool first = x[0][i] > x[1][i];
+    float max_val = first ? x[0][i] : x[1][i];
+    uint8_t max_id = first ? 0 : 1;
+    for (int j = 2; j < num_inputs; ++j) {
+      if (x[j][i] > max_val) {
+        max_val = x[j][i];
+        max_id = j;
+      }
+    }
+    y[i] = max_val;
+    mask[i] = max_id;
+  }
+}
+inline void scale(const int n, const float alpha, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = alpha * x[i]; }
+}
+inline void scale_bias(const int n, const float alpha, const float beta,
+    const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = alpha * x[i] + beta; }
+}
+inline void asum_update(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] += ::fabsf(x[i]); }
+}
+inline void sumsq_update(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] += x[i] * x[i]; }
+}
+
+}  // namespace generic
+
+#ifdef CAFFE_X86_KERNELS
+
+// Defines the kernels of one instruction set in terms of the vector
+// primitives below: KERNEL_TARGET, V (vector type), W (floats per vector),
+// VI (int vector type), M (comparison mask type) and the operations.
+#define DEFINE_CPU_KERNELS \
+KERNEL_TARGET void add(const int n, const float* a, const float* b, \
+    float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, ADD(LOAD(a + i), LOAD(b + i))); } \
+  generic::add(n - i, a + i, b + i, y + i); \
+} \
+KERNEL_TARGET void sub(const int n, const float* a, const float* b, \
+    float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, SUB(LOAD(a + i), LOAD(b + i))); } \
+  generic::sub(n - i, a + i, b + i, y + i); \
+} \
+KERNEL_TARGET void mul(const int n, const float* a, const float* b, \
+    float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, MUL(LOAD(a + i), LOAD(b + i))); } \
+  generic::mul(n - i, a + i, b + i, y + i); \
+} \
+KERNEL_TARGET void div(const int n, const float* a, const float* b, \
+    float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, DIV(LOAD(a + i), LOAD(b + i))); } \
+  generic::div(n - i, a + i, b + i, y + i); \
+} \
+KERNEL_TARGET void sqr(const int n, const float* a, float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V v = LOAD(a + i); \
+    STORE(y + i, MUL(v, v)); \
+  } \
+  generic::sqr(n - i, a + i, y + i); \
+} \
+KERNEL_TARGET void sqrt(const int n, const float* a, float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, SQRT(LOAD(a + i))); } \
+  generic::sqrt(n - i, a + i, y + i); \
+} \
+KERNEL_TARGET void relu(const int n, const float* x, \
+    const float negative_slope, float* y) { \
+  const V zero = SET1(0); \
+  const V slope = SET1(negative_slope); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V v = LOAD(x + i); \
+    STORE(y + i, ADD(MAX(zero, v), MUL(slope, MIN(zero, v)))); \
+  } \
+  generic::relu(n - i, x + i, negative_slope, y + i); \
+} \
+KERNEL_TARGET void relu_backward(const int n, const float* top_diff, \
+    const float* bottom_data, const float negative_slope, \
+    float* bottom_diff) { \
+  const V zero = SET1(0); \
+  const V one = SET1(1); \
+  const V slope = SET1(negative_slope); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V x = LOAD(bottom_data + i); \
+    const V factor = BLEND(CMPGT(x, zero), \
+        BLEND(CMPLE(x, zero), zero, slope), one); \
+    STORE(bottom_diff + i, MUL(LOAD(top_diff + i), factor)); \
+  } \
+  generic::relu_backward(n - i, top_diff + i, bottom_data + i, \
+      negative_slope, bottom_diff + i); \
+} \
+KERNEL_TARGET void max_update(const int n, const float* x, const int index, \
+    float* y, int* mask) { \
+  const VI index_v = SET1I(index); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V xv = LOAD(x + i); \
+    const V yv = LOAD(y + i); \
+    const M greater = CMPGT(xv, yv); \
+    STORE(y + i, BLEND(greater, yv, xv)); \
+    STOREI(mask + i, BLENDI(greater, LOADI(mask + i), index_v)); \
+  } \
+  generic::max_update(n - i, x + i, index, y + i, mask + i); \
+} \
+KERNEL_TARGET void transform_u8(const int n, const uint8_t* x, \
+    const float* mean, const float mean_value, const float scale, \
+    float* y) { \
+  const V scale_v = SET1(scale); \
+  const V mean_v = SET1(mean_value); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V v = LOAD_U8(x + i); \
+    STORE(y + i, MUL(SUB(v, mean ? LOAD(mean + i) : mean_v), scale_v)); \
+  } \
+  generic::transform_u8(n - i, x + i, mean ? mean + i : NULL, mean_value, \
+      scale, y + i); \
+} \
+KERNEL_TARGET void sum_n(const int begin, const int end, \
+    const int num_inputs, const float* const* x, const float* coeffs, \
+    float* y) { \
+  int i = begin; \
+  for (; i + W <= end; i += W) { \
+    V sum = coeffs ? MUL(SET1(coeffs[0]), LOAD(x[0] + i)) : LOAD(x[0] + i); \
+    for (int j = 1; j < num_inputs; ++j) { \
+      sum = ADD(sum, coeffs ? MUL(SET1(coeffs[j]), LOAD(x[j] + i)) \
+          : LOAD(x[j] + i)); \
+    } \
+    STORE(y + i, sum); \
+  } \
+  generic::sum_n(i, end, num_inputs, x, coeffs, y); \
+} \
+KERNEL_TARGET void prod_n(const int begin, const int end, \
+    const int num_inputs, const float* const* x, float* y) { \
+  int i = begin; \
+  for (; i + W <= end; i += W) { \
+    V prod = LOAD(x[0] + i); \
+    for (int j = 1; j < num_inputs; ++j) { \
+      prod = MUL(prod, LOAD(x[j] + i)); \
+    } \
+    STORE(y + i, prod); \
+  } \
+  generic::prod_n(i, end, num_inputs, x, y); \
+} \
+KERNEL_TARGET void max_n(const int begin, const int end, \
+    const int num_inputs, const float* const* x, float* y, \
+    uint8_t* mask) { \
+  const VI zero_i = SET1I(0); \
+  const VI one_i = SET1I(1); \
+  int i = begin; \
+  for (; i + W <= end; i += W) { \
+    const V a = LOAD(x[0] + i); \
+    const V b = LOAD(x[1] + i); \
+    const M first = CMPGT(a, b); \
+    V max_val = BLEND(first, b, a); \
+    VI max_id = BLENDI(first, one_i, zero_i); \
+    for (int j = 2; j < num_inputs; ++j) { \
+      const V v = LOAD(x[j] + i); \
+      const M greater = CMPGT(v, max_val); \
+      max_val = BLEND(greater, max_val, v); \
+      max_id = BLENDI(greater, max_id, SET1I(j)); \
+    } \
+    STORE(y + i, max_val); \
+    STORE_U8(mask + i, max_id); \
+  } \
+  generic::max_n(i, end, num_inputs, x, y, mask); \
+} \
+KERNEL_TARGET void scale(const int n, const float alpha, const float* x, \
+    float* y) { \
+  const V alpha_v = SET1(alpha); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { STORE(y + i, MUL(alpha_v, LOAD(x + i))); } \
+  generic::scale(n - i, alpha, x + i, y + i); \
+} \
+KERNEL_TARGET void scale_bias(const int n, const float alpha, \
+    const float beta, const float* x, float* y) { \
+  const V alpha_v = SET1(alpha); \
+  const V beta_v = SET1(beta); \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    STORE(y + i, ADD(MUL(alpha_v, LOAD(x + i)), beta_v)); \
+  } \
+  generic::scale_bias(n - i, alpha, beta, x + i, y + i); \
+} \
+KERNEL_TARGET void asum_update(const int n, const float* x, float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    STORE(y + i, ADD(LOAD(y + i), ABS(LOAD(x + i)))); \
+  } \
+  generic::asum_update(n - i, x + i, y + i); \
+} \
+KERNEL_TARGET void sumsq_update(const int n, const float* x, float* y) { \
+  int i = 0; \
+  for (; i + W <= n; i += W) { \
+    const V v = LOAD(x + i); \
+    STORE(y + i, ADD(LOAD(y + i), MUL(v, v))); \
+  } \
+  generic::sumsq_update(n - i, x + i, y + i); \
+}
+
+// SSE4.2 (the blends and byte conversions are SSE4.1)
+namespace sse42 {
+#define KERNEL_TARGET __attribute__((target("sse4.2")))
+typedef __m128 V;
+typedef __m128i VI;
+typedef __m128 M;
+const int W = 4;
+#define LOAD _mm_loadu_ps
+#define STORE _mm_storeu_ps
+#define LOADI(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+#define STOREI(p, v) _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v)
+#define SET1 _mm_set1_ps
+#define SET1I _mm_set1_epi32
+#define ADD _mm_add_ps
+#define SUB _mm_sub_ps
+#define MUL _mm_mul_ps
+#define DIV _mm_div_ps
+#define SQRT _mm_sqrt_ps
+#define MAX _mm_max_ps
+#define MIN _mm_min_ps
+#define CMPGT _mm_cmpgt_ps
+#define CMPLE _mm_cmple_ps
+#define BLEND(m, a, b) _mm_blendv_ps(a, b, m)
+#define BLENDI(m, a, b) _mm_castps_si128(_mm_blendv_ps( \
+    _mm_castsi128_ps(a), _mm_castsi128_ps(b), m))
+#define ABS(v) _mm_andnot_ps(_mm_set1_ps(-0.f), v)
+KERNEL_TARGET inline V LOAD_U8(const uint8_t* p) {
+  int32_t bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+}
+KERNEL_TARGET inline void STORE_U8(uint8_t* p, const VI v) {
+  const __m128i words = _mm_packus_epi32(v, v);
+  const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+  memcpy(p, &bytes, sizeof(bytes));
+}
+DEFINE_CPU_KERNELS
+#undef KERNEL_TARGET
+#undef LOAD
+#undef STORE
+#undef LOADI
+#undef STOREI
+#undef SET1
+#undef SET1I
+#undef ADD
+#undef SUB
+#undef MUL
+#undef DIV
+#undef SQRT
+#undef MAX
+#undef MIN
+#undef CMPGT
+#undef CMPLE
+#undef BLEND
+#undef BLENDI
+#undef ABS
+}  // namespace sse42
+
+namespace avx2 {
+#define KERNEL_TARGET __attribute__((target("avx2")))
+typedef __m256 V;
+typedef __m256i VI;
+typedef __m256 M;
+const int W = 8;
+#define LOAD _mm256_loadu_ps
+#define STORE _mm256_storeu_ps
+#define LOADI(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define STOREI(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v)
+#define SET1 _mm256_set1_ps
+#define SET1I _mm256_set1_epi32
+#define ADD _mm256_add_ps
+#define SUB _mm256_sub_ps
+#define MUL _mm256_mul_ps
+#define DIV _mm256_div_ps
+#define SQRT _mm256_sqrt_ps
+#define MAX _mm256_max_ps
+#define MIN _mm256_min_ps
+#define CMPGT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define CMPLE(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define BLEND(m, a, b) _mm256_blendv_ps(a, b, m)
+#define BLENDI(m, a, b) _mm256_castps_si256(_mm256_blendv_ps( \
+    _mm256_castsi256_ps(a), _mm256_castsi256_ps(b), m))
+#define ABS(v) _mm256_andnot_ps(_mm256_set1_ps(-0.f), v)
+KERNEL_TARGET inline V LOAD_U8(const uint8_t* p) {
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+KERNEL_TARGET inline void STORE_U8(uint8_t* p, const VI v) {
+  const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v),
+      _mm256_extracti128_si256(v, 1));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+      _mm_packus_epi16(words, words));
+}
+DEFINE_CPU_KERNELS
+#undef KERNEL_TARGET
+#undef LOAD
+#undef STORE
+#undef LOADI
+#undef STOREI
+#undef SET1
+#undef SET1I
+#undef ADD
+#undef SUB
+#undef MUL
+#undef DIV
+#undef SQRT
+#undef MAX
+#undef MIN
+#undef CMPGT
+#undef CMPLE
+#undef BLEND
+#undef BLENDI
+#undef ABS
+}  // namespace avx2
+
+namespace avx512 {
+// AVX-512F has fused multiply-adds; keep products and sums separate so the
+// results round like the generic ones.
+#define KERNEL_TARGET \
+    __attribute__((target("avx512f"), optimize("fp-contract=off")))
+typedef __m512 V;
+typedef __m512i VI;
+typedef __mmask16 M;
+const int W = 16;
+#define LOAD _mm512_loadu_ps
+#define STORE _mm512_storeu_ps
+#define LOADI _mm512_loadu_si512
+#define STOREI _mm512_storeu_si512
+#define SET1 _mm512_set1_ps
+#define SET1I _mm512_set1_epi32
+#define ADD _mm512_add_ps
+#define SUB _mm512_sub_ps
+#define MUL _mm512_mul_ps
+#define DIV _mm512_div_ps
+#define SQRT _mm512_sqrt_ps
+#define MAX _mm512_max_ps
+#define MIN _mm512_min_ps
+#define CMPGT(a, b) _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define CMPLE(a, b) _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ)
+#define BLEND _mm512_mask_blend_ps
+#define BLENDI _mm512_mask_blend_epi32
+// AVX-512F has no float logic; clear the sign bits as integers.
+#define ABS(v) _mm512_castsi512_ps(_mm512_and_si512( \
+    _mm512_castps_si512(v), _mm512_set1_epi32(0x7fffffff)))
+KERNEL_TARGET inline V LOAD_U8(const uint8_t* p) {
+  return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+KERNEL_TARGET inline void STORE_U8(uint8_t* p, const VI v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_cvtepi32_epi8(v));
+}
+DEFINE_CPU_KERNELS
+#undef KERNEL_TARGET
+#undef LOAD
+#undef STORE
+#undef LOADI
+#undef STOREI
+#undef SET1
+#undef SET1I
+#undef ADD
+#undef SUB
+#undef MUL
+#undef DIV
+#undef SQRT
+#undef MAX
+#undef MIN
+#undef CMPGT
+#undef CMPLE
+#undef BLEND
+#undef BLENDI
+#undef ABS
+}  // namespace avx512
+
+#undef DEFINE_CPU_KERNELS
+
+#endif  // CAFFE_X86_KERNELS
+
+#define CPU_KERNEL_TABLE(isa) { \
+  &isa::add, &isa::sub, &isa::mul, &isa::div, &isa::sqr, &isa::sqrt, \
+  &isa::relu, &isa::relu_backward, &isa::max_update, &isa::transform_u8, \
+  &isa::sum_n, &isa::prod_n, &isa::max_n, &isa::scale, &isa::scale_bias, \
+  &isa::asum_update, &isa::sumsq_update \
+}
+
+const CpuKernels& GetCpuKernels(const CpuIsa isa) {
+  static const CpuKernels generic_kernels = CPU_KERNEL_TABLE(generic);
+#ifdef CAFFE_X86_KERNELS
+  static const CpuKernels sse42_kernels = CPU_KERNEL_TABLE(sse42);
+  static const CpuKernels avx2_kernels = CPU_KERNEL_TABLE(avx2);
+  static const CpuKernels avx512_kernels = CPU_KERNEL_TABLE(avx512);
+  switch (isa) {
+  case CPU_ISA_SSE42:
+    return sse42_kernels;
+  case CPU_ISA_AVX2:
+    return avx2_kernels;
+  case CPU_ISA_AVX512:
+    return avx512_kernels;
+  default:
+    break;
+  }
+#endif
+  return generic_kernels;
+}
+
+}  // namespace caffe
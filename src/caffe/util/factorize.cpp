@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/factorize.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The geometry of a 3-D convolution, per spatial axis (T, H, W).
+struct ConvGeometry {
+  int kernel[3];
+  int stride[3];
+  int pad[3];
+  int dilation[3];
+};
+
+// Reads a convolution's geometry the way BaseConvolutionLayer does, or the
+// way CudnnNdConvolutionLayer does for NdConvolution layers.
+static ConvGeometry ReadGeometry(const LayerParameter& layer) {
+  const ConvolutionParameter& conv_param = layer.convolution_param();
+  ConvGeometry geometry;
+  for (int i = 0; i < 3; ++i) {
+    if (layer.type() == "NdConvolution") {
+      geometry.kernel[i] = conv_param.kernel_shape().dim(i);
+      geometry.stride[i] = conv_param.has_stride_shape() ?
+          conv_param.stride_shape().dim(i) : 1;
+      geometry.pad[i] = conv_param.has_pad_shape() ?
+          conv_param.pad_shape().dim(i) : 0;
+      geometry.dilation[i] = 1;
+      continue;
+    }
+    const int num_kernel_dims = conv_param.kernel_size_size();
+    const int num_stride_dims = conv_param.stride_size();
+    const int num_pad_dims = conv_param.pad_size();
+    const int num_dilation_dims = conv_param.dilation_size();
+    geometry.kernel[i] = conv_param.kernel_size(num_kernel_dims == 1 ? 0 : i);
+    geometry.stride[i] = num_stride_dims == 0 ? 1 :
+        conv_param.stride(num_stride_dims == 1 ? 0 : i);
+    geometry.pad[i] = num_pad_dims == 0 ? 0 :
+        conv_param.pad(num_pad_dims == 1 ? 0 : i);
+    geometry.dilation[i] = num_dilation_dims == 0 ? 1 :
+        conv_param.dilation(num_dilation_dims == 1 ? 0 : i);
+  }
+  return geometry;
+}
+
+// Writes a geometry into a convolution of the given type, per axis.
+static void WriteGeometry(const string& type, const ConvGeometry& geometry,
+    ConvolutionParameter* conv_param) {
+  conv_param->clear_kernel_size();
+  conv_param->clear_stride();
+  conv_param->clear_pad();
+  conv_param->clear_dilation();
+  conv_param->clear_kernel_shape();
+  conv_param->clear_stride_shape();
+  conv_param->clear_pad_shape();
+  for (int i = 0; i < 3; ++i) {
+    if (type == "NdConvolution") {
+      conv_param->mutable_kernel_shape()->add_dim(geometry.kernel[i]);
+      conv_param->mutable_stride_shape()->add_dim(geometry.stride[i]);
+      conv_param->mutable_pad_shape()->add_dim(geometry.pad[i]);
+    } else {
+      conv_param->add_kernel_size(geometry.kernel[i]);
+      conv_param->add_stride(geometry.stride[i]);
+      conv_param->add_pad(geometry.pad[i]);
+      conv_param->add_dilation(geometry.dilation[i]);
+    }
+  }
+}
+
+void SymmetricEigen(const int n, vector<double>* a,
+    vector<double>* v) {
+  vector<double>& A = *a;
+  vector<double>& V = *v;
+  V.assign(n * n, 0);
+  double norm = 0;
+  for (int i = 0; i < n; ++i) {
+    V[i * n + i] = 1;
+    for (int j = 0; j < n; ++j) {
+      norm += A[i * n + j] * A[i * n + j];
+    }
+  }
+  const int kMaxSweeps = 50;
+  for (int sweep = 0; sweep < kMaxSweeps; ++sweep) {
+    double off = 0;
+    for (int p = 0; p < n; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        off += A[p * n + q] * A[p * n + q];
+      }
+    }
+    if (off <= 1e-24 * norm) { break; }
+    for (int p = 0; p < n; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        const double apq = A[p * n + q];
+        if (apq == 0) { continue; }
+        // The rotation by t = tan(angle) that zeroes a[p][q].
+        const double theta = (A[q * n + q] - A[p * n + p]) / (2 * apq);
+        const double t = (theta >= 0 ? 1 : -1) /
+            (std::fabs(theta) + std::sqrt(theta * theta + 1));
+        const double c = 1 / std::sqrt(t * t + 1);
+        const double s = t * c;
+        for (int k = 0; k < n; ++k) {
+          const double akp = A[k * n + p];
+          const double akq = A[k * n + q];
+          A[k * n + p] = c * akp - s * akq;
+          A[k * n + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; ++k) {
+          const double apk = A[p * n + k];
+          const double aqk = A[q * n + k];
+          A[p * n + k] = c * apk - s * aqk;
+          A[q * n + k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < n; ++k) {
+          const double vkp = V[k * n + p];
+          const double vkq = V[k * n + q];
+          V[k * n + p] = c * vkp - s * vkq;
+          V[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+double LowRankFactor(const vector<double>& a, const int m,
+    const int n, const int rank, const double energy, vector<double>* left,
+    vector<double>* right, int* out_rank) {
+  const bool transpose = n > m;
+  const int d = transpose ? m : n;
+  vector<double> gram(d * d);
+  if (transpose) {
+    caffe_cpu_gemm<double>(CblasNoTrans, CblasTrans, d, d, n, 1.,
+        &a[0], &a[0], 0., &gram[0]);
+  } else {
+    caffe_cpu_gemm<double>(CblasTrans, CblasNoTrans, d, d, m, 1.,
+        &a[0], &a[0], 0., &gram[0]);
+  }
+  vector<double> eigenvectors;
+  SymmetricEigen(d, &gram, &eigenvectors);
+  // The squared singular values, negated to sort them in decreasing order.
+  vector<std::pair<double, int> > eigenvalues(d);
+  double total = 0;
+  for (int i = 0; i < d; ++i) {
+    const double eigenvalue = std::max(gram[i * d + i], 0.);
+    eigenvalues[i] = std::make_pair(-eigenvalue, i);
+    total += eigenvalue;
+  }
+  std::sort(eigenvalues.begin(), eigenvalues.end());
+  int r = std::min(rank, d);
+  if (r <= 0) {
+    double kept = 0;
+    for (r = 0; r < d && kept < energy * total * (1 - 1e-12); ++r) {
+      kept -= eigenvalues[r].first;
+    }
+    r = std::max(r, 1);
+  }
+  // basis holds the kept eigenvectors as rows (r x d).
+  vector<double> basis(r * d);
+  for (int i = 0; i < r; ++i) {
+    for (int j = 0; j < d; ++j) {
+      basis[i * d + j] = eigenvectors[j * d + eigenvalues[i].second];
+    }
+  }
+  left->resize(m * r);
+  right->resize(r * n);
+  if (transpose) {
+    // a ~= U_r (U_r^T a)
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < r; ++j) {
+        (*left)[i * r + j] = basis[j * d + i];
+      }
+    }
+    caffe_cpu_gemm<double>(CblasNoTrans, CblasNoTrans, r, n, m, 1.,
+        &basis[0], &a[0], 0., &(*right)[0]);
+  } else {
+    // a ~= (a V_r) V_r^T
+    caffe_cpu_gemm<double>(CblasNoTrans, CblasTrans, m, r, n, 1.,
+        &a[0], &basis[0], 0., &(*left)[0]);
+    *right = basis;
+  }
+  vector<double> product(m * n);
+  caffe_cpu_gemm<double>(CblasNoTrans, CblasNoTrans, m, n, r, 1.,
+      &(*left)[0], &(*right)[0], 0., &product[0]);
+  double error = 0;
+  double norm = 0;
+  for (int i = 0; i < m * n; ++i) {
+    error += (a[i] - product[i]) * (a[i] - product[i]);
+    norm += a[i] * a[i];
+  }
+  *out_rank = r;
+  return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+double FactorizeConvolution(const LayerParameter& layer,
+    const Blob<float>& weights, const FactorizationMethod method,
+    const int requested_rank, const double energy,
+    ConvFactorization* result) {
+  const int num_output = weights.shape(0);
+  const int channels = weights.shape(1);
+  const int kernel_t = weights.shape(2);
+  const int kernel_hw = weights.count(3);
+  const float* w = weights.cpu_data();
+  // The filters as a matrix whose rank the factorization bounds: over
+  // (o, t) x (c, h, w) for separable, and o x (c, t, h, w) for channel.
+  const bool separable = method == SEPARABLE_FACTORIZATION;
+  const int m = separable ? num_output * kernel_t : num_output;
+  const int n = weights.count() / m;
+  vector<double> a(weights.count());
+  for (int o = 0; o < num_output; ++o) {
+    for (int c = 0; c < channels; ++c) {
+      for (int t = 0; t < kernel_t; ++t) {
+        for (int hw = 0; hw < kernel_hw; ++hw) {
+          const int index = ((o * channels + c) * kernel_t + t) * kernel_hw +
+              hw;
+          if (separable) {
+            a[(o * kernel_t + t) * n + c * kernel_hw + hw] = w[index];
+          } else {
+            a[index] = w[index];
+          }
+        }
+      }
+    }
+  }
+  vector<double> left, right;
+  int rank;
+  const double error = LowRankFactor(a, m, n, requested_rank, energy, &left,
+      &right, &rank);
+
+  // The first layer maps the bottom onto rank channels, without a bias;
+  // the second maps those onto the outputs, with the original bias.
+  const ConvGeometry geometry = ReadGeometry(layer);
+  ConvGeometry first_geometry = geometry;
+  ConvGeometry second_geometry = geometry;
+  for (int i = 0; i < 3; ++i) {
+    // separable: the first layer is spatial and the second temporal;
+    // channel: the first layer is the original and the second 1x1x1.
+    const bool second_is_unit = !separable || i > 0;
+    ConvGeometry& unit = second_is_unit ? second_geometry : first_geometry;
+    unit.kernel[i] = 1;
+    unit.stride[i] = 1;
+    unit.pad[i] = 0;
+    unit.dilation[i] = 1;
+  }
+  const string first_suffix = separable ? "_spatial" : "_basis";
+  const string second_suffix = separable ? "_temporal" : "_proj";
+  result->first = layer;
+  result->first.set_name(layer.name() + first_suffix);
+  result->first.clear_top();
+  result->first.add_top(layer.name() + first_suffix);
+  result->first.mutable_convolution_param()->set_num_output(rank);
+  result->first.mutable_convolution_param()->set_bias_term(false);
+  result->first.mutable_convolution_param()->clear_bias_filler();
+  while (result->first.param_size() > 1) {
+    result->first.mutable_param()->RemoveLast();
+  }
+  WriteGeometry(layer.type(), first_geometry,
+      result->first.mutable_convolution_param());
+  result->second = layer;
+  result->second.set_name(layer.name() + second_suffix);
+  result->second.clear_bottom();
+  result->second.add_bottom(layer.name() + first_suffix);
+  WriteGeometry(layer.type(), second_geometry,
+      result->second.mutable_convolution_param());
+
+  result->first_shape.clear();
+  result->first_shape.push_back(rank);
+  result->first_shape.push_back(channels);
+  for (int i = 0; i < 3; ++i) {
+    result->first_shape.push_back(first_geometry.kernel[i]);
+  }
+  result->second_shape.clear();
+  result->second_shape.push_back(num_output);
+  result->second_shape.push_back(rank);
+  for (int i = 0; i < 3; ++i) {
+    result->second_shape.push_back(second_geometry.kernel[i]);
+  }
+  // right is laid out as the first layer's (rank, C, ...) filters. left is
+  // laid out as the second layer's (O, rank) filters for channel, but as
+  // (O, T, rank) for separable, where the filters are (O, rank, T).
+  result->first_weights.assign(right.begin(), right.end());
+  result->second_weights.resize(left.size());
+  for (int o = 0; o < num_output; ++o) {
+    for (int r = 0; r < rank; ++r) {
+      for (int t = 0; t < (separable ? kernel_t : 1); ++t) {
+        result->second_weights[(o * rank + r) * (separable ? kernel_t : 1) +
+            t] = separable ? left[(o * kernel_t + t) * rank + r] :
+            left[o * rank + r];
+      }
+    }
+  }
+  return error;
+}
+
+}  // namespace caffe
@@ -1,5 +1,7 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -123,6 +125,94 @@ void hdf5_save_nd_dataset<double>(
   delete[] dims;
 }
 
+static inline hid_t hdf5_native_type(float) { return H5T_NATIVE_FLOAT; }
+static inline hid_t hdf5_native_type(double) { return H5T_NATIVE_DOUBLE; }
+
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    int num_rows, int chunk_rows) {
+  CHECK_GE(blob.num_axes(), 1);
+  CHECK_LE(num_rows, blob.shape(0));
+  CHECK_GT(chunk_rows, 0);
+  const int num_axes = blob.num_axes();
+  const hid_t type = hdf5_native_type(Dtype(0));
+  std::vector<hsize_t> dims(num_axes);
+  for (int i = 0; i < num_axes; ++i) {
+    dims[i] = blob.shape(i);
+  }
+  herr_t status;
+  hid_t dataset_id;
+  if (H5LTfind_dataset(file_id, dataset_name.c_str())) {
+    dataset_id = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+    CHECK_GE(dataset_id, 0) << "Failed to open dataset " << dataset_name;
+  } else {
+    // Start empty along the first axis and let it grow without bound.
+    std::vector<hsize_t> max_dims(dims), chunk_dims(dims);
+    dims[0] = 0;
+    max_dims[0] = H5S_UNLIMITED;
+    // HDF5 caps chunks below 4 GB, so hold fewer rows per chunk if need be.
+    const hsize_t kMaxChunkBytes = 0xFFFFFFFFu;
+    hsize_t row_bytes = sizeof(Dtype);
+    for (int i = 1; i < num_axes; ++i) {
+      row_bytes *= std::max<hsize_t>(dims[i], 1);
+    }
+    CHECK_LE(row_bytes, kMaxChunkBytes)
+        << "Rows of dataset " << dataset_name << " exceed an HDF5 chunk";
+    chunk_dims[0] = std::min<hsize_t>(chunk_rows, kMaxChunkBytes / row_bytes);
+    hid_t space_id = H5Screate_simple(num_axes, dims.data(), max_dims.data());
+    CHECK_GE(space_id, 0) << "Failed to create dataspace for " << dataset_name;
+    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    status = H5Pset_chunk(plist_id, num_axes, chunk_dims.data());
+    CHECK_GE(status, 0) << "Failed to set chunking for " << dataset_name;
+    dataset_id = H5Dcreate2(file_id, dataset_name.c_str(), type, space_id,
+        H5P_DEFAULT, plist_id, H5P_DEFAULT);
+    CHECK_GE(dataset_id, 0) << "Failed to make dataset " << dataset_name;
+    H5Pclose(plist_id);
+    H5Sclose(space_id);
+  }
+  // Grow the dataset by num_rows and write them into the new tail.
+  hid_t space_id = H5Dget_space(dataset_id);
+  CHECK_EQ(H5Sget_simple_extent_ndims(space_id), num_axes)
+      << "Number of axes mismatch for dataset " << dataset_name;
+  std::vector<hsize_t> old_dims(num_axes);
+  H5Sget_simple_extent_dims(space_id, old_dims.data(), NULL);
+  H5Sclose(space_id);
+  for (int i = 1; i < num_axes; ++i) {
+    CHECK_EQ(old_dims[i], dims[i])
+        << "Shape mismatch on axis " << i << " of dataset " << dataset_name;
+  }
+  std::vector<hsize_t> new_dims(old_dims), offset(num_axes, 0);
+  new_dims[0] += num_rows;
+  offset[0] = old_dims[0];
+  dims[0] = num_rows;
+  status = H5Dset_extent(dataset_id, new_dims.data());
+  CHECK_GE(status, 0) << "Failed to extend dataset " << dataset_name;
+  space_id = H5Dget_space(dataset_id);
+  status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, offset.data(), NULL,
+      dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of dataset " << dataset_name;
+  hid_t mem_space_id = H5Screate_simple(num_axes, dims.data(), NULL);
+  status = H5Dwrite(dataset_id, type, mem_space_id, space_id, H5P_DEFAULT,
+      blob.cpu_data());
+  CHECK_GE(status, 0) << "Failed to append to dataset " << dataset_name;
+  H5Sclose(mem_space_id);
+  H5Sclose(space_id);
+  H5Dclose(dataset_id);
+}
+
+template void hdf5_append_nd_dataset<float>(
+    const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
+    int num_rows, int chunk_rows);
+template void hdf5_append_nd_dataset<double>(
+    const hid_t file_id, const string& dataset_name, const Blob<double>& blob,
+    int num_rows, int chunk_rows);
+
+boost::mutex& hdf5_mutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
   // Get size of dataset
   size_t size;
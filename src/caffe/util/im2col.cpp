@@ -66,6 +66,78 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
 
+template <typename Dtype>
+void im2col_3d_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_l = (length + 2 * pad_l -
+    (dilation_l * (kernel_l - 1) + 1)) / stride_l + 1;
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int channel_size = length * height * width;
+  const int output_size = output_h * output_w;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_frame = 0; kernel_frame < kernel_l; kernel_frame++) {
+      for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+        for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+          int input_frame = -pad_l + kernel_frame * dilation_l;
+          for (int output_frames = output_l; output_frames; output_frames--) {
+            if (!is_a_ge_zero_and_a_lt_b(input_frame, length)) {
+              caffe_set(output_size, Dtype(0), data_col);
+              data_col += output_size;
+              input_frame += stride_l;
+              continue;
+            }
+            const Dtype* data_frame = data_im + input_frame * height * width;
+            int input_row = -pad_h + kernel_row * dilation_h;
+            for (int output_rows = output_h; output_rows; output_rows--) {
+              if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+                for (int output_cols = output_w; output_cols; output_cols--) {
+                  *(data_col++) = 0;
+                }
+              } else {
+                int input_col = -pad_w + kernel_col * dilation_w;
+                for (int output_col = output_w; output_col; output_col--) {
+                  if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
+                    *(data_col++) = data_frame[input_row * width + input_col];
+                  } else {
+                    *(data_col++) = 0;
+                  }
+                  input_col += stride_w;
+                }
+              }
+              input_row += stride_h;
+            }
+            input_frame += stride_l;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void im2col_3d_cpu<float>(const float* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    float* data_col);
+template void im2col_3d_cpu<double>(const double* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    double* data_col);
+
 template <typename Dtype>
 inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
     const int num_spatial_axes, const int* im_shape, const int* col_shape,
@@ -210,6 +282,196 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_im);
 
+template <typename Dtype>
+void col2im_3d_cpu(const Dtype* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  caffe_set(length * height * width * channels, Dtype(0), data_im);
+  const int output_l = (length + 2 * pad_l -
+    (dilation_l * (kernel_l - 1) + 1)) / stride_l + 1;
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int channel_size = length * height * width;
+  const int output_size = output_h * output_w;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_frame = 0; kernel_frame < kernel_l; kernel_frame++) {
+      for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+        for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+          int input_frame = -pad_l + kernel_frame * dilation_l;
+          for (int output_frames = output_l; output_frames; output_frames--) {
+            if (!is_a_ge_zero_and_a_lt_b(input_frame, length)) {
+              data_col += output_size;
+              input_frame += stride_l;
+              continue;
+            }
+            Dtype* data_frame = data_im + input_frame * height * width;
+            int input_row = -pad_h + kernel_row * dilation_h;
+            for (int output_rows = output_h; output_rows; output_rows--) {
+              if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+                data_col += output_w;
+              } else {
+                int input_col = -pad_w + kernel_col * dilation_w;
+                for (int output_col = output_w; output_col; output_col--) {
+                  if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
+                    data_frame[input_row * width + input_col] += *data_col;
+                  }
+                  data_col++;
+                  input_col += stride_w;
+                }
+              }
+              input_row += stride_h;
+            }
+            input_frame += stride_l;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void col2im_3d_cpu<float>(const float* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    float* data_im);
+template void col2im_3d_cpu<double>(const double* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    double* data_im);
+
+// The channels-last column buffer has one row per output location, holding
+// the channels of every kernel tap in turn: (output l, h, w) x
+// (kernel l, h, w, channels). Each tap copies channels contiguous values.
+template <typename Dtype>
+void im2col_channels_last_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_l = (length + 2 * pad_l -
+    (dilation_l * (kernel_l - 1) + 1)) / stride_l + 1;
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  for (int output_frame = 0; output_frame < output_l; ++output_frame) {
+    for (int output_row = 0; output_row < output_h; ++output_row) {
+      for (int output_col = 0; output_col < output_w; ++output_col) {
+        for (int kernel_frame = 0; kernel_frame < kernel_l; ++kernel_frame) {
+          const int input_frame = output_frame * stride_l - pad_l +
+              kernel_frame * dilation_l;
+          for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+            const int input_row = output_row * stride_h - pad_h +
+                kernel_row * dilation_h;
+            for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+              const int input_col = output_col * stride_w - pad_w +
+                  kernel_col * dilation_w;
+              if (is_a_ge_zero_and_a_lt_b(input_frame, length) &&
+                  is_a_ge_zero_and_a_lt_b(input_row, height) &&
+                  is_a_ge_zero_and_a_lt_b(input_col, width)) {
+                caffe_copy(channels, data_im + ((input_frame * height +
+                    input_row) * width + input_col) * channels, data_col);
+              } else {
+                caffe_set(channels, Dtype(0), data_col);
+              }
+              data_col += channels;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void im2col_channels_last_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    float* data_col);
+template void im2col_channels_last_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    double* data_col);
+
+template <typename Dtype>
+void col2im_channels_last_cpu(const Dtype* data_col, const int channels,
+    const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  caffe_set(length * height * width * channels, Dtype(0), data_im);
+  const int output_l = (length + 2 * pad_l -
+    (dilation_l * (kernel_l - 1) + 1)) / stride_l + 1;
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  for (int output_frame = 0; output_frame < output_l; ++output_frame) {
+    for (int output_row = 0; output_row < output_h; ++output_row) {
+      for (int output_col = 0; output_col < output_w; ++output_col) {
+        for (int kernel_frame = 0; kernel_frame < kernel_l; ++kernel_frame) {
+          const int input_frame = output_frame * stride_l - pad_l +
+              kernel_frame * dilation_l;
+          for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+            const int input_row = output_row * stride_h - pad_h +
+                kernel_row * dilation_h;
+            for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+              const int input_col = output_col * stride_w - pad_w +
+                  kernel_col * dilation_w;
+              if (is_a_ge_zero_and_a_lt_b(input_frame, length) &&
+                  is_a_ge_zero_and_a_lt_b(input_row, height) &&
+                  is_a_ge_zero_and_a_lt_b(input_col, width)) {
+                caffe_axpy(channels, Dtype(1), data_col, data_im +
+                    ((input_frame * height + input_row) * width + input_col) *
+                    channels);
+              }
+              data_col += channels;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void col2im_channels_last_cpu<float>(const float* data_col,
+    const int channels, const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    float* data_im);
+template void col2im_channels_last_cpu<double>(const double* data_col,
+    const int channels, const int length, const int height, const int width,
+    const int kernel_l, const int kernel_h, const int kernel_w,
+    const int pad_l, const int pad_h, const int pad_w,
+    const int stride_l, const int stride_h, const int stride_w,
+    const int dilation_l, const int dilation_h, const int dilation_w,
+    double* data_im);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -0,0 +1,169 @@
+#include <map>
+#include <set>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/insert_reorders.hpp"
+#include "caffe/util/layout.hpp"
+
+namespace caffe {
+
+// Whether all layers of the net run in the default PLANAR layout.
+static bool AllPlanar(const NetParameter& param) {
+  if (param.layout() != PLANAR) {
+    return false;
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (param.layer(i).layout() != PLANAR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+static BlobLayout ResolveLayout(const NetParameter& param,
+    const LayerParameter& layer_param,
+    const map<string, BlobLayout>& blob_layout) {
+  if (layer_param.has_layout()) {
+    return layer_param.layout();
+  }
+  // Data layers produce PLANAR blobs.
+  if (layer_param.bottom_size() == 0) {
+    return PLANAR;
+  }
+  if (LayerRegistry<Dtype>::LayoutAgnostic(layer_param)) {
+    return blob_layout.find(layer_param.bottom(0))->second;
+  }
+  return LayerRegistry<Dtype>::SupportsLayout(layer_param, param.layout()) ?
+      param.layout() : PLANAR;
+}
+
+// Renames every use of a blob in the layers of param.
+static void RenameBlob(const string& blob_name, const string& new_name,
+    NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    for (int j = 0; j < layer_param->bottom_size(); ++j) {
+      if (layer_param->bottom(j) == blob_name) {
+        layer_param->set_bottom(j, new_name);
+      }
+    }
+    for (int j = 0; j < layer_param->top_size(); ++j) {
+      if (layer_param->top(j) == blob_name) {
+        layer_param->set_top(j, new_name);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void InsertReorders(const NetParameter& param,
+    NetParameter* param_reordered) {
+  param_reordered->CopyFrom(param);
+  if (AllPlanar(param)) {
+    return;
+  }
+  param_reordered->clear_layer();
+  // Layout of every blob, and the blob that currently holds the values of a
+  // blob named in param (it differs once an in-place layer runs on a
+  // reordered copy).
+  map<string, BlobLayout> blob_layout;
+  map<string, string> current_name;
+  set<string> outputs;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter layer_param(param.layer(i));
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      CHECK(current_name.count(blob_name)) << "Unknown bottom blob '"
+          << blob_name << "' (layer '" << layer_param.name()
+          << "', bottom index " << j << ")";
+      layer_param.set_bottom(j, current_name[blob_name]);
+      outputs.erase(blob_name);
+    }
+    if (!layer_param.has_phase()) {
+      layer_param.set_phase(param.state().phase());
+    }
+    const BlobLayout layout =
+        ResolveLayout<Dtype>(param, layer_param, blob_layout);
+    // Reorder the bottoms stored in another layout.
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      if (blob_layout[blob_name] == layout) {
+        continue;
+      }
+      ConfigureReorderLayer(blob_name, layout,
+          param_reordered->add_layer());
+      const string& reordered_name = ReorderBlobName(blob_name, layout);
+      blob_layout[reordered_name] = layout;
+      for (int k = 0; k < layer_param.top_size(); ++k) {
+        if (layer_param.top(k) == blob_name) {
+          // In-place computation continues on the reordered blob.
+          layer_param.set_top(k, reordered_name);
+          current_name[param.layer(i).top(k)] = reordered_name;
+        }
+      }
+      layer_param.set_bottom(j, reordered_name);
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& original_name = param.layer(i).top(j);
+      if (layer_param.top(j) == original_name) {
+        current_name[original_name] = original_name;
+      }
+      blob_layout[layer_param.top(j)] = layout;
+      outputs.insert(original_name);
+    }
+    if (layout != PLANAR) {
+      layer_param.set_layout(layout);
+    } else {
+      layer_param.clear_layout();
+    }
+    param_reordered->add_layer()->CopyFrom(layer_param);
+  }
+  // Hand out the net outputs in the PLANAR layout under their own names.
+  for (set<string>::const_iterator it = outputs.begin(); it != outputs.end();
+       ++it) {
+    const string& current = current_name[*it];
+    const BlobLayout layout = blob_layout[current];
+    if (layout == PLANAR) {
+      continue;
+    }
+    string source = current;
+    if (current == *it) {
+      source = ReorderBlobName(*it, layout);
+      RenameBlob(*it, source, param_reordered);
+    } else {
+      // The name still belongs to the blob the output was reordered from.
+      RenameBlob(*it, ReorderBlobName(*it, blob_layout[*it]),
+          param_reordered);
+    }
+    LayerParameter* reorder_layer_param = param_reordered->add_layer();
+    ConfigureReorderLayer(source, PLANAR, reorder_layer_param);
+    reorder_layer_param->set_top(0, *it);
+  }
+}
+
+void ConfigureReorderLayer(const string& blob_name, const BlobLayout layout,
+    LayerParameter* reorder_layer_param) {
+  reorder_layer_param->Clear();
+  reorder_layer_param->add_bottom(blob_name);
+  reorder_layer_param->set_name(ReorderBlobName(blob_name, layout));
+  reorder_layer_param->set_type("Reorder");
+  reorder_layer_param->add_top(ReorderBlobName(blob_name, layout));
+  if (layout != PLANAR) {
+    reorder_layer_param->set_layout(layout);
+  }
+}
+
+string ReorderBlobName(const string& blob_name, const BlobLayout layout) {
+  return blob_name + "_" + BlobLayoutName(layout);
+}
+
+template void InsertReorders<float>(const NetParameter& param,
+    NetParameter* param_reordered);
+template void InsertReorders<double>(const NetParameter& param,
+    NetParameter* param_reordered);
+
+}  // namespace caffe
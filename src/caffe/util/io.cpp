@@ -12,7 +12,12 @@
 #include <opencv2/videoio/videoio.hpp>
 #endif
 #endif  // USE_OPENCV
+#ifdef USE_LIBJPEG_TURBO
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif  // USE_LIBJPEG_TURBO
 #include <stdint.h>
+#include <stdio.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -30,7 +35,11 @@
 // Check if a given path is a regular file or a path
 void check_path(const std::string& path, bool* is_file, bool* is_dir) {
   struct stat path_stat;
-  stat(path.c_str(), &path_stat);
+  if (stat(path.c_str(), &path_stat) != 0) {
+    *is_file = false;
+    *is_dir = false;
+    return;
+  }
   *is_file = S_ISREG(path_stat.st_mode);
   *is_dir  = S_ISDIR(path_stat.st_mode);
 }
@@ -157,10 +166,58 @@ bool ReadImageToDatum(const string& filename, const int label,
   }
 }
 
+// The file of a frame extracted from a video: 4-digit zero-padded.
+static string FrameFilename(const string& path, const int frame,
+    const char* prefix = "image") {
+  char image_filename[256];
+  snprintf(image_filename, sizeof(image_filename), "%s/%s_%04d.jpg",
+           path.c_str(), prefix, frame);
+  return image_filename;
+}
+
+// The number of files of a frame directory with the prefix, numbered from 1.
+static int CountFrameFiles(const string& path, const char* prefix) {
+  int num_frames = 0;
+  bool is_frame_file, is_frame_path;
+  while (true) {
+    check_path(FrameFilename(path, num_frames + 1, prefix), &is_frame_file,
+               &is_frame_path);
+    if (!is_frame_file) {
+      return num_frames;
+    }
+    ++num_frames;
+  }
+}
+
+// The frames of a clip of length consecutive frames.
+static vector<int> ConsecutiveFrames(const int start_frame, const int length) {
+  vector<int> frames(length);
+  for (int i = 0; i < length; ++i) {
+    frames[i] = start_frame + i;
+  }
+  return frames;
+}
+
+int CountVideoFrames(const string& path) {
+  bool is_video_file, is_path;
+  check_path(path, &is_video_file, &is_path);
+  if (is_video_file) {
+    cv::VideoCapture cap(path);
+    if (!cap.isOpened()) {
+      LOG(ERROR) << "Cannot open a video file=" << path;
+      return 0;
+    }
+    return cap.get(CV_CAP_PROP_FRAME_COUNT);
+  } else if (!is_path) {
+    LOG(ERROR) << "Could not open or find file " << path;
+    return 0;
+  }
+  return CountFrameFiles(path, "image");
+}
+
 bool ReadVideoToCVMat(const string& path,
-    const int start_frame, const int length, const int height, const int width,
+    const vector<int>& frames, const int height, const int width,
     const bool is_color, std::vector<cv::Mat>* cv_imgs) {
-
   // Check if path is a directory that holds extracted images from a video,
   // or a regular video file.
   bool is_video_file, is_path;
@@ -169,6 +226,7 @@ bool ReadVideoToCVMat(const string& path,
     LOG(ERROR) << "Could not open or find file " << path;
     return false;
   }
+  CHECK(!frames.empty()) << "No frames to read";
 
   cv::Mat cv_img, cv_img_origin;
 
@@ -182,25 +240,40 @@ bool ReadVideoToCVMat(const string& path,
       return false;
     }
 
+    // Each frame is decoded once, in the order of the video.
+    vector<int> sorted_frames(frames);
+    std::sort(sorted_frames.begin(), sorted_frames.end());
+    sorted_frames.erase(std::unique(sorted_frames.begin(),
+                                    sorted_frames.end()),
+                        sorted_frames.end());
     int num_frames = cap.get(CV_CAP_PROP_FRAME_COUNT) + 1;
-    int end_frame = start_frame + length - 1;
+    const int start_frame = sorted_frames.front();
+    const int end_frame = sorted_frames.back();
     if (num_frames < end_frame) {
       LOG(ERROR) << "not enough frames; num_frames=" << num_frames <<
                     ", start_frame=" << start_frame <<
-                    ", length=" << length;
+                    ", end_frame=" << end_frame;
       return false;
     }
 
     // CV_CAP_PROP_POS_FRAMES is 0-based whereas start_frame is 1-based
     cap.set(CV_CAP_PROP_POS_FRAMES, start_frame - 2);
-    for (size_t i = start_frame; i <= end_frame; ++i) {
+    vector<cv::Mat> sorted_imgs;
+    int last_frame = start_frame - 1;
+    for (int i = 0; i < sorted_frames.size(); ++i) {
+      // Frames in between are demuxed and decoded, but neither retrieved
+      // nor converted.
+      for (; last_frame < sorted_frames[i] - 1; ++last_frame) {
+        cap.grab();
+      }
+      last_frame = sorted_frames[i];
       cap.read(cv_img_origin);
       if (!cv_img_origin.data) {
-        LOG(INFO) << "Could not read frame=" << i <<
+        LOG(INFO) << "Could not read frame=" << sorted_frames[i] <<
                       " from a video file=" << path <<
                       ", where num of frames=" << num_frames <<
                       ". Use previous frame.";
-        cv_imgs->push_back(cv_img.clone());
+        sorted_imgs.push_back(cv_img.clone());
         cv_img_origin.release();
         continue;
       }
@@ -218,26 +291,28 @@ bool ReadVideoToCVMat(const string& path,
       } else {
         cv_img = cv_img_origin;
       }
-      cv_imgs->push_back(cv_img.clone());
+      sorted_imgs.push_back(cv_img.clone());
       cv_img_origin.release();
     }
     cap.release();
+    for (int i = 0; i < frames.size(); ++i) {
+      const int index = std::lower_bound(sorted_frames.begin(),
+          sorted_frames.end(), frames[i]) - sorted_frames.begin();
+      // Repeated frames share their data.
+      cv_imgs->push_back(sorted_imgs[index]);
+    }
 
-  // In case of a directory with extracted frames within
+  // In case of a directory with extracted frames within, where frames not
+  // in the clip are never read.
   } else {
     int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
       CV_LOAD_IMAGE_GRAYSCALE);
 
-    // Filename: 6-digit zero-padded
-    int end_frame = start_frame + length - 1;
-    char image_filename[256];
-
-    for (int i = start_frame; i <= end_frame; ++i) {
-      snprintf(image_filename, sizeof(image_filename), "%s/image_%04d.jpg",
-               path.c_str(), i);
+    for (int i = 0; i < frames.size(); ++i) {
+      const string image_filename = FrameFilename(path, frames[i]);
       cv_img_origin = cv::imread(image_filename, cv_read_flag);
       if (!cv_img_origin.data) {
-        LOG(ERROR) << "Could not read frame=" << i <<
+        LOG(ERROR) << "Could not read frame=" << frames[i] <<
                       " from an image file=" << image_filename;
         cv_imgs->clear();
         return false;
@@ -254,6 +329,215 @@ bool ReadVideoToCVMat(const string& path,
   return true;
 }
 
+bool ReadVideoToCVMat(const string& path,
+    const int start_frame, const int length, const int height, const int width,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs) {
+  return ReadVideoToCVMat(path, ConsecutiveFrames(start_frame, length),
+                          height, width, is_color, cv_imgs);
+}
+
+#ifdef USE_LIBJPEG_TURBO
+// Logs libjpeg errors and returns to the decoder instead of exiting.
+struct JPEGErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void JPEGErrorExit(j_common_ptr cinfo) {
+  char message[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, message);
+  LOG(ERROR) << message;
+  longjmp(reinterpret_cast<JPEGErrorManager*>(cinfo->err)->jump, 1);
+}
+
+// Reads the size of a JPEG file from its header and, given a roi, decodes
+// the roi alone: libjpeg-turbo skips the rows above it, stops after its last
+// row, and only decodes the columns of the iMCUs it overlaps.
+static bool DecodeJPEG(const string& filename, const cv::Rect* roi,
+    const bool is_color, int* height, int* width, cv::Mat* cv_img) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file) {
+    LOG(ERROR) << "Could not open or find file " << filename;
+    return false;
+  }
+  jpeg_decompress_struct cinfo;
+  JPEGErrorManager error;
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = JPEGErrorExit;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, file);
+  jpeg_read_header(&cinfo, TRUE);
+  *height = cinfo.image_height;
+  *width = cinfo.image_width;
+  if (roi) {
+    CHECK(roi->x >= 0 && roi->y >= 0 && roi->x + roi->width <= *width &&
+        roi->y + roi->height <= *height) << "Crop out of " << filename;
+    cinfo.out_color_space = is_color ? JCS_EXT_BGR : JCS_GRAYSCALE;
+    jpeg_start_decompress(&cinfo);
+    // Widens the columns to whole iMCUs.
+    JDIMENSION x = roi->x;
+    JDIMENSION decoded_width = roi->width;
+    jpeg_crop_scanline(&cinfo, &x, &decoded_width);
+    cv_img->create(roi->height, decoded_width, is_color ? CV_8UC3 : CV_8UC1);
+    if (roi->y > 0) {
+      jpeg_skip_scanlines(&cinfo, roi->y);
+    }
+    for (int h = 0; h < roi->height; ++h) {
+      JSAMPROW row = cv_img->ptr<uchar>(h);
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    *cv_img = (*cv_img)(cv::Rect(roi->x - x, 0, roi->width, roi->height));
+  }
+  // Also aborts the decompression of the rows below the roi.
+  jpeg_destroy_decompress(&cinfo);
+  fclose(file);
+  return true;
+}
+#endif  // USE_LIBJPEG_TURBO
+
+// Reads the roi of an image, decoding no more of JPEG images than needed.
+static cv::Mat ReadImageCropToCVMat(const string& filename,
+    const cv::Rect& roi, const bool is_color) {
+  cv::Mat cv_img;
+#ifdef USE_LIBJPEG_TURBO
+  int height, width;
+  if (matchExt(filename, "jpg") &&
+      DecodeJPEG(filename, &roi, is_color, &height, &width, &cv_img)) {
+    return cv_img;
+  }
+#endif  // USE_LIBJPEG_TURBO
+  cv_img = ReadImageToCVMat(filename, is_color);
+  if (!cv_img.data) {
+    return cv_img;
+  }
+  CHECK(roi.x >= 0 && roi.y >= 0 && roi.x + roi.width <= cv_img.cols &&
+      roi.y + roi.height <= cv_img.rows) << "Crop out of " << filename;
+  return cv_img(roi);
+}
+
+bool ReadVideoFrameSize(const string& path, const int frame_num,
+    int* height, int* width) {
+  bool is_video_file, is_path;
+  check_path(path, &is_video_file, &is_path);
+  if (is_video_file) {
+    cv::VideoCapture cap(path);
+    if (!cap.isOpened()) {
+      LOG(ERROR) << "Cannot open a video file=" << path;
+      return false;
+    }
+    *height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+    *width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
+    return true;
+  } else if (!is_path) {
+    LOG(ERROR) << "Could not open or find file " << path;
+    return false;
+  }
+  const string image_filename = FrameFilename(path, frame_num);
+#ifdef USE_LIBJPEG_TURBO
+  if (DecodeJPEG(image_filename, NULL, true, height, width, NULL)) {
+    return true;
+  }
+#endif  // USE_LIBJPEG_TURBO
+  const cv::Mat cv_img = ReadImageToCVMat(image_filename);
+  if (!cv_img.data) {
+    return false;
+  }
+  *height = cv_img.rows;
+  *width = cv_img.cols;
+  return true;
+}
+
+bool ReadVideoCropToCVMat(const string& path,
+    const vector<int>& frames, const cv::Rect& roi,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs) {
+  bool is_video_file, is_path;
+  check_path(path, &is_video_file, &is_path);
+  if (!is_path) {
+    // Video files decode whole frames anyway.
+    if (!ReadVideoToCVMat(path, frames, 0, 0, is_color, cv_imgs)) {
+      return false;
+    }
+    for (int i = 0; i < cv_imgs->size(); ++i) {
+      cv::Mat& cv_img = (*cv_imgs)[i];
+      if (!cv_img.data || roi.x + roi.width > cv_img.cols ||
+          roi.y + roi.height > cv_img.rows) {
+        LOG(ERROR) << "Could not crop frame=" << frames[i] <<
+                      " from a video file=" << path;
+        cv_imgs->clear();
+        return false;
+      }
+      cv_img = cv_img(roi);
+    }
+    return true;
+  }
+  for (int i = 0; i < frames.size(); ++i) {
+    const string image_filename = FrameFilename(path, frames[i]);
+    cv::Mat cv_img = ReadImageCropToCVMat(image_filename, roi, is_color);
+    if (!cv_img.data) {
+      LOG(ERROR) << "Could not read frame=" << frames[i] <<
+                    " from an image file=" << image_filename;
+      cv_imgs->clear();
+      return false;
+    }
+    cv_imgs->push_back(cv_img);
+  }
+  return true;
+}
+
+bool ReadVideoCropToCVMat(const string& path,
+    const int start_frame, const int length, const cv::Rect& roi,
+    const bool is_color, std::vector<cv::Mat>* cv_imgs) {
+  return ReadVideoCropToCVMat(path, ConsecutiveFrames(start_frame, length),
+                              roi, is_color, cv_imgs);
+}
+
+int CountFlowFrames(const string& path) {
+  return std::min(CountFrameFiles(path, "flow_x"),
+                  CountFrameFiles(path, "flow_y"));
+}
+
+// Reads the flow of the frames as two-channel images, cropped to the roi
+// unless it is NULL, and resized to height x width otherwise.
+static bool ReadFlowFrames(const string& path, const vector<int>& frames,
+    const cv::Rect* roi, const int height, const int width,
+    std::vector<cv::Mat>* cv_imgs) {
+  const char* const kPrefixes[] = {"flow_x", "flow_y"};
+  for (int i = 0; i < frames.size(); ++i) {
+    cv::Mat flow_xy[2];
+    for (int j = 0; j < 2; ++j) {
+      const string image_filename = FrameFilename(path, frames[i],
+                                                  kPrefixes[j]);
+      flow_xy[j] = roi ? ReadImageCropToCVMat(image_filename, *roi, false)
+          : ReadImageToCVMat(image_filename, height, width, false);
+      if (!flow_xy[j].data) {
+        LOG(ERROR) << "Could not read frame=" << frames[i] <<
+                      " from an image file=" << image_filename;
+        cv_imgs->clear();
+        return false;
+      }
+    }
+    cv::Mat cv_img;
+    cv::merge(flow_xy, 2, cv_img);
+    cv_imgs->push_back(cv_img);
+  }
+  return true;
+}
+
+bool ReadFlowToCVMat(const string& path, const vector<int>& frames,
+    const int height, const int width, std::vector<cv::Mat>* cv_imgs) {
+  return ReadFlowFrames(path, frames, NULL, height, width, cv_imgs);
+}
+
+bool ReadFlowCropToCVMat(const string& path, const vector<int>& frames,
+    const cv::Rect& roi, std::vector<cv::Mat>* cv_imgs) {
+  return ReadFlowFrames(path, frames, &roi, 0, 0, cv_imgs);
+}
+
 #endif  // USE_OPENCV
 
 bool ReadFileToDatum(const string& filename, const int label,
@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/layout.hpp"
+
+namespace caffe {
+
+string BlobLayoutName(const BlobLayout layout) {
+  switch (layout) {
+  case PLANAR:
+    return "planar";
+  case CHANNELS_LAST:
+    return "channels_last";
+  default:
+    LOG(FATAL) << "Unknown blob layout: " << layout;
+  }
+  return "";
+}
+
+// Transposes every rows x cols matrix of num in tiles, so that both the
+// reads and the writes stay within a few cache lines.
+template <typename Dtype>
+static void transpose_cpu(const int num, const int rows, const int cols,
+    const Dtype* src, Dtype* dst) {
+  const int kTile = 16;
+  for (int n = 0; n < num; ++n) {
+    for (int r0 = 0; r0 < rows; r0 += kTile) {
+      const int r1 = std::min(r0 + kTile, rows);
+      for (int c0 = 0; c0 < cols; c0 += kTile) {
+        const int c1 = std::min(c0 + kTile, cols);
+        for (int r = r0; r < r1; ++r) {
+          for (int c = c0; c < c1; ++c) {
+            dst[c * rows + r] = src[r * cols + c];
+          }
+        }
+      }
+    }
+    src += rows * cols;
+    dst += rows * cols;
+  }
+}
+
+template <typename Dtype>
+void planar_to_channels_last_cpu(const int num, const int channels,
+    const int spatial, const Dtype* planar, Dtype* channels_last) {
+  transpose_cpu(num, channels, spatial, planar, channels_last);
+}
+
+template <typename Dtype>
+void channels_last_to_planar_cpu(const int num, const int channels,
+    const int spatial, const Dtype* channels_last, Dtype* planar) {
+  transpose_cpu(num, spatial, channels, channels_last, planar);
+}
+
+template void planar_to_channels_last_cpu<float>(const int num,
+    const int channels, const int spatial, const float* planar,
+    float* channels_last);
+template void planar_to_channels_last_cpu<double>(const int num,
+    const int channels, const int spatial, const double* planar,
+    double* channels_last);
+template void channels_last_to_planar_cpu<float>(const int num,
+    const int channels, const int spatial, const float* channels_last,
+    float* planar);
+template void channels_last_to_planar_cpu<double>(const int num,
+    const int channels, const int spatial, const double* channels_last,
+    double* planar);
+
+}  // namespace caffe
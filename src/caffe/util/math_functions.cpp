@@ -1,14 +1,89 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_isa.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 #include "caffe/util/rng.hpp"
 
+#ifndef USE_MKL
+// Provided by OpenBLAS only, so looked up at run time.
+extern "C" void openblas_set_num_threads(int num_threads)
+    __attribute__((weak));
+extern "C" int openblas_set_num_threads_local(int num_threads)
+    __attribute__((weak));
+#endif
+
 namespace caffe {
 
+// Multiply-adds worth a BLAS thread of their own.
+static const double kBlasWorkPerThread = 1 << 20;
+
+#ifndef USE_MKL
+// Guards the process-wide OpenBLAS count.
+static boost::mutex openblas_mutex;
+// Set once a thread limit fell back to the process-wide count; it then
+// stays 1, so that limited threads cannot oversubscribe the CPUs.
+static bool openblas_serial = false;
+#endif
+
+void caffe_set_blas_threads(const int num_threads,
+    const bool calling_thread_only) {
+  CHECK_GE(num_threads, 1);
+#ifdef USE_MKL
+  if (calling_thread_only) {
+    mkl_set_num_threads_local(num_threads);
+  } else {
+    mkl_set_num_threads(num_threads);
+  }
+#else
+  if (calling_thread_only && openblas_set_num_threads_local) {
+    openblas_set_num_threads_local(num_threads);
+    return;
+  }
+  if (!openblas_set_num_threads) {
+    return;
+  }
+  const int budget = calling_thread_only ? Caffe::num_threads() : 0;
+  boost::mutex::scoped_lock lock(openblas_mutex);
+  if (calling_thread_only) {
+    if (openblas_serial || num_threads >= budget) {
+      return;
+    }
+    LOG(WARNING) << "OpenBLAS cannot limit the threads of a single thread "
+        << "(openblas_set_num_threads_local needs 0.3.27); running all BLAS "
+        << "calls single-threaded.";
+    openblas_serial = true;
+  }
+  openblas_set_num_threads(openblas_serial ? 1 : num_threads);
+#endif
+}
+
+// Sets the BLAS threads of a call doing the given number of multiply-adds:
+// many for large calls, one for small ones, never more than the calling
+// thread may use. Only done where the setting is per thread, as changing
+// the process-wide one per call would race with the other threads.
+static void set_call_blas_threads(const double work) {
+#ifndef USE_MKL
+  if (!openblas_set_num_threads_local) {
+    return;
+  }
+#endif
+  const int num_threads = std::max(1, std::min(Caffe::max_threads(),
+      static_cast<int>(work / kBlasWorkPerThread)));
+#ifdef USE_MKL
+  mkl_set_num_threads_local(num_threads);
+#else
+  openblas_set_num_threads_local(num_threads);
+#endif
+}
+
 template<>
 void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
@@ -16,6 +91,7 @@ void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     float* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
+  set_call_blas_threads(static_cast<double>(M) * N * K);
   cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
       ldb, beta, C, N);
 }
@@ -27,6 +103,7 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
     double* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
+  set_call_blas_threads(static_cast<double>(M) * N * K);
   cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
       ldb, beta, C, N);
 }
@@ -35,6 +112,7 @@ template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
     const float beta, float* y) {
+  set_call_blas_threads(static_cast<double>(M) * N);
   cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
 }
 
@@ -42,6 +120,7 @@ template <>
 void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const double alpha, const double* A, const double* x,
     const double beta, double* y) {
+  set_call_blas_threads(static_cast<double>(M) * N);
   cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
 }
 
@@ -129,7 +208,11 @@ void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
+#ifdef USE_MKL
   vsAdd(n, a, b, y);
+#else
+  cpu_kernels().add(n, a, b, y);
+#endif
 }
 
 template <>
@@ -141,7 +224,11 @@ void caffe_add<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
+#ifdef USE_MKL
   vsSub(n, a, b, y);
+#else
+  cpu_kernels().sub(n, a, b, y);
+#endif
 }
 
 template <>
@@ -153,7 +240,11 @@ void caffe_sub<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
+#ifdef USE_MKL
   vsMul(n, a, b, y);
+#else
+  cpu_kernels().mul(n, a, b, y);
+#endif
 }
 
 template <>
@@ -165,7 +256,11 @@ void caffe_mul<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
+#ifdef USE_MKL
   vsDiv(n, a, b, y);
+#else
+  cpu_kernels().div(n, a, b, y);
+#endif
 }
 
 template <>
@@ -177,6 +272,18 @@ void caffe_div<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
+#ifndef USE_MKL
+  // The common exponents of the solvers and normalization layers. Only -0
+  // and -inf square roots differ from pow: sqrt keeps their sign.
+  if (b == 2) {
+    cpu_kernels().sqr(n, a, y);
+    return;
+  }
+  if (b == 0.5) {
+    cpu_kernels().sqrt(n, a, y);
+    return;
+  }
+#endif
   vsPowx(n, a, b, y);
 }
 
@@ -188,7 +295,11 @@ void caffe_powx<double>(const int n, const double* a, const double b,
 
 template <>
 void caffe_sqr<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsSqr(n, a, y);
+#else
+  cpu_kernels().sqr(n, a, y);
+#endif
 }
 
 template <>
@@ -226,6 +337,236 @@ void caffe_abs<double>(const int n, const double* a, double* y) {
     vdAbs(n, a, y);
 }
 
+template <>
+void caffe_cpu_relu<float>(const int n, const float* x,
+    const float negative_slope, float* y) {
+  cpu_kernels().relu(n, x, negative_slope, y);
+}
+
+template <>
+void caffe_cpu_relu<double>(const int n, const double* x,
+    const double negative_slope, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::max(x[i], double(0))
+        + negative_slope * std::min(x[i], double(0));
+  }
+}
+
+template <>
+void caffe_cpu_relu_backward<float>(const int n, const float* top_diff,
+    const float* bottom_data, const float negative_slope,
+    float* bottom_diff) {
+  cpu_kernels().relu_backward(n, top_diff, bottom_data, negative_slope,
+      bottom_diff);
+}
+
+template <>
+void caffe_cpu_relu_backward<double>(const int n, const double* top_diff,
+    const double* bottom_data, const double negative_slope,
+    double* bottom_diff) {
+  for (int i = 0; i < n; ++i) {
+    bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+        + negative_slope * (bottom_data[i] <= 0));
+  }
+}
+
+template <>
+void caffe_cpu_max_update<float>(const int n, const float* x,
+    const int index, float* y, int* mask) {
+  cpu_kernels().max_update(n, x, index, y, mask);
+}
+
+template <>
+void caffe_cpu_max_update<double>(const int n, const double* x,
+    const int index, double* y, int* mask) {
+  for (int i = 0; i < n; ++i) {
+    if (x[i] > y[i]) {
+      y[i] = x[i];
+      mask[i] = index;
+    }
+  }
+}
+
+template <>
+void caffe_cpu_asum_update<float>(const int n, const float* x, float* y) {
+  cpu_kernels().asum_update(n, x, y);
+}
+
+template <>
+void caffe_cpu_asum_update<double>(const int n, const double* x,
+    double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += std::fabs(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_sumsq_update<float>(const int n, const float* x, float* y) {
+  cpu_kernels().sumsq_update(n, x, y);
+}
+
+template <>
+void caffe_cpu_sumsq_update<double>(const int n, const double* x,
+    double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += x[i] * x[i];
+  }
+}
+
+template <>
+void caffe_cpu_transform_u8<float>(const int n, const uint8_t* x,
+    const float* mean, const float mean_value, const float scale, float* y) {
+  cpu_kernels().transform_u8(n, x, mean, mean_value, scale, y);
+}
+
+template <>
+void caffe_cpu_transform_u8<double>(const int n, const uint8_t* x,
+    const double* mean, const double mean_value, const double scale,
+    double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = (static_cast<double>(x[i]) - (mean ? mean[i] : mean_value))
+        * scale;
+  }
+}
+
+// Values worth a parallel chunk of the n-ary element-wise functions.
+static const int kNaryChunkWork = 1 << 14;
+
+static void sum_n_double(const int begin, const int end, const int num_inputs,
+    const double* const* x, const double* coeffs, double* y) {
+  for (int i = begin; i < end; ++i) {
+    double sum = coeffs ? coeffs[0] * x[0][i] : x[0][i];
+    for (int j = 1; j < num_inputs; ++j) {
+      sum += coeffs ? coeffs[j] * x[j][i] : x[j][i];
+    }
+    y[i] = sum;
+  }
+}
+
+static void prod_n_double(const int begin, const int end,
+    const int num_inputs, const double* const* x, double* y) {
+  for (int i = begin; i < end; ++i) {
+    double prod = x[0][i];
+    for (int j = 1; j < num_inputs; ++j) {
+      prod *= x[j][i];
+    }
+    y[i] = prod;
+  }
+}
+
+static void max_n_double(const int begin, const int end, const int num_inputs,
+    const double* const* x, double* y, uint8_t* mask) {
+  for (int i = begin; i < end; ++i) {
+    const bool first = x[0][i] > x[1][i];
+    double max_val = first ? x[0][i] : x[1][i];
+    uint8_t max_id = first ? 0 : 1;
+    for (int j = 2; j < num_inputs; ++j) {
+      if (x[j][i] > max_val) {
+        max_val = x[j][i];
+        max_id = j;
+      }
+    }
+    y[i] = max_val;
+    mask[i] = max_id;
+  }
+}
+
+template <>
+void caffe_cpu_sum_n<float>(const int n, const int num_inputs,
+    const float* const* x, const float* coeffs, float* y) {
+  CHECK_GE(num_inputs, 1);
+  parallel_for(0, n, boost::bind(cpu_kernels().sum_n, _1, _2, num_inputs, x,
+      coeffs, y), kNaryChunkWork);
+}
+
+template <>
+void caffe_cpu_sum_n<double>(const int n, const int num_inputs,
+    const double* const* x, const double* coeffs, double* y) {
+  CHECK_GE(num_inputs, 1);
+  parallel_for(0, n, boost::bind(sum_n_double, _1, _2, num_inputs, x, coeffs,
+      y), kNaryChunkWork);
+}
+
+template <>
+void caffe_cpu_prod_n<float>(const int n, const int num_inputs,
+    const float* const* x, float* y) {
+  CHECK_GE(num_inputs, 1);
+  parallel_for(0, n, boost::bind(cpu_kernels().prod_n, _1, _2, num_inputs, x,
+      y), kNaryChunkWork);
+}
+
+template <>
+void caffe_cpu_prod_n<double>(const int n, const int num_inputs,
+    const double* const* x, double* y) {
+  CHECK_GE(num_inputs, 1);
+  parallel_for(0, n, boost::bind(prod_n_double, _1, _2, num_inputs, x, y),
+      kNaryChunkWork);
+}
+
+template <>
+void caffe_cpu_max_n<float>(const int n, const int num_inputs,
+    const float* const* x, float* y, uint8_t* mask) {
+  CHECK_GE(num_inputs, 2);
+  CHECK_LE(num_inputs, 256);
+  parallel_for(0, n, boost::bind(cpu_kernels().max_n, _1, _2, num_inputs, x,
+      y, mask), kNaryChunkWork);
+}
+
+template <>
+void caffe_cpu_max_n<double>(const int n, const int num_inputs,
+    const double* const* x, double* y, uint8_t* mask) {
+  CHECK_GE(num_inputs, 2);
+  CHECK_LE(num_inputs, 256);
+  parallel_for(0, n, boost::bind(max_n_double, _1, _2, num_inputs, x, y,
+      mask), kNaryChunkWork);
+}
+
+// One run of caffe_cpu_channel_scale_bias: y = alpha * x, plus *beta if
+// given.
+static void scale_run(const int n, const float alpha, const float* beta,
+    const float* x, float* y) {
+  if (beta) {
+    cpu_kernels().scale_bias(n, alpha, *beta, x, y);
+  } else {
+    cpu_kernels().scale(n, alpha, x, y);
+  }
+}
+
+static void scale_run(const int n, const double alpha, const double* beta,
+    const double* x, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = beta ? alpha * x[i] + *beta : alpha * x[i];
+  }
+}
+
+template <typename Dtype>
+static void channel_scale_bias_runs(const int dim, const int inner_dim,
+    const Dtype* scale, const Dtype* bias, const Dtype* x, Dtype* y,
+    const int begin, const int end) {
+  for (int run = begin; run < end; ++run) {
+    const int d = run % dim;
+    const int offset = run * inner_dim;
+    scale_run(inner_dim, scale ? scale[d] : Dtype(1), bias ? bias + d : NULL,
+        x + offset, y + offset);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_channel_scale_bias(const int outer_dim, const int dim,
+    const int inner_dim, const Dtype* scale, const Dtype* bias,
+    const Dtype* x, Dtype* y) {
+  parallel_for(0, outer_dim * dim, boost::bind(
+      &channel_scale_bias_runs<Dtype>, dim, inner_dim, scale, bias, x, y,
+      _1, _2), std::max(1, kNaryChunkWork / std::max(1, inner_dim)));
+}
+
+template void caffe_cpu_channel_scale_bias<float>(const int outer_dim,
+    const int dim, const int inner_dim, const float* scale, const float* bias,
+    const float* x, float* y);
+template void caffe_cpu_channel_scale_bias<double>(const int outer_dim,
+    const int dim, const int inner_dim, const double* scale,
+    const double* bias, const double* x, double* y);
+
 unsigned int caffe_rng_rand() {
   return (*caffe_rng())();
 }
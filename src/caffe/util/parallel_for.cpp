@@ -0,0 +1,150 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Upper bound on the chunks of a range: enough to balance the load of
+// dozens of threads, few enough to keep the scheduling overhead small.
+static const int kMaxChunks = 256;
+
+// The chunks of one ParallelForChunks call. Each participant works through
+// its own block of chunks from the front and steals from the back of the
+// others' blocks when done.
+class ParallelJob {
+ public:
+  ParallelJob(const int num_chunks, const int num_participants,
+      const boost::function<void(int)>& chunk_body)
+      : chunk_body_(chunk_body), remaining_(num_chunks) {
+    for (int i = 0; i < num_participants; ++i) {
+      blocks_.push_back(shared_ptr<Block>(new Block(
+          ParallelChunkBegin(0, num_chunks, num_participants, i),
+          ParallelChunkBegin(0, num_chunks, num_participants, i + 1))));
+    }
+  }
+
+  void Work(const int participant) {
+    int chunk;
+    while (Take(participant, &chunk) || Steal(participant, &chunk)) {
+      chunk_body_(chunk);
+      boost::mutex::scoped_lock lock(mutex_);
+      if (--remaining_ == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+
+  void Wait() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (remaining_ > 0) {
+      done_.wait(lock);
+    }
+  }
+
+ protected:
+  struct Block {
+    Block(const int front, const int back) : front(front), back(back) {}
+    boost::mutex mutex;
+    int front, back;
+  };
+
+  bool Take(const int participant, int* chunk) {
+    Block& block = *blocks_[participant];
+    boost::mutex::scoped_lock lock(block.mutex);
+    if (block.front == block.back) {
+      return false;
+    }
+    *chunk = block.front++;
+    return true;
+  }
+
+  bool Steal(const int participant, int* chunk) {
+    for (int i = 1; i < blocks_.size(); ++i) {
+      Block& block = *blocks_[(participant + i) % blocks_.size()];
+      boost::mutex::scoped_lock lock(block.mutex);
+      if (block.front < block.back) {
+        *chunk = --block.back;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  boost::function<void(int)> chunk_body_;
+  vector<shared_ptr<Block> > blocks_;
+  boost::mutex mutex_;
+  boost::condition_variable done_;
+  int remaining_;
+};
+
+int ParallelNumChunks(const int n, const int grain) {
+  CHECK_GE(grain, 1);
+  if (n <= 0) {
+    return 0;
+  }
+  return std::min(kMaxChunks, (n - 1) / grain + 1);
+}
+
+void ParallelForChunks(const int num_chunks,
+    const boost::function<void(int)>& chunk_body) {
+  // Pool workers, and callers running chunks, have a max_threads() of 1, so
+  // nested calls end up serial.
+  const int max_threads = Caffe::max_threads();
+  int num_participants = 1;
+  if (num_chunks > 1 && max_threads > 1 && !ThreadPool::InWorker()) {
+    num_participants = std::min(num_chunks, std::min(max_threads,
+        Caffe::thread_pool().num_threads() + 1));
+  }
+  if (num_participants == 1) {
+    for (int i = 0; i < num_chunks; ++i) {
+      chunk_body(i);
+    }
+    return;
+  }
+  shared_ptr<ParallelJob> job(
+      new ParallelJob(num_chunks, num_participants, chunk_body));
+  ThreadPool& pool = Caffe::thread_pool();
+  for (int i = 1; i < num_participants; ++i) {
+    pool.Schedule(boost::bind(&ParallelJob::Work, job, i));
+  }
+  // The calling thread takes part, so the job completes even when the pool
+  // is busy with other work.
+  const int limit = Caffe::set_max_threads(1);
+  job->Work(0);
+  job->Wait();
+  Caffe::set_max_threads(limit);
+}
+
+// Runs the indices of one chunk of a parallel_for range.
+class ParallelForChunk {
+ public:
+  ParallelForChunk(const int begin, const int n, const int num_chunks,
+      const boost::function<void(int, int)>& body)
+      : begin_(begin), n_(n), num_chunks_(num_chunks), body_(body) {}
+  void operator()(const int chunk) const {
+    body_(ParallelChunkBegin(begin_, n_, num_chunks_, chunk),
+        ParallelChunkBegin(begin_, n_, num_chunks_, chunk + 1));
+  }
+
+ private:
+  int begin_, n_, num_chunks_;
+  const boost::function<void(int, int)>& body_;
+};
+
+void parallel_for(const int begin, const int end,
+    const boost::function<void(int, int)>& body, const int grain) {
+  const int n = end - begin;
+  if (n <= 0) {
+    return;
+  }
+  const int num_chunks = ParallelNumChunks(n, grain);
+  ParallelForChunks(num_chunks,
+      ParallelForChunk(begin, n, num_chunks, body));
+}
+
+}  // namespace caffe
@@ -0,0 +1,112 @@
+#include <boost/thread.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+static boost::thread_specific_ptr<bool> in_worker_;
+
+ThreadPool::ThreadPool(int num_threads, const vector<int>& cpus) {
+  CHECK_GE(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    try {
+      threads_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::Work, this, cpu)));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  // An empty task stops the worker that takes it.
+  for (int i = 0; i < threads_.size(); ++i) {
+    tasks_.push(Task());
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::Schedule(const Task& task) {
+  CHECK(task) << "Cannot schedule an empty task";
+  CHECK(!threads_.empty()) << "The thread pool has no threads";
+  tasks_.push(task);
+}
+
+bool ThreadPool::InWorker() {
+  return in_worker_.get() && *in_worker_;
+}
+
+void ThreadPool::Work(int cpu) {
+  in_worker_.reset(new bool(true));
+  if (cpu >= 0) {
+    SetThreadAffinity(vector<int>(1, cpu));
+  }
+  // The pool threads are the parallelism: BLAS calls of tasks stay serial.
+  Caffe::set_max_threads(1);
+  while (true) {
+    Task task = tasks_.pop();
+    if (!task) {
+      break;
+    }
+    task();
+  }
+}
+
+vector<int> ParseCpuList(const string& list) {
+  vector<int> cpus;
+  std::stringstream stream(list);
+  string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    int first, last;
+    char dash;
+    std::stringstream range_stream(range);
+    CHECK(range_stream >> first) << "Bad CPU list: " << list;
+    last = first;
+    if (range_stream >> dash) {
+      CHECK(dash == '-' && range_stream >> last) << "Bad CPU list: " << list;
+    }
+    CHECK(range_stream.eof()) << "Bad CPU list: " << list;
+    CHECK_GE(first, 0) << "Bad CPU list: " << list;
+    CHECK_LE(first, last) << "Bad CPU list: " << list;
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+void SetThreadAffinity(const vector<int>& cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < cpus.size(); ++i) {
+    CHECK_LT(cpus[i], CPU_SETSIZE) << "CPU " << cpus[i] << " out of range";
+    CPU_SET(cpus[i], &set);
+  }
+  const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error) {
+    LOG(WARNING) << "Could not set the CPU affinity of a thread: error "
+                 << error;
+  }
+#else
+  LOG_FIRST_N(WARNING, 1) << "CPU affinity is only supported on Linux";
+#endif
+}
+
+}  // namespace caffe
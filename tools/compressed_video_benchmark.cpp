@@ -0,0 +1,99 @@
+// This program times reading clips of videos as BGR frames, with
+// ReadVideoToCVMat, against reading them in the compressed domain, with
+// ReadCompressedVideo, as the CompressedVideoData layer does.
+// Usage:
+//    compressed_video_benchmark [FLAGS] VIDEO [VIDEO...]
+//
+// For example, on the test video:
+//    compressed_video_benchmark --length=16
+//        src/caffe/test/test_data/UCF-101_Rowing_g16_c03.avi
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/compressed_video.hpp"
+#include "caffe/util/io.hpp"
+
+using caffe::CPUTimer;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_int32(start, 1, "The first frame of the clips.");
+DEFINE_int32(length, 16, "The number of frames of the clips.");
+DEFINE_int32(temporal_stride, 1, "The step between the frames of the clips.");
+DEFINE_int32(new_height, 0,
+    "Optional; the height ReadVideoToCVMat resizes the frames to.");
+DEFINE_int32(new_width, 0,
+    "Optional; the width ReadVideoToCVMat resizes the frames to.");
+DEFINE_int32(iterations, 10, "The number of times each clip is read.");
+
+int main(int argc, char** argv) {
+#if defined(USE_OPENCV) && defined(USE_FFMPEG)
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time reading video clips as BGR frames against\n"
+        "reading them in the compressed domain.\n"
+        "Usage:\n"
+        "    compressed_video_benchmark [FLAGS] VIDEO [VIDEO...]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/compressed_video_benchmark");
+    return 1;
+  }
+  CHECK_GT(FLAGS_length, 0) << "length must be positive.";
+  CHECK_GT(FLAGS_temporal_stride, 0) << "temporal_stride must be positive.";
+  vector<int> frames;
+  for (int i = 0; i < FLAGS_length; ++i) {
+    frames.push_back(FLAGS_start + i * FLAGS_temporal_stride);
+  }
+
+  double bgr_time = 0;
+  double compressed_time = 0;
+  CPUTimer timer;
+  for (int i = 1; i < argc; ++i) {
+    const string path(argv[i]);
+    double video_bgr_time = 0;
+    double video_compressed_time = 0;
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      std::vector<cv::Mat> cv_imgs;
+      timer.Start();
+      CHECK(caffe::ReadVideoToCVMat(path, frames, FLAGS_new_height,
+          FLAGS_new_width, true, &cv_imgs)) << "Could not load " << path;
+      video_bgr_time += timer.MilliSeconds();
+      caffe::CompressedFrames compressed;
+      timer.Start();
+      CHECK(caffe::ReadCompressedVideo(path, frames, &compressed))
+          << "Could not load " << path;
+      video_compressed_time += timer.MilliSeconds();
+    }
+    LOG(INFO) << path << ": ReadVideoToCVMat "
+              << video_bgr_time / FLAGS_iterations << " ms, "
+              << "ReadCompressedVideo "
+              << video_compressed_time / FLAGS_iterations << " ms per clip.";
+    bgr_time += video_bgr_time;
+    compressed_time += video_compressed_time;
+  }
+  const int num_clips = (argc - 1) * FLAGS_iterations;
+  LOG(INFO) << "Average ReadVideoToCVMat: " << bgr_time / num_clips
+            << " ms per clip.";
+  LOG(INFO) << "Average ReadCompressedVideo: " << compressed_time / num_clips
+            << " ms per clip.";
+#else
+  LOG(FATAL) << "This tool requires OpenCV and FFmpeg; compile with "
+                "USE_OPENCV and USE_FFMPEG.";
+#endif  // USE_OPENCV && USE_FFMPEG
+  return 0;
+}
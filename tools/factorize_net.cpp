@@ -0,0 +1,282 @@
+// This program factorizes the 3-D convolutions of a trained net into cheaper
+// pairs of convolutions and writes out the new net and its weights.
+// Usage:
+//    factorize_net --model=net.prototxt --weights=net.caffemodel
+//        --output_model=out.prototxt --output_weights=out.caffemodel
+//        [--method=separable|channel] [--layers=conv2a,conv3a]
+//        [--rank=N | --energy=0.95] [--solver=solver.prototxt]
+//
+// The methods are described in caffe/util/factorize.hpp.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "caffe/caffe.hpp"
+#include "caffe/util/factorize.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::ConvFactorization;
+using caffe::ConvolutionParameter;
+using caffe::LayerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::shared_ptr;
+using caffe::Solver;
+using caffe::SolverParameter;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights of the model.");
+DEFINE_string(output_model, "",
+    "Where to write the factorized model definition.");
+DEFINE_string(output_weights, "",
+    "Where to write the factorized weights.");
+DEFINE_string(method, "separable",
+    "How to factorize: 'separable' into spatial and temporal convolutions, "
+    "or 'channel' into a convolution onto fewer channels and a 1x1x1 one.");
+DEFINE_string(layers, "",
+    "Optional; the convolutions to factorize, separated by ','. "
+    "By default, every 3-D convolution that the method applies to.");
+DEFINE_int32(rank, 0,
+    "Optional; the number of intermediate channels of each factorization. "
+    "By default, the rank is chosen by --energy.");
+DEFINE_double(energy, 0.95,
+    "The fraction of the filter energy (the sum of the squared singular "
+    "values) that each factorization keeps, when --rank is not set.");
+DEFINE_int32(gpu, -1,
+    "Optional; run in GPU mode on the given device ID.");
+DEFINE_string(solver, "",
+    "Optional; a solver definition to fine-tune the factorized net with. "
+    "Its net is replaced by --output_model, which then must be a train/test "
+    "net.");
+DEFINE_int32(iterations, 0,
+    "Optional; the number of fine-tuning iterations, instead of the "
+    "solver's max_iter.");
+
+// Whether the method applies to the layer, or why not.
+static bool Factorizable(const LayerParameter& layer,
+    const Net<float>& net, string* reason) {
+  if (layer.type() != "Convolution" && layer.type() != "NdConvolution") {
+    *reason = "not a convolution";
+    return false;
+  }
+  const ConvolutionParameter& conv_param = layer.convolution_param();
+  if (conv_param.group() != 1 || conv_param.axis() != 1) {
+    *reason = "only ungrouped convolutions over axis 1 are supported";
+    return false;
+  }
+  const shared_ptr<caffe::Layer<float> > net_layer =
+      net.layer_by_name(layer.name());
+  if (!net_layer || net_layer->blobs().empty() ||
+      net_layer->blobs()[0]->num_axes() != 5) {
+    *reason = "not a 3-D convolution in this phase";
+    return false;
+  }
+  // The filters are (O, C, T, H, W).
+  const Blob<float>& weights = *net_layer->blobs()[0];
+  if (FLAGS_method == "separable" &&
+      (weights.shape(2) == 1 || weights.count(3) == 1)) {
+    *reason = "already separable";
+    return false;
+  }
+  return true;
+}
+
+// The multiply-adds per sample of a convolution or inner product layer.
+static double LayerMacs(const Net<float>& net, const int layer_id) {
+  caffe::Layer<float>& layer = *net.layers()[layer_id];
+  const string type = layer.type();
+  if (layer.blobs().empty() || (type != "Convolution" &&
+      type != "NdConvolution" && type != "InnerProduct")) {
+    return 0;
+  }
+  const Blob<float>& top = *net.top_vecs()[layer_id][0];
+  const double weights = layer.blobs()[0]->count();
+  if (type == "InnerProduct") { return weights; }
+  // Each weight is applied once per output position.
+  return weights * top.count(2);
+}
+
+static double NetMacs(const Net<float>& net) {
+  double macs = 0;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    macs += LayerMacs(net, i);
+  }
+  return macs;
+}
+
+// Fine-tunes the factorized net from its weights with the given solver,
+// and writes the result back over them.
+static void FineTune() {
+  SolverParameter solver_param;
+  caffe::ReadSolverParamsFromTextFileOrDie(FLAGS_solver, &solver_param);
+  solver_param.clear_net_param();
+  solver_param.clear_train_net();
+  solver_param.clear_train_net_param();
+  solver_param.clear_test_net();
+  solver_param.clear_test_net_param();
+  solver_param.set_net(FLAGS_output_model);
+  if (FLAGS_iterations > 0) {
+    solver_param.set_max_iter(FLAGS_iterations);
+  }
+  solver_param.set_snapshot_after_train(false);
+  shared_ptr<Solver<float> > solver(
+      caffe::SolverRegistry<float>::CreateSolver(solver_param));
+  solver->net()->CopyTrainedLayersFrom(FLAGS_output_weights);
+  for (int i = 0; i < solver->test_nets().size(); ++i) {
+    solver->test_nets()[i]->CopyTrainedLayersFrom(FLAGS_output_weights);
+  }
+  LOG(INFO) << "Fine-tuning for " << solver_param.max_iter()
+      << " iterations.";
+  solver->Solve();
+  NetParameter net_param;
+  solver->net()->ToProto(&net_param, false);
+  caffe::WriteProtoToBinaryFile(net_param, FLAGS_output_weights);
+  LOG(INFO) << "Wrote the fine-tuned weights to " << FLAGS_output_weights;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  gflags::SetUsageMessage("Factorizes the 3-D convolutions of a trained "
+      "net.\nUsage:\n"
+      "    factorize_net --model=net.prototxt --weights=net.caffemodel "
+      "--output_model=out.prototxt --output_weights=out.caffemodel");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights.";
+  CHECK_GT(FLAGS_output_model.size(), 0) << "Need an output model.";
+  CHECK_GT(FLAGS_output_weights.size(), 0) << "Need output weights.";
+  CHECK(FLAGS_method == "separable" || FLAGS_method == "channel")
+      << "Unknown method: " << FLAGS_method;
+  CHECK(FLAGS_rank > 0 || (FLAGS_energy > 0 && FLAGS_energy <= 1))
+      << "Need a positive rank or an energy in (0, 1].";
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  Net<float> net(FLAGS_model, caffe::TEST);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  vector<string> names;
+  if (FLAGS_layers.size()) {
+    boost::split(names, FLAGS_layers, boost::is_any_of(","));
+  }
+  std::map<string, ConvFactorization> factorizations;
+  double old_macs = 0;
+  double new_macs = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& layer = net_param.layer(i);
+    const bool named = std::find(names.begin(), names.end(), layer.name()) !=
+        names.end();
+    if (!names.empty() && !named) { continue; }
+    string reason;
+    if (!Factorizable(layer, net, &reason)) {
+      CHECK(!named) << "Cannot factorize " << layer.name() << ": " << reason;
+      continue;
+    }
+    const Blob<float>& weights = *net.layer_by_name(layer.name())->blobs()[0];
+    ConvFactorization& factorization = factorizations[layer.name()];
+    const double error = caffe::FactorizeConvolution(layer, weights,
+        FLAGS_method == "separable" ? caffe::SEPARABLE_FACTORIZATION :
+        caffe::CHANNEL_FACTORIZATION, FLAGS_rank, FLAGS_energy,
+        &factorization);
+    // The first layer runs at the bottom's temporal resolution for
+    // separable, and both run at the top's resolution for channel.
+    int layer_id = 0;
+    while (net.layer_names()[layer_id] != layer.name()) { ++layer_id; }
+    const Blob<float>& bottom = *net.bottom_vecs()[layer_id][0];
+    const Blob<float>& top = *net.top_vecs()[layer_id][0];
+    double first_positions = top.count(2);
+    if (FLAGS_method == "separable") {
+      first_positions = first_positions / top.shape(2) * bottom.shape(2);
+    }
+    const double layer_macs = LayerMacs(net, layer_id);
+    const double factorized_macs =
+        factorization.first_weights.size() * first_positions +
+        factorization.second_weights.size() * top.count(2);
+    LOG_IF(WARNING, factorized_macs >= layer_macs) << layer.name()
+        << " costs no less at rank " << factorization.first_shape[0]
+        << "; lower --rank or --energy.";
+    old_macs += layer_macs;
+    new_macs += factorized_macs;
+    LOG(INFO) << layer.name() << ": rank "
+        << factorization.first_shape[0] << ", relative error " << error
+        << ", weights " << weights.count() << " -> "
+        << factorization.first_weights.size() +
+           factorization.second_weights.size()
+        << ", MACs per sample " << layer_macs << " -> " << factorized_macs;
+  }
+  CHECK(!factorizations.empty()) << "Found no convolutions to factorize.";
+  const double net_macs = NetMacs(net);
+  LOG(INFO) << "Factorized " << factorizations.size() << " layers: "
+      << "MACs per sample " << old_macs << " -> " << new_macs
+      << "; the net's convolution and inner product MACs "
+      << net_macs << " -> " << net_macs - old_macs + new_macs
+      << " (" << (net_macs - old_macs + new_macs) / net_macs
+      << " of the original).";
+
+  // Replace each factorized layer by its pair in the model definition.
+  NetParameter output_param(net_param);
+  output_param.clear_layer();
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& layer = net_param.layer(i);
+    if (factorizations.count(layer.name())) {
+      const ConvFactorization& factorization = factorizations[layer.name()];
+      output_param.add_layer()->CopyFrom(factorization.first);
+      output_param.add_layer()->CopyFrom(factorization.second);
+    } else {
+      output_param.add_layer()->CopyFrom(layer);
+    }
+  }
+  caffe::WriteProtoToTextFile(output_param, FLAGS_output_model);
+  LOG(INFO) << "Wrote the factorized model to " << FLAGS_output_model;
+
+  // The other layers keep their weights by name.
+  NetParameter test_param(output_param);
+  test_param.mutable_state()->set_phase(caffe::TEST);
+  Net<float> output_net(test_param);
+  output_net.CopyTrainedLayersFrom(FLAGS_weights);
+  for (std::map<string, ConvFactorization>::const_iterator it =
+       factorizations.begin(); it != factorizations.end(); ++it) {
+    const ConvFactorization& factorization = it->second;
+    const vector<shared_ptr<Blob<float> > >& first =
+        output_net.layer_by_name(factorization.first.name())->blobs();
+    const vector<shared_ptr<Blob<float> > >& second =
+        output_net.layer_by_name(factorization.second.name())->blobs();
+    CHECK(first[0]->shape() == factorization.first_shape);
+    CHECK(second[0]->shape() == factorization.second_shape);
+    std::copy(factorization.first_weights.begin(),
+        factorization.first_weights.end(), first[0]->mutable_cpu_data());
+    std::copy(factorization.second_weights.begin(),
+        factorization.second_weights.end(), second[0]->mutable_cpu_data());
+    if (second.size() > 1) {
+      second[1]->CopyFrom(*net.layer_by_name(it->first)->blobs()[1]);
+    }
+  }
+  NetParameter weights_param;
+  output_net.ToProto(&weights_param, false);
+  caffe::WriteProtoToBinaryFile(weights_param, FLAGS_output_weights);
+  LOG(INFO) << "Wrote the factorized weights to " << FLAGS_output_weights;
+
+  if (FLAGS_solver.size()) {
+    FineTune();
+  }
+  return 0;
+}